@@ -15,9 +15,17 @@
  * in favor of NEON version or platform-specific conversion
  */
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_CSPACE_X86
+// the C versions are the fallback and the reference for cspace_x86.c
+#define CSPACE_C(name) name##_c
+#else
+#define CSPACE_C(name) name
+#endif
+
 #ifndef __arm__
 
-void bgr555_to_rgb565(void *dst_, const void *src_, int bytes)
+void CSPACE_C(bgr555_to_rgb565)(void *dst_, const void *src_, int bytes)
 {
 	const unsigned int *src = src_;
 	unsigned int *dst = dst_;
@@ -58,7 +66,7 @@ void bgr888_to_rgb565(void *dst_, const void *src_, int bytes)
 
 #ifndef __ARM_NEON__
 
-void bgr888_to_rgb565(void *dst_, const void *src_, int bytes)
+void CSPACE_C(bgr888_to_rgb565)(void *dst_, const void *src_, int bytes)
 {
     const unsigned char *src = src_;
     unsigned int *dst = dst_;
@@ -76,9 +84,45 @@ void bgr888_to_rgb565(void *dst_, const void *src_, int bytes)
     }
 }
 
-// TODO?
-void rgb888_to_rgb565(void *dst, const void *src, int bytes) {}
-void bgr888_to_rgb888(void *dst, const void *src, int bytes) {}
+void CSPACE_C(rgb888_to_rgb565)(void *dst_, const void *src_, int bytes)
+{
+    const unsigned char *src = src_;
+    unsigned short *dst = dst_;
+
+    for (; bytes >= 3; bytes -= 3, src += 3, dst++)
+        *dst = ((src[2] & 0xf8) << 8) | ((src[1] & 0xfc) << 3) | (src[0] >> 3);
+}
+
+void CSPACE_C(bgr888_to_rgb888)(void *dst_, const void *src_, int bytes)
+{
+    const unsigned char *src = src_;
+    unsigned char *dst = dst_;
+    unsigned char t;
+
+    for (; bytes >= 3; bytes -= 3, src += 3, dst += 3) {
+        t = src[0];
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = t;
+    }
+}
+
+// brightness2k is 0..0x800, products wrap at 16 bits like the NEON one
+void CSPACE_C(bgr555_to_rgb565_b)(void *dst_, const void *src_, int bytes,
+	int brightness2k)
+{
+	const unsigned short *src = src_;
+	unsigned short *dst = dst_;
+	unsigned short r, g, b;
+	int x;
+
+	for (x = 0; x < bytes / 2; x++) {
+		r = (src[x] & 0x1f) * brightness2k;
+		g = ((src[x] >> 5) & 0x1f) * brightness2k;
+		b = ((src[x] >> 10) & 0x1f) * brightness2k;
+		dst[x] = (r & 0xf800) | ((g >> 5) & 0x07e0) | (b >> 11);
+	}
+}
 
 #endif // __ARM_NEON__
 
@@ -117,7 +161,7 @@ void bgr_to_uyvy_init(void)
   }
 }
 
-void rgb565_to_uyvy(void *d, const void *s, int pixels)
+void CSPACE_C(rgb565_to_uyvy)(void *d, const void *s, int pixels)
 {
   unsigned int *dst = d;
   const unsigned short *src = s;
@@ -146,7 +190,7 @@ void rgb565_to_uyvy(void *d, const void *s, int pixels)
   }
 }
 
-void bgr555_to_uyvy(void *d, const void *s, int pixels)
+void CSPACE_C(bgr555_to_uyvy)(void *d, const void *s, int pixels)
 {
   unsigned int *dst = d;
   const unsigned short *src = s;
@@ -174,7 +218,7 @@ void bgr555_to_uyvy(void *d, const void *s, int pixels)
   }
 }
 
-void bgr888_to_uyvy(void *d, const void *s, int pixels)
+void CSPACE_C(bgr888_to_uyvy)(void *d, const void *s, int pixels)
 {
   unsigned int *dst = d;
   const unsigned char *src8 = s;
@@ -197,3 +241,7 @@ void bgr888_to_uyvy(void *d, const void *s, int pixels)
     *dst = (y1 << 24) | (v << 16) | (y0 << 8) | u;
   }
 }
+
+#ifdef HAVE_CSPACE_X86
+#include "cspace_x86.c"
+#endif
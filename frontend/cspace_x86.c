@@ -0,0 +1,541 @@
+/*
+ * SSE2/SSSE3/AVX2 versions of the converters, picked once at startup
+ * according to what the CPU supports. They must produce exactly what the
+ * C versions in cspace.c do (see test_cspace.c), which also convert the
+ * leftovers that don't fill a whole vector.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+// will be included from cspace.c
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define TARGET_SSE2  __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+
+enum {
+	CSPACE_X86_C,
+	CSPACE_X86_SSE2,
+	CSPACE_X86_SSSE3,       // the 24bpp ones need pshufb
+	CSPACE_X86_AVX2,
+	CSPACE_X86_LEVELS
+};
+
+// Everything is written once over these. The 24bpp converters work on
+// blocks of 16 pixels, 48 bytes; avx2 does two blocks at a time with one
+// in each 128 bit lane, so a and b are the addresses for the first and
+// the second block, sse2 ignores b.
+
+#define cs_vec_sse2 __m128i
+#define cs_vec_avx2 __m256i
+
+#define cs_bytes_sse2 16
+#define cs_bytes_avx2 32
+
+#define cs_and_sse2(a, b)        _mm_and_si128(a, b)
+#define cs_or_sse2(a, b)         _mm_or_si128(a, b)
+#define cs_xor_sse2(a, b)        _mm_xor_si128(a, b)
+#define cs_add16_sse2(a, b)      _mm_add_epi16(a, b)
+#define cs_sub16_sse2(a, b)      _mm_sub_epi16(a, b)
+#define cs_add32_sse2(a, b)      _mm_add_epi32(a, b)
+#define cs_sub32_sse2(a, b)      _mm_sub_epi32(a, b)
+#define cs_mul16_sse2(a, b)      _mm_mullo_epi16(a, b)
+#define cs_mulhu16_sse2(a, b)    _mm_mulhi_epu16(a, b)
+#define cs_madd16_sse2(a, b)     _mm_madd_epi16(a, b)
+#define cs_min16_sse2(a, b)      _mm_min_epi16(a, b)
+#define cs_max16_sse2(a, b)      _mm_max_epi16(a, b)
+#define cs_shr16_sse2(a, n)      _mm_srli_epi16(a, n)
+#define cs_sar16_sse2(a, n)      _mm_srai_epi16(a, n)
+#define cs_shl16_sse2(a, n)      _mm_slli_epi16(a, n)
+#define cs_shr32_sse2(a, n)      _mm_srli_epi32(a, n)
+#define cs_sar32_sse2(a, n)      _mm_srai_epi32(a, n)
+#define cs_shl32_sse2(a, n)      _mm_slli_epi32(a, n)
+#define cs_zip16lo_sse2(a, b)    _mm_unpacklo_epi16(a, b)
+#define cs_zip16hi_sse2(a, b)    _mm_unpackhi_epi16(a, b)
+#define cs_pack32_sse2(a, b)     _mm_packs_epi32(a, b)
+#define cs_shuffle8_sse2(a, m)   _mm_shuffle_epi8(a, m)
+#define cs_alignr_sse2(a, b, n)  _mm_alignr_epi8(a, b, n)
+#define cs_bshr_sse2(a, n)       _mm_srli_si128(a, n)
+#define cs_dup16_sse2(v)         _mm_set1_epi16(v)
+#define cs_dup32_sse2(v)         _mm_set1_epi32(v)
+#define cs_zero_sse2()           _mm_setzero_si128()
+
+#define cs_and_avx2(a, b)        _mm256_and_si256(a, b)
+#define cs_or_avx2(a, b)         _mm256_or_si256(a, b)
+#define cs_xor_avx2(a, b)        _mm256_xor_si256(a, b)
+#define cs_add16_avx2(a, b)      _mm256_add_epi16(a, b)
+#define cs_sub16_avx2(a, b)      _mm256_sub_epi16(a, b)
+#define cs_add32_avx2(a, b)      _mm256_add_epi32(a, b)
+#define cs_sub32_avx2(a, b)      _mm256_sub_epi32(a, b)
+#define cs_mul16_avx2(a, b)      _mm256_mullo_epi16(a, b)
+#define cs_mulhu16_avx2(a, b)    _mm256_mulhi_epu16(a, b)
+#define cs_madd16_avx2(a, b)     _mm256_madd_epi16(a, b)
+#define cs_min16_avx2(a, b)      _mm256_min_epi16(a, b)
+#define cs_max16_avx2(a, b)      _mm256_max_epi16(a, b)
+#define cs_shr16_avx2(a, n)      _mm256_srli_epi16(a, n)
+#define cs_sar16_avx2(a, n)      _mm256_srai_epi16(a, n)
+#define cs_shl16_avx2(a, n)      _mm256_slli_epi16(a, n)
+#define cs_shr32_avx2(a, n)      _mm256_srli_epi32(a, n)
+#define cs_sar32_avx2(a, n)      _mm256_srai_epi32(a, n)
+#define cs_shl32_avx2(a, n)      _mm256_slli_epi32(a, n)
+#define cs_zip16lo_avx2(a, b)    _mm256_unpacklo_epi16(a, b)
+#define cs_zip16hi_avx2(a, b)    _mm256_unpackhi_epi16(a, b)
+#define cs_pack32_avx2(a, b)     _mm256_packs_epi32(a, b)
+#define cs_shuffle8_avx2(a, m)   _mm256_shuffle_epi8(a, m)
+#define cs_alignr_avx2(a, b, n)  _mm256_alignr_epi8(a, b, n)
+#define cs_bshr_avx2(a, n)       _mm256_srli_si256(a, n)
+#define cs_dup16_avx2(v)         _mm256_set1_epi16(v)
+#define cs_dup32_avx2(v)         _mm256_set1_epi32(v)
+#define cs_zero_avx2()           _mm256_setzero_si256()
+
+#define cs_load_sse2(a)                                                        \
+  _mm_loadu_si128((const __m128i *)(a))                                        \
+
+#define cs_load_avx2(a)                                                        \
+  _mm256_loadu_si256((const __m256i *)(a))                                     \
+
+#define cs_store_sse2(v, a)                                                    \
+  _mm_storeu_si128((__m128i *)(a), v)                                          \
+
+#define cs_store_avx2(v, a)                                                    \
+  _mm256_storeu_si256((__m256i *)(a), v)                                       \
+
+#define cs_load2_sse2(a, b)                                                    \
+  cs_load_sse2(a)                                                              \
+
+#define cs_load2_avx2(a, b)                                                    \
+  _mm256_inserti128_si256(_mm256_castsi128_si256(cs_load_sse2(a)),             \
+   cs_load_sse2(b), 1)                                                         \
+
+#define cs_store2_sse2(v, a, b)                                                \
+  cs_store_sse2(v, a)                                                          \
+
+#define cs_store2_avx2(v, a, b)                                                \
+  _mm_storeu_si128((__m128i *)(a), _mm256_castsi256_si128(v));                 \
+  _mm_storeu_si128((__m128i *)(b), _mm256_extracti128_si256(v, 1))             \
+
+// 16 byte shuffle masks, the same for each lane
+#define cs_mask_sse2(m)                                                        \
+  cs_load_sse2(m)                                                              \
+
+#define cs_mask_avx2(m)                                                        \
+  _mm256_broadcastsi128_si256(cs_load_sse2(m))                                 \
+
+// u32s to s16s, values may use all 16 bits
+#define cs_narrow32(w, a, b)                                                   \
+  cs_pack32_##w(cs_sar32_##w(cs_shl32_##w(a, 16), 16),                         \
+   cs_sar32_##w(cs_shl32_##w(b, 16), 16))                                      \
+
+#define cs_clamp_u8(w, a)                                                      \
+  cs_min16_##w(cs_max16_##w(a, cs_zero_##w()), cs_dup16_##w(255))              \
+
+
+// The 48 byte source blocks are split into 4 windows, each with 4 whole
+// pixels in the low 12 bytes.
+#define cs_windows(w, win, src)                                                \
+{                                                                              \
+  cs_vec_##w a_ = cs_load2_##w(src, src + 48);                                 \
+  cs_vec_##w b_ = cs_load2_##w(src + 16, src + 64);                            \
+  cs_vec_##w c_ = cs_load2_##w(src + 32, src + 80);                            \
+  win[0] = a_;                                                                 \
+  win[1] = cs_alignr_##w(b_, a_, 12);                                          \
+  win[2] = cs_alignr_##w(c_, b_, 8);                                           \
+  win[3] = cs_bshr_##w(c_, 4);                                                 \
+}                                                                              \
+
+#define X 0x80
+
+// pixels from 4 byte windows to u32s: first byte, second byte, third byte
+static const uint8_t cs_mask_888_to_32[16] =
+	{ 0, 1, 2, X, 3, 4, 5, X, 6, 7, 8, X, 9, 10, 11, X };
+static const uint8_t cs_mask_888_to_32_swap[16] =
+	{ 2, 1, 0, X, 5, 4, 3, X, 8, 7, 6, X, 11, 10, 9, X };
+
+// first and third byte as u16 pairs, and the second one twice
+static const uint8_t cs_mask_888_rb[16] =
+	{ 0, X, 2, X, 3, X, 5, X, 6, X, 8, X, 9, X, 11, X };
+static const uint8_t cs_mask_888_gg[16] =
+	{ 1, X, 1, X, 4, X, 4, X, 7, X, 7, X, 10, X, 10, X };
+
+// bgr888_to_rgb888, output 16 bytes n from source 16 bytes m
+static const uint8_t cs_mask_swap_00[16] =
+	{ 2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, X };
+static const uint8_t cs_mask_swap_01[16] =
+	{ X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, 1 };
+static const uint8_t cs_mask_swap_10[16] =
+	{ X, 15, X, X, X, X, X, X, X, X, X, X, X, X, X, X };
+static const uint8_t cs_mask_swap_11[16] =
+	{ 0, X, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, X, 15 };
+static const uint8_t cs_mask_swap_12[16] =
+	{ X, X, X, X, X, X, X, X, X, X, X, X, X, X, 0, X };
+static const uint8_t cs_mask_swap_21[16] =
+	{ 14, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X };
+static const uint8_t cs_mask_swap_22[16] =
+	{ X, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13 };
+
+#undef X
+
+
+#define cs_bgr555_to_rgb565(w, target)                                         \
+static target void bgr555_to_rgb565_##w(void *dst_, const void *src_,          \
+ int bytes)                                                                    \
+{                                                                              \
+  const uint8_t *src = src_;                                                   \
+  uint8_t *dst = dst_;                                                         \
+  cs_vec_##w p;                                                                \
+                                                                               \
+  for(; bytes >= cs_bytes_##w; bytes -= cs_bytes_##w,                          \
+   src += cs_bytes_##w, dst += cs_bytes_##w)                                   \
+  {                                                                            \
+    p = cs_load_##w(src);                                                      \
+    p = cs_or_##w(cs_or_##w(cs_and_##w(cs_shr16_##w(p, 10),                    \
+     cs_dup16_##w(0x1f)), cs_shl16_##w(cs_and_##w(p, cs_dup16_##w(0x3e0)),     \
+     1)), cs_shl16_##w(p, 11));                                                \
+    cs_store_##w(p, dst);                                                      \
+  }                                                                            \
+  bgr555_to_rgb565_c(dst, src, bytes);                                         \
+}                                                                              \
+
+#define cs_bgr555_to_rgb565_b(w, target)                                       \
+static target void bgr555_to_rgb565_b_##w(void *dst_, const void *src_,        \
+ int bytes, int brightness2k)                                                  \
+{                                                                              \
+  const uint8_t *src = src_;                                                   \
+  uint8_t *dst = dst_;                                                         \
+  cs_vec_##w k = cs_dup16_##w(brightness2k);                                   \
+  cs_vec_##w c1f = cs_dup16_##w(0x1f);                                         \
+  cs_vec_##w p, r, g, b;                                                       \
+                                                                               \
+  for(; bytes >= cs_bytes_##w; bytes -= cs_bytes_##w,                          \
+   src += cs_bytes_##w, dst += cs_bytes_##w)                                   \
+  {                                                                            \
+    p = cs_load_##w(src);                                                      \
+    r = cs_mul16_##w(cs_and_##w(p, c1f), k);                                   \
+    g = cs_mul16_##w(cs_and_##w(cs_shr16_##w(p, 5), c1f), k);                  \
+    b = cs_mul16_##w(cs_and_##w(cs_shr16_##w(p, 10), c1f), k);                 \
+    p = cs_or_##w(cs_or_##w(cs_and_##w(r, cs_dup16_##w(0xf800)),               \
+     cs_and_##w(cs_shr16_##w(g, 5), cs_dup16_##w(0x07e0))),                    \
+     cs_shr16_##w(b, 11));                                                     \
+    cs_store_##w(p, dst);                                                      \
+  }                                                                            \
+  bgr555_to_rgb565_b_c(dst, src, bytes, brightness2k);                         \
+}                                                                              \
+
+// the first byte ends up at the top, bgr888_to_rgb565 takes them in order
+// and rgb888_to_rgb565 swapped
+#define cs_888_to_rgb565(name, order_mask, w, target)                          \
+static target void name##_##w(void *dst_, const void *src_, int bytes)         \
+{                                                                              \
+  const uint8_t *src = src_;                                                   \
+  uint8_t *dst = dst_;                                                         \
+  cs_vec_##w mask = cs_mask_##w(order_mask);                                   \
+  cs_vec_##w win[4], px[4];                                                    \
+  int i;                                                                       \
+                                                                               \
+  for(; bytes >= cs_bytes_##w * 3; bytes -= cs_bytes_##w * 3,                  \
+   src += cs_bytes_##w * 3, dst += cs_bytes_##w * 2)                           \
+  {                                                                            \
+    cs_windows(w, win, src);                                                   \
+    for(i = 0; i < 4; i++)                                                     \
+    {                                                                          \
+      cs_vec_##w v = cs_shuffle8_##w(win[i], mask);                            \
+      px[i] = cs_or_##w(cs_or_##w(                                             \
+       cs_shl32_##w(cs_and_##w(v, cs_dup32_##w(0xf8)), 8),                     \
+       cs_and_##w(cs_shr32_##w(v, 5), cs_dup32_##w(0x7e0))),                   \
+       cs_and_##w(cs_shr32_##w(v, 19), cs_dup32_##w(0x1f)));                   \
+    }                                                                          \
+    cs_store2_##w(cs_narrow32(w, px[0], px[1]), dst, dst + 32);                \
+    cs_store2_##w(cs_narrow32(w, px[2], px[3]), dst + 16, dst + 48);           \
+  }                                                                            \
+  name##_c(dst, src, bytes);                                                   \
+}                                                                              \
+
+#define cs_bgr888_to_rgb888(w, target)                                         \
+static target void bgr888_to_rgb888_##w(void *dst_, const void *src_,          \
+ int bytes)                                                                    \
+{                                                                              \
+  const uint8_t *src = src_;                                                   \
+  uint8_t *dst = dst_;                                                         \
+  cs_vec_##w a, b, c, o;                                                       \
+                                                                               \
+  for(; bytes >= cs_bytes_##w * 3; bytes -= cs_bytes_##w * 3,                  \
+   src += cs_bytes_##w * 3, dst += cs_bytes_##w * 3)                           \
+  {                                                                            \
+    a = cs_load2_##w(src, src + 48);                                           \
+    b = cs_load2_##w(src + 16, src + 64);                                      \
+    c = cs_load2_##w(src + 32, src + 80);                                      \
+    o = cs_or_##w(cs_shuffle8_##w(a, cs_mask_##w(cs_mask_swap_00)),            \
+     cs_shuffle8_##w(b, cs_mask_##w(cs_mask_swap_01)));                        \
+    cs_store2_##w(o, dst, dst + 48);                                           \
+    o = cs_or_##w(cs_or_##w(                                                   \
+     cs_shuffle8_##w(a, cs_mask_##w(cs_mask_swap_10)),                         \
+     cs_shuffle8_##w(b, cs_mask_##w(cs_mask_swap_11))),                        \
+     cs_shuffle8_##w(c, cs_mask_##w(cs_mask_swap_12)));                        \
+    cs_store2_##w(o, dst + 16, dst + 64);                                      \
+    o = cs_or_##w(cs_shuffle8_##w(b, cs_mask_##w(cs_mask_swap_21)),            \
+     cs_shuffle8_##w(c, cs_mask_##w(cs_mask_swap_22)));                        \
+    cs_store2_##w(o, dst + 32, dst + 80);                                      \
+  }                                                                            \
+  bgr888_to_rgb888_c(dst, src, bytes);                                         \
+}                                                                              \
+
+
+// UYVY: the lookup tables of bgr_to_uyvy_init() are replaced by math that
+// gives the same values for every possible input.
+
+// yuv_ry[r] + yuv_gy[g] + yuv_by[b] as u32s, the tables being the linear
+// part plus a small rounding term e. 38469 * g doesn't fit in madd, so it's
+// done as (g << 16) - 27067 * g.
+#define cs_uyvy_y32(w, zip, r, g, b, e)                                        \
+  cs_add32_##w(cs_add32_##w(                                                   \
+   cs_madd16_##w(cs_zip16##zip##_##w(r, b),                                    \
+    cs_dup32_##w((7471 << 16) | 19595)),                                       \
+   cs_madd16_##w(cs_zip16##zip##_##w(g, e),                                    \
+    cs_dup32_##w((1 << 16) | (-27067 & 0xffff)))),                             \
+   cs_zip16##zip##_##w(cs_zero_##w(), g))                                      \
+
+// (yuv_ry[r] + yuv_gy[g] + yuv_by[b]) >> 16 for 5 bit r, g, b
+#define cs_uyvy_y5(w, r, g, b)                                                 \
+({                                                                             \
+  cs_vec_##w e_ = cs_add16_##w(cs_add16_##w(                                   \
+   cs_shr16_##w(cs_add16_##w(cs_mul16_##w(r, cs_dup16_##w(17)),                \
+    cs_dup16_##w(30)), 6),                                                     \
+   cs_shr16_##w(cs_add16_##w(cs_mul16_##w(g, cs_dup16_##w(81)),                \
+    cs_dup16_##w(65)), 7)),                                                    \
+   cs_shr16_##w(cs_add16_##w(cs_mul16_##w(b, cs_dup16_##w(7)),                 \
+    cs_dup16_##w(29)), 6));                                                    \
+  cs_pack32_##w(cs_shr32_##w(cs_uyvy_y32(w, lo, r, g, b, e_), 16),             \
+   cs_shr32_##w(cs_uyvy_y32(w, hi, r, g, b, e_), 16));                         \
+})                                                                             \
+
+// sign(d) * ((|d| >> d_shift) * f), f being the u or v table slope
+#define cs_uyvy_uv(w, d, d_shift, f)                                           \
+({                                                                             \
+  cs_vec_##w s_ = cs_sar16_##w(d, 15);                                         \
+  cs_vec_##w a_ = cs_max16_##w(d, cs_sub16_##w(cs_zero_##w(), d));             \
+  a_ = f(w, cs_shr16_##w(a_, d_shift));                                        \
+  cs_clamp_u8(w, cs_add16_##w(cs_sub16_##w(cs_xor_##w(a_, s_), s_),            \
+   cs_dup16_##w(128)));                                                        \
+})                                                                             \
+
+// (int)(8 * 0.565f * i) and (int)(8 * 0.713f * i) for i in 0..31
+#define cs_uyvy_u(w, a) cs_mulhu16_##w(cs_shl16_##w(a, 7), cs_dup16_##w(2315))
+#define cs_uyvy_v(w, a) cs_shr16_##w(cs_mul16_##w(a, cs_dup16_##w(365)), 6)
+
+// y is the final Y of each pixel, u and v are taken from even pixels
+#define cs_uyvy_out(w, y, u, v)                                                \
+  cs_or_##w(cs_or_##w(cs_shl16_##w(y, 8),                                      \
+   cs_and_##w(u, cs_dup32_##w(0xffff))), cs_shl32_##w(v, 16))                  \
+
+#define cs_16_to_uyvy(name, r_shift, g_shift, b_shift, w, target)              \
+static target void name##_##w(void *d, const void *s, int pixels)              \
+{                                                                              \
+  const uint8_t *src = s;                                                      \
+  uint8_t *dst = d;                                                            \
+  cs_vec_##w c1f = cs_dup16_##w(0x1f);                                         \
+  cs_vec_##w p, r, g, b, y, u, v;                                              \
+                                                                               \
+  for(; pixels >= cs_bytes_##w / 2; pixels -= cs_bytes_##w / 2,               \
+   src += cs_bytes_##w, dst += cs_bytes_##w)                                   \
+  {                                                                            \
+    p = cs_load_##w(src);                                                      \
+    r = cs_and_##w(cs_shr16_##w(p, r_shift), c1f);                             \
+    g = cs_and_##w(cs_shr16_##w(p, g_shift), c1f);                             \
+    b = cs_and_##w(cs_shr16_##w(p, b_shift), c1f);                             \
+    y = cs_uyvy_y5(w, r, g, b);                                                \
+    u = cs_uyvy_uv(w, cs_sub16_##w(b, y), 0, cs_uyvy_u);                       \
+    v = cs_uyvy_uv(w, cs_sub16_##w(r, y), 0, cs_uyvy_v);                       \
+    /* 16 + 219 * y / 31 */                                                    \
+    y = cs_add16_##w(cs_shr16_##w(cs_mul16_##w(y, cs_dup16_##w(1809)), 8),     \
+     cs_dup16_##w(16));                                                        \
+    cs_store_##w(cs_uyvy_out(w, y, u, v), dst);                                \
+  }                                                                            \
+  name##_c(dst, src, pixels);                                                  \
+}                                                                              \
+
+#define cs_bgr888_to_uyvy(w, target)                                           \
+static target void bgr888_to_uyvy_##w(void *d, const void *s, int pixels)      \
+{                                                                              \
+  const uint8_t *src = s;                                                      \
+  uint8_t *dst = d;                                                            \
+  cs_vec_##w mask_rb = cs_mask_##w(cs_mask_888_rb);                            \
+  cs_vec_##w mask_gg = cs_mask_##w(cs_mask_888_gg);                            \
+  cs_vec_##w win[4], y32[4], db32[4], dr32[4], y, u, v;                        \
+  int i;                                                                       \
+                                                                               \
+  for(; pixels >= cs_bytes_##w; pixels -= cs_bytes_##w,                        \
+   src += cs_bytes_##w * 3, dst += cs_bytes_##w * 2)                           \
+  {                                                                            \
+    cs_windows(w, win, src);                                                   \
+    for(i = 0; i < 4; i++)                                                     \
+    {                                                                          \
+      cs_vec_##w rb = cs_shuffle8_##w(win[i], mask_rb);                        \
+      cs_vec_##w gg = cs_shuffle8_##w(win[i], mask_gg);                        \
+      y32[i] = cs_shr32_##w(cs_add32_##w(                                      \
+       cs_madd16_##w(rb, cs_dup32_##w((7471 << 16) | 19595)),                  \
+       cs_madd16_##w(gg, cs_dup32_##w((19235 << 16) | 19235))), 16);           \
+      db32[i] = cs_sub32_##w(cs_shr32_##w(rb, 16), y32[i]);                    \
+      dr32[i] = cs_sub32_##w(cs_and_##w(rb, cs_dup32_##w(0xffff)), y32[i]);    \
+    }                                                                          \
+    for(i = 0; i < 4; i += 2)                                                  \
+    {                                                                          \
+      y = cs_pack32_##w(y32[i], y32[i + 1]);                                   \
+      u = cs_uyvy_uv(w, cs_pack32_##w(db32[i], db32[i + 1]), 3, cs_uyvy_u);    \
+      v = cs_uyvy_uv(w, cs_pack32_##w(dr32[i], dr32[i + 1]), 3, cs_uyvy_v);    \
+      /* 16 + 219 * y / 255 */                                                 \
+      y = cs_add16_##w(cs_mulhu16_##w(y, cs_dup16_##w(56284)),                 \
+       cs_dup16_##w(16));                                                      \
+      cs_store2_##w(cs_uyvy_out(w, y, u, v), dst + i * 8, dst + 32 + i * 8);   \
+    }                                                                          \
+  }                                                                            \
+  bgr888_to_uyvy_c(dst, src, pixels);                                          \
+}                                                                              \
+
+#define cs_rgb565_to_uyvy(w, target)                                           \
+  cs_16_to_uyvy(rgb565_to_uyvy, 11, 6, 0, w, target)                           \
+
+#define cs_bgr555_to_uyvy(w, target)                                           \
+  cs_16_to_uyvy(bgr555_to_uyvy, 0, 5, 10, w, target)                           \
+
+#define cs_bgr888_to_rgb565(w, target)                                         \
+  cs_888_to_rgb565(bgr888_to_rgb565, cs_mask_888_to_32, w, target)             \
+
+#define cs_rgb888_to_rgb565(w, target)                                         \
+  cs_888_to_rgb565(rgb888_to_rgb565, cs_mask_888_to_32_swap, w, target)        \
+
+// 16bpp sources only need sse2
+cs_bgr555_to_rgb565(sse2, TARGET_SSE2)
+cs_bgr555_to_rgb565_b(sse2, TARGET_SSE2)
+cs_rgb565_to_uyvy(sse2, TARGET_SSE2)
+cs_bgr555_to_uyvy(sse2, TARGET_SSE2)
+cs_bgr888_to_rgb565(sse2, TARGET_SSSE3)
+cs_rgb888_to_rgb565(sse2, TARGET_SSSE3)
+cs_bgr888_to_rgb888(sse2, TARGET_SSSE3)
+cs_bgr888_to_uyvy(sse2, TARGET_SSSE3)
+
+cs_bgr555_to_rgb565(avx2, TARGET_AVX2)
+cs_bgr555_to_rgb565_b(avx2, TARGET_AVX2)
+cs_rgb565_to_uyvy(avx2, TARGET_AVX2)
+cs_bgr555_to_uyvy(avx2, TARGET_AVX2)
+cs_bgr888_to_rgb565(avx2, TARGET_AVX2)
+cs_rgb888_to_rgb565(avx2, TARGET_AVX2)
+cs_bgr888_to_rgb888(avx2, TARGET_AVX2)
+cs_bgr888_to_uyvy(avx2, TARGET_AVX2)
+
+
+typedef void (cspace_conv_function)(void *dst, const void *src, int bytes);
+
+static struct {
+	cspace_conv_function *bgr555_to_rgb565;
+	cspace_conv_function *bgr888_to_rgb888;
+	cspace_conv_function *bgr888_to_rgb565;
+	cspace_conv_function *rgb888_to_rgb565;
+	void (*bgr555_to_rgb565_b)(void *dst, const void *src, int bytes,
+		int brightness2k);
+	cspace_conv_function *rgb565_to_uyvy;
+	cspace_conv_function *bgr555_to_uyvy;
+	cspace_conv_function *bgr888_to_uyvy;
+} cspace_x86 = {
+	bgr555_to_rgb565_c,
+	bgr888_to_rgb888_c,
+	bgr888_to_rgb565_c,
+	rgb888_to_rgb565_c,
+	bgr555_to_rgb565_b_c,
+	rgb565_to_uyvy_c,
+	bgr555_to_uyvy_c,
+	bgr888_to_uyvy_c,
+};
+
+static int cspace_x86_detect_level(void)
+{
+	int level = CSPACE_X86_C;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		level = CSPACE_X86_SSE2;
+	if (__builtin_cpu_supports("ssse3"))
+		level = CSPACE_X86_SSSE3;
+	if (__builtin_cpu_supports("avx2"))
+		level = CSPACE_X86_AVX2;
+
+	return level;
+}
+
+// switches to the best versions the CPU has, up to max_level
+static int cspace_x86_init(int max_level)
+{
+	int level = cspace_x86_detect_level();
+
+	if (level > max_level)
+		level = max_level;
+
+#define cs_select(name, sse2_level) \
+	cspace_x86.name = level >= CSPACE_X86_AVX2 ? name##_avx2 : \
+		level >= sse2_level ? name##_sse2 : name##_c
+
+	cs_select(bgr555_to_rgb565, CSPACE_X86_SSE2);
+	cs_select(bgr555_to_rgb565_b, CSPACE_X86_SSE2);
+	cs_select(rgb565_to_uyvy, CSPACE_X86_SSE2);
+	cs_select(bgr555_to_uyvy, CSPACE_X86_SSE2);
+	cs_select(bgr888_to_rgb888, CSPACE_X86_SSSE3);
+	cs_select(bgr888_to_rgb565, CSPACE_X86_SSSE3);
+	cs_select(rgb888_to_rgb565, CSPACE_X86_SSSE3);
+	cs_select(bgr888_to_uyvy, CSPACE_X86_SSSE3);
+
+#undef cs_select
+
+	return level;
+}
+
+static void __attribute__((constructor)) cspace_x86_startup(void)
+{
+	cspace_x86_init(CSPACE_X86_AVX2);
+}
+
+void bgr555_to_rgb565(void *dst, const void *src, int bytes)
+{
+	cspace_x86.bgr555_to_rgb565(dst, src, bytes);
+}
+
+void bgr888_to_rgb888(void *dst, const void *src, int bytes)
+{
+	cspace_x86.bgr888_to_rgb888(dst, src, bytes);
+}
+
+void bgr888_to_rgb565(void *dst, const void *src, int bytes)
+{
+	cspace_x86.bgr888_to_rgb565(dst, src, bytes);
+}
+
+void rgb888_to_rgb565(void *dst, const void *src, int bytes)
+{
+	cspace_x86.rgb888_to_rgb565(dst, src, bytes);
+}
+
+void bgr555_to_rgb565_b(void *dst, const void *src, int bytes,
+	int brightness2k)
+{
+	cspace_x86.bgr555_to_rgb565_b(dst, src, bytes, brightness2k);
+}
+
+void rgb565_to_uyvy(void *d, const void *s, int pixels)
+{
+	cspace_x86.rgb565_to_uyvy(d, s, pixels);
+}
+
+void bgr555_to_uyvy(void *d, const void *s, int pixels)
+{
+	cspace_x86.bgr555_to_uyvy(d, s, pixels);
+}
+
+void bgr888_to_uyvy(void *d, const void *s, int pixels)
+{
+	cspace_x86.bgr888_to_uyvy(d, s, pixels);
+}
@@ -0,0 +1,131 @@
+/*
+ * Chrome trace (json array format) export of gpulib's per frame stats:
+ * a slice per frame with the renderer, sync and vout spans under it, and
+ * counters for the primitives, pixels and texels of each kind.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "gpu_trace.h"
+#include "plugin_lib.h"
+#include "../plugins/gpulib/stats.h"
+
+#ifndef NO_OS
+
+static FILE *trace_f;
+static uint64_t trace_base;
+
+static const char * const prim_names[GPU_STAT_PRIM_CNT] = {
+	[GPU_STAT_POLY]             = "poly",
+	[GPU_STAT_POLY_GOURAUD]     = "poly gouraud",
+	[GPU_STAT_POLY_TEX]         = "poly tex",
+	[GPU_STAT_POLY_GOURAUD_TEX] = "poly gouraud tex",
+	[GPU_STAT_SPRITE]           = "sprite",
+	[GPU_STAT_RECT]             = "rect",
+	[GPU_STAT_LINE]             = "line",
+	[GPU_STAT_FILL]             = "fill",
+	[GPU_STAT_COPY]             = "vram copy",
+	[GPU_STAT_VRAM_WRITE]       = "vram write",
+	[GPU_STAT_VRAM_READ]        = "vram read",
+};
+
+static const char * const time_names[GPU_STAT_TIME_CNT] = {
+	[GPU_STAT_CMD_LIST] = "do_cmd_list",
+	[GPU_STAT_SYNC]     = "renderer_sync",
+	[GPU_STAT_VOUT]     = "vout_update",
+};
+
+// microseconds since the first frame, what the format wants
+static double ts(uint64_t ns)
+{
+	return (ns - trace_base) / 1000.0;
+}
+
+static void write_counters(const char *name, double t,
+	const uint64_t *vals, const uint32_t *vals32)
+{
+	unsigned long long v;
+	int i;
+
+	fprintf(trace_f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,"
+		"\"ts\":%.3f,\"args\":{", name, t);
+	for (i = 0; i < GPU_STAT_PRIM_CNT; i++) {
+		v = vals ? vals[i] : vals32[i];
+		fprintf(trace_f, "%s\"%s\":%llu", i ? "," : "", prim_names[i], v);
+	}
+	fprintf(trace_f, "}}");
+}
+
+static void trace_frame(const struct gpu_frame_stats *s)
+{
+	double t;
+	uint32_t i;
+
+	if (trace_base == 0)
+		trace_base = s->start_ns;
+	t = ts(s->start_ns);
+
+	fprintf(trace_f, ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,"
+		"\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+		t, (s->end_ns - s->start_ns) / 1000.0, s->frame);
+	for (i = 0; i < s->span_cnt; i++)
+		fprintf(trace_f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+			"\"tid\":2,\"ts\":%.3f,\"dur\":%.3f}",
+			time_names[s->spans[i].type], ts(s->spans[i].start_ns),
+			s->spans[i].dur_ns / 1000.0);
+
+	write_counters("primitives", t, NULL, s->count);
+	write_counters("pixels", t, s->pixels, NULL);
+	write_counters("texels", t, s->texels, NULL);
+
+	fprintf(trace_f, ",\n{\"name\":\"gpu ms\",\"ph\":\"C\",\"pid\":1,"
+		"\"ts\":%.3f,\"args\":{", t);
+	for (i = 0; i < GPU_STAT_TIME_CNT; i++)
+		fprintf(trace_f, "%s\"%s\":%.3f", i ? "," : "", time_names[i],
+			s->ns[i] / 1000000.0);
+	fprintf(trace_f, "}}");
+}
+
+void gpu_trace_init(void)
+{
+	const char *fname = getenv("GPU_TRACE");
+
+	if (fname == NULL || trace_f != NULL)
+		return;
+	trace_f = fopen(fname, "w");
+	if (trace_f == NULL) {
+		perror(fname);
+		return;
+	}
+	trace_base = 0;
+	fprintf(trace_f, "[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"tid\":1,\"args\":{\"name\":\"frames\"}},\n"
+		"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"tid\":2,\"args\":{\"name\":\"gpulib\"}}");
+	pl_rearmed_cbs.pl_gpu_frame_stats = trace_frame;
+}
+
+void gpu_trace_finish(void)
+{
+	if (trace_f == NULL)
+		return;
+	pl_rearmed_cbs.pl_gpu_frame_stats = NULL;
+	fprintf(trace_f, "\n]\n");
+	fclose(trace_f);
+	trace_f = NULL;
+}
+
+#else
+
+void gpu_trace_init(void) {}
+void gpu_trace_finish(void) {}
+
+#endif // NO_OS
@@ -0,0 +1,9 @@
+#ifndef __GPU_TRACE_H__
+#define __GPU_TRACE_H__
+
+// with GPU_TRACE=<file> in the environment, writes gpulib's per frame
+// stats as Chrome trace json, for chrome://tracing or ui.perfetto.dev
+void gpu_trace_init(void);
+void gpu_trace_finish(void);
+
+#endif /* __GPU_TRACE_H__ */
@@ -62,6 +62,7 @@
 #define ISHEXDEC ((buf[cursor] >= '0') && (buf[cursor] <= '9')) || ((buf[cursor] >= 'a') && (buf[cursor] <= 'f')) || ((buf[cursor] >= 'A') && (buf[cursor] <= 'F'))
 
 #define INTERNAL_FPS_SAMPLE_PERIOD 64
+#define CD_STATS_LOG_PERIOD 600
 
 //hack to prevent retroarch freezing when reseting in the menu but not while running with the hot key
 static int rebootemu = 0;
@@ -86,6 +87,7 @@ static bool duping_enable;
 static bool found_bios;
 static bool display_internal_fps = false;
 static unsigned frame_count = 0;
+static bool log_cd_stats = false;
 static bool libretro_supports_bitmasks = false;
 #ifdef GPU_PEOPS
 static int show_advanced_gpu_peops_settings = -1;
@@ -246,11 +248,13 @@ static void convert(void *buf, size_t bytes)
 }
 #endif
 
-static void vout_flip(const void *vram, int stride, int bgr24, int w, int h)
+/* converts rows y0..y1-1 of the w*h frame */
+static void vout_flip_rows(const void *vram, int stride, int bgr24, int w, int h,
+      int y0, int y1)
 {
    unsigned short *dest = vout_buf_ptr;
    const unsigned short *src = vram;
-   int dstride = vout_width, h1 = h;
+   int dstride = vout_width, h1;
    int doffs;
 
    if (vram == NULL)
@@ -267,8 +271,12 @@ static void vout_flip(const void *vram, int stride, int bgr24, int w, int h)
       // clear borders
       memset(vout_buf_ptr, 0, dstride * h * 2);
       vout_doffs_old = doffs;
+      y0 = 0;
+      y1 = h;
    }
-   dest += doffs;
+   dest += doffs + y0 * dstride;
+   src += y0 * stride;
+   h1 = y1 - y0;
 
    if (bgr24)
    {
@@ -294,6 +302,34 @@ out:
    pl_rearmed_cbs.flip_cnt++;
 }
 
+static void vout_flip(const void *vram, int stride, int bgr24, int w, int h)
+{
+   vout_flip_rows(vram, stride, bgr24, w, h, 0, h);
+}
+
+#ifdef FRONTEND_SUPPORTS_RGB565
+/* our own vout_buf keeps the last frame, so only the rows that were drawn
+ * to need converting, and unchanged frames can be duped */
+static void vout_flip_partial(const void *vram, int stride, int bgr24,
+      int w, int h, int dirty_y, int dirty_h)
+{
+   static void *last_buf;
+
+   if (vout_buf_ptr != vout_buf || last_buf != vout_buf)
+   {
+      last_buf = vout_buf_ptr;
+      dirty_y = 0;
+      dirty_h = h;
+   }
+   if (dirty_h == 0)
+   {
+      pl_rearmed_cbs.flip_cnt++;
+      return;
+   }
+   vout_flip_rows(vram, stride, bgr24, w, h, dirty_y, dirty_y + dirty_h);
+}
+#endif
+
 #ifdef _3DS
 typedef struct
 {
@@ -470,6 +506,9 @@ struct rearmed_cbs pl_rearmed_cbs = {
    .pl_vout_set_mode = vout_set_mode,
    .pl_vout_flip     = vout_flip,
    .pl_vout_close    = vout_close,
+#ifdef FRONTEND_SUPPORTS_RGB565
+   .pl_vout_flip_partial = vout_flip_partial,
+#endif
    .mmap             = pl_mmap,
    .munmap           = pl_munmap,
    /* from psxcounters */
@@ -1604,6 +1643,12 @@ static void update_variables(bool in_flight)
       else if (strcmp(var.value, "enabled") == 0)
          pl_rearmed_cbs.gpu_neon.enhancement_no_main = 1;
    }
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_neon_render_threads";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      pl_rearmed_cbs.gpu_neon.render_threads = atoi(var.value);
 #endif
 
    var.value = NULL;
@@ -1731,18 +1776,42 @@ static void update_variables(bool in_flight)
       {
          Config.AsyncCD = 1;
          Config.CHD_Precache = 0;
+         Config.CdPreload = 0;
       }
       else if (strcmp(var.value, "sync") == 0)
       {
          Config.AsyncCD = 0;
          Config.CHD_Precache = 0;
+         Config.CdPreload = 0;
       }
       else if (strcmp(var.value, "precache") == 0)
       {
          Config.AsyncCD = 0;
          Config.CHD_Precache = 1;
+         Config.CdPreload = 0;
+      }
+      else if (strcmp(var.value, "preload") == 0)
+      {
+         Config.AsyncCD = 0;
+         Config.CHD_Precache = 0;
+         Config.CdPreload = 1;
       }
    }
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_cd_threads";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      Config.CompressedThreads = atoi(var.value);
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_cd_cache";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      Config.CompressedCacheSize = atoi(var.value) << 20;
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_cd_stats";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      log_cd_stats = strcmp(var.value, "enabled") == 0;
 #endif
 
    var.value = NULL;
@@ -2502,6 +2571,31 @@ static void print_internal_fps(void)
       frame_count = 0;
 }
 
+// counters since the disc was opened, every CD_STATS_LOG_PERIOD frames
+static void print_cd_stats(void)
+{
+   static unsigned frames;
+   struct CdrIsoStats s;
+
+   if (!log_cd_stats || !log_cb || !cdrIsoActive())
+   {
+      frames = 0;
+      return;
+   }
+   if (++frames < CD_STATS_LOG_PERIOD)
+      return;
+   frames = 0;
+
+   cdrIsoGetStats(&s);
+   log_cb(RETRO_LOG_INFO, "CD readahead: %u hits, %u misses, %u stalls\n",
+      s.ra_hits, s.ra_misses, s.ra_stalls);
+   log_cb(RETRO_LOG_INFO, "CD cache: %u hits, %u misses, %u unpacked, %u us avg\n",
+      s.cache_hits, s.cache_misses, s.unpack_count,
+      s.unpack_count ? (unsigned)(s.unpack_us / s.unpack_count) : 0);
+   log_cb(RETRO_LOG_INFO, "CD preload: %u hits, %u misses\n",
+      s.preload_hits, s.preload_misses);
+}
+
 void retro_run(void)
 {
    //SysReset must be run while core is running,Not in menu (Locks up Retroarch)
@@ -2518,6 +2612,7 @@ void retro_run(void)
    }
 
    print_internal_fps();
+   print_cd_stats();
 
    input_poll_cb();
 
@@ -618,6 +618,19 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "disabled",
    },
+   {
+      "pcsx_rearmed_neon_render_threads",
+      "Render Threads",
+      "Splits drawing over this many threads, mostly helps Enhanced Resolution on multi-core devices.",
+      {
+         { "1", NULL },
+         { "2", NULL },
+         { "3", NULL },
+         { "4", NULL },
+         { NULL, NULL },
+      },
+      "1",
+   },
 #endif /* GPU_NEON */
 
    {
@@ -924,15 +937,54 @@ struct retro_core_option_definition option_defs_us[] = {
    {
       "pcsx_rearmed_async_cd",
       "CD Access Method (Restart)",
-      "Select method used to read data from content disk images. 'Synchronous' mimics original hardware. 'Asynchronous' can reduce stuttering on devices with slow storage. 'Precache' loads disk image into memory for faster access (CHD only).",
+      "Select method used to read data from content disk images. 'Synchronous' mimics original hardware. 'Asynchronous' can reduce stuttering on devices with slow storage. 'Precache' loads disk image into memory for faster access (CHD only). 'Preload' copies the whole disk, decompressed, into memory in the background so that no disk access happens while playing (uses up to ~800 MB).",
       {
          { "sync",     "Synchronous" },
          { "async",    "Asynchronous" },
          { "precache", "Precache" },
+         { "preload",  "Preload" },
          { NULL, NULL},
       },
       "sync",
    },
+   {
+      "pcsx_rearmed_cd_threads",
+      "Decompression Threads (Restart)",
+      "Number of threads decompressing CHD hunks or PBP/CBIN blocks ahead of the emulated drive. Helps with LZMA/FLAC compressed CHDs on multi-core devices. CHD images don't use them with 'Precache'.",
+      {
+         { "0", "disabled" },
+         { "1", NULL },
+         { "2", NULL },
+         { "3", NULL },
+         { "4", NULL },
+         { NULL, NULL},
+      },
+      "0",
+   },
+   {
+      "pcsx_rearmed_cd_cache",
+      "Decompression Cache Size (Restart)",
+      "Memory used to keep recently decompressed CHD hunks or PBP/CBIN blocks around.",
+      {
+         { "1",  "1 MB" },
+         { "4",  "4 MB" },
+         { "16", "16 MB" },
+         { "64", "64 MB" },
+         { NULL, NULL},
+      },
+      "1",
+   },
+   {
+      "pcsx_rearmed_cd_stats",
+      "Log CD Read Statistics",
+      "Writes the readahead, decompression cache and preload hit/miss counters to the log every 10 seconds.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
 #endif
    /* ADVANCED OPTIONS */
    {
@@ -19,6 +19,7 @@
 #include "plugin.h"
 #include "plugin_lib.h"
 #include "pcnt.h"
+#include "gpu_trace.h"
 #include "menu.h"
 #include "plat.h"
 #include "../libpcsxcore/misc.h"
@@ -50,6 +51,8 @@ int ready_to_go, g_emu_want_quit, g_emu_resetting;
 unsigned long gpuDisp;
 char cfgfile_basename[MAXPATHLEN];
 int state_slot;
+int rewind_buf_sel;	// 0: off, n: 16MB << (n - 1)
+int rewind_enabled;
 enum sched_action emu_action, emu_action_old;
 char hud_msg[64];
 int hud_new_msg;
@@ -124,12 +127,15 @@ void emu_set_default_config(void)
 	Config.Xa = Config.Cdda = Config.Sio =
 	Config.SpuIrq = Config.RCntFix = Config.VSyncWA = 0;
 	Config.PsxAuto = 1;
+	Config.CompressedThreads = 0;
+	Config.CompressedCacheSize = 1 << 20;
 
 	pl_rearmed_cbs.thread_rendering = 0;
 
 	pl_rearmed_cbs.gpu_neon.allow_interlace = 2; // auto
 	pl_rearmed_cbs.gpu_neon.enhancement_enable =
 	pl_rearmed_cbs.gpu_neon.enhancement_no_main = 0;
+	pl_rearmed_cbs.gpu_neon.render_threads = 1;
 	pl_rearmed_cbs.gpu_peops.iUseDither = 0;
 	pl_rearmed_cbs.gpu_peops.dwActFixes = 1<<7;
 	pl_rearmed_cbs.gpu_unai.ilace_force = 0;
@@ -154,6 +160,7 @@ void emu_set_default_config(void)
 	spu_config.iVolume = 768;
 	spu_config.iTempo = 0;
 	spu_config.iUseThread = 1; // no effect if only 1 core is detected
+	spu_config.iThreadCount = 0;
 #if defined(HAVE_PRE_ARMV7) && !defined(_3DS) /* XXX GPH hack */
 	spu_config.iUseReverb = 0;
 	spu_config.iUseInterpolation = 0;
@@ -178,8 +185,9 @@ void do_emu_action(void)
 		snprintf(hud_msg, sizeof(hud_msg), ret == 0 ? "LOADED" : "FAIL!");
 		break;
 	case SACTION_SAVE_STATE:
-		ret = emu_save_state(state_slot);
-		snprintf(hud_msg, sizeof(hud_msg), ret == 0 ? "SAVED" : "FAIL!");
+		// the message is updated again once the file is written
+		ret = emu_save_state_async(state_slot);
+		snprintf(hud_msg, sizeof(hud_msg), ret == 0 ? "SAVING" : "FAIL!");
 		break;
 #ifndef NO_FRONTEND
 	case SACTION_ENTER_MENU:
@@ -223,6 +231,15 @@ do_state_slot:
 		toggle_fast_forward(0);
 		plugin_call_rearmed_cbs();
 		break;
+	case SACTION_REWIND:
+		if (!rewind_enabled)
+			return;
+		// step back again on the next frame while the key is held
+		emu_action_old = SACTION_NONE;
+		ret = RewindStep(1);
+		snprintf(hud_msg, sizeof(hud_msg), ret > 0 ? "REWIND" :
+			ret == 0 ? "REWIND: NO MORE HISTORY" : "FAIL!");
+		break;
 	case SACTION_TOGGLE_FPS:
 		if ((g_opts & (OPT_SHOWFPS|OPT_SHOWCPU))
 		    == (OPT_SHOWFPS|OPT_SHOWCPU))
@@ -408,6 +425,25 @@ void emu_on_new_cd(int show_hud_msg)
 		snprintf(hud_msg, sizeof(hud_msg), BOOT_MSG);
 		hud_new_msg = 3;
 	}
+
+	// snapshots of the previous game are useless now
+	emu_set_rewind(1);
+}
+
+// (re)allocate the rewind ring for rewind_buf_sel, or just empty it
+void emu_set_rewind(int clear)
+{
+	static u32 size;
+	u32 new_size = rewind_buf_sel ? (16u << 20) << (rewind_buf_sel - 1) : 0;
+
+	if (new_size == size && !clear)
+		return;
+	if (RewindInit(new_size, 1) != 0) {
+		SysPrintf("failed to allocate %u bytes for rewind\n", new_size);
+		new_size = 0;
+	}
+	size = new_size;
+	rewind_enabled = size != 0;
 }
 
 int emu_core_preinit(void)
@@ -450,6 +486,7 @@ int emu_core_init(void)
 	}
 
 	LoadMcds(Config.Mcd1, Config.Mcd2);
+	gpu_trace_init();
 
 	if (Config.Debug) {
 		StartDebugger();
@@ -659,11 +696,15 @@ int main(int argc, char *argv[])
 		emu_action = SACTION_NONE;
 
 		psxCpu->Execute();
+		// with rewind on, Execute() returns after every frame
+		if (rewind_enabled && emu_action != SACTION_REWIND)
+			RewindFrame();
 		if (emu_action != SACTION_NONE)
 			do_emu_action();
 	}
 
 	printf("Exit..\n");
+	SaveStateAsyncWait();
 	ClosePlugins();
 	SysClose();
 	menu_finish();
@@ -744,6 +785,7 @@ void SysReset() {
 void SysClose() {
 	EmuShutdown();
 	ReleasePlugins();
+	gpu_trace_finish();
 
 	StopDebugger();
 
@@ -791,6 +833,50 @@ int emu_save_state(int slot)
 	return ret;
 }
 
+// 0 - nothing new, 1 - saved, 2 - failed; set by the writer thread
+static int save_state_result;
+
+// runs on the writer thread, hud_msg is left to emu_check_save_state()
+static void save_state_done(const char *file, int ret, void *param)
+{
+#if defined(HAVE_PRE_ARMV7) && !defined(_3DS) && !defined(__SWITCH__) /* XXX GPH hack */
+	sync();
+#endif
+	SysPrintf("* %s \"%s\" [%d]\n",
+		ret == 0 ? "saved" : "failed to save", file, (int)(long)param);
+	__atomic_store_n(&save_state_result, ret == 0 ? 1 : 2, __ATOMIC_RELEASE);
+	free((void *)file);
+}
+
+// called every frame from the emu thread
+void emu_check_save_state(void)
+{
+	int result;
+
+	if (!__atomic_load_n(&save_state_result, __ATOMIC_RELAXED))
+		return;
+	result = __atomic_exchange_n(&save_state_result, 0, __ATOMIC_ACQUIRE);
+	if (result == 0)
+		return;
+
+	snprintf(hud_msg, sizeof(hud_msg), result == 1 ? "SAVED" : "FAIL!");
+	hud_new_msg = 3;
+}
+
+// returns once the state is captured, writing happens in the background
+int emu_save_state_async(int slot)
+{
+	char fname[MAXPATHLEN];
+	int ret;
+
+	ret = get_state_filename(fname, sizeof(fname), slot);
+	if (ret != 0)
+		return ret;
+
+	// freed by save_state_done
+	return SaveStateAsync(strdup(fname), save_state_done, (void *)(long)slot);
+}
+
 int emu_load_state(int slot)
 {
 	char fname[MAXPATHLEN];
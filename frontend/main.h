@@ -35,6 +35,7 @@
 extern char cfgfile_basename[MAXPATHLEN];
 
 extern int state_slot;
+extern int rewind_buf_sel, rewind_enabled;
 
 /* emu_core_preinit - must be the very first call
  * emu_core_init - to be called after platform-specific setup */
@@ -45,10 +46,13 @@ void emu_core_ask_exit(void);
 
 void emu_set_default_config(void);
 void emu_on_new_cd(int show_hud_msg);
+void emu_set_rewind(int clear);
 
 int get_state_filename(char *buf, int size, int i);
 int emu_check_state(int slot);
 int emu_save_state(int slot);
+int emu_save_state_async(int slot);
+void emu_check_save_state(void);
 int emu_load_state(int slot);
 
 void set_cd_image(const char *fname);
@@ -75,6 +79,7 @@ enum sched_action {
 	SACTION_MINIMIZE,
 	SACTION_TOGGLE_FPS,
 	SACTION_TOGGLE_FULLSCREEN,
+	SACTION_REWIND,
 	SACTION_GUN_TRIGGER = 16,
 	SACTION_GUN_A,
 	SACTION_GUN_B,
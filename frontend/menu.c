@@ -94,6 +94,7 @@ static int cpu_clock, cpu_clock_st, volume_boost, frameskip;
 static char last_selected_fname[MAXPATHLEN];
 static int config_save_counter, region, in_type_sel1, in_type_sel2;
 static int psx_clock;
+static int cd_threads, cd_cache_sel;
 static int memcard1_sel = -1, memcard2_sel = -1;
 extern int g_autostateld_opt;
 int g_opts, g_scaler, g_gamma = 100;
@@ -303,6 +304,8 @@ static void menu_sync_config(void)
 		Config.PsxType = region - 1;
 	}
 	cycle_multiplier = 10000 / psx_clock;
+	Config.CompressedThreads = cd_threads;
+	Config.CompressedCacheSize = (1 << (cd_cache_sel * 2)) << 20;
 
 	switch (in_type_sel1) {
 	case 1:  in_type[0] = PSE_PAD_TYPE_ANALOGPAD; break;
@@ -333,6 +336,7 @@ static void menu_set_defconfig(void)
 	g_gamma = 100;
 	volume_boost = 0;
 	frameskip = 0;
+	rewind_buf_sel = 0;
 	analog_deadzone = 50;
 	soft_scaling = 1;
 	soft_filter = 0;
@@ -342,6 +346,8 @@ static void menu_set_defconfig(void)
 	psx_clock = DEFAULT_PSX_CLOCK;
 
 	region = 0;
+	cd_threads = 0;
+	cd_cache_sel = 0;
 	in_type_sel1 = in_type_sel2 = 0;
 	in_evdev_allow_abs_only = 0;
 
@@ -396,6 +402,8 @@ static const struct {
 	CE_CONFIG_VAL(VSyncWA),
 	CE_CONFIG_VAL(Cpu),
 	CE_INTVAL(region),
+	CE_INTVAL(cd_threads),
+	CE_INTVAL(cd_cache_sel),
 	CE_INTVAL_V(g_scaler, 3),
 	CE_INTVAL(g_gamma),
 	CE_INTVAL(g_layer_x),
@@ -409,6 +417,7 @@ static const struct {
 	CE_INTVAL(plat_target.hwfilter),
 	CE_INTVAL(plat_target.vout_fullscreen),
 	CE_INTVAL(state_slot),
+	CE_INTVAL(rewind_buf_sel),
 	CE_INTVAL(cpu_clock),
 	CE_INTVAL(g_opts),
 	CE_INTVAL(in_type_sel1),
@@ -437,6 +446,7 @@ static const struct {
 	CE_INTVAL_P(gpu_neon.allow_interlace),
 	CE_INTVAL_P(gpu_neon.enhancement_enable),
 	CE_INTVAL_P(gpu_neon.enhancement_no_main),
+	CE_INTVAL_P(gpu_neon.render_threads),
 	CE_INTVAL_P(gpu_peopsgl.bDrawDither),
 	CE_INTVAL_P(gpu_peopsgl.iFilterType),
 	CE_INTVAL_P(gpu_peopsgl.iFrameTexType),
@@ -453,6 +463,7 @@ static const struct {
 	CE_INTVAL(spu_config.iUseInterpolation),
 	CE_INTVAL(spu_config.iTempo),
 	CE_INTVAL(spu_config.iUseThread),
+	CE_INTVAL(spu_config.iThreadCount),
 	CE_INTVAL(config_save_counter),
 	CE_INTVAL(in_evdev_allow_abs_only),
 	CE_INTVAL(volume_boost),
@@ -863,6 +874,7 @@ me_bind_action emuctrl_actions[] =
 	{ "Switch Renderer  ", 1 << SACTION_SWITCH_DISPMODE },
 #endif
 	{ "Fast Forward     ", 1 << SACTION_FAST_FORWARD },
+	{ "Rewind           ", 1 << SACTION_REWIND },
 #if MENU_SHOW_MINIMIZE
 	{ "Minimize         ", 1 << SACTION_MINIMIZE },
 #endif
@@ -1345,6 +1357,9 @@ static const char h_gpu_neon_enhanced[] =
 	"(not available for high resolution games)";
 static const char h_gpu_neon_enhanced_hack[] =
 	"Speed hack for above option (glitches some games)";
+static const char h_gpu_neon_threads[] =
+	"Threads that draw parts of the screen each,\n"
+	"helps mostly with enhanced resolution";
 static const char *men_gpu_interlace[] = { "Off", "On", "Auto", NULL };
 
 static menu_entry e_menu_plugin_gpu_neon[] =
@@ -1352,6 +1367,7 @@ static menu_entry e_menu_plugin_gpu_neon[] =
 	mee_enum      ("Enable interlace mode",      0, pl_rearmed_cbs.gpu_neon.allow_interlace, men_gpu_interlace),
 	mee_onoff_h   ("Enhanced resolution (slow)", 0, pl_rearmed_cbs.gpu_neon.enhancement_enable, 1, h_gpu_neon_enhanced),
 	mee_onoff_h   ("Enhanced res. speed hack",   0, pl_rearmed_cbs.gpu_neon.enhancement_no_main, 1, h_gpu_neon_enhanced_hack),
+	mee_range_h   ("Render threads",             0, pl_rearmed_cbs.gpu_neon.render_threads, 1, 4, h_gpu_neon_threads),
 	mee_end,
 };
 
@@ -1460,6 +1476,8 @@ static const char *men_spu_interp[] = { "None", "Simple", "Gaussian", "Cubic", N
 static const char h_spu_volboost[]  = "Large values cause distortion";
 static const char h_spu_tempo[]     = "Slows down audio if emu is too slow\n"
 				      "This is inaccurate and breaks games";
+static const char h_spu_threads[]   = "Threads used to render voices when\n"
+				      "Threaded SPU is on, 0 = auto";
 
 static menu_entry e_menu_plugin_spu[] =
 {
@@ -1469,6 +1487,9 @@ static menu_entry e_menu_plugin_spu[] =
 	mee_onoff     ("Diablo Music fix",          0, spu_config.idiablofix, 1),
 	mee_onoff     ("Adjust XA pitch",           0, spu_config.iXAPitch, 1),
 	mee_onoff_h   ("Adjust tempo",              0, spu_config.iTempo, 1, h_spu_tempo),
+#ifndef C64X_DSP
+	mee_range_h   ("Voice threads",             0, spu_config.iThreadCount, 0, 4, h_spu_threads),
+#endif
 	mee_end,
 };
 
@@ -1569,6 +1590,13 @@ static const char h_cfg_nodrc[]  = "Disable dynamic recompiler and use interpret
 				   "Might be useful to overcome some dynarec bugs";
 static const char h_cfg_shacks[] = "Breaks games but may give better performance\n"
 				   "must reload game for any change to take effect";
+static const char h_cfg_cdthr[]  = "Threads decompressing CHD/PBP/CBIN images ahead\n"
+				   "of the emulated drive, 0 = on demand\n"
+				   "must reload game for any change to take effect";
+static const char h_cfg_cdcache[]= "Memory for recently decompressed CHD hunks or\n"
+				   "PBP/CBIN blocks\n"
+				   "must reload game for any change to take effect";
+static const char *men_cd_cache[] = { "1 MB", "4 MB", "16 MB", "64 MB", NULL };
 
 static menu_entry e_menu_adv_options[] =
 {
@@ -1582,6 +1610,8 @@ static menu_entry e_menu_adv_options[] =
 	//mee_onoff_h   ("Rootcounter hack",       0, Config.RCntFix, 1, h_cfg_rcnt1),
 	mee_onoff_h   ("Rootcounter hack 2",     0, Config.VSyncWA, 1, h_cfg_rcnt2),
 	mee_onoff_h   ("Disable dynarec (slow!)",0, Config.Cpu, 1, h_cfg_nodrc),
+	mee_range_h   ("CD decompress threads",  0, cd_threads, 0, 4, h_cfg_cdthr),
+	mee_enum_h    ("CD decompress cache",    0, cd_cache_sel, men_cd_cache, h_cfg_cdcache),
 	mee_handler_h ("[Speed hacks]",             menu_loop_speed_hacks, h_cfg_shacks),
 	mee_end,
 };
@@ -1604,6 +1634,7 @@ static int mh_restore_defaults(int id, int keys)
 
 static const char *men_region[]       = { "Auto", "NTSC", "PAL", NULL };
 static const char *men_frameskip[]    = { "Auto", "Off", "1", "2", "3", NULL };
+static const char *men_rewind[]       = { "OFF", "16 MB", "32 MB", "64 MB", NULL };
 /*
 static const char *men_confirm_save[] = { "OFF", "writes", "loads", "both", NULL };
 static const char h_confirm_save[]    = "Ask for confirmation when overwriting save,\n"
@@ -1612,6 +1643,8 @@ static const char h_confirm_save[]    = "Ask for confirmation when overwriting s
 static const char h_restore_def[]     = "Switches back to default / recommended\n"
 					"configuration";
 static const char h_frameskip[]       = "Warning: frameskip sometimes causes glitches\n";
+static const char h_rewind[]          = "Memory for the frames kept for the Rewind key,\n"
+					"more memory gives a longer history";
 
 static menu_entry e_menu_options[] =
 {
@@ -1620,6 +1653,7 @@ static menu_entry e_menu_options[] =
 	mee_enum_h    ("Frameskip",                0, frameskip, men_frameskip, h_frameskip),
 	mee_onoff     ("Show FPS",                 0, g_opts, OPT_SHOWFPS),
 	mee_enum      ("Region",                   0, region, men_region),
+	mee_enum_h    ("Rewind buffer",            0, rewind_buf_sel, men_rewind, h_rewind),
 	mee_range     ("CPU clock",                MA_OPT_CPU_CLOCKS, cpu_clock, 20, 5000),
 #ifdef C64X_DSP
 	mee_onoff     ("Use C64x DSP for sound",   MA_OPT_SPU_THREAD, spu_config.iUseThread, 1),
@@ -2609,6 +2643,7 @@ void menu_prepare_emu(void)
 		CDR_stop();
 
 	menu_sync_config();
+	emu_set_rewind(0);
 	if (cpu_clock > 0)
 		plat_target_cpu_clock_set(cpu_clock);
 
@@ -47,6 +47,7 @@ extern void CALLBACK SPUabout(void);
 extern long CALLBACK SPUfreeze(unsigned int, void *, unsigned int);
 extern void CALLBACK SPUasync(unsigned int, unsigned int);
 extern int  CALLBACK SPUplayCDDAchannel(short *, int);
+extern void * CALLBACK SPUgetRam(void);
 
 /* PAD */
 static long PADreadPort1(PadDataS *pad) {
@@ -127,6 +128,7 @@ extern void GPUupdateLace(void);
 extern long GPUfreeze(uint32_t, void *);
 extern void GPUvBlank(int, int);
 extern void GPUrearmedCallbacks(const struct rearmed_cbs *cbs);
+extern void *GPUgetVram(void);
 
 
 #define DUMMY(id, name) \
@@ -188,6 +190,7 @@ static const struct {
 	DIRECT_SPU(SPUregisterScheduleCb),
 	DIRECT_SPU(SPUasync),
 	DIRECT_SPU(SPUplayCDDAchannel),
+	DIRECT_SPU(SPUgetRam),
 	/* PAD */
 	DUMMY_PAD(PADinit),
 	DUMMY_PAD(PADshutdown),
@@ -221,6 +224,7 @@ static const struct {
 	DIRECT_GPU(GPUfreeze),
 	DIRECT_GPU(GPUvBlank),
 	DIRECT_GPU(GPUrearmedCallbacks),
+	DIRECT_GPU(GPUgetVram),
 
 	DUMMY_GPU(GPUdisplayText),
 /*
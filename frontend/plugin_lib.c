@@ -127,8 +127,10 @@ static void print_cpu_usage(int w, int h, int border)
 static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h)
 {
 	extern void spu_get_debug_info(int *chans_out, int *run_chans,
-		int *fmod_chans_out, int *noise_chans_out); // hack
-	int live_chans, run_chans, fmod_chans, noise_chans;
+		int *fmod_chans_out, int *noise_chans_out,
+		int *adpcm_hit_pct); // hack
+	extern int out_get_latency_ms(void);
+	int live_chans, run_chans, fmod_chans, noise_chans, hit_pct, latency;
 
 	static const unsigned short colors[2] = { 0x1fe3, 0x0700 };
 	unsigned short *dest = (unsigned short *)pl_vout_buf +
@@ -139,7 +141,8 @@ static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h)
 	if (dest == NULL || pl_vout_bpp != 16)
 		return;
 
-	spu_get_debug_info(&live_chans, &run_chans, &fmod_chans, &noise_chans);
+	spu_get_debug_info(&live_chans, &run_chans, &fmod_chans, &noise_chans,
+		&hit_pct);
 
 	for (c = 0; c < 24; c++) {
 		d = dest + c * 8;
@@ -151,6 +154,12 @@ static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h)
 			for (x = 0; x < 8; x++)
 				d[x] = p;
 	}
+
+	// decoded block cache hit rate, audio output latency
+	latency = out_get_latency_ms();
+	if (hit_pct >= 0 || latency >= 0)
+		hud_printf(pl_vout_buf, pl_vout_w, vout_w / 2 + 192/2 + 4,
+			vout_h - HUD_HEIGHT, "%3d %3dms", hit_pct, latency);
 }
 
 static void print_hud(int w, int h, int xborder)
@@ -652,6 +661,12 @@ void pl_frame_limit(void)
 	 * thousands of times per frame for some reason */
 	update_input();
 
+	emu_check_save_state();
+
+	/* back to the main loop for a rewind snapshot */
+	if (rewind_enabled)
+		stop = 1;
+
 	pcnt_end(PCNT_ALL);
 	gettimeofday(&now, 0);
 
@@ -49,6 +49,8 @@ void  pl_switch_dispmode(void);
 void  pl_timing_prepare(int is_pal);
 void  pl_frame_limit(void);
 
+struct gpu_frame_stats;
+
 struct rearmed_cbs {
 	void  (*pl_get_layer_pos)(int *x, int *y, int *w, int *h);
 	int   (*pl_vout_open)(void);
@@ -61,6 +63,13 @@ struct rearmed_cbs {
 	// only used by some frontends
 	void  (*pl_vout_set_raw_vram)(void *vram);
 	void  (*pl_set_gpu_caps)(int caps);
+	// like pl_vout_flip, but only rows dirty_y..dirty_y+dirty_h-1 were
+	// drawn to since the last flip (none if dirty_h is 0), for frontends
+	// that keep the last frame and can convert just those
+	void  (*pl_vout_flip_partial)(const void *vram, int stride, int bgr24,
+				      int w, int h, int dirty_y, int dirty_h);
+	// per frame counters and timings from gpulib, see plugins/gpulib/stats.h
+	void  (*pl_gpu_frame_stats)(const struct gpu_frame_stats *stats);
 	// some stats, for display by some plugins
 	int flips_per_sec, cpu_usage;
 	float vsps_cur; // currect vsync/s
@@ -80,6 +89,7 @@ struct rearmed_cbs {
 		int   enhancement_enable;
 		int   enhancement_no_main;
 		int   allow_dithering;
+		int   render_threads; // 0/1 draw on the emu thread
 	} gpu_neon;
 	struct {
 		int   iUseDither;
@@ -0,0 +1,184 @@
+/*
+ * checks the x86 SIMD converters against the C ones on random data,
+ * sizes and alignments, then times each of them at every level
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cspace.c"
+
+#ifdef HAVE_CSPACE_X86
+
+// enough for a 640x480 frame at 24bpp, plus room for the alignments
+#define BUF_SIZE (640 * 480 * 4 + 64)
+
+static unsigned char src[BUF_SIZE];
+static unsigned char dst_ref[BUF_SIZE], dst_test[BUF_SIZE];
+
+static const char *level_names[CSPACE_X86_LEVELS] =
+	{ "c", "sse2", "ssse3", "avx2" };
+
+static unsigned int seed = 0x12345678;
+static int failed;
+
+static unsigned int rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static void fill_random(void *ptr, size_t size)
+{
+	unsigned char *p = ptr;
+	while (size--)
+		*p++ = rnd();
+}
+
+enum { CONV_BYTES, CONV_BRIGHTNESS, CONV_PIXELS };
+
+static const struct conv {
+	const char *name;
+	int type;
+	int bpp;              // source bytes per pixel
+	cspace_conv_function *ref, *test;
+	void (*ref_b)(void *, const void *, int, int);
+	void (*test_b)(void *, const void *, int, int);
+} convs[] = {
+	{ "bgr555_to_rgb565", CONV_BYTES, 2,
+	  bgr555_to_rgb565_c, bgr555_to_rgb565 },
+	{ "bgr555_to_rgb565_b", CONV_BRIGHTNESS, 2,
+	  NULL, NULL, bgr555_to_rgb565_b_c, bgr555_to_rgb565_b },
+	{ "bgr888_to_rgb888", CONV_BYTES, 3,
+	  bgr888_to_rgb888_c, bgr888_to_rgb888 },
+	{ "bgr888_to_rgb565", CONV_BYTES, 3,
+	  bgr888_to_rgb565_c, bgr888_to_rgb565 },
+	{ "rgb888_to_rgb565", CONV_BYTES, 3,
+	  rgb888_to_rgb565_c, rgb888_to_rgb565 },
+	{ "rgb565_to_uyvy", CONV_PIXELS, 2,
+	  rgb565_to_uyvy_c, rgb565_to_uyvy },
+	{ "bgr555_to_uyvy", CONV_PIXELS, 2,
+	  bgr555_to_uyvy_c, bgr555_to_uyvy },
+	{ "bgr888_to_uyvy", CONV_PIXELS, 3,
+	  bgr888_to_uyvy_c, bgr888_to_uyvy },
+};
+
+#define CONV_CNT (sizeof(convs) / sizeof(convs[0]))
+
+static void run(const struct conv *c, int ref, void *d, const void *s,
+	int pixels, int k)
+{
+	switch (c->type) {
+	case CONV_BYTES:
+		(ref ? c->ref : c->test)(d, s, pixels * c->bpp);
+		break;
+	case CONV_BRIGHTNESS:
+		(ref ? c->ref_b : c->test_b)(d, s, pixels * c->bpp, k);
+		break;
+	case CONV_PIXELS:
+		(ref ? c->ref : c->test)(d, s, pixels);
+		break;
+	}
+}
+
+static void check(const struct conv *c, int level)
+{
+	int i, pixels, s_ofs, d_ofs, k;
+
+	for (i = 0; i < 2000; i++) {
+		// mostly short, to hit every leftover count
+		pixels = (i & 3) ? rnd() % 200 : rnd() % 4096;
+		s_ofs = rnd() & 15;
+		d_ofs = rnd() & 15;
+		k = (i & 7) ? rnd() % 0x801 : rnd() & 0xffff;
+
+		fill_random(src, pixels * 3 + 64);
+		fill_random(dst_ref, pixels * 4 + 64);
+		memcpy(dst_test, dst_ref, pixels * 4 + 64);
+
+		run(c, 1, dst_ref + d_ofs, src + s_ofs, pixels, k);
+		run(c, 0, dst_test + d_ofs, src + s_ofs, pixels, k);
+
+		if (memcmp(dst_ref, dst_test, pixels * 4 + 64)) {
+			printf("%s %s: mismatch, %d pixels, offsets %d %d, k %d\n",
+				c->name, level_names[level], pixels, s_ofs, d_ofs, k);
+			failed = 1;
+			return;
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// source MB/s for converting a 640x480 frame over and over
+static double bench(const struct conv *c)
+{
+	int pixels = 640 * 480, loops = 0;
+	double start = now(), t;
+
+	do {
+		run(c, 0, dst_test, src, pixels, 0x400);
+		loops++;
+	} while ((t = now() - start) < 0.2);
+
+	return (double)loops * pixels * c->bpp / t / (1024 * 1024);
+}
+
+int main(int argc, char *argv[])
+{
+	int do_bench = argc > 1 && !strcmp(argv[1], "-b");
+	int max_level, level;
+	unsigned int i;
+
+	bgr_to_uyvy_init();
+	max_level = cspace_x86_init(CSPACE_X86_AVX2);
+
+	for (level = CSPACE_X86_SSE2; level <= max_level; level++) {
+		cspace_x86_init(level);
+		for (i = 0; i < CONV_CNT; i++)
+			check(&convs[i], level);
+	}
+	printf("%s, levels up to %s checked\n", failed ? "FAILED" : "ok",
+		level_names[max_level]);
+
+	if (do_bench) {
+		printf("%-20s", "MB/s");
+		for (level = CSPACE_X86_C; level <= max_level; level++)
+			printf("%8s", level_names[level]);
+		printf("\n");
+		fill_random(src, sizeof(src));
+		for (i = 0; i < CONV_CNT; i++) {
+			printf("%-20s", convs[i].name);
+			for (level = CSPACE_X86_C; level <= max_level; level++) {
+				cspace_x86_init(level);
+				printf("%8.0f", bench(&convs[i]));
+				fflush(stdout);
+			}
+			printf("\n");
+		}
+	}
+
+	return failed;
+}
+
+#else
+
+int main()
+{
+	printf("no x86 SIMD converters in this build\n");
+	return 0;
+}
+
+#endif
@@ -27,6 +27,7 @@ SOURCES_C := $(CORE_DIR)/cdriso.c \
              $(CORE_DIR)/cheat.c \
              $(CORE_DIR)/decode_xa.c \
              $(CORE_DIR)/mdec.c \
+             $(CORE_DIR)/memtrack.c \
              $(CORE_DIR)/misc.c \
              $(CORE_DIR)/plugins.c \
              $(CORE_DIR)/ppf.c \
@@ -51,11 +52,14 @@ SOURCES_C += $(SPU_DIR)/dma.c \
              $(SPU_DIR)/registers.c \
              $(SPU_DIR)/spu.c \
              $(SPU_DIR)/out.c \
-             $(SPU_DIR)/nullsnd.c
+             $(SPU_DIR)/nullsnd.c \
+             $(SPU_DIR)/record.c
 
 # gpu
 SOURCES_C += $(GPU_DIR)/gpu.c \
-             $(GPU_DIR)/vout_pl.c
+             $(GPU_DIR)/vout_pl.c \
+             $(GPU_DIR)/record.c \
+             $(GPU_DIR)/stats.c
 
 # cdrcimg
 SOURCES_C += $(CDR_DIR)/cdrcimg.c
@@ -69,6 +73,7 @@ SOURCES_C += $(INPUT_DIR)/main.c \
 SOURCES_C += $(FRONTEND_DIR)/main.c \
              $(FRONTEND_DIR)/plugin.c \
              $(FRONTEND_DIR)/cspace.c \
+             $(FRONTEND_DIR)/gpu_trace.c \
              $(FRONTEND_DIR)/libretro.c
 
 # libchdr
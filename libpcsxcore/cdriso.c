@@ -43,6 +43,12 @@
 #include <unistd.h>
 #endif
 
+#if (defined(__linux__) || defined(__APPLE__)) && !defined(NO_OS) && !defined(USE_LIBRETRO_VFS)
+#define HAVE_CDIMG_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #ifdef USE_LIBRETRO_VFS
 #include <streams/file_stream_transforms.h>
 #undef fseeko
@@ -95,8 +101,7 @@ static unsigned int pregapOffset;
 
 // compressed image stuff
 static struct {
-	unsigned char buff_raw[16][CD_FRAMESIZE_RAW];
-	unsigned char buff_compressed[CD_FRAMESIZE_RAW * 16 + 100];
+	unsigned char (*buff_raw)[CD_FRAMESIZE_RAW];
 	off_t *index_table;
 	unsigned int index_len;
 	unsigned int block_shift;
@@ -104,6 +109,13 @@ static struct {
 	unsigned int sector_in_blk;
 } *compr_img;
 
+// per thread block decompression state
+struct compr_ctx {
+	FILE *f;
+	z_stream z;
+	unsigned char buff_compressed[CD_FRAMESIZE_RAW * 16 + 100];
+};
+
 #ifdef HAVE_CHD
 static struct {
 	unsigned char (*buffer)[CD_FRAMESIZE_RAW + SUB_FRAMESIZE];
@@ -115,6 +127,87 @@ static struct {
 } *chd_img;
 #endif
 
+// Cache of decompressed CHD hunks or PBP/CBIN blocks ("units"). The
+// reading thread decompresses on a miss, optional worker threads (each
+// with its own file handle and decompressor state) fill in the units
+// following the last one read.
+#define UNPACK_MAX_THREADS 8
+
+enum {
+	UNPACK_READY = 0,
+	UNPACK_QUEUED,		// waiting for a worker to pick it up
+	UNPACK_BUSY,		// being decompressed
+};
+
+struct unpack_entry {
+	int unit;		// -1 if unused
+	int state;		// UNPACK_*
+	unsigned int last_used;
+	unsigned char *data;
+};
+
+static struct {
+	struct unpack_entry *entries;
+	unsigned char *mem;
+	unsigned int len;
+	unsigned int unit_bytes;
+	unsigned int use_counter;
+	int current;		// entry that CDR_getBuffer points into
+	int units;		// total in the image
+	int (*unpack)(void *ctx, int unit, unsigned char *dest);
+	void *(*ctx_open)(void);
+	void (*ctx_close)(void *ctx);
+	void *ctx;		// used by the reading thread(s)
+	int nthreads;
+#ifndef _WIN32
+	struct {
+		pthread_t thread;
+		void *ctx;
+	} workers[UNPACK_MAX_THREADS];
+	pthread_mutex_t lock;
+	pthread_mutex_t ctx_lock; // cdda and data may both read
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	boolean running;
+#endif
+} ucache;
+
+#ifdef HAVE_CDIMG_MMAP
+// uncompressed image mapped into memory, read without stdio
+static struct {
+	unsigned char *base;
+	size_t size;
+	unsigned char *sector; // last sector read for cdbuffer
+} cdimg_map;
+#endif
+
+#ifndef _WIN32
+// Whole image copied into memory by a background thread, in chunks of
+// sectors (a hunk/block for compressed images). Sectors whose chunk isn't
+// there yet are read the normal way.
+static struct {
+	unsigned char *data;
+	size_t size;
+	boolean mapped;		// data is an anonymous mapping, not malloc
+	unsigned char *ready;	// per chunk, set with release once loaded
+	int sectors;
+	int chunk;		// sectors per chunk
+	int chunks;
+	int stride;		// bytes per sector in data
+	int hint;		// chunk the emu thread is waiting on, or -1
+	int loaded;
+	unsigned int start_time;
+	unsigned char *sector;	// last sector read for cdbuffer, NULL if not preloaded
+	int (*read_func)(FILE *f, unsigned int base, void *dest, int sector);
+	unsigned char *(*get_buffer)(void);
+	void *ctx;		// own decompressor for compressed ones
+	pthread_t thread;
+	boolean running;
+} preload;
+#endif
+
+static struct CdrIsoStats cdr_stats;
+
 int (*cdimg_read_func)(FILE *f, unsigned int base, void *dest, int sector);
 
 char* CALLBACK CDR__getDriveLetter(void);
@@ -1053,8 +1146,9 @@ static int handlecbin(const char *isofile) {
 	if (index_table == NULL)
 		goto fail_io;
 
-	ret = fread(index_table, sizeof(index_table[0]), compr_img->index_len, cdHandle);
-	if (ret != compr_img->index_len) {
+	// one more entry than blocks, the last one marks the end of data
+	ret = fread(index_table, sizeof(index_table[0]), compr_img->index_len + 1, cdHandle);
+	if (ret != compr_img->index_len + 1) {
 		SysPrintf("failed to read index table\n");
 		goto fail_index;
 	}
@@ -1098,10 +1192,6 @@ static int handlechd(const char *isofile) {
 
    chd_img->header = chd_get_header(chd_img->chd);
 
-   chd_img->buffer = malloc(chd_img->header->hunkbytes);
-   if (chd_img->buffer == NULL)
-		goto fail_io;
-
    chd_img->sectors_per_hunk = chd_img->header->hunkbytes / (CD_FRAMESIZE_RAW + SUB_FRAMESIZE);
    chd_img->current_hunk = (unsigned int)-1;
 
@@ -1156,7 +1246,8 @@ static int handlechd(const char *isofile) {
 
 fail_io:
 	if (chd_img != NULL) {
-		free(chd_img->buffer);
+		if (chd_img->chd != NULL)
+			chd_close(chd_img->chd);
 		free(chd_img);
 		chd_img = NULL;
 	}
@@ -1216,19 +1307,29 @@ static void readThreadStart() {}
 #else
 static pthread_t read_thread_id;
 
+// the emu thread is the only producer of requests and the only consumer
+// of sectors, the read thread is the reverse, so all exchange is done with
+// acquire/release indices. Locks are only taken when one side has to sleep.
 static pthread_cond_t read_thread_msg_avail;
-static pthread_cond_t read_thread_msg_done;
 static pthread_mutex_t read_thread_msg_lock;
+static int read_thread_idle;
+static pthread_cond_t read_req_space_cond; // also under read_thread_msg_lock
+static int read_req_waiting;
 
 static pthread_cond_t sectorbuffer_cond;
 static pthread_mutex_t sectorbuffer_lock;
+static int sectorbuffer_waiting;
 
 static boolean read_thread_running = FALSE;
-static int read_thread_sector_start = -1;
-static int read_thread_sector_end = -1;
+
+#define READ_REQ_QUEUE_SIZE 256 // must be power of 2
+
+static int read_req_queue[READ_REQ_QUEUE_SIZE];
+static unsigned int read_req_head; // written by emu thread
+static unsigned int read_req_tail; // written by read thread
 
 typedef struct {
-  int sector;
+  int sector; // stored last, once ret and data are valid
   long ret;
   unsigned char data[CD_FRAMESIZE_RAW];
 } SectorBufferEntry;
@@ -1236,7 +1337,9 @@ typedef struct {
 #define SECTOR_BUFFER_SIZE 4096
 
 static SectorBufferEntry *sectorbuffer;
-static size_t sectorbuffer_index;
+static int sectorbuffer_index; // -1 if last read didn't go through the thread
+static int read_thread_ra_unit; // sectors per hunk/block
+static int read_thread_last_request;
 
 int (*sync_cdimg_read_func)(FILE *f, unsigned int base, void *dest, int sector);
 unsigned char *(*sync_CDR_getBuffer)(void);
@@ -1244,113 +1347,149 @@ unsigned char *(*sync_CDR_getBuffer)(void);
 static unsigned char * CALLBACK ISOgetBuffer_async(void);
 static int cdread_async(FILE *f, unsigned int base, void *dest, int sector);
 
+static void sectorbuffer_publish(int index, int sector, long ret) {
+  sectorbuffer[index].ret = ret;
+  // seq_cst pairs with the waiter's store of sectorbuffer_waiting: each side
+  // stores then loads the other's flag, so one of them must see the other
+  __atomic_store_n(&sectorbuffer[index].sector, sector, __ATOMIC_SEQ_CST);
+
+  // only bother the emu thread if it ran out of data
+  if (__atomic_load_n(&sectorbuffer_waiting, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&sectorbuffer_lock);
+    pthread_cond_signal(&sectorbuffer_cond);
+    pthread_mutex_unlock(&sectorbuffer_lock);
+  }
+}
+
 static void *readThreadMain(void *param) {
   int max_sector = -1;
-  int requested_sector_start = -1;
-  int requested_sector_end = -1;
+  int requested_sector = -1;
   int last_read_sector = -1;
+  unsigned int tail = 0;
   int index = 0;
 
   int ra_sector = -1;
   int max_ra = 128;
-  int initial_ra = 1;
+  int ra_unit = read_thread_ra_unit;
   int speedmult_ra = 4;
+  int seq_run = 0;
+  int want_ra, target;
 
   int ra_count = 0;
   int how_far_ahead = 0;
 
-  unsigned char tmpdata[CD_FRAMESIZE_RAW];
   long ret;
 
+  // keep readahead in whole hunks/blocks, anything else is decompressed
+  // again or thrown away
+  max_ra = (max_ra + ra_unit - 1) / ra_unit * ra_unit;
+
   max_sector = msf2sec(ti[numtracks].start) + msf2sec(ti[numtracks].length);
+  if (max_sector <= 0) // no toc (plain .bin/.cbn), let the read func decide
+    max_sector = 0x7fffffff;
 
   while(1) {
-    pthread_mutex_lock(&read_thread_msg_lock);
-
     // If we don't have readahead and we don't have a sector request, wait for one.
     // If we still have readahead to go, don't block, just keep going.
-    // And if we ever have a sector request pending, acknowledge and reset it.
-
-    if (!ra_count) {
-      if (read_thread_sector_start == -1 && read_thread_running) {
+    if (!ra_count && tail == __atomic_load_n(&read_req_head, __ATOMIC_ACQUIRE)) {
+      pthread_mutex_lock(&read_thread_msg_lock);
+      __atomic_store_n(&read_thread_idle, 1, __ATOMIC_SEQ_CST);
+      if (tail == __atomic_load_n(&read_req_head, __ATOMIC_SEQ_CST)
+          && read_thread_running)
         pthread_cond_wait(&read_thread_msg_avail, &read_thread_msg_lock);
-      }
+      __atomic_store_n(&read_thread_idle, 0, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&read_thread_msg_lock);
     }
 
-    if (read_thread_sector_start != -1) {
-      requested_sector_start = read_thread_sector_start;
-      requested_sector_end = read_thread_sector_end;
-      read_thread_sector_start = -1;
-      read_thread_sector_end = -1;
-      pthread_cond_signal(&read_thread_msg_done);
-    }
+    if (!__atomic_load_n(&read_thread_running, __ATOMIC_ACQUIRE))
+      break;
 
-    pthread_mutex_unlock(&read_thread_msg_lock);
+    while (tail != __atomic_load_n(&read_req_head, __ATOMIC_ACQUIRE)) {
+      requested_sector = read_req_queue[tail % READ_REQ_QUEUE_SIZE];
+      __atomic_store_n(&read_req_tail, ++tail, __ATOMIC_SEQ_CST);
 
-    if (!read_thread_running)
-      break;
+      // the emu thread filled the queue and waits for room
+      if (__atomic_load_n(&read_req_waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&read_thread_msg_lock);
+        pthread_cond_signal(&read_req_space_cond);
+        pthread_mutex_unlock(&read_thread_msg_lock);
+      }
 
-    // Readahead code, based on the implementation in mednafen psx's cdromif.cpp
-    if (requested_sector_start != -1) {
-      if (last_read_sector != -1 && last_read_sector == (requested_sector_start - 1)) {
-        how_far_ahead = ra_sector - requested_sector_end;
-
-        if(how_far_ahead <= max_ra)
-          ra_count = (max_ra - how_far_ahead + 1 ? max_ra - how_far_ahead + 1 : speedmult_ra);
-        else
-          ra_count++;
-      } else if (requested_sector_end != last_read_sector) {
-        ra_sector = requested_sector_end;
-        ra_count = initial_ra;
+      // Readahead window grows with the length of the current sequential
+      // run (streaming) and is dropped on seeks, always ending on a hunk
+      // boundary.
+      if (last_read_sector != -1 && last_read_sector == (requested_sector - 1)) {
+        if (seq_run < max_ra)
+          seq_run++;
+        want_ra = ra_unit + seq_run * speedmult_ra;
+        if (want_ra > max_ra)
+          want_ra = max_ra;
+
+        how_far_ahead = ra_sector - requested_sector;
+        if (how_far_ahead < 0) {
+          // reader fell behind, don't bother with what was already consumed
+          ra_sector = requested_sector;
+          how_far_ahead = 0;
+        }
+        if (how_far_ahead < want_ra) {
+          target = (requested_sector + want_ra + ra_unit - 1) / ra_unit * ra_unit;
+          if (target - ra_sector > ra_count)
+            ra_count = target - ra_sector;
+        }
+      } else if (requested_sector != last_read_sector) {
+        // seek, cancel whatever was still queued
+        seq_run = 0;
+        ra_sector = requested_sector;
+        ra_count = (requested_sector / ra_unit + 1) * ra_unit - requested_sector;
       }
 
-      last_read_sector = requested_sector_end;
+      last_read_sector = requested_sector;
     }
 
+    if (!ra_count)
+      continue;
+
     index = ra_sector % SECTOR_BUFFER_SIZE;
 
     // check for end of CD
-    if (ra_count && ra_sector >= max_sector) {
+    if (ra_sector >= max_sector) {
       ra_count = 0;
-      pthread_mutex_lock(&sectorbuffer_lock);
-      sectorbuffer[index].ret = -1;
-      sectorbuffer[index].sector = ra_sector;
-      pthread_cond_signal(&sectorbuffer_cond);
-      pthread_mutex_unlock(&sectorbuffer_lock);
+      __atomic_store_n(&sectorbuffer[index].sector, -1, __ATOMIC_RELEASE);
+      sectorbuffer_publish(index, ra_sector, -1);
+      continue;
     }
 
-    if (ra_count) {
-      pthread_mutex_lock(&sectorbuffer_lock);
-      if (sectorbuffer[index].sector != ra_sector) {
-        pthread_mutex_unlock(&sectorbuffer_lock);
-
-        ret = sync_cdimg_read_func(cdHandle, 0, tmpdata, ra_sector);
-
-        pthread_mutex_lock(&sectorbuffer_lock);
-        sectorbuffer[index].ret = ret;
-        sectorbuffer[index].sector = ra_sector;
-        memcpy(sectorbuffer[index].data, tmpdata, CD_FRAMESIZE_RAW);
-      }
-      pthread_cond_signal(&sectorbuffer_cond);
-      pthread_mutex_unlock(&sectorbuffer_lock);
-
-      ra_sector++;
-      ra_count--;
+    if (__atomic_load_n(&sectorbuffer[index].sector, __ATOMIC_RELAXED) != ra_sector) {
+      // retire the old slot contents first, then read straight into it
+      __atomic_store_n(&sectorbuffer[index].sector, -1, __ATOMIC_RELEASE);
+      ret = sync_cdimg_read_func(cdHandle, 0, sectorbuffer[index].data, ra_sector);
+      sectorbuffer_publish(index, ra_sector, ret);
     }
+
+    ra_sector++;
+    ra_count--;
   }
 
   return NULL;
 }
 
 static void readThreadStop() {
+  // not started, or already stopped
+  if (cdimg_read_func != cdread_async)
+    return;
+
   if (read_thread_running == TRUE) {
-    read_thread_running = FALSE;
+    SysPrintf("async CD: %u hits, %u misses, %u stalls\n",
+      cdr_stats.ra_hits, cdr_stats.ra_misses, cdr_stats.ra_stalls);
+    pthread_mutex_lock(&read_thread_msg_lock);
+    __atomic_store_n(&read_thread_running, FALSE, __ATOMIC_RELEASE);
     pthread_cond_signal(&read_thread_msg_avail);
+    pthread_mutex_unlock(&read_thread_msg_lock);
     pthread_join(read_thread_id, NULL);
   }
 
-  pthread_cond_destroy(&read_thread_msg_done);
   pthread_cond_destroy(&read_thread_msg_avail);
+  pthread_cond_destroy(&read_req_space_cond);
   pthread_mutex_destroy(&read_thread_msg_lock);
 
   pthread_cond_destroy(&sectorbuffer_cond);
@@ -1364,29 +1503,43 @@ static void readThreadStop() {
 }
 
 static void readThreadStart() {
+  int i;
+
   SysPrintf("Starting async CD thread\n");
 
   if (read_thread_running == TRUE)
     return;
 
   read_thread_running = TRUE;
-  read_thread_sector_start = -1;
-  read_thread_sector_end = -1;
-  sectorbuffer_index = 0;
-
-  sectorbuffer = calloc(SECTOR_BUFFER_SIZE, sizeof(SectorBufferEntry));
-  if(!sectorbuffer)
-    goto error;
-
-  sectorbuffer[0].sector = -1; // Otherwise we might think we've already fetched sector 0!
+  read_thread_idle = 0;
+  read_req_waiting = 0;
+  read_thread_last_request = -1;
+  read_thread_ra_unit = 1;
+  if (compr_img != NULL)
+    read_thread_ra_unit = 1 << compr_img->block_shift;
+#ifdef HAVE_CHD
+  else if (chd_img != NULL)
+    read_thread_ra_unit = chd_img->sectors_per_hunk;
+#endif
+  read_req_head = read_req_tail = 0;
+  sectorbuffer_waiting = 0;
+  sectorbuffer_index = -1;
 
   sync_CDR_getBuffer = CDR_getBuffer;
   CDR_getBuffer = ISOgetBuffer_async;
   sync_cdimg_read_func = cdimg_read_func;
   cdimg_read_func = cdread_async;
 
+  sectorbuffer = malloc(SECTOR_BUFFER_SIZE * sizeof(SectorBufferEntry));
+  if(!sectorbuffer)
+    goto error;
+
+  // Otherwise we might think we've already fetched sector 0!
+  for (i = 0; i < SECTOR_BUFFER_SIZE; i++)
+    sectorbuffer[i].sector = -1;
+
   if (pthread_cond_init(&read_thread_msg_avail, NULL) ||
-      pthread_cond_init(&read_thread_msg_done, NULL) ||
+      pthread_cond_init(&read_req_space_cond, NULL) ||
       pthread_mutex_init(&read_thread_msg_lock, NULL) ||
       pthread_cond_init(&sectorbuffer_cond, NULL) ||
       pthread_mutex_init(&sectorbuffer_lock, NULL) ||
@@ -1399,6 +1552,7 @@ static void readThreadStart() {
   SysPrintf("Error starting async CD thread\n");
   SysPrintf("Falling back to sync\n");
 
+  read_thread_running = FALSE;
   readThreadStop();
 }
 #endif
@@ -1430,63 +1584,335 @@ done:
 	return ret;
 }
 
-static int uncompress2_pcsx(void *out, unsigned long *out_size, void *in, unsigned long in_size)
+static unsigned int get_usec(void)
+{
+#ifdef _WIN32
+	return GetTickCount() * 1000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static void ucache_lock(void) {
+#ifndef _WIN32
+	pthread_mutex_lock(&ucache.lock);
+#endif
+}
+
+static void ucache_unlock(void) {
+#ifndef _WIN32
+	pthread_mutex_unlock(&ucache.lock);
+#endif
+}
+
+static struct unpack_entry *ucache_find(int unit) {
+	unsigned int i;
+
+	for (i = 0; i < ucache.len; i++)
+		if (ucache.entries[i].unit == unit)
+			return &ucache.entries[i];
+	return NULL;
+}
+
+// find an entry to (re)use, called with the cache locked
+static struct unpack_entry *ucache_evict(void) {
+	struct unpack_entry *e, *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < ucache.len; i++) {
+		e = &ucache.entries[i];
+		if (i == ucache.current || e->state == UNPACK_BUSY)
+			continue;
+		if (e->unit == -1)
+			return e;
+		// dropping a prefetch that wasn't started is cheaper than
+		// dropping something already decompressed
+		if (best == NULL || (e->state == UNPACK_QUEUED && best->state != UNPACK_QUEUED)
+		    || (e->state == best->state && e->last_used < best->last_used))
+			best = e;
+	}
+	return best;
+}
+
+#ifndef _WIN32
+static void *ucache_worker_main(void *param) {
+	void *ctx = param;
+	struct unpack_entry *e;
+	unsigned int i, t;
+	int ret;
+
+	pthread_mutex_lock(&ucache.lock);
+	while (1) {
+		e = NULL;
+		while (ucache.running) {
+			// the nearest queued unit is the one needed first
+			for (i = 0; i < ucache.len; i++) {
+				if (ucache.entries[i].state != UNPACK_QUEUED)
+					continue;
+				if (e == NULL || ucache.entries[i].unit < e->unit)
+					e = &ucache.entries[i];
+			}
+			if (e != NULL)
+				break;
+			pthread_cond_wait(&ucache.work_cond, &ucache.lock);
+		}
+		if (!ucache.running)
+			break;
+
+		e->state = UNPACK_BUSY;
+		pthread_mutex_unlock(&ucache.lock);
+
+		t = get_usec();
+		ret = ucache.unpack(ctx, e->unit, e->data);
+		t = get_usec() - t;
+
+		pthread_mutex_lock(&ucache.lock);
+		cdr_stats.unpack_count++;
+		cdr_stats.unpack_us += t;
+		if (ret != 0)
+			e->unit = -1;
+		e->state = UNPACK_READY;
+		e->last_used = ++ucache.use_counter;
+		pthread_cond_broadcast(&ucache.done_cond);
+	}
+	pthread_mutex_unlock(&ucache.lock);
+
+	return NULL;
+}
+#endif
+
+static int ucache_init(unsigned int unit_bytes, int units, int nthreads) {
+	unsigned int i, len;
+
+#ifdef _WIN32
+	nthreads = 0;
+#endif
+	if (ucache.ctx_open == NULL || nthreads < 0)
+		nthreads = 0;
+	if (nthreads > UNPACK_MAX_THREADS)
+		nthreads = UNPACK_MAX_THREADS;
+
+	len = Config.CompressedCacheSize / unit_bytes;
+	// room for the current unit, one being read for cdda,
+	// and a couple queued per worker
+	if (len < 3 + nthreads * 2)
+		len = 3 + nthreads * 2;
+
+	ucache.entries = calloc(len, sizeof(ucache.entries[0]));
+	ucache.mem = malloc((size_t)len * unit_bytes);
+	if (ucache.entries == NULL || ucache.mem == NULL) {
+		free(ucache.entries);
+		free(ucache.mem);
+		ucache.entries = NULL;
+		ucache.mem = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < len; i++) {
+		ucache.entries[i].unit = -1;
+		ucache.entries[i].data = ucache.mem + (size_t)i * unit_bytes;
+	}
+	ucache.len = len;
+	ucache.unit_bytes = unit_bytes;
+	ucache.units = units;
+	ucache.current = -1;
+	ucache.use_counter = 0;
+	ucache.nthreads = 0;
+
+#ifndef _WIN32
+	pthread_mutex_init(&ucache.lock, NULL);
+	pthread_mutex_init(&ucache.ctx_lock, NULL);
+	pthread_cond_init(&ucache.work_cond, NULL);
+	pthread_cond_init(&ucache.done_cond, NULL);
+
+	ucache.running = TRUE;
+	for (i = 0; i < nthreads; i++) {
+		void *ctx = ucache.ctx_open();
+		if (ctx == NULL)
+			break;
+		if (pthread_create(&ucache.workers[i].thread, NULL, ucache_worker_main, ctx)) {
+			ucache.ctx_close(ctx);
+			break;
+		}
+		ucache.workers[i].ctx = ctx;
+	}
+	ucache.nthreads = i;
+#endif
+	SysPrintf("cache of %u decompressed units, %d threads\n",
+		len, ucache.nthreads);
+
+	return 0;
+}
+
+static void ucache_free(void) {
+	int i;
+
+	if (ucache.entries == NULL)
+		return;
+
+#ifndef _WIN32
+	pthread_mutex_lock(&ucache.lock);
+	ucache.running = FALSE;
+	pthread_cond_broadcast(&ucache.work_cond);
+	pthread_mutex_unlock(&ucache.lock);
+
+	for (i = 0; i < ucache.nthreads; i++) {
+		pthread_join(ucache.workers[i].thread, NULL);
+		ucache.ctx_close(ucache.workers[i].ctx);
+		ucache.workers[i].ctx = NULL;
+	}
+	pthread_cond_destroy(&ucache.done_cond);
+	pthread_cond_destroy(&ucache.work_cond);
+	pthread_mutex_destroy(&ucache.ctx_lock);
+	pthread_mutex_destroy(&ucache.lock);
+#endif
+	if (cdr_stats.unpack_count)
+		SysPrintf("cache: %u hits, %u misses, %u units unpacked, %u us avg\n",
+			cdr_stats.cache_hits, cdr_stats.cache_misses, cdr_stats.unpack_count,
+			(unsigned int)(cdr_stats.unpack_us / cdr_stats.unpack_count));
+
+	ucache.ctx_close(ucache.ctx);
+	ucache.ctx = NULL;
+	free(ucache.mem);
+	free(ucache.entries);
+	ucache.mem = NULL;
+	ucache.entries = NULL;
+	ucache.len = 0;
+	ucache.nthreads = 0;
+}
+
+// queue the units after 'unit' for the workers, called with the cache locked
+static void ucache_prefetch(int unit) {
+#ifndef _WIN32
+	int i, count = ucache.nthreads * 2;
+	struct unpack_entry *e;
+
+	for (i = 1; i <= count && unit + i < ucache.units; i++) {
+		if (ucache_find(unit + i) != NULL)
+			continue;
+		e = ucache_evict();
+		if (e == NULL)
+			break;
+		e->unit = unit + i;
+		e->state = UNPACK_QUEUED;
+	}
+	pthread_cond_broadcast(&ucache.work_cond);
+#endif
+}
+
+// Copy 'len' bytes at 'offs' of a unit to dest. If dest is NULL, make
+// the unit current (safe from eviction) and return it instead.
+static unsigned char *ucache_read(int unit, void *dest, size_t offs, size_t len) {
+	struct unpack_entry *e;
+	unsigned int t;
+	int ret;
+
+	ucache_lock();
+	while ((e = ucache_find(unit)) != NULL && e->state == UNPACK_BUSY) {
+#ifndef _WIN32
+		// a worker is on it already
+		pthread_cond_wait(&ucache.done_cond, &ucache.lock);
+#endif
+	}
+
+	if (e != NULL && e->state == UNPACK_READY) {
+		cdr_stats.cache_hits++;
+		goto found;
+	}
+
+	// not there, or queued but not started yet - do it here
+	cdr_stats.cache_misses++;
+	if (e == NULL) {
+		if (dest == NULL) // the current unit is being replaced
+			ucache.current = -1;
+		e = ucache_evict();
+		if (e == NULL) {
+			ucache_unlock();
+			return NULL;
+		}
+		e->unit = unit;
+	}
+	e->state = UNPACK_BUSY;
+	ucache_unlock();
+
+#ifndef _WIN32
+	pthread_mutex_lock(&ucache.ctx_lock);
+#endif
+	t = get_usec();
+	ret = ucache.unpack(ucache.ctx, unit, e->data);
+	t = get_usec() - t;
+#ifndef _WIN32
+	pthread_mutex_unlock(&ucache.ctx_lock);
+#endif
+
+	ucache_lock();
+	cdr_stats.unpack_count++;
+	cdr_stats.unpack_us += t;
+	e->state = UNPACK_READY;
+#ifndef _WIN32
+	pthread_cond_broadcast(&ucache.done_cond);
+#endif
+	if (ret != 0) {
+		e->unit = -1;
+		ucache_unlock();
+		return NULL;
+	}
+
+found:
+	e->last_used = ++ucache.use_counter;
+	if (dest != NULL)
+		memcpy(dest, e->data + offs, len);
+	else
+		ucache.current = e - ucache.entries;
+	if (ucache.nthreads)
+		ucache_prefetch(unit);
+	ucache_unlock();
+
+	return e->data;
+}
+
+static int uncompress2_pcsx(z_stream *z, void *out, unsigned long *out_size, void *in, unsigned long in_size)
 {
-	static z_stream z;
 	int ret = 0;
 
-	if (z.zalloc == NULL) {
-		// XXX: one-time leak here..
-		z.next_in = Z_NULL;
-		z.avail_in = 0;
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		ret = inflateInit2(&z, -15);
+	if (z->zalloc == NULL) {
+		z->next_in = Z_NULL;
+		z->avail_in = 0;
+		z->zalloc = Z_NULL;
+		z->zfree = Z_NULL;
+		z->opaque = Z_NULL;
+		ret = inflateInit2(z, -15);
 	}
 	else
-		ret = inflateReset(&z);
+		ret = inflateReset(z);
 	if (ret != Z_OK)
 		return ret;
 
-	z.next_in = in;
-	z.avail_in = in_size;
-	z.next_out = out;
-	z.avail_out = *out_size;
+	z->next_in = in;
+	z->avail_in = in_size;
+	z->next_out = out;
+	z->avail_out = *out_size;
 
-	ret = inflate(&z, Z_NO_FLUSH);
-	//inflateEnd(&z);
+	ret = inflate(z, Z_NO_FLUSH);
+	//inflateEnd(z);
 
-	*out_size -= z.avail_out;
+	*out_size -= z->avail_out;
 	return ret == 1 ? 0 : ret;
 }
 
-static int cdread_compressed(FILE *f, unsigned int base, void *dest, int sector)
+static int compr_unpack(void *ctx_, int block, unsigned char *dest)
 {
+	struct compr_ctx *ctx = ctx_;
 	unsigned long cdbuffer_size, cdbuffer_size_expect;
 	unsigned int size;
 	int is_compressed;
 	off_t start_byte;
-	int ret, block;
-
-	if (base)
-		sector += base / 2352;
-
-	block = sector >> compr_img->block_shift;
-	compr_img->sector_in_blk = sector & ((1 << compr_img->block_shift) - 1);
-
-	if (block == compr_img->current_block) {
-		//printf("hit sect %d\n", sector);
-		goto finish;
-	}
-
-	if (sector >= compr_img->index_len * 16) {
-		SysPrintf("sector %d is past img end\n", sector);
-		return -1;
-	}
+	int ret;
 
 	start_byte = compr_img->index_table[block] & ~OFF_T_MSB;
-	if (fseeko(cdHandle, start_byte, SEEK_SET) != 0) {
+	if (fseeko(ctx->f, start_byte, SEEK_SET) != 0) {
 		SysPrintf("seek error for block %d at %llx: ",
 			block, (long long)start_byte);
 		perror(NULL);
@@ -1495,62 +1921,196 @@ static int cdread_compressed(FILE *f, unsigned int base, void *dest, int sector)
 
 	is_compressed = !(compr_img->index_table[block] & OFF_T_MSB);
 	size = (compr_img->index_table[block + 1] & ~OFF_T_MSB) - start_byte;
-	if (size > sizeof(compr_img->buff_compressed)) {
+	if (size > sizeof(ctx->buff_compressed)) {
 		SysPrintf("block %d is too large: %u\n", block, size);
 		return -1;
 	}
 
-	if (fread(is_compressed ? compr_img->buff_compressed : compr_img->buff_raw[0],
-				1, size, cdHandle) != size) {
+	if (fread(is_compressed ? ctx->buff_compressed : dest,
+				1, size, ctx->f) != size) {
 		SysPrintf("read error for block %d at %x: ", block, start_byte);
 		perror(NULL);
 		return -1;
 	}
 
 	if (is_compressed) {
-		cdbuffer_size_expect = sizeof(compr_img->buff_raw[0]) << compr_img->block_shift;
+		cdbuffer_size_expect = CD_FRAMESIZE_RAW << compr_img->block_shift;
 		cdbuffer_size = cdbuffer_size_expect;
-		ret = uncompress2_pcsx(compr_img->buff_raw[0], &cdbuffer_size, compr_img->buff_compressed, size);
+		ret = uncompress2_pcsx(&ctx->z, dest, &cdbuffer_size, ctx->buff_compressed, size);
 		if (ret != 0) {
-			SysPrintf("uncompress failed with %d for block %d, sector %d\n",
-					ret, block, sector);
+			SysPrintf("uncompress failed with %d for block %d\n",
+					ret, block);
 			return -1;
 		}
 		if (cdbuffer_size != cdbuffer_size_expect)
-			SysPrintf("cdbuffer_size: %lu != %lu, sector %d\n", cdbuffer_size,
-					cdbuffer_size_expect, sector);
+			SysPrintf("cdbuffer_size: %lu != %lu, block %d\n", cdbuffer_size,
+					cdbuffer_size_expect, block);
+	}
+
+	return 0;
+}
+
+static void *compr_ctx_open(void)
+{
+	struct compr_ctx *ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->f = fopen(GetIsoFile(), "rb");
+	if (ctx->f == NULL) {
+		free(ctx);
+		return NULL;
 	}
+	return ctx;
+}
 
-	// done at last!
-	compr_img->current_block = block;
+static void compr_ctx_close(void *ctx_)
+{
+	struct compr_ctx *ctx = ctx_;
+
+	if (ctx->z.zalloc != NULL)
+		inflateEnd(&ctx->z);
+	if (ctx->f != cdHandle)
+		fclose(ctx->f);
+	free(ctx);
+}
+
+static int compr_cache_init(void)
+{
+	struct compr_ctx *ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return -1;
+
+	ctx->f = cdHandle;
+	ucache.ctx = ctx;
+	ucache.unpack = compr_unpack;
+	ucache.ctx_open = compr_ctx_open;
+	ucache.ctx_close = compr_ctx_close;
+
+	if (ucache_init(CD_FRAMESIZE_RAW << compr_img->block_shift,
+			compr_img->index_len, Config.CompressedThreads) != 0)
+		return -1;
+
+	// something to point at until the first read
+	compr_img->buff_raw = (void *)ucache.entries[0].data;
+	return 0;
+}
+
+static int cdread_compressed(FILE *f, unsigned int base, void *dest, int sector)
+{
+	unsigned char *data;
+	int block;
+
+	if (base)
+		sector += base / 2352;
+
+	block = sector >> compr_img->block_shift;
+	compr_img->sector_in_blk = sector & ((1 << compr_img->block_shift) - 1);
+
+	if (sector < 0 || sector >= compr_img->index_len << compr_img->block_shift) {
+		SysPrintf("sector %d is past img end\n", sector);
+		return -1;
+	}
+
+	if (dest != cdbuffer) { // copy avoid HACK
+		data = ucache_read(block, dest,
+			compr_img->sector_in_blk * CD_FRAMESIZE_RAW, CD_FRAMESIZE_RAW);
+		return data != NULL ? CD_FRAMESIZE_RAW : -1;
+	}
+
+	if (block != compr_img->current_block) {
+		data = ucache_read(block, NULL, 0, 0);
+		if (data == NULL) {
+			compr_img->current_block = (unsigned int)-1;
+			return -1;
+		}
+		compr_img->buff_raw = (void *)data;
+		compr_img->current_block = block;
+	}
 
-finish:
-	if (dest != cdbuffer) // copy avoid HACK
-		memcpy(dest, compr_img->buff_raw[compr_img->sector_in_blk],
-			CD_FRAMESIZE_RAW);
 	return CD_FRAMESIZE_RAW;
 }
 
 #ifdef HAVE_CHD
+static int chd_unpack(void *ctx, int hunk, unsigned char *dest)
+{
+	chd_error err = chd_read(ctx, hunk, dest);
+	if (err != CHDERR_NONE) {
+		SysPrintf("chd_read hunk %d: %s\n", hunk, chd_error_string(err));
+		return -1;
+	}
+	return 0;
+}
+
+// libchdr keeps codec state per file, so each worker opens its own
+static void *chd_ctx_open(void)
+{
+	chd_file *chd = NULL;
+
+	if (chd_open(GetIsoFile(), CHD_OPEN_READ, NULL, &chd) != CHDERR_NONE)
+		return NULL;
+	return chd;
+}
+
+static void chd_ctx_close(void *ctx)
+{
+	if (ctx != chd_img->chd)
+		chd_close(ctx);
+}
+
+static int chd_cache_init(void)
+{
+	int nthreads = Config.CompressedThreads;
+
+	// precache keeps the whole compressed file in memory per handle,
+	// don't multiply that by the worker count
+	if (Config.CHD_Precache)
+		nthreads = 0;
+
+	ucache.ctx = chd_img->chd;
+	ucache.unpack = chd_unpack;
+	ucache.ctx_open = chd_ctx_open;
+	ucache.ctx_close = chd_ctx_close;
+
+	if (ucache_init(chd_img->header->hunkbytes,
+			chd_img->header->totalhunks, nthreads) != 0)
+		return -1;
+
+	chd_img->buffer = (void *)ucache.entries[0].data;
+	return 0;
+}
+
 static int cdread_chd(FILE *f, unsigned int base, void *dest, int sector)
 {
+	unsigned char *data;
 	int hunk;
 
 	if (base)
 		sector += base;
 
+	if (sector < 0 || sector / chd_img->sectors_per_hunk >= chd_img->header->totalhunks)
+		return -1;
+
 	hunk = sector / chd_img->sectors_per_hunk;
 	chd_img->sector_in_hunk = sector % chd_img->sectors_per_hunk;
 
+	if (dest != cdbuffer) { // copy avoid HACK
+		data = ucache_read(hunk, dest, chd_img->sector_in_hunk
+			* (CD_FRAMESIZE_RAW + SUB_FRAMESIZE), CD_FRAMESIZE_RAW);
+		return data != NULL ? CD_FRAMESIZE_RAW : -1;
+	}
+
 	if (hunk != chd_img->current_hunk)
 	{
-		chd_read(chd_img->chd, hunk, chd_img->buffer);
+		data = ucache_read(hunk, NULL, 0, 0);
+		if (data == NULL) {
+			chd_img->current_hunk = (unsigned int)-1;
+			return -1;
+		}
+		chd_img->buffer = (void *)data;
 		chd_img->current_hunk = hunk;
 	}
 
-	if (dest != cdbuffer) // copy avoid HACK
-		memcpy(dest, chd_img->buffer[chd_img->sector_in_hunk],
-			CD_FRAMESIZE_RAW);
 	return CD_FRAMESIZE_RAW;
 }
 #endif
@@ -1569,11 +2129,52 @@ static int cdread_2048(FILE *f, unsigned int base, void *dest, int sector)
 	return ret;
 }
 
+#ifdef HAVE_CDIMG_MMAP
+static int cdread_mmap(FILE *f, unsigned int base, void *dest, int sector)
+{
+	size_t offs = (size_t)base + (size_t)sector * CD_FRAMESIZE_RAW;
+
+	// other handles (separate cdda files) and reads past the end go through stdio
+	if (f != cdHandle || sector < 0 || offs + CD_FRAMESIZE_RAW > cdimg_map.size) {
+		if (dest == cdbuffer)
+			cdimg_map.sector = cdbuffer;
+		return cdread_normal(f, base, dest, sector);
+	}
+
+	if (dest == cdbuffer) // copy avoid HACK
+		cdimg_map.sector = cdimg_map.base + offs;
+	else
+		memcpy(dest, cdimg_map.base + offs, CD_FRAMESIZE_RAW);
+	return CD_FRAMESIZE_RAW;
+}
+
+static int cdread_sub_mixed_mmap(FILE *f, unsigned int base, void *dest, int sector)
+{
+	size_t offs = (size_t)base + (size_t)sector * (CD_FRAMESIZE_RAW + SUB_FRAMESIZE);
+
+	if (f != cdHandle || sector < 0
+	    || offs + CD_FRAMESIZE_RAW + SUB_FRAMESIZE > cdimg_map.size) {
+		if (dest == cdbuffer)
+			cdimg_map.sector = cdbuffer;
+		return cdread_sub_mixed(f, base, dest, sector);
+	}
+
+	if (dest == cdbuffer)
+		cdimg_map.sector = cdimg_map.base + offs;
+	else
+		memcpy(dest, cdimg_map.base + offs, CD_FRAMESIZE_RAW);
+	memcpy(subbuffer, cdimg_map.base + offs + CD_FRAMESIZE_RAW, SUB_FRAMESIZE);
+
+	if (subChanRaw) DecodeRawSubData();
+	return CD_FRAMESIZE_RAW;
+}
+#endif
+
 #ifndef _WIN32
 
 static int cdread_async(FILE *f, unsigned int base, void *dest, int sector) {
-  boolean found = FALSE;
   int i = sector % SECTOR_BUFFER_SIZE;
+  unsigned int head;
   long ret;
 
   if (f != cdHandle || base != 0 || dest != cdbuffer) {
@@ -1582,35 +2183,50 @@ static int cdread_async(FILE *f, unsigned int base, void *dest, int sector) {
     return sync_cdimg_read_func(f, base, dest, sector);
   }
 
-  pthread_mutex_lock(&read_thread_msg_lock);
-
-  // Only wait if we're not trying to read the next sector and
-  // sector_start is set (meaning the last request hasn't been
-  // processed yet)
-  while(read_thread_sector_start != -1 && read_thread_sector_end + 1 != sector) {
-    pthread_cond_wait(&read_thread_msg_done, &read_thread_msg_lock);
+  if (sector < 0) {
+    // may happen when a savestate is loaded before anything was read
+    sectorbuffer_index = -1;
+    return -1;
   }
 
-  if (read_thread_sector_start == -1)
-    read_thread_sector_start = sector;
+  head = read_req_head;
+  if (head - __atomic_load_n(&read_req_tail, __ATOMIC_ACQUIRE) >= READ_REQ_QUEUE_SIZE) {
+    // queue full, sleep until the read thread takes something off it
+    pthread_mutex_lock(&read_thread_msg_lock);
+    __atomic_store_n(&read_req_waiting, 1, __ATOMIC_SEQ_CST);
+    while (head - __atomic_load_n(&read_req_tail, __ATOMIC_SEQ_CST) >= READ_REQ_QUEUE_SIZE)
+      pthread_cond_wait(&read_req_space_cond, &read_thread_msg_lock);
+    __atomic_store_n(&read_req_waiting, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&read_thread_msg_lock);
+  }
+  read_req_queue[head % READ_REQ_QUEUE_SIZE] = sector;
+  __atomic_store_n(&read_req_head, head + 1, __ATOMIC_SEQ_CST);
 
-  read_thread_sector_end = sector;
-  pthread_cond_signal(&read_thread_msg_avail);
-  pthread_mutex_unlock(&read_thread_msg_lock);
+  if (__atomic_load_n(&read_thread_idle, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&read_thread_msg_lock);
+    pthread_cond_signal(&read_thread_msg_avail);
+    pthread_mutex_unlock(&read_thread_msg_lock);
+  }
 
-  do {
+  if (__atomic_load_n(&sectorbuffer[i].sector, __ATOMIC_ACQUIRE) == sector)
+    cdr_stats.ra_hits++;
+  else {
+    // not prefetched yet, sleep until the read thread gets to it
+    if (sector == read_thread_last_request + 1)
+      cdr_stats.ra_stalls++;
+    else
+      cdr_stats.ra_misses++;
     pthread_mutex_lock(&sectorbuffer_lock);
-    if (sectorbuffer[i].sector == sector) {
-      sectorbuffer_index = i;
-      ret = sectorbuffer[i].ret;
-      found = TRUE;
-    }
-
-    if (!found) {
+    __atomic_store_n(&sectorbuffer_waiting, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&sectorbuffer[i].sector, __ATOMIC_SEQ_CST) != sector)
       pthread_cond_wait(&sectorbuffer_cond, &sectorbuffer_lock);
-    }
+    __atomic_store_n(&sectorbuffer_waiting, 0, __ATOMIC_RELAXED);
     pthread_mutex_unlock(&sectorbuffer_lock);
-  } while (!found);
+  }
+
+  read_thread_last_request = sector;
+  sectorbuffer_index = i;
+  ret = sectorbuffer[i].ret;
 
   return ret;
 }
@@ -1629,11 +2245,9 @@ static unsigned char * CALLBACK ISOgetBuffer_chd(void) {
 
 #ifndef _WIN32
 static unsigned char * CALLBACK ISOgetBuffer_async(void) {
-  unsigned char *buffer;
-  pthread_mutex_lock(&sectorbuffer_lock);
-  buffer = sectorbuffer[sectorbuffer_index].data;
-  pthread_mutex_unlock(&sectorbuffer_lock);
-  return buffer + 12;
+  if (sectorbuffer_index < 0)
+    return cdbuffer + 12;
+  return sectorbuffer[sectorbuffer_index].data + 12;
 }
 
 #endif
@@ -1642,6 +2256,277 @@ static unsigned char * CALLBACK ISOgetBuffer(void) {
 	return cdbuffer + 12;
 }
 
+#ifdef HAVE_CDIMG_MMAP
+static unsigned char * CALLBACK ISOgetBuffer_mmap(void) {
+	return cdimg_map.sector + 12;
+}
+
+// map the whole image so that sector reads need no syscalls or copies,
+// stdio remains in use if this fails (32bit address space, odd fs, etc)
+static void cdimg_map_open(void) {
+	struct stat st;
+	void *ptr;
+
+	if (fstat(fileno(cdHandle), &st) != 0 || st.st_size < CD_FRAMESIZE_RAW
+	    || (unsigned long long)st.st_size > (size_t)-1)
+		return;
+
+	// private+writable so that PPF patching of the returned buffer works
+	ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		fileno(cdHandle), 0);
+	if (ptr == MAP_FAILED) {
+		SysPrintf("cdimg mmap failed: %s, using stdio\n", strerror(errno));
+		return;
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+	cdimg_map.base = ptr;
+	cdimg_map.size = st.st_size;
+	cdimg_map.sector = cdbuffer;
+}
+
+static void cdimg_map_close(void) {
+	if (cdimg_map.base != NULL)
+		munmap(cdimg_map.base, cdimg_map.size);
+	cdimg_map.base = NULL;
+	cdimg_map.size = 0;
+	cdimg_map.sector = cdbuffer;
+}
+#endif
+
+#ifndef _WIN32
+static unsigned int get_usec(void);
+
+static int preload_chunk(int chunk) {
+	unsigned char *dest = preload.data + (size_t)chunk * preload.chunk * preload.stride;
+	size_t len = (size_t)preload.chunk * preload.stride;
+	size_t offs = (size_t)chunk * len;
+
+	if (preload.ctx != NULL)
+		return ucache.unpack(preload.ctx, chunk, dest);
+
+#ifdef HAVE_CDIMG_MMAP
+	// pread doesn't move the file position the emu thread is using
+	if (offs + len > preload.size)
+		len = preload.size - offs;
+	if (pread(fileno(cdHandle), dest, len, offs) != (ssize_t)len)
+		return -1;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static void *preloadThreadMain(void *param) {
+	int chunk = 0, left = preload.chunks, hint;
+
+	while (left > 0 && __atomic_load_n(&preload.running, __ATOMIC_ACQUIRE)) {
+		// go where the game is reading, then carry on from there
+		hint = __atomic_exchange_n(&preload.hint, -1, __ATOMIC_RELAXED);
+		if (hint >= 0)
+			chunk = hint;
+
+		while (preload.ready[chunk])
+			chunk = (chunk + 1) % preload.chunks;
+
+		if (preload_chunk(chunk) != 0) {
+			SysPrintf("preload: failed to read chunk %d, stopping\n", chunk);
+			break;
+		}
+		__atomic_store_n(&preload.ready[chunk], 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&preload.loaded, preload.chunks - --left, __ATOMIC_RELAXED);
+	}
+
+	if (left == 0)
+		SysPrintf("preload: %d sectors in memory after %u ms\n",
+			preload.sectors, (get_usec() - preload.start_time) / 1000);
+	return NULL;
+}
+
+static int cdread_preload(FILE *f, unsigned int base, void *dest, int sector)
+{
+	unsigned char *ptr;
+	int s, chunk, ret;
+
+	// separate cdda files are not preloaded
+	if (f != cdHandle && (multifile || f != ti[1].handle))
+		goto fallback;
+
+#ifdef HAVE_CHD
+	if (chd_img != NULL)
+		s = sector + base;
+	else
+#endif
+	if (compr_img != NULL)
+		s = sector + base / CD_FRAMESIZE_RAW;
+	else
+		s = sector + base / preload.stride;
+	if (s < 0 || s >= preload.sectors)
+		goto fallback;
+
+	chunk = s / preload.chunk;
+	if (!__atomic_load_n(&preload.ready[chunk], __ATOMIC_ACQUIRE)) {
+		cdr_stats.preload_misses++;
+		__atomic_store_n(&preload.hint, chunk, __ATOMIC_RELAXED);
+		goto fallback;
+	}
+	cdr_stats.preload_hits++;
+
+	ptr = preload.data + (size_t)s * preload.stride;
+	if (dest == cdbuffer) // copy avoid HACK
+		preload.sector = ptr;
+	else
+		memcpy(dest, ptr, CD_FRAMESIZE_RAW);
+	if (subChanMixed) {
+		memcpy(subbuffer, ptr + CD_FRAMESIZE_RAW, SUB_FRAMESIZE);
+		if (subChanRaw) DecodeRawSubData();
+	}
+	return CD_FRAMESIZE_RAW;
+
+fallback:
+	ret = preload.read_func(f, base, dest, sector);
+	if (dest == cdbuffer)
+		preload.sector = NULL;
+	return ret;
+}
+
+static unsigned char * CALLBACK ISOgetBuffer_preload(void) {
+	if (preload.sector == NULL)
+		return preload.get_buffer();
+	return preload.sector + 12;
+}
+
+static void *preload_alloc(size_t size) {
+	void *ptr;
+
+#if defined(HAVE_CDIMG_MMAP) && defined(MAP_ANONYMOUS)
+	// anonymous mapping so that it can use huge pages where available
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+		madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+		preload.mapped = TRUE;
+		return ptr;
+	}
+#endif
+	preload.mapped = FALSE;
+	return malloc(size);
+}
+
+static void preloadStop(void) {
+	if (preload.data == NULL)
+		return;
+
+	if (preload.running) {
+		__atomic_store_n(&preload.running, FALSE, __ATOMIC_RELEASE);
+		pthread_join(preload.thread, NULL);
+		SysPrintf("preload: %d/%d chunks loaded, %u hits, %u misses\n",
+			preload.loaded, preload.chunks,
+			cdr_stats.preload_hits, cdr_stats.preload_misses);
+	}
+	if (preload.ctx != NULL)
+		ucache.ctx_close(preload.ctx);
+	preload.ctx = NULL;
+
+	cdimg_read_func = preload.read_func;
+	CDR_getBuffer = preload.get_buffer;
+
+#ifdef HAVE_CDIMG_MMAP
+	if (preload.mapped)
+		munmap(preload.data, preload.size);
+	else
+#endif
+	free(preload.data);
+	free(preload.ready);
+	preload.data = NULL;
+	preload.ready = NULL;
+}
+
+static void preloadStart(void) {
+	memset(&preload, 0, sizeof(preload));
+	preload.hint = -1;
+
+	if (ucache.entries != NULL) {
+		// compressed, keep whole decompressed units
+		preload.chunk = 1;
+		if (compr_img != NULL)
+			preload.chunk = 1 << compr_img->block_shift;
+#ifdef HAVE_CHD
+		else if (chd_img != NULL)
+			preload.chunk = chd_img->sectors_per_hunk;
+#endif
+		preload.chunks = ucache.units;
+		preload.sectors = ucache.units * preload.chunk;
+		preload.size = (size_t)ucache.units * ucache.unit_bytes;
+		preload.stride = ucache.unit_bytes / preload.chunk;
+		preload.ctx = ucache.ctx_open();
+		if (preload.ctx == NULL)
+			goto fail;
+	}
+#ifdef HAVE_CDIMG_MMAP
+	else if (cdimg_read_func == cdread_normal || cdimg_read_func == cdread_sub_mixed) {
+		struct stat st;
+		off_t size;
+
+		if (fstat(fileno(cdHandle), &st) != 0)
+			goto fail;
+		size = st.st_size;
+		preload.stride = CD_FRAMESIZE_RAW + (subChanMixed ? SUB_FRAMESIZE : 0);
+		preload.chunk = 64;
+		preload.sectors = size / preload.stride;
+		preload.chunks = (preload.sectors + preload.chunk - 1) / preload.chunk;
+		preload.size = (size_t)preload.sectors * preload.stride;
+		if (preload.sectors <= 0 || (unsigned long long)size > (size_t)-1)
+			goto fail;
+	}
+#endif
+	else {
+		SysPrintf("preload: not supported for this image type\n");
+		return;
+	}
+
+	preload.ready = calloc(preload.chunks, 1);
+	preload.data = preload_alloc(preload.size);
+	if (preload.ready == NULL || preload.data == NULL) {
+		SysPrintf("preload: can't allocate %zu bytes\n", preload.size);
+		free(preload.ready);
+		free(preload.data);
+		preload.data = NULL;
+		goto fail;
+	}
+
+	preload.read_func = cdimg_read_func;
+	preload.get_buffer = CDR_getBuffer;
+	cdimg_read_func = cdread_preload;
+	CDR_getBuffer = ISOgetBuffer_preload;
+
+	preload.start_time = get_usec();
+	preload.running = TRUE;
+	if (pthread_create(&preload.thread, NULL, preloadThreadMain, NULL)) {
+		SysPrintf("preload: failed to start thread\n");
+		preload.running = FALSE;
+		preloadStop();
+		return;
+	}
+	SysPrintf("preload: loading %d sectors in the background\n", preload.sectors);
+	return;
+
+fail:
+	SysPrintf("preload: failed, reading from the image\n");
+	if (preload.ctx != NULL)
+		ucache.ctx_close(preload.ctx);
+	free(preload.ready);
+	memset(&preload, 0, sizeof(preload));
+}
+#else
+static void preloadStop(void) {}
+static void preloadStart(void) {}
+#endif
+
 static void PrintTracks(void) {
 	int i;
 
@@ -1674,6 +2559,7 @@ static long CALLBACK ISOopen(void) {
 
 	sprintf(image_str, "Loaded CD Image: %s", GetIsoFile());
 
+	memset(&cdr_stats, 0, sizeof(cdr_stats));
 	cddaBigEndian = FALSE;
 	subChanMixed = FALSE;
 	subChanRaw = FALSE;
@@ -1714,6 +2600,17 @@ static long CALLBACK ISOopen(void) {
 	}
 #endif
 
+	if (compr_img != NULL && compr_cache_init() != 0) {
+		SysPrintf("failed to set up block cache\n");
+		return -1;
+	}
+#ifdef HAVE_CHD
+	if (chd_img != NULL && chd_cache_init() != 0) {
+		SysPrintf("failed to set up hunk cache\n");
+		return -1;
+	}
+#endif
+
 	if (!subChanMixed && opensubfile(GetIsoFile()) == 0) {
 		strcat(image_str, "[+sub]");
 	}
@@ -1776,6 +2673,18 @@ static long CALLBACK ISOopen(void) {
 	else if (isMode1ISO)
 		cdimg_read_func = cdread_2048;
 
+#ifdef HAVE_CDIMG_MMAP
+	// no point mapping what is about to be copied to memory anyway
+	if (!Config.CdPreload && (cdimg_read_func == cdread_normal
+	    || cdimg_read_func == cdread_sub_mixed)) {
+		cdimg_map_open();
+		if (cdimg_map.base != NULL) {
+			CDR_getBuffer = ISOgetBuffer_mmap;
+			cdimg_read_func = subChanMixed ? cdread_sub_mixed_mmap : cdread_mmap;
+		}
+	}
+#endif
+
 	// make sure we have another handle open for cdda
 	if (numtracks > 1 && ti[1].handle == NULL) {
 		ti[1].handle = fopen(bin_filename, "rb");
@@ -1783,7 +2692,9 @@ static long CALLBACK ISOopen(void) {
 	cdda_cur_sector = 0;
 	cdda_file_offset = 0;
 
-  if (Config.AsyncCD) {
+	if (Config.CdPreload)
+		preloadStart();
+  else if (Config.AsyncCD) {
     readThreadStart();
   }
 	return 0;
@@ -1792,6 +2703,13 @@ static long CALLBACK ISOopen(void) {
 static long CALLBACK ISOclose(void) {
 	int i;
 
+	// everything that may still read through the caches goes first, the
+	// config may have changed since ISOopen so stop whatever is running
+	stopCDDA();
+	preloadStop();
+	readThreadStop();
+	ucache_free();
+
 	if (cdHandle != NULL) {
 		fclose(cdHandle);
 		cdHandle = NULL;
@@ -1800,7 +2718,6 @@ static long CALLBACK ISOclose(void) {
 		fclose(subHandle);
 		subHandle = NULL;
 	}
-	stopCDDA();
 	cddaHandle = NULL;
 
 	if (compr_img != NULL) {
@@ -1812,7 +2729,6 @@ static long CALLBACK ISOclose(void) {
 #ifdef HAVE_CHD
 	if (chd_img != NULL) {
 		chd_close(chd_img->chd);
-		free(chd_img->buffer);
 		free(chd_img);
 		chd_img = NULL;
 	}
@@ -1831,9 +2747,9 @@ static long CALLBACK ISOclose(void) {
 	memset(cdbuffer, 0, sizeof(cdbuffer));
 	CDR_getBuffer = ISOgetBuffer;
 
-	if (Config.AsyncCD) {
-		readThreadStop();
-	}
+#ifdef HAVE_CDIMG_MMAP
+	cdimg_map_close();
+#endif
 
 	return 0;
 }
@@ -2094,3 +3010,7 @@ void cdrIsoInit(void) {
 int cdrIsoActive(void) {
 	return (cdHandle != NULL);
 }
+
+void cdrIsoGetStats(struct CdrIsoStats *stats) {
+	*stats = cdr_stats;
+}
@@ -25,8 +25,21 @@
 extern "C" {
 #endif
 
+struct CdrIsoStats {
+	unsigned int ra_hits;	// sector was already read ahead
+	unsigned int ra_misses;	// seek, had to wait for the read
+	unsigned int ra_stalls;	// sequential read caught up with readahead
+	unsigned int cache_hits;	// decompressed hunk/block was cached
+	unsigned int cache_misses;
+	unsigned int unpack_count;	// hunks/blocks decompressed
+	unsigned long long unpack_us;	// time spent on that
+	unsigned int preload_hits;	// served from the in-memory copy
+	unsigned int preload_misses;	// not loaded yet, read from the image
+};
+
 void cdrIsoInit(void);
 int cdrIsoActive(void);
+void cdrIsoGetStats(struct CdrIsoStats *stats);
 
 extern unsigned int cdrIsoMultidiskCount;
 extern unsigned int cdrIsoMultidiskSelect;
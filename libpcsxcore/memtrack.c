@@ -0,0 +1,291 @@
+/*  Pcsx - Pc Psx Emulator
+ *  Copyright (C) 1999-2016  Pcsx Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+/*
+ * Page level write tracking with mprotect() and a fault handler.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "memtrack.h"
+
+#if (defined(__linux__) || defined(__APPLE__)) && !defined(NO_OS)
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct memtrack_region {
+	unsigned char *ptr;
+	u32 size;
+	u32 start, end;		// the part made of whole pages
+	u32 pages;
+	unsigned char *shadow;
+	volatile unsigned char *dirty;	// per page of [start, end)
+};
+
+static struct memtrack_region regions[MEMTRACK_REGIONS];
+static u32 page_size, page_shift;
+static int handler_installed;
+static volatile int armed;
+static struct sigaction old_segv, old_bus;
+
+static void memtrack_fault(int sig, siginfo_t *si, void *ctx)
+{
+	uintptr_t addr = (uintptr_t)si->si_addr;
+	struct sigaction *old;
+	u32 page, offs;
+	int i;
+
+	for (i = 0; i < MEMTRACK_REGIONS; i++) {
+		struct memtrack_region *r = &regions[i];
+		if (r->dirty == NULL || addr < (uintptr_t)r->ptr + r->start
+		    || addr >= (uintptr_t)r->ptr + r->end)
+			continue;
+		page = (addr - (uintptr_t)r->ptr - r->start) >> page_shift;
+		offs = r->start + (page << page_shift);
+		// the first thread to get here saves the page, others just
+		// retry the write until it's unprotected
+		if (__sync_lock_test_and_set(&r->dirty[page], 1) == 0) {
+			memcpy(r->shadow + offs, r->ptr + offs, page_size);
+			mprotect(r->ptr + offs, page_size, PROT_READ | PROT_WRITE);
+		}
+		return;
+	}
+
+	// not ours
+	old = sig == SIGBUS ? &old_bus : &old_segv;
+	if (old->sa_flags & SA_SIGINFO)
+		old->sa_sigaction(sig, si, ctx);
+	else if (old->sa_handler != SIG_DFL && old->sa_handler != SIG_IGN)
+		old->sa_handler(sig);
+	else
+		// fault again with the old action in place
+		sigaction(sig, old, NULL);
+}
+
+int MemTrackInit(void)
+{
+	struct sigaction sa;
+	long ps;
+
+	if (handler_installed)
+		return 0;
+
+	ps = sysconf(_SC_PAGESIZE);
+	if (ps <= 0 || (ps & (ps - 1)))
+		return -1;
+	page_size = ps;
+	for (page_shift = 0; (1u << page_shift) < page_size; page_shift++)
+		;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = memtrack_fault;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGSEGV, &sa, &old_segv) != 0)
+		return -1;
+	if (sigaction(SIGBUS, &sa, &old_bus) != 0) {
+		sigaction(SIGSEGV, &old_segv, NULL);
+		return -1;
+	}
+	handler_installed = 1;
+	return 0;
+}
+
+static void region_unprotect(struct memtrack_region *r)
+{
+	if (r->end > r->start)
+		mprotect(r->ptr + r->start, r->end - r->start, PROT_READ | PROT_WRITE);
+}
+
+void MemTrackShutdown(void)
+{
+	int i;
+
+	for (i = 0; i < MEMTRACK_REGIONS; i++) {
+		if (armed)
+			region_unprotect(&regions[i]);
+		free(regions[i].shadow);
+		free((void *)regions[i].dirty);
+	}
+	memset(regions, 0, sizeof(regions));
+	armed = 0;
+
+	if (handler_installed) {
+		sigaction(SIGSEGV, &old_segv, NULL);
+		sigaction(SIGBUS, &old_bus, NULL);
+		handler_installed = 0;
+	}
+}
+
+// A moved region keeps its shadow, the new memory is then compared
+// against what the old one had at the last MemTrackArm().
+int MemTrackSetRegion(int id, void *ptr, u32 size)
+{
+	struct memtrack_region *r = &regions[id];
+	uintptr_t a = (uintptr_t)ptr;
+	u32 start, end;
+	int fresh = 0;
+
+	if (r->ptr == ptr && r->size == size && r->dirty != NULL)
+		return 0;
+	// the old memory may be gone already, can't go through MemTrackSuspend
+	if (armed || !handler_installed)
+		return -1;
+
+	free((void *)r->dirty);
+	r->dirty = NULL;
+	if (ptr == NULL || size != r->size) {
+		free(r->shadow);
+		r->shadow = NULL;
+	}
+	r->ptr = ptr;
+	r->size = size;
+	if (ptr == NULL)
+		return 0;
+
+	start = ((a + page_size - 1) & ~(uintptr_t)(page_size - 1)) - a;
+	end = ((a + size) & ~(uintptr_t)(page_size - 1)) - a;
+	if (start >= size || end <= start)
+		start = end = 0;
+	if (r->shadow == NULL) {
+		r->shadow = malloc(size);
+		fresh = 1;
+	}
+	r->dirty = malloc(((end - start) >> page_shift) + 1);
+	if (r->shadow == NULL || r->dirty == NULL) {
+		MemTrackSetRegion(id, NULL, 0);
+		return -1;
+	}
+	r->start = start;
+	r->end = end;
+	r->pages = (end - start) >> page_shift;
+	memset((void *)r->dirty, 1, r->pages);
+	return fresh;
+}
+
+void *MemTrackRegionPtr(int id)
+{
+	return regions[id].ptr;
+}
+
+const void *MemTrackShadow(int id)
+{
+	return regions[id].shadow;
+}
+
+int MemTrackArm(void)
+{
+	struct memtrack_region *r;
+	u32 page, n;
+	int i;
+
+	for (i = 0; i < MEMTRACK_REGIONS; i++) {
+		r = &regions[i];
+		if (r->dirty == NULL)
+			continue;
+		memcpy(r->shadow, r->ptr, r->start);
+		memcpy(r->shadow + r->end, r->ptr + r->end, r->size - r->end);
+		for (page = 0; page < r->pages; page = n) {
+			for (n = page; n < r->pages && r->dirty[n]; n++)
+				;
+			if (n == page) {
+				n++;
+				continue;
+			}
+			if (mprotect(r->ptr + r->start + (page << page_shift),
+			      (n - page) << page_shift, PROT_READ) != 0) {
+				armed = 1;
+				MemTrackSuspend();
+				return -1;
+			}
+			memset((void *)(r->dirty + page), 0, n - page);
+		}
+	}
+	armed = 1;
+	return 0;
+}
+
+void MemTrackSuspend(void)
+{
+	struct memtrack_region *r;
+	u32 page, offs;
+	int i;
+
+	if (!armed)
+		return;
+
+	for (i = 0; i < MEMTRACK_REGIONS; i++) {
+		r = &regions[i];
+		if (r->dirty == NULL)
+			continue;
+		region_unprotect(r);
+		for (page = 0; page < r->pages; page++) {
+			if (r->dirty[page])
+				continue;
+			offs = r->start + (page << page_shift);
+			memcpy(r->shadow + offs, r->ptr + offs, page_size);
+			r->dirty[page] = 1;
+		}
+	}
+	armed = 0;
+}
+
+int MemTrackArmed(void)
+{
+	return armed;
+}
+
+u32 MemTrackNextDirty(int id, u32 *offs)
+{
+	struct memtrack_region *r = &regions[id];
+	u32 o = *offs, page, n;
+
+	if (r->dirty == NULL || o >= r->size)
+		return 0;
+	if (o < r->start)
+		return r->start - o;
+	if (o < r->end) {
+		page = (o - r->start) >> page_shift;
+		for (; page < r->pages && !r->dirty[page]; page++)
+			;
+		if (page < r->pages) {
+			for (n = page; n < r->pages && r->dirty[n]; n++)
+				;
+			*offs = r->start + (page << page_shift);
+			return (n - page) << page_shift;
+		}
+		o = r->end;
+	}
+	*offs = o;
+	return r->size - o;
+}
+
+#else // no page protection
+
+int MemTrackInit(void) { return -1; }
+void MemTrackShutdown(void) {}
+int MemTrackSetRegion(int id, void *ptr, u32 size) { return -1; }
+void *MemTrackRegionPtr(int id) { return NULL; }
+const void *MemTrackShadow(int id) { return NULL; }
+int MemTrackArm(void) { return -1; }
+void MemTrackSuspend(void) {}
+int MemTrackArmed(void) { return 0; }
+u32 MemTrackNextDirty(int id, u32 *offs) { return 0; }
+
+#endif
@@ -0,0 +1,73 @@
+/*  Pcsx - Pc Psx Emulator
+ *  Copyright (C) 1999-2016  Pcsx Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __MEMTRACK_H__
+#define __MEMTRACK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "psxcommon.h"
+
+// Page level write tracking of emulated memory, used to keep deltas
+// of just the changed pages (see Rewind* in misc.c).
+//
+// Tracked pages are write protected. The first write to one after
+// MemTrackArm() marks it dirty and copies its old contents to the same
+// offset in the region's shadow buffer before letting the write through,
+// so for every dirty span both the previous and the current data are at
+// hand. Partial pages at unaligned region edges can't be protected, they
+// are always reported dirty and their shadow is refreshed on arming.
+//
+// Anything that writes tracked memory from the kernel (read() into RAM
+// etc.) or frees it must call MemTrackSuspend() first.
+enum {
+	MEMTRACK_RAM = 0,
+	MEMTRACK_PSXH,
+	MEMTRACK_VRAM,
+	MEMTRACK_SPU,
+	MEMTRACK_REGIONS
+};
+
+// 0 if page protection and fault handling are usable on this platform
+int MemTrackInit(void);
+void MemTrackShutdown(void);
+
+// ptr == NULL removes the region. Only allowed while suspended.
+// Returns -1 on failure, 1 if the shadow was (re)allocated and so
+// doesn't have the old data, 0 otherwise.
+int MemTrackSetRegion(int id, void *ptr, u32 size);
+void *MemTrackRegionPtr(int id);
+const void *MemTrackShadow(int id);
+
+// clean all pages and write protect them, -1 if that failed (tracking
+// is then suspended)
+int MemTrackArm(void);
+// unprotect everything, pages not written yet are copied to the shadow
+// and marked dirty, so nothing is lost until the next MemTrackArm()
+void MemTrackSuspend(void);
+int MemTrackArmed(void);
+
+// find the next span at or after *offs that was written since the last
+// MemTrackArm(), returns its length with *offs set to its start, or 0
+u32 MemTrackNextDirty(int id, u32 *offs);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
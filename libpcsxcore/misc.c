@@ -26,6 +26,8 @@
 #include "mdec.h"
 #include "gpu.h"
 #include "ppf.h"
+#include "memtrack.h"
+#include <stddef.h>
 #include <zlib.h>
 
 char CdromId[10] = "";
@@ -585,97 +587,389 @@ struct PcsxSaveFuncs SaveFuncs = {
 	zlib_open, zlib_read, zlib_write, zlib_seek, zlib_close
 };
 
+// In-memory state streams. SaveFuncs are pointed at these while a
+// state is captured to or restored from memory.
+struct mem_state {
+	unsigned char *buf;
+	size_t size;
+	size_t alloc;
+	size_t pos;
+	int error;
+};
+
+static void *mem_open(const char *name, const char *mode)
+{
+	return NULL;
+}
+
+static int mem_read(void *file, void *buf, u32 len)
+{
+	struct mem_state *ms = file;
+
+	if (ms->pos >= ms->size)
+		len = 0;
+	else if (len > ms->size - ms->pos)
+		len = ms->size - ms->pos;
+	memcpy(buf, ms->buf + ms->pos, len);
+	ms->pos += len;
+	return len;
+}
+
+static int mem_write(void *file, const void *buf, u32 len)
+{
+	struct mem_state *ms = file;
+
+	if (ms->pos + len > ms->alloc) {
+		size_t alloc = (ms->pos + len) * 5 / 4;
+		unsigned char *p = realloc(ms->buf, alloc);
+		if (p == NULL) {
+			ms->error = 1;
+			return -1;
+		}
+		ms->buf = p;
+		ms->alloc = alloc;
+	}
+	memcpy(ms->buf + ms->pos, buf, len);
+	ms->pos += len;
+	if (ms->pos > ms->size)
+		ms->size = ms->pos;
+	return len;
+}
+
+static long mem_seek(void *file, long offs, int whence)
+{
+	struct mem_state *ms = file;
+
+	switch (whence) {
+	case SEEK_SET:
+		ms->pos = offs;
+		return ms->pos;
+	case SEEK_CUR:
+		ms->pos += offs;
+		return ms->pos;
+	case SEEK_END:
+		ms->pos = ms->size + offs;
+		return ms->pos;
+	}
+	return -1;
+}
+
+static void mem_close(void *file)
+{
+}
+
+static const struct PcsxSaveFuncs MemSaveFuncs = {
+	mem_open, mem_read, mem_write, mem_seek, mem_close
+};
+
 static const char PcsxHeader[32] = "STv4 PCSX v" PCSX_VERSION;
 
 // Savestate Versioning!
 // If you make changes to the savestate version, please increment the value below.
-static const u32 SaveVersion = 0x8b410006;
+// Changes to a single component should rather bump its section version.
+static const u32 SaveVersion = 0x8b410007;
+// single blob in a fixed order, can still be loaded
+static const u32 SaveVersionOld = 0x8b410006;
+
+// The state is a header, an index and a list of sections:
+//   char header[32], u32 version, boolean hle, u32 count,
+//   struct state_section index[count], section data...
+// Offsets in the index are from the start of the (uncompressed) stream.
+// The thumbnail and RAM come first so that tools reading just those
+// don't have to inflate the rest.
+#define STATE_MAX_SECTIONS 32
+
+struct state_section {
+	u32 tag;
+	u32 version;
+	u32 offset;
+	u32 size;
+};
 
-int SaveState(const char *file) {
-	void *f;
-	GPUFreeze_t *gpufP;
-	SPUFreeze_t *spufP;
-	int Size;
-	unsigned char *pMem;
+static const struct {
+	u32 tag;
+	u32 version;
+	u32 size;	// if fixed
+	boolean optional;
+} StateSections[] = {
+	{ STATE_SCREEN, 1, 128 * 96 * 3, TRUE },
+	{ STATE_RAM, 1, 0x00200000 },
+	{ STATE_BIOS, 1, 0x00080000 },
+	{ STATE_PSXH, 1, 0x00010000 },
+	{ STATE_CPU, 1, sizeof(psxRegs) },
+	{ STATE_GPU, 1, sizeof(GPUFreeze_t) },
+	{ STATE_SPU, 1 },
+	{ STATE_SIO, 1 },
+	{ STATE_CDR, 1 },
+	{ STATE_HW, 1 },
+	{ STATE_RCNT, 1 },
+	{ STATE_MDEC, 1 },
+	{ STATE_DYNAREC, 1, 0, TRUE },
+};
 
-	f = SaveFuncs.open(file, "wb");
-	if (f == NULL) return -1;
+static u32 section_version(u32 tag) {
+	int i;
 
-	new_dyna_before_save();
+	for (i = 0; i < sizeof(StateSections) / sizeof(StateSections[0]); i++)
+		if (StateSections[i].tag == tag)
+			return StateSections[i].version;
+	return 0;
+}
 
-	SaveFuncs.write(f, (void *)PcsxHeader, 32);
-	SaveFuncs.write(f, (void *)&SaveVersion, sizeof(u32));
-	SaveFuncs.write(f, (void *)&Config.HLE, sizeof(boolean));
+// small components are frozen to memory first, so that their size is
+// known when the index is written
+static struct mem_state state_staging;
+
+// SPUFreeze_t.SPURam, cut out of no_ram states
+#define SPU_RAM_OFFS offsetof(SPUFreeze_t, SPURam)
+#define SPU_RAM_SIZE 0x80000
+
+// no_ram leaves out the screen, RAM, scratchpad/IO, VRAM and SPU RAM
+// (and the BIOS unless HLE keeps its state there) for the rewind code,
+// which tracks those by page. Such a stream is only loadable by
+// load_state_fp() with no_ram set over the same memory.
+static int save_state_fp(void *f, int no_ram) {
+	struct state_section sect[STATE_MAX_SECTIONS];
+	const void *data[STATE_MAX_SECTIONS];
+	struct PcsxSaveFuncs funcs;
+	GPUFreeze_t *gpufP;
+	SPUFreeze_t *spufP;
+	unsigned char *pMem;
+	u32 count = 0, offset, i;
+	int Size, ret = -1;
+
+#define ADD_SECTION(tag_, ptr_, size_) { \
+	sect[count].tag = tag_; \
+	sect[count].version = section_version(tag_); \
+	sect[count].size = size_; \
+	data[count++] = ptr_; \
+}
+#define STAGE_SECTION(tag_, freeze) { \
+	offset = state_staging.pos; \
+	freeze; \
+	ADD_SECTION(tag_, NULL, state_staging.pos - offset); \
+	sect[count - 1].offset = offset; \
+}
 
 	pMem = (unsigned char *)malloc(128 * 96 * 3);
-	if (pMem == NULL) return -1;
-	GPU_getScreenPic(pMem);
-	SaveFuncs.write(f, pMem, 128 * 96 * 3);
-	free(pMem);
+	gpufP = (GPUFreeze_t *)malloc(sizeof(GPUFreeze_t));
+	spufP = (SPUFreeze_t *) malloc(16);
+	if (pMem == NULL || gpufP == NULL || spufP == NULL)
+		goto out;
+
+	if (!no_ram) {
+		GPU_getScreenPic(pMem);
+		ADD_SECTION(STATE_SCREEN, pMem, 128 * 96 * 3);
+	}
 
 	if (Config.HLE)
 		psxBiosFreeze(1);
 
-	SaveFuncs.write(f, psxM, 0x00200000);
-	SaveFuncs.write(f, psxR, 0x00080000);
-	SaveFuncs.write(f, psxH, 0x00010000);
-	SaveFuncs.write(f, (void *)&psxRegs, sizeof(psxRegs));
+	if (!no_ram)
+		ADD_SECTION(STATE_RAM, psxM, 0x00200000);
+	if (!no_ram || Config.HLE)
+		ADD_SECTION(STATE_BIOS, psxR, 0x00080000);
+	if (!no_ram)
+		ADD_SECTION(STATE_PSXH, psxH, 0x00010000);
+	ADD_SECTION(STATE_CPU, &psxRegs, sizeof(psxRegs));
 
 	// gpu
-	gpufP = (GPUFreeze_t *)malloc(sizeof(GPUFreeze_t));
 	gpufP->ulFreezeVersion = 1;
-	GPU_freeze(1, gpufP);
-	SaveFuncs.write(f, gpufP, sizeof(GPUFreeze_t));
-	free(gpufP);
+	GPU_freeze(no_ram ? 3 : 1, gpufP);
+	ADD_SECTION(STATE_GPU, gpufP, no_ram ? offsetof(GPUFreeze_t, psxVRam) : sizeof(GPUFreeze_t));
 
 	// spu
-	spufP = (SPUFreeze_t *) malloc(16);
 	SPU_freeze(2, spufP, psxRegs.cycle);
-	Size = spufP->Size; SaveFuncs.write(f, &Size, 4);
+	Size = spufP->Size;
 	free(spufP);
 	spufP = (SPUFreeze_t *) malloc(Size);
-	SPU_freeze(1, spufP, psxRegs.cycle);
-	SaveFuncs.write(f, spufP, Size);
+	if (spufP == NULL)
+		goto out;
+	SPU_freeze(no_ram ? 3 : 1, spufP, psxRegs.cycle);
+	if (no_ram) {
+		memmove((char *)spufP + SPU_RAM_OFFS, (char *)spufP + SPU_RAM_OFFS + SPU_RAM_SIZE,
+			Size - SPU_RAM_OFFS - SPU_RAM_SIZE);
+		Size -= SPU_RAM_SIZE;
+	}
+	ADD_SECTION(STATE_SPU, spufP, Size);
+
+	funcs = SaveFuncs;
+	SaveFuncs = MemSaveFuncs;
+	state_staging.size = state_staging.pos = 0;
+	state_staging.error = 0;
+	STAGE_SECTION(STATE_SIO, sioFreeze(&state_staging, 1));
+	STAGE_SECTION(STATE_CDR, cdrFreeze(&state_staging, 1));
+	STAGE_SECTION(STATE_HW, psxHwFreeze(&state_staging, 1));
+	STAGE_SECTION(STATE_RCNT, psxRcntFreeze(&state_staging, 1));
+	STAGE_SECTION(STATE_MDEC, mdecFreeze(&state_staging, 1));
+	STAGE_SECTION(STATE_DYNAREC, new_dyna_freeze(&state_staging, 1));
+	SaveFuncs = funcs;
+	if (state_staging.error)
+		goto out;
+#undef STAGE_SECTION
+#undef ADD_SECTION
+
+	offset = 32 + sizeof(u32) + sizeof(boolean) + sizeof(u32) + count * sizeof(sect[0]);
+	for (i = 0; i < count; i++) {
+		if (data[i] == NULL)
+			data[i] = state_staging.buf + sect[i].offset;
+		sect[i].offset = offset;
+		offset += sect[i].size;
+	}
+
+	SaveFuncs.write(f, (void *)PcsxHeader, 32);
+	SaveFuncs.write(f, (void *)&SaveVersion, sizeof(u32));
+	SaveFuncs.write(f, (void *)&Config.HLE, sizeof(boolean));
+	SaveFuncs.write(f, &count, sizeof(u32));
+	SaveFuncs.write(f, sect, count * sizeof(sect[0]));
+	for (i = 0; i < count; i++)
+		SaveFuncs.write(f, data[i], sect[i].size);
+	ret = 0;
+
+out:
+	free(pMem);
+	free(gpufP);
 	free(spufP);
+	return ret;
+}
 
-	sioFreeze(f, 1);
-	cdrFreeze(f, 1);
-	psxHwFreeze(f, 1);
-	psxRcntFreeze(f, 1);
-	mdecFreeze(f, 1);
-	new_dyna_freeze(f, 1);
+int SaveState(const char *file) {
+	void *f;
+	int ret;
+
+	f = SaveFuncs.open(file, "wb");
+	if (f == NULL) return -1;
+
+	new_dyna_before_save();
+
+	ret = save_state_fp(f, 0);
 
 	SaveFuncs.close(f);
 
 	new_dyna_after_save();
 
-	return 0;
+	return ret;
 }
 
-int LoadState(const char *file) {
-	void *f;
+static int load_state_old(void *f) {
 	GPUFreeze_t *gpufP;
 	SPUFreeze_t *spufP;
 	int Size;
+
+	SaveFuncs.seek(f, 128 * 96 * 3, SEEK_CUR);
+
+	SaveFuncs.read(f, psxM, 0x00200000);
+	SaveFuncs.read(f, psxR, 0x00080000);
+	SaveFuncs.read(f, psxH, 0x00010000);
+	SaveFuncs.read(f, (void *)&psxRegs, sizeof(psxRegs));
+
+	if (Config.HLE)
+		psxBiosFreeze(0);
+
+	// gpu
+	gpufP = (GPUFreeze_t *)malloc(sizeof(GPUFreeze_t));
+	SaveFuncs.read(f, gpufP, sizeof(GPUFreeze_t));
+	GPU_freeze(0, gpufP);
+	free(gpufP);
+	if (HW_GPU_STATUS == 0)
+		HW_GPU_STATUS = GPU_readStatus();
+
+	// spu
+	SaveFuncs.read(f, &Size, 4);
+	spufP = (SPUFreeze_t *)malloc(Size);
+	SaveFuncs.read(f, spufP, Size);
+	SPU_freeze(0, spufP, psxRegs.cycle);
+	free(spufP);
+
+	sioFreeze(f, 0);
+	cdrFreeze(f, 0);
+	psxHwFreeze(f, 0);
+	psxRcntFreeze(f, 0);
+	mdecFreeze(f, 0);
+	new_dyna_freeze(f, 0);
+
+	return 0;
+}
+
+static int read_state_index(void *f, struct state_section *sect, u32 *count) {
+	if (SaveFuncs.read(f, count, sizeof(u32)) != sizeof(u32)
+	    || *count > STATE_MAX_SECTIONS)
+		return -1;
+	if (SaveFuncs.read(f, sect, *count * sizeof(sect[0])) != *count * sizeof(sect[0]))
+		return -1;
+	return 0;
+}
+
+static struct state_section *find_section(struct state_section *sect, u32 count, u32 tag) {
+	u32 i;
+
+	for (i = 0; i < count; i++)
+		if (sect[i].tag == tag)
+			return &sect[i];
+	return NULL;
+}
+
+// position f at the start of a section, NULL if it's not there
+static struct state_section *seek_section(void *f, struct state_section *sect, u32 count, u32 tag) {
+	struct state_section *s = find_section(sect, count, tag);
+
+	if (s == NULL || s->version != section_version(tag))
+		return NULL;
+	if (SaveFuncs.seek(f, s->offset, SEEK_SET) < 0)
+		return NULL;
+	return s;
+}
+
+static int load_state_fp(void *f, int no_ram) {
+	struct state_section sect[STATE_MAX_SECTIONS], *s;
+	GPUFreeze_t *gpufP;
+	SPUFreeze_t *spufP;
+	unsigned char *ram = NULL;
 	char header[32];
-	u32 version;
+	u32 version, count, tag;
 	boolean hle;
-
-	f = SaveFuncs.open(file, "rb");
-	if (f == NULL) return -1;
+	int i;
 
 	SaveFuncs.read(f, header, sizeof(header));
 	SaveFuncs.read(f, &version, sizeof(u32));
 	SaveFuncs.read(f, &hle, sizeof(boolean));
 
-	if (strncmp("STv4 PCSX", header, 9) != 0 || version != SaveVersion) {
-		SaveFuncs.close(f);
+	if (strncmp("STv4 PCSX", header, 9) != 0)
+		return -1;
+	if (version != SaveVersion && version != SaveVersionOld)
 		return -1;
+
+	if (version == SaveVersion) {
+		if (read_state_index(f, sect, &count) != 0)
+			return -1;
+
+		// check everything before touching emu state
+		for (i = 0; !no_ram && i < sizeof(StateSections) / sizeof(StateSections[0]); i++) {
+			tag = StateSections[i].tag;
+			s = find_section(sect, count, tag);
+			if (s != NULL && s->version == StateSections[i].version
+			    && (StateSections[i].size == 0 || s->size == StateSections[i].size))
+				continue;
+			if (StateSections[i].optional)
+				continue;
+			SysPrintf("savestate: section %.4s is %s\n", (char *)&tag,
+				s == NULL ? "missing" : "incompatible");
+			return -1;
+		}
 	}
+
 	Config.HLE = hle;
 
-	if (Config.HLE)
+	if (Config.HLE) {
+		// RAM is in place already with no_ram, keep it from being reset
+		if (no_ram && (ram = malloc(0x00200000)) != NULL)
+			memcpy(ram, psxM, 0x00200000);
 		psxBiosInit();
+		if (ram != NULL) {
+			memcpy(psxM, ram, 0x00200000);
+			free(ram);
+		}
+	}
 
 #if defined(LIGHTREC)
 	if (Config.Cpu != CPU_INTERPRETER)
@@ -683,11 +977,21 @@ int LoadState(const char *file) {
 	else
 #endif
 	psxCpu->Reset();
-	SaveFuncs.seek(f, 128 * 96 * 3, SEEK_CUR);
 
-	SaveFuncs.read(f, psxM, 0x00200000);
-	SaveFuncs.read(f, psxR, 0x00080000);
-	SaveFuncs.read(f, psxH, 0x00010000);
+	if (version == SaveVersionOld)
+		return load_state_old(f);
+
+	if (!no_ram) {
+		seek_section(f, sect, count, STATE_RAM);
+		SaveFuncs.read(f, psxM, 0x00200000);
+	}
+	if (seek_section(f, sect, count, STATE_BIOS) != NULL)
+		SaveFuncs.read(f, psxR, 0x00080000);
+	if (!no_ram) {
+		seek_section(f, sect, count, STATE_PSXH);
+		SaveFuncs.read(f, psxH, 0x00010000);
+	}
+	seek_section(f, sect, count, STATE_CPU);
 	SaveFuncs.read(f, (void *)&psxRegs, sizeof(psxRegs));
 
 	if (Config.HLE)
@@ -695,37 +999,315 @@ int LoadState(const char *file) {
 
 	// gpu
 	gpufP = (GPUFreeze_t *)malloc(sizeof(GPUFreeze_t));
-	SaveFuncs.read(f, gpufP, sizeof(GPUFreeze_t));
+	if (gpufP == NULL)
+		return -1;
+	s = seek_section(f, sect, count, STATE_GPU);
+	if (no_ram) {
+		if (s == NULL || s->size > sizeof(GPUFreeze_t)) {
+			free(gpufP);
+			return -1;
+		}
+		SaveFuncs.read(f, gpufP, s->size);
+		memcpy(gpufP->psxVRam, GPU_getVram(), sizeof(gpufP->psxVRam));
+	}
+	else
+		SaveFuncs.read(f, gpufP, sizeof(GPUFreeze_t));
 	GPU_freeze(0, gpufP);
 	free(gpufP);
 	if (HW_GPU_STATUS == 0)
 		HW_GPU_STATUS = GPU_readStatus();
 
 	// spu
-	SaveFuncs.read(f, &Size, 4);
-	spufP = (SPUFreeze_t *)malloc(Size);
-	SaveFuncs.read(f, spufP, Size);
+	s = seek_section(f, sect, count, STATE_SPU);
+	if (s == NULL)
+		return -1;
+	spufP = (SPUFreeze_t *)malloc(s->size + (no_ram ? SPU_RAM_SIZE : 0));
+	if (spufP == NULL)
+		return -1;
+	if (no_ram) {
+		SaveFuncs.read(f, spufP, SPU_RAM_OFFS);
+		memcpy((char *)spufP + SPU_RAM_OFFS, SPU_getRam(), SPU_RAM_SIZE);
+		SaveFuncs.read(f, (char *)spufP + SPU_RAM_OFFS + SPU_RAM_SIZE, s->size - SPU_RAM_OFFS);
+	}
+	else
+		SaveFuncs.read(f, spufP, s->size);
 	SPU_freeze(0, spufP, psxRegs.cycle);
 	free(spufP);
 
+	seek_section(f, sect, count, STATE_SIO);
 	sioFreeze(f, 0);
+	seek_section(f, sect, count, STATE_CDR);
 	cdrFreeze(f, 0);
+	seek_section(f, sect, count, STATE_HW);
 	psxHwFreeze(f, 0);
+	seek_section(f, sect, count, STATE_RCNT);
 	psxRcntFreeze(f, 0);
+	seek_section(f, sect, count, STATE_MDEC);
 	mdecFreeze(f, 0);
+	// without block info the dynarec finds blocks itself, it
+	// must see the end of data then
+	if (seek_section(f, sect, count, STATE_DYNAREC) == NULL) {
+		u32 end = 0;
+		for (i = 0; i < count; i++)
+			if (sect[i].offset + sect[i].size > end)
+				end = sect[i].offset + sect[i].size;
+		SaveFuncs.seek(f, end, SEEK_SET);
+	}
 	new_dyna_freeze(f, 0);
 
+	return 0;
+}
+
+// Read one section without loading the state, e.g. the STATE_SCREEN
+// thumbnail. Returns the section size (which may be more than 'size')
+// or -1.
+int LoadStateSection(const char *file, u32 tag, void *buf, u32 size) {
+	struct state_section sect[STATE_MAX_SECTIONS], *s;
+	char header[32];
+	u32 version, count;
+	boolean hle;
+	void *f;
+	int ret = -1;
+
+	SaveStateAsyncWait();
+
+	f = SaveFuncs.open(file, "rb");
+	if (f == NULL) return -1;
+
+	SaveFuncs.read(f, header, sizeof(header));
+	SaveFuncs.read(f, &version, sizeof(u32));
+	SaveFuncs.read(f, &hle, sizeof(boolean));
+
+	if (strncmp("STv4 PCSX", header, 9) == 0 && version == SaveVersion
+	    && read_state_index(f, sect, &count) == 0
+	    && (s = seek_section(f, sect, count, tag)) != NULL) {
+		if (size > s->size)
+			size = s->size;
+		if (SaveFuncs.read(f, buf, size) == size)
+			ret = s->size;
+	}
+
 	SaveFuncs.close(f);
 
+	return ret;
+}
+
+static int mem_state_save(struct mem_state *ms, int no_ram) {
+	struct PcsxSaveFuncs funcs = SaveFuncs;
+	int ret;
+
+	ms->size = ms->pos = 0;
+	ms->error = 0;
+
+	SaveFuncs = MemSaveFuncs;
+	new_dyna_before_save();
+	ret = save_state_fp(ms, no_ram);
+	new_dyna_after_save();
+	SaveFuncs = funcs;
+
+	return ms->error ? -1 : ret;
+}
+
+static int mem_state_load(struct mem_state *ms, int no_ram) {
+	struct PcsxSaveFuncs funcs = SaveFuncs;
+	int ret;
+
+	ms->pos = 0;
+
+	SaveFuncs = MemSaveFuncs;
+	ret = load_state_fp(ms, no_ram);
+	SaveFuncs = funcs;
+
+	return ret;
+}
+
+// Asynchronous saving: the state is captured into memory on the calling
+// thread, compression and file I/O are left to a writer thread using the
+// SaveFuncs that were set at the time of the call.
+#define SAVE_ASYNC_MAX 2
+
+enum {
+	SAVE_JOB_FREE = 0,
+	SAVE_JOB_QUEUED,
+	SAVE_JOB_WRITING,
+};
+
+struct save_job {
+	int state;
+	unsigned int seq;
+	struct mem_state ms;
+	struct PcsxSaveFuncs funcs;
+	const char *file;
+	SaveStateDoneCb done;
+	void *param;
+};
+
+static int save_job_write(struct save_job *job) {
+	void *f;
+
+	f = job->funcs.open(job->file, "wb");
+	if (f == NULL)
+		return -1;
+	if (job->funcs.write(f, job->ms.buf, job->ms.size) != job->ms.size) {
+		job->funcs.close(f);
+		return -1;
+	}
+	job->funcs.close(f);
+	return 0;
+}
+
+#ifndef _WIN32
+#include <pthread.h>
+
+static struct {
+	struct save_job jobs[SAVE_ASYNC_MAX];
+	unsigned int seq;
+	boolean started;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond; // a job was queued or finished
+} save_async = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *save_async_main(void *param) {
+	struct save_job *job;
+	int i, ret;
+
+	pthread_mutex_lock(&save_async.lock);
+	while (1) {
+		// oldest first
+		job = NULL;
+		for (i = 0; i < SAVE_ASYNC_MAX; i++) {
+			if (save_async.jobs[i].state != SAVE_JOB_QUEUED)
+				continue;
+			if (job == NULL || (int)(save_async.jobs[i].seq - job->seq) < 0)
+				job = &save_async.jobs[i];
+		}
+		if (job == NULL) {
+			pthread_cond_wait(&save_async.cond, &save_async.lock);
+			continue;
+		}
+
+		job->state = SAVE_JOB_WRITING;
+		pthread_mutex_unlock(&save_async.lock);
+
+		ret = save_job_write(job);
+		if (job->done != NULL)
+			job->done(job->file, ret, job->param);
+
+		pthread_mutex_lock(&save_async.lock);
+		job->state = SAVE_JOB_FREE;
+		pthread_cond_broadcast(&save_async.cond);
+	}
+
+	return NULL;
+}
+
+int SaveStateAsync(const char *file, SaveStateDoneCb done, void *param) {
+	struct save_job *job = NULL;
+	int i;
+
+	pthread_mutex_lock(&save_async.lock);
+	if (!save_async.started) {
+		if (pthread_create(&save_async.thread, NULL, save_async_main, NULL) != 0) {
+			pthread_mutex_unlock(&save_async.lock);
+			i = SaveState(file);
+			if (done != NULL)
+				done(file, i, param);
+			return i;
+		}
+		save_async.started = TRUE;
+	}
+	// wait for a free slot if too many saves are still being written
+	while (1) {
+		for (i = 0; i < SAVE_ASYNC_MAX; i++)
+			if (save_async.jobs[i].state == SAVE_JOB_FREE)
+				job = &save_async.jobs[i];
+		if (job != NULL)
+			break;
+		pthread_cond_wait(&save_async.cond, &save_async.lock);
+	}
+	pthread_mutex_unlock(&save_async.lock);
+
+	// only this thread takes free jobs, no need to hold the lock
+	if (mem_state_save(&job->ms, 0) != 0) {
+		if (done != NULL)
+			done(file, -1, param);
+		return -1;
+	}
+	job->funcs = SaveFuncs;
+	job->file = file;
+	job->done = done;
+	job->param = param;
+
+	pthread_mutex_lock(&save_async.lock);
+	job->seq = save_async.seq++;
+	job->state = SAVE_JOB_QUEUED;
+	pthread_cond_broadcast(&save_async.cond);
+	pthread_mutex_unlock(&save_async.lock);
+
 	return 0;
 }
 
+void SaveStateAsyncWait(void) {
+	int i;
+
+	pthread_mutex_lock(&save_async.lock);
+	for (i = 0; i < SAVE_ASYNC_MAX; i++) {
+		while (save_async.jobs[i].state != SAVE_JOB_FREE)
+			pthread_cond_wait(&save_async.cond, &save_async.lock);
+	}
+	pthread_mutex_unlock(&save_async.lock);
+}
+#else
+static struct save_job save_sync_job;
+
+int SaveStateAsync(const char *file, SaveStateDoneCb done, void *param) {
+	int ret;
+
+	ret = mem_state_save(&save_sync_job.ms, 0);
+	if (ret == 0) {
+		save_sync_job.funcs = SaveFuncs;
+		save_sync_job.file = file;
+		ret = save_job_write(&save_sync_job);
+	}
+	if (done != NULL)
+		done(file, ret, param);
+	return ret;
+}
+
+void SaveStateAsyncWait(void) {}
+#endif
+
+int LoadState(const char *file) {
+	void *f;
+	int ret;
+
+	// might be loading what is still being written
+	SaveStateAsyncWait();
+
+	f = SaveFuncs.open(file, "rb");
+	if (f == NULL) return -1;
+
+	// the file may be read() straight into RAM
+	MemTrackSuspend();
+	ret = load_state_fp(f, 0);
+
+	SaveFuncs.close(f);
+
+	return ret;
+}
+
 int CheckState(const char *file) {
 	void *f;
 	char header[32];
 	u32 version;
 	boolean hle;
 
+	SaveStateAsyncWait();
+
 	f = SaveFuncs.open(file, "rb");
 	if (f == NULL) return -1;
 
@@ -735,12 +1317,414 @@ int CheckState(const char *file) {
 
 	SaveFuncs.close(f);
 
-	if (strncmp("STv4 PCSX", header, 9) != 0 || version != SaveVersion)
+	if (strncmp("STv4 PCSX", header, 9) != 0)
+		return -1;
+	if (version != SaveVersion && version != SaveVersionOld)
 		return -1;
 
 	return 0;
 }
 
+// Rewind: the newest snapshot is kept whole, older ones as the XOR
+// against the following snapshot, run-length encoded (mostly zeros),
+// in a ring of fixed size. Stepping back applies them newest first.
+//
+// With page tracking (memtrack.c) the snapshot is a no_ram stream and
+// RAM, scratchpad, VRAM and SPU RAM are left in place. Each entry then
+// also has the XOR of only the pages written since the previous
+// snapshot against their old data in the tracker's shadow, as
+// (u32 region, u32 offset, u32 length) + tokens after the stream part.
+#define REWIND_MAX_ENTRIES 8192
+
+struct rewind_entry {
+	u32 offs;
+	u32 len;
+	u32 prev_size;	// stream size of the older snapshot
+};
+
+static struct {
+	unsigned char *buf;
+	u32 size;
+	u32 tail;	// end of the newest entry
+	struct rewind_entry entries[REWIND_MAX_ENTRIES];
+	int first, count;
+	int interval, frame;
+	int tracked;	// 1: by page, -1: full snapshots, 0: not decided
+	struct mem_state head;	// newest snapshot
+	struct mem_state cur;
+	unsigned char *enc;
+	size_t enc_alloc;
+} rewind_ring;
+
+static const u32 rewind_region_size[MEMTRACK_REGIONS] = {
+	0x00200000, 0x00010000, 1024 * 512 * 2, SPU_RAM_SIZE
+};
+
+static void rewind_clear(void) {
+	rewind_ring.first = rewind_ring.count = 0;
+	rewind_ring.tail = 0;
+}
+
+int RewindInit(u32 size, int interval) {
+	if (interval < 1)
+		interval = 1;
+	rewind_ring.interval = interval;
+	rewind_ring.frame = 0;
+	rewind_ring.tracked = 0;
+	rewind_clear();
+	rewind_ring.head.size = 0;
+
+	if (size == rewind_ring.size)
+		return 0;
+
+	free(rewind_ring.buf);
+	rewind_ring.buf = NULL;
+	rewind_ring.size = 0;
+	if (size == 0) {
+		MemTrackShutdown();
+		free(rewind_ring.head.buf);
+		free(rewind_ring.cur.buf);
+		free(rewind_ring.enc);
+		memset(&rewind_ring.head, 0, sizeof(rewind_ring.head));
+		memset(&rewind_ring.cur, 0, sizeof(rewind_ring.cur));
+		rewind_ring.enc = NULL;
+		rewind_ring.enc_alloc = 0;
+		return 0;
+	}
+
+	rewind_ring.buf = malloc(size);
+	if (rewind_ring.buf == NULL)
+		return -1;
+	rewind_ring.size = size;
+	return 0;
+}
+
+static void rewind_untrack(void) {
+	SysPrintf("rewind: no page tracking, using full snapshots\n");
+	MemTrackShutdown();
+	rewind_ring.tracked = -1;
+	rewind_clear();
+	rewind_ring.head.size = 0;
+}
+
+// (re)register the tracked memory, VRAM and SPU RAM move when plugins
+// are reloaded. Returns -1 if full snapshots have to be used instead.
+static int rewind_track(void) {
+	void *ptr[MEMTRACK_REGIONS];
+	int i, ret, fresh = 0;
+
+	if (rewind_ring.tracked < 0)
+		return -1;
+
+	ptr[MEMTRACK_RAM] = psxM;
+	ptr[MEMTRACK_PSXH] = psxH;
+	ptr[MEMTRACK_VRAM] = GPU_getVram != NULL ? GPU_getVram() : NULL;
+	ptr[MEMTRACK_SPU] = SPU_getRam != NULL ? SPU_getRam() : NULL;
+	if (MemTrackInit() != 0)
+		goto fail;
+	for (i = 0; i < MEMTRACK_REGIONS; i++) {
+		if (ptr[i] == NULL)
+			goto fail;
+		ret = MemTrackSetRegion(i, ptr[i], rewind_region_size[i]);
+		if (ret < 0)
+			goto fail;
+		fresh |= ret;
+	}
+	if (fresh) {
+		// no old data to make entries against
+		rewind_clear();
+		rewind_ring.head.size = 0;
+	}
+	rewind_ring.tracked = 1;
+	return 0;
+
+fail:
+	rewind_untrack();
+	return -1;
+}
+
+static int rewind_enc_reserve(size_t need) {
+	unsigned char *p;
+
+	if (need <= rewind_ring.enc_alloc)
+		return 0;
+	need += need / 4;
+	p = realloc(rewind_ring.enc, need);
+	if (p == NULL)
+		return -1;
+	rewind_ring.enc = p;
+	rewind_ring.enc_alloc = need;
+	return 0;
+}
+
+// a ^ b as (u32 zero count, u32 literal count, literals) tokens, the
+// shorter stream is treated as zero-padded
+#define REWIND_XB(i) (((i) < a_size ? a[i] : 0) ^ ((i) < b_size ? b[i] : 0))
+
+static size_t rewind_encode(unsigned char *out, const unsigned char *a, size_t a_size,
+	const unsigned char *b, size_t b_size)
+{
+	size_t n = a_size > b_size ? a_size : b_size;
+	size_t common = a_size < b_size ? a_size : b_size;
+	size_t i = 0, o = 0, start, k;
+	u64 wa, wb;
+	u32 skip, lit;
+
+	while (i < n) {
+		start = i;
+		while (i + 8 <= common) {
+			memcpy(&wa, a + i, 8);
+			memcpy(&wb, b + i, 8);
+			if (wa != wb)
+				break;
+			i += 8;
+		}
+		while (i < n && REWIND_XB(i) == 0)
+			i++;
+		if (i == n)
+			break; // trailing zeros need no token
+		skip = i - start;
+
+		// literals until enough zeros to pay for the next token, so
+		// the output never exceeds the input by more than one token
+		start = i;
+		for (; i < n; i++) {
+			if (REWIND_XB(i) != 0 || i + 8 > n)
+				continue;
+			for (k = 1; k < 8; k++)
+				if (REWIND_XB(i + k) != 0)
+					break;
+			if (k == 8)
+				break;
+		}
+		lit = i - start;
+
+		memcpy(out + o, &skip, 4);
+		memcpy(out + o + 4, &lit, 4);
+		o += 8;
+		for (; start < i; start++)
+			out[o++] = REWIND_XB(start);
+	}
+
+	return o;
+}
+
+static void rewind_decode(unsigned char *buf, size_t size, const unsigned char *in, size_t len)
+{
+	size_t i = 0, o = 0;
+	u32 skip, lit;
+
+	while (o + 8 <= len) {
+		memcpy(&skip, in + o, 4);
+		memcpy(&lit, in + o + 4, 4);
+		o += 8;
+		i += skip;
+		if (i + lit > size || o + lit > len)
+			break;
+		while (lit-- > 0)
+			buf[i++] ^= in[o++];
+	}
+}
+
+static int rewind_push(size_t len, u32 prev_size) {
+	struct rewind_entry *e;
+	u32 pos = rewind_ring.tail;
+	int i, n, drop;
+
+	if (len > rewind_ring.size) {
+		// too big to keep, older snapshots can't be reached anymore
+		rewind_clear();
+		return -1;
+	}
+	if (pos + len > rewind_ring.size)
+		pos = 0;
+
+	// After wrapping to 0 the way may be blocked by newer entries than the
+	// oldest one, and the chain can only be cut from the old end, so drop
+	// everything up to the newest entry in the way.
+	drop = rewind_ring.count == REWIND_MAX_ENTRIES ? 1 : 0;
+	for (n = 0; n < rewind_ring.count; n++) {
+		e = &rewind_ring.entries[(rewind_ring.first + n) % REWIND_MAX_ENTRIES];
+		if (e->offs < pos + len && e->offs + e->len > pos)
+			drop = n + 1;
+	}
+	rewind_ring.first = (rewind_ring.first + drop) % REWIND_MAX_ENTRIES;
+	rewind_ring.count -= drop;
+
+	i = (rewind_ring.first + rewind_ring.count) % REWIND_MAX_ENTRIES;
+	e = &rewind_ring.entries[i];
+	e->offs = pos;
+	e->len = len;
+	e->prev_size = prev_size;
+	memcpy(rewind_ring.buf + pos, rewind_ring.enc, len);
+	rewind_ring.count++;
+	rewind_ring.tail = pos + len;
+	return 0;
+}
+
+static void rewind_frame_tracked(void) {
+	struct mem_state tmp;
+	const unsigned char *shadow;
+	unsigned char *ptr;
+	u32 hdr[3], offs, len;
+	size_t o;
+	int id;
+
+	if (mem_state_save(&rewind_ring.cur, 1) != 0)
+		return;
+
+	if (rewind_ring.head.size != 0) {
+		o = (rewind_ring.cur.size > rewind_ring.head.size ? rewind_ring.cur.size : rewind_ring.head.size);
+		if (rewind_enc_reserve(4 + o + 16) != 0)
+			return;
+		len = rewind_encode(rewind_ring.enc + 4, rewind_ring.head.buf, rewind_ring.head.size,
+			rewind_ring.cur.buf, rewind_ring.cur.size);
+		memcpy(rewind_ring.enc, &len, 4);
+		o = 4 + len;
+
+		for (id = 0; id < MEMTRACK_REGIONS; id++) {
+			ptr = MemTrackRegionPtr(id);
+			shadow = MemTrackShadow(id);
+			for (offs = 0; (len = MemTrackNextDirty(id, &offs)) != 0; offs += len) {
+				// not armed yet, so the next try covers this too
+				if (rewind_enc_reserve(o + sizeof(hdr) + len + 16) != 0)
+					return;
+				hdr[0] = id;
+				hdr[1] = offs;
+				hdr[2] = rewind_encode(rewind_ring.enc + o + sizeof(hdr),
+					shadow + offs, len, ptr + offs, len);
+				if (hdr[2] == 0)
+					continue; // written, but with the same data
+				memcpy(rewind_ring.enc + o, hdr, sizeof(hdr));
+				o += sizeof(hdr) + hdr[2];
+			}
+		}
+		rewind_push(o, rewind_ring.head.size);
+	}
+
+	if (MemTrackArm() != 0) {
+		rewind_untrack();
+		return;
+	}
+	tmp = rewind_ring.head;
+	rewind_ring.head = rewind_ring.cur;
+	rewind_ring.cur = tmp;
+}
+
+void RewindFrame(void) {
+	struct mem_state tmp;
+	size_t need;
+
+	if (rewind_ring.buf == NULL || ++rewind_ring.frame < rewind_ring.interval)
+		return;
+	rewind_ring.frame = 0;
+
+	if (rewind_track() == 0) {
+		rewind_frame_tracked();
+		return;
+	}
+
+	if (mem_state_save(&rewind_ring.cur, 0) != 0)
+		return;
+
+	if (rewind_ring.head.size != 0) {
+		need = (rewind_ring.cur.size > rewind_ring.head.size ? rewind_ring.cur.size : rewind_ring.head.size);
+		if (rewind_enc_reserve(need + 16) != 0)
+			return;
+		need = rewind_encode(rewind_ring.enc, rewind_ring.head.buf, rewind_ring.head.size,
+			rewind_ring.cur.buf, rewind_ring.cur.size);
+		rewind_push(need, rewind_ring.head.size);
+	}
+
+	tmp = rewind_ring.head;
+	rewind_ring.head = rewind_ring.cur;
+	rewind_ring.cur = tmp;
+}
+
+// page part of a tracked entry
+static void rewind_undo_pages(const unsigned char *p, const unsigned char *end) {
+	unsigned char *ptr;
+	u32 hdr[3];
+
+	while (p + sizeof(hdr) <= end) {
+		memcpy(hdr, p, sizeof(hdr));
+		p += sizeof(hdr);
+		if (hdr[0] >= MEMTRACK_REGIONS || hdr[1] >= rewind_region_size[hdr[0]]
+		    || hdr[2] > end - p)
+			break;
+		ptr = MemTrackRegionPtr(hdr[0]);
+		rewind_decode(ptr + hdr[1], rewind_region_size[hdr[0]] - hdr[1], p, hdr[2]);
+		p += hdr[2];
+	}
+}
+
+// Go back 'count' snapshots (or as far as possible) and load that state.
+// Returns the number of snapshots actually stepped back.
+int RewindStep(int count) {
+	struct rewind_entry *e;
+	const unsigned char *p, *shadow;
+	unsigned char *ptr;
+	size_t size;
+	u32 offs, len;
+	int i, done, tracked;
+
+	if (rewind_ring.buf == NULL || rewind_ring.head.size == 0)
+		return -1;
+
+	tracked = rewind_ring.tracked > 0;
+	if (tracked) {
+		if (rewind_track() != 0 || rewind_ring.head.size == 0)
+			return -1;
+		// undo what was written since the newest snapshot
+		for (i = 0; i < MEMTRACK_REGIONS; i++) {
+			ptr = MemTrackRegionPtr(i);
+			shadow = MemTrackShadow(i);
+			for (offs = 0; (len = MemTrackNextDirty(i, &offs)) != 0; offs += len)
+				memcpy(ptr + offs, shadow + offs, len);
+		}
+	}
+
+	for (done = 0; done < count && rewind_ring.count > 0; done++) {
+		i = (rewind_ring.first + rewind_ring.count - 1) % REWIND_MAX_ENTRIES;
+		e = &rewind_ring.entries[i];
+		p = rewind_ring.buf + e->offs;
+		len = e->len;
+		if (tracked) {
+			memcpy(&len, p, 4);
+			p += 4;
+			if (len > e->len - 4)
+				return -1;
+		}
+
+		size = rewind_ring.head.size;
+		if (e->prev_size > size) {
+			rewind_ring.head.pos = size;
+			while (rewind_ring.head.size < e->prev_size) {
+				static const unsigned char zero[1024];
+				size = e->prev_size - rewind_ring.head.size;
+				mem_write(&rewind_ring.head, zero, size < sizeof(zero) ? size : sizeof(zero));
+				if (rewind_ring.head.error)
+					return -1;
+			}
+		}
+		rewind_decode(rewind_ring.head.buf, rewind_ring.head.size, p, len);
+		rewind_ring.head.size = e->prev_size;
+		// pages not written since the snapshot fault in as they're changed
+		if (tracked)
+			rewind_undo_pages(p + len, rewind_ring.buf + e->offs + e->len);
+
+		rewind_ring.count--;
+		rewind_ring.tail = rewind_ring.count > 0 ? e->offs : 0;
+	}
+
+	rewind_ring.frame = 0;
+	if (mem_state_load(&rewind_ring.head, tracked) != 0)
+		return -1;
+	if (tracked && MemTrackArm() != 0)
+		rewind_untrack();
+	return done;
+}
+
 // NET Function Helpers
 
 int SendPcsxInfo() {
@@ -61,9 +61,36 @@ int LoadCdromFile(const char *filename, EXE_HEADER *head);
 int CheckCdrom();
 int Load(const char *ExePath);
 
+// savestate section tags
+#define STATE_TAG(a, b, c, d) ((a) | ((b) << 8) | ((c) << 16) | ((u32)(d) << 24))
+#define STATE_SCREEN	STATE_TAG('S', 'C', 'R', 'N') // 128x96 RGB888 thumbnail
+#define STATE_RAM	STATE_TAG('R', 'A', 'M', ' ')
+#define STATE_BIOS	STATE_TAG('B', 'I', 'O', 'S')
+#define STATE_PSXH	STATE_TAG('P', 'S', 'X', 'H') // scratchpad and I/O area
+#define STATE_CPU	STATE_TAG('C', 'P', 'U', ' ')
+#define STATE_GPU	STATE_TAG('G', 'P', 'U', ' ')
+#define STATE_SPU	STATE_TAG('S', 'P', 'U', ' ')
+#define STATE_SIO	STATE_TAG('S', 'I', 'O', ' ')
+#define STATE_CDR	STATE_TAG('C', 'D', 'R', ' ')
+#define STATE_HW	STATE_TAG('H', 'W', ' ', ' ')
+#define STATE_RCNT	STATE_TAG('R', 'C', 'N', 'T')
+#define STATE_MDEC	STATE_TAG('M', 'D', 'E', 'C')
+#define STATE_DYNAREC	STATE_TAG('D', 'Y', 'N', 'A')
+
 int SaveState(const char *file);
 int LoadState(const char *file);
 int CheckState(const char *file);
+int LoadStateSection(const char *file, u32 tag, void *buf, u32 size);
+// 'file' is passed to SaveFuncs.open as is, so it must stay valid until
+// 'done' is called with the result. That happens exactly once, from the
+// writer thread unless the state couldn't even be captured.
+typedef void (*SaveStateDoneCb)(const char *file, int result, void *param);
+int SaveStateAsync(const char *file, SaveStateDoneCb done, void *param);
+void SaveStateAsyncWait(void);
+
+int RewindInit(u32 size, int interval);
+void RewindFrame(void);
+int RewindStep(int count);
 
 int SendPcsxInfo();
 int RecvPcsxInfo();
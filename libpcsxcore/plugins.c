@@ -23,6 +23,7 @@
 
 #include "plugins.h"
 #include "cdriso.h"
+#include "memtrack.h"
 #include "../plugins/dfinput/externals.h"
 
 static char IsoFile[MAXPATHLEN] = "";
@@ -51,6 +52,7 @@ GPUgetScreenPic       GPU_getScreenPic;
 GPUshowScreenPic      GPU_showScreenPic;
 GPUclearDynarec       GPU_clearDynarec;
 GPUvBlank             GPU_vBlank;
+GPUgetVram            GPU_getVram;
 
 CDRinit               CDR_init;
 CDRshutdown           CDR_shutdown;
@@ -92,6 +94,7 @@ SPUregisterCallback   SPU_registerCallback;
 SPUregisterScheduleCb SPU_registerScheduleCb;
 SPUasync              SPU_async;
 SPUplayCDDAchannel    SPU_playCDDAchannel;
+SPUgetRam             SPU_getRam;
 
 PADconfigure          PAD1_configure;
 PADabout              PAD1_about;
@@ -243,6 +246,7 @@ static int LoadGPUplugin(const char *GPUdll) {
 	LoadGpuSym0(showScreenPic, "GPUshowScreenPic");
 	LoadGpuSym0(clearDynarec, "GPUclearDynarec");
 	LoadGpuSym0(vBlank, "GPUvBlank");
+	LoadGpuSymN(getVram, "GPUgetVram");
 	LoadGpuSym0(configure, "GPUconfigure");
 	LoadGpuSym0(test, "GPUtest");
 	LoadGpuSym0(about, "GPUabout");
@@ -362,6 +366,7 @@ static int LoadSPUplugin(const char *SPUdll) {
 	LoadSpuSym0(registerScheduleCb, "SPUregisterScheduleCb");
 	LoadSpuSymN(async, "SPUasync");
 	LoadSpuSymN(playCDDAchannel, "SPUplayCDDAchannel");
+	LoadSpuSymN(getRam, "SPUgetRam");
 
 	return 0;
 }
@@ -1204,6 +1209,9 @@ int LoadPlugins() {
 }
 
 void ReleasePlugins() {
+	// VRAM and SPU RAM are freed below
+	MemTrackSuspend();
+
 	if (Config.UseNet) {
 		int ret = NET_close();
 		if (ret < 0) Config.UseNet = FALSE;
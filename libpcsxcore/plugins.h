@@ -90,6 +90,9 @@ typedef long (CALLBACK* GPUgetScreenPic)(unsigned char *);
 typedef long (CALLBACK* GPUshowScreenPic)(unsigned char *);
 typedef void (CALLBACK* GPUclearDynarec)(void (CALLBACK *callback)(void));
 typedef void (CALLBACK* GPUvBlank)(int, int);
+// optional, the 1MB VRAM for page tracking. A plugin providing it must
+// also handle GPUfreeze type 3 (save without copying VRAM).
+typedef void* (CALLBACK* GPUgetVram)(void);
 
 // GPU function pointers
 extern GPUupdateLace    GPU_updateLace;
@@ -115,6 +118,7 @@ extern GPUgetScreenPic  GPU_getScreenPic;
 extern GPUshowScreenPic GPU_showScreenPic;
 extern GPUclearDynarec  GPU_clearDynarec;
 extern GPUvBlank        GPU_vBlank;
+extern GPUgetVram       GPU_getVram;
 
 // CD-ROM Functions
 typedef long (CALLBACK* CDRinit)(void);
@@ -203,6 +207,9 @@ typedef struct {
 typedef long (CALLBACK* SPUfreeze)(uint32_t, SPUFreeze_t *, uint32_t);
 typedef void (CALLBACK* SPUasync)(uint32_t, uint32_t);
 typedef int  (CALLBACK* SPUplayCDDAchannel)(short *, int);
+// optional, the 512KB SPU RAM for page tracking. A plugin providing it
+// must also handle SPUfreeze mode 3 (save without copying the RAM).
+typedef void* (CALLBACK* SPUgetRam)(void);
 
 // SPU function pointers
 extern SPUconfigure        SPU_configure;
@@ -225,6 +232,7 @@ extern SPUregisterCallback SPU_registerCallback;
 extern SPUregisterScheduleCb SPU_registerScheduleCb;
 extern SPUasync            SPU_async;
 extern SPUplayCDDAchannel  SPU_playCDDAchannel;
+extern SPUgetRam           SPU_getRam;
 
 // PAD Functions
 typedef long (CALLBACK* PADconfigure)(void);
@@ -122,6 +122,9 @@ typedef struct {
 	boolean Cdda;
 	boolean AsyncCD;
 	boolean CHD_Precache; /* loads disk image into memory, works with CHD only. */
+	u8 CompressedThreads; /* CHD/PBP/CBIN decompression threads, 0 - decompress on demand */
+	u32 CompressedCacheSize; /* decompressed hunk/block cache size, bytes */
+	boolean CdPreload; /* copy the whole disk image to memory in the background */
 	boolean HLE;
 	boolean SlowBoot;
 	boolean Debug;
@@ -28,6 +28,7 @@
 #include "r3000a.h"
 #include "psxhw.h"
 #include "debug.h"
+#include "memtrack.h"
 
 #include "memmap.h"
 
@@ -246,6 +247,7 @@ void psxMemReset() {
 }
 
 void psxMemShutdown() {
+	MemTrackSuspend();
 	psxUnmap(psxM, 0x00210000, MAP_TAG_RAM); psxM = NULL;
 	psxUnmap(psxH, 0x10000, MAP_TAG_OTHER); psxH = NULL;
 	psxUnmap(psxR, 0x80000, MAP_TAG_OTHER); psxR = NULL;
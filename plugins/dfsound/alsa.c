@@ -37,7 +37,7 @@ static int alsa_init(void)
  unsigned int pspeed;
  int pchannels;
  int format;
- unsigned int buffer_time = 100000;
+ unsigned int buffer_time = 60000;                   // small, see alsa_feed
  unsigned int period_time = buffer_time / 4;
  const char *alsa_name = "default";
  const char *name;
@@ -147,6 +147,7 @@ static int alsa_init(void)
   }
 
  buffer_size = snd_pcm_status_get_avail(status);
+ out_rate_reset();
  retval = 0;
 
 out:
@@ -185,7 +186,9 @@ static int alsa_busy(void)
 // FEED SOUND DATA
 static void alsa_feed(void *pSound, int lBytes)
 {
+ snd_pcm_sframes_t delay;
  char sbuf[4096];
+ int l;
 
  if (handle == NULL) return;
 
@@ -193,20 +196,23 @@ static void alsa_feed(void *pSound, int lBytes)
   {
    memset(sbuf, 0, sizeof(sbuf));
    snd_pcm_prepare(handle);
-   snd_pcm_writei(handle, sbuf, sizeof(sbuf) / 4);
-   snd_pcm_writei(handle, sbuf, sizeof(sbuf) / 4);
-   snd_pcm_writei(handle, sbuf, sizeof(sbuf) / 4);
+   for (l = buffer_size / 3; l > 0; l -= (int)sizeof(sbuf) / 4)
+    snd_pcm_writei(handle, sbuf, l < (int)sizeof(sbuf) / 4 ? l : (int)sizeof(sbuf) / 4);
   }
- else
+
+ // keep the device buffer about a third full, the rest is headroom
+ // for the emu's frame sized bursts
+ if (snd_pcm_delay(handle, &delay) < 0)
+  delay = 0;
+ lBytes = out_rate_control(pSound, lBytes, delay, buffer_size / 3, &pSound);
+
+ l = snd_pcm_avail(handle);
+ if (l < lBytes / 4)
   {
-   int l = snd_pcm_avail(handle);
-   if (l < lBytes / 4)
-    {
-     if (l == 0)
-      return;
-
-     lBytes = l * 4;
-    }
+   if (l <= 0)
+    return;
+
+   lBytes = l * 4;
   }
 
  snd_pcm_writei(handle, pSound, lBytes / 4);
@@ -20,6 +20,8 @@
 #define _IN_DMA
 
 #include "externals.h"
+#include "dma.h"
+#include "record.h"
 
 ////////////////////////////////////////////////////////////////////////
 // READ DMA (one value)
@@ -28,6 +30,8 @@
 unsigned short CALLBACK SPUreadDMA(void)
 {
  unsigned short s = *(unsigned short *)(spu.spuMemC + spu.spuAddr);
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_READ_DMA, spu_rec.cycles, 0, 0, NULL, 0);
  spu.spuAddr += 2;
  spu.spuAddr &= 0x7fffe;
 
@@ -43,6 +47,9 @@ void CALLBACK SPUreadDMAMem(unsigned short *pusPSXMem, int iSize,
 {
  int i;
 
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_READ_DMA_MEM, cycles, iSize, 0, NULL, 0);
+
  do_samples_if_needed(cycles, 1);
 
  for(i=0;i<iSize;i++)
@@ -67,7 +74,11 @@ void CALLBACK SPUreadDMAMem(unsigned short *pusPSXMem, int iSize,
   
 void CALLBACK SPUwriteDMA(unsigned short val)
 {
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_WRITE_DMA, spu_rec.cycles, 0, val, NULL, 0);
+
  *(unsigned short *)(spu.spuMemC + spu.spuAddr) = val;
+ adpcm_cache_invalidate(spu.spuAddr, 2);
 
  spu.spuAddr += 2;
  spu.spuAddr &= 0x7fffe;
@@ -82,9 +93,13 @@ void CALLBACK SPUwriteDMAMem(unsigned short *pusPSXMem, int iSize,
  unsigned int cycles)
 {
  int i;
- 
+
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_WRITE_DMA_MEM, cycles, 0, 0, pusPSXMem, iSize * 2);
+
  do_samples_if_needed(cycles, 1);
  spu.bMemDirty = 1;
+ adpcm_cache_invalidate(spu.spuAddr, iSize * 2);
 
  if(spu.spuAddr + iSize*2 < 0x80000)
   {
@@ -28,8 +28,8 @@
 #define __P_DMA_H__
 
 unsigned short CALLBACK SPUreadDMA(void);
-void CALLBACK SPUreadDMAMem(unsigned short * pusPSXMem,int iSize);
+void CALLBACK SPUreadDMAMem(unsigned short * pusPSXMem,int iSize,unsigned int cycles);
 void CALLBACK SPUwriteDMA(unsigned short val);
-void CALLBACK SPUwriteDMAMem(unsigned short * pusPSXMem,int iSize);
+void CALLBACK SPUwriteDMAMem(unsigned short * pusPSXMem,int iSize,unsigned int cycles);
 
 #endif /* __P_DMA_H__ */
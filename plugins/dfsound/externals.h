@@ -167,6 +167,9 @@ typedef struct
 
  // MIX_DEST_xx - FB_SRC_x
  int FB_SRC_A0, FB_SRC_A1, FB_SRC_B0, FB_SRC_B1;
+
+ // max samples MixREVERB can run stage by stage, see REVERBPrepBatch()
+ int batch;
 } REVERBInfo;
 
 ///////////////////////////////////////////////////////////
@@ -245,6 +248,7 @@ extern SPUInfo spu;
 
 void do_samples(unsigned int cycles_to, int do_sync);
 void schedule_next_irq(void);
+void adpcm_cache_invalidate(unsigned int addr, unsigned int size);
 
 #define regAreaGet(ch,offset) \
   spu.regArea[((ch<<4)|(offset))>>1]
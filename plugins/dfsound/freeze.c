@@ -22,6 +22,7 @@
 #include "externals.h"
 #include "registers.h"
 #include "spu.h"
+#include "record.h"
 
 ////////////////////////////////////////////////////////////////////////
 // freeze structs
@@ -237,6 +238,8 @@ long CALLBACK SPUfreeze(uint32_t ulFreezeMode, SPUFreeze_t * pF,
   {//--------------------------------------------------//
    if(ulFreezeMode==1)                                 
     memset(pF,0,sizeof(SPUFreeze_t)+sizeof(SPUOSSFreeze_t));
+   else if(ulFreezeMode==3)                            // save w/o ram, the
+    memset(pF+1,0,sizeof(SPUOSSFreeze_t));             // caller tracks it
 
    strcpy(pF->szSPUName,"PBOSS");
    pF->ulFreezeVersion=5;
@@ -244,7 +247,8 @@ long CALLBACK SPUfreeze(uint32_t ulFreezeMode, SPUFreeze_t * pF,
 
    if(ulFreezeMode==2) return 1;                       // info mode? ok, bye
                                                        // save mode:
-   memcpy(pF->cSPURam,spu.spuMem,0x80000);             // copy common infos
+   if(ulFreezeMode!=3)
+    memcpy(pF->cSPURam,spu.spuMem,0x80000);            // copy common infos
    memcpy(pF->cSPUPort,spu.regArea,0x200);
 
    if(spu.xapGlobal && spu.XAPlay!=spu.XAFeed)         // some xa
@@ -277,9 +281,16 @@ long CALLBACK SPUfreeze(uint32_t ulFreezeMode, SPUFreeze_t * pF,
                                                        
  if(ulFreezeMode!=0) return 0;                         // bad mode? bye
 
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_LOAD, cycles, 0, 0, pF,
+   pF->ulFreezeVersion == 5 ? sizeof(SPUFreeze_t) + sizeof(SPUOSSFreeze_t)
+                            : sizeof(SPUFreeze_t));
+ spu_rec.mute++;                                       // for the calls below
+
  memcpy(spu.spuMem,pF->cSPURam,0x80000);               // get ram
  memcpy(spu.regArea,pF->cSPUPort,0x200);
  spu.bMemDirty = 1;
+ adpcm_cache_invalidate(0, 0x80000);
 
  if(pF->xaS.nsamples<=4032)                            // start xa again
   SPUplayADPCMchannel(&pF->xaS);
@@ -311,9 +322,33 @@ long CALLBACK SPUfreeze(uint32_t ulFreezeMode, SPUFreeze_t * pF,
  if (spu.spuCtrl & CTRL_IRQ)
   schedule_next_irq();
 
+ spu_rec.mute--;
  return 1;
 }
 
+// full state for the recorder and test_replay, free() when done
+void *spu_state_save(unsigned int cycles, unsigned int *size)
+{
+ SPUFreeze_t *pF;
+
+ *size = sizeof(SPUFreeze_t) + sizeof(SPUOSSFreeze_t);
+ pF = malloc(*size);
+ if (pF != NULL)
+  SPUfreeze(1, pF, cycles);
+ return pF;
+}
+
+void spu_state_load(void *state, unsigned int size, unsigned int cycles)
+{
+ SPUFreeze_t *pF = state;
+
+ if (size < sizeof(SPUFreeze_t))
+  return;
+ if (pF->ulFreezeVersion == 5 && size < sizeof(SPUFreeze_t) + sizeof(SPUOSSFreeze_t))
+  pF->ulFreezeVersion = 0;                             // truncated, don't trust
+ SPUfreeze(0, pF, cycles);
+}
+
 ////////////////////////////////////////////////////////////////////////
 
 void LoadStateV5(SPUFreeze_t * pF)
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "out.h"
 
 #define MAX_OUT_DRIVERS 5
@@ -50,3 +51,183 @@ void SetupSound(void)
 	// printf("selected sound output driver: %s\n", out_current->name);
 }
 
+
+int out_ring_init(struct out_ring *r, unsigned int frames)
+{
+	unsigned int size = 1;
+
+	while (size < frames)
+		size <<= 1;
+	r->buf = malloc(size * 4);
+	if (r->buf == NULL)
+		return -1;
+	r->size = size;
+	r->rpos = r->wpos = 0;
+	return 0;
+}
+
+void out_ring_free(struct out_ring *r)
+{
+	free(r->buf);
+	r->buf = NULL;
+}
+
+int out_ring_used(struct out_ring *r)
+{
+	return __atomic_load_n(&r->wpos, __ATOMIC_ACQUIRE)
+		- __atomic_load_n(&r->rpos, __ATOMIC_ACQUIRE);
+}
+
+// producer side, drops what doesn't fit
+int out_ring_write(struct out_ring *r, const void *data, int frames)
+{
+	unsigned int wpos = r->wpos, pos, n;
+	int space;
+
+	space = r->size - (wpos - __atomic_load_n(&r->rpos, __ATOMIC_ACQUIRE));
+	if (frames > space)
+		frames = space;
+
+	pos = wpos & (r->size - 1);
+	n = r->size - pos;
+	if (n > (unsigned int)frames)
+		n = frames;
+	memcpy(r->buf + pos * 2, data, n * 4);
+	memcpy(r->buf, (const short *)data + n * 2, (frames - n) * 4);
+
+	__atomic_store_n(&r->wpos, wpos + frames, __ATOMIC_RELEASE);
+	return frames;
+}
+
+// consumer side
+int out_ring_read(struct out_ring *r, void *data, int frames)
+{
+	unsigned int rpos = r->rpos, pos, n;
+	int used;
+
+	used = __atomic_load_n(&r->wpos, __ATOMIC_ACQUIRE) - rpos;
+	if (frames > used)
+		frames = used;
+
+	pos = rpos & (r->size - 1);
+	n = r->size - pos;
+	if (n > (unsigned int)frames)
+		n = frames;
+	memcpy(data, r->buf + pos * 2, n * 4);
+	memcpy((short *)data + n * 2, r->buf, (frames - n) * 4);
+
+	__atomic_store_n(&r->rpos, rpos + frames, __ATOMIC_RELEASE);
+	return frames;
+}
+
+// The SPU runs off the emu's clock and the device off its own, so instead
+// of relying on a large buffer to absorb the drift the output gets
+// stretched by up to +-0.5% to keep 'queued' (frames not yet played when
+// this is called) near 'target'.
+#define RATE_MAX_ADJ  328       // 0.5% in 16.16
+#define RATE_AVG_SHIFT 4
+#define RATE_SUM_SHIFT 6
+
+static struct {
+	short *buf;
+	int buf_frames;
+	unsigned int pos;       // 16.16, input position of the next output frame
+	short last[2];          // last input frame of the previous call
+	int err_avg;            // smoothed fill error, 16.16
+	int err_sum;            // integral of it, cancels steady clock drift
+	int latency_avg;        // frames, 16.16
+	int started;
+} rc;
+
+void out_rate_reset(void)
+{
+	free(rc.buf);
+	memset(&rc, 0, sizeof(rc));
+}
+
+int out_rate_control(const void *data, int bytes, int queued, int target,
+	void **out)
+{
+	const short *in = data;
+	int frames = bytes / 4;
+	int i, n, err, step, f, l0, r0, l1, r1;
+	short *o;
+
+	if (frames <= 0 || target <= 0) {
+		*out = (void *)data;
+		return bytes;
+	}
+
+	if (queued < 0)
+		queued = 0;
+	if (queued > 0x7fff)
+		queued = 0x7fff;
+	if (!rc.started)
+		rc.latency_avg = queued << 16;
+	rc.started = 1;
+	rc.latency_avg += ((queued << 16) - rc.latency_avg) >> RATE_AVG_SHIFT;
+
+	// too much queued -> consume the input faster (produce fewer frames)
+	err = (int)((long long)(queued - target) * 65536 / target);
+	if (err > 65536)
+		err = 65536;
+	if (err < -65536)
+		err = -65536;
+	rc.err_avg += (err - rc.err_avg) >> RATE_AVG_SHIFT;
+	rc.err_sum += rc.err_avg >> RATE_SUM_SHIFT;
+	if (rc.err_sum > 65536)
+		rc.err_sum = 65536;
+	if (rc.err_sum < -65536)
+		rc.err_sum = -65536;
+	err = rc.err_avg / 2 + rc.err_sum;
+	if (err > 65536)
+		err = 65536;
+	if (err < -65536)
+		err = -65536;
+	step = 65536 + (int)((long long)err * RATE_MAX_ADJ >> 16);
+
+	n = (int)(((long long)frames << 16) / step) + 2;
+	if (n > rc.buf_frames) {
+		o = realloc(rc.buf, n * 4);
+		if (o == NULL) {
+			*out = (void *)data;
+			return bytes;
+		}
+		rc.buf = o;
+		rc.buf_frames = n;
+	}
+
+	// linear interpolation, output frame at pos is between
+	// in[(pos >> 16) - 1] and in[pos >> 16], in[-1] is rc.last
+	o = rc.buf;
+	for (i = 0; (int)(rc.pos >> 16) < frames; i++, rc.pos += step) {
+		int x = rc.pos >> 16;
+		f = (rc.pos & 0xffff) >> 1;
+		if (x == 0) {
+			l0 = rc.last[0];
+			r0 = rc.last[1];
+		}
+		else {
+			l0 = in[x * 2 - 2];
+			r0 = in[x * 2 - 1];
+		}
+		l1 = in[x * 2];
+		r1 = in[x * 2 + 1];
+		o[i * 2]     = l0 + ((l1 - l0) * f >> 15);
+		o[i * 2 + 1] = r0 + ((r1 - r0) * f >> 15);
+	}
+	rc.pos -= frames << 16;
+	rc.last[0] = in[frames * 2 - 2];
+	rc.last[1] = in[frames * 2 - 1];
+
+	*out = rc.buf;
+	return i * 4;
+}
+
+// how long a sample fed now takes to be heard, -1 if not known
+int out_get_latency_ms(void)
+{
+	if (!rc.started)
+		return -1;
+	return (int)((long long)rc.latency_avg * 1000 / 44100 >> 16);
+}
@@ -13,4 +13,24 @@ extern struct out_driver *out_current;
 
 void SetupSound(void);
 
+// single producer/consumer ring of stereo frames, no locks, so the
+// device callback thread can't stall the emu and vice versa
+struct out_ring {
+	short *buf;
+	unsigned int size;              // frames, power of 2
+	unsigned int rpos, wpos;        // free running
+};
+
+int  out_ring_init(struct out_ring *r, unsigned int frames);
+void out_ring_free(struct out_ring *r);
+int  out_ring_used(struct out_ring *r);
+int  out_ring_write(struct out_ring *r, const void *data, int frames);
+int  out_ring_read(struct out_ring *r, void *data, int frames);
+
+// dynamic rate control, returns the stretched data in *out
+int  out_rate_control(const void *data, int bytes, int queued, int target,
+	void **out);
+void out_rate_reset(void);
+int  out_get_latency_ms(void);
+
 #endif /* __P_OUT_H__ */
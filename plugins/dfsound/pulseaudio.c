@@ -18,6 +18,7 @@ comment              : Much of this was taken from simple.c, in the pulseaudio
  ***************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 
 #include <pulse/pulseaudio.h>
 #include "out.h"
@@ -56,8 +57,10 @@ static Settings settings = {
      .latency_in_msec = 20,
 };
 
-// the number of bytes written in SoundFeedStreamData
-const int mixlen = 3240;
+// the emu feeds this ring, the server pulls from it in stream_request_cb
+#define RING_FRAMES 4096
+static struct out_ring ring;
+static int server_latency;                             // frames
 
 // used to calculate how much space is used in the buffer, for debugging purposes
 //int maxlength = 0;
@@ -122,9 +125,28 @@ static void stream_latency_update_cb (pa_stream *stream, void *userdata)
 static void stream_request_cb (pa_stream *stream, size_t length, void *userdata)
 {
      Device *dev = userdata;
+     pa_usec_t usec;
+     int negative;
+     void *buf;
+     int got;
 
      if ((stream == NULL) || (dev == NULL))
 	  return;
+
+     length &= ~3;
+     if (length > 0 && pa_stream_begin_write (stream, &buf, &length) == 0)
+     {
+	  got = out_ring_read (&ring, buf, length / 4);
+	  // ran dry, give silence or the server won't ask again
+	  memset ((char *)buf + got * 4, 0, length - got * 4);
+	  pa_stream_write (stream, buf, length, NULL, 0LL, PA_SEEK_RELATIVE);
+     }
+
+     if (pa_stream_get_latency (stream, &usec, &negative) == 0)
+	  __atomic_store_n (&server_latency,
+			    negative ? 0 : (int)(usec * settings.frequency / 1000000),
+			    __ATOMIC_RELAXED);
+
      pa_threaded_mainloop_signal (dev->mainloop, 0);
 }
 
@@ -136,6 +158,11 @@ static int pulse_init(void)
 {
      int error_number;
 
+     if (ring.buf == NULL && out_ring_init (&ring, RING_FRAMES) != 0)
+	  return -1;
+     server_latency = 0;
+     out_rate_reset ();
+
      // Acquire mainloop ///////////////////////////////////////////////////////
      device.mainloop = pa_threaded_mainloop_new ();
      if (device.mainloop == NULL)
@@ -195,7 +222,8 @@ static int pulse_init(void)
      device.spec.rate = settings.frequency;
 
      pa_buffer_attr buffer_attributes;
-     buffer_attributes.tlength = pa_bytes_per_second (& device.spec) / 5;
+     // small, rate control in pulse_feed keeps it from running dry
+     buffer_attributes.tlength = pa_bytes_per_second (& device.spec) / 25;
      buffer_attributes.maxlength = buffer_attributes.tlength * 3;
      buffer_attributes.minreq = buffer_attributes.tlength / 3;
      buffer_attributes.prebuf = buffer_attributes.tlength;
@@ -285,6 +313,7 @@ static void pulse_finish(void)
 	  device.mainloop = NULL;
      }
 
+     out_ring_free (&ring);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -293,18 +322,10 @@ static void pulse_finish(void)
 
 static int pulse_busy(void)
 {
-     int free_space;
-
      if ((device.mainloop == NULL) || (device.api == NULL) || ( device.context == NULL) || (device.stream == NULL))
      	  return 1;
 
-     pa_threaded_mainloop_lock (device.mainloop);
-     free_space = pa_stream_writable_size (device.stream);
-     pa_threaded_mainloop_unlock (device.mainloop);
-
-     //fprintf (stderr, "Free space: %d\n", free_space);
-     //fprintf (stderr, "Used space: %d\n", maxlength - free_space);
-     if  (free_space < mixlen * 3)
+     if  (out_ring_used (&ring) > RING_FRAMES / 2)
      {
 	  // Don't buffer anymore, just play
 	  //fprintf (stderr, "Not buffering.\n");
@@ -324,19 +345,18 @@ static int pulse_busy(void)
 
 static void pulse_feed(void *pSound, int lBytes)
 {
-     if (device.mainloop != NULL)
-     {
-	  pa_threaded_mainloop_lock (device.mainloop);
-	  if (pa_stream_write (device.stream, pSound, lBytes, NULL, 0LL, PA_SEEK_RELATIVE) < 0)
-	  {
-	       fprintf (stderr, "Could not perform write\n");
-	  }
-	  else
-	  {
-	       //fprintf (stderr, "Wrote %d bytes\n", lBytes);
-	       pa_threaded_mainloop_unlock (device.mainloop);
-	  }
-     }
+     int queued;
+
+     if (device.mainloop == NULL || ring.buf == NULL)
+	  return;
+
+     // no locking, the server thread pulls from the ring
+     queued = out_ring_used (&ring)
+	  + __atomic_load_n (&server_latency, __ATOMIC_RELAXED);
+     lBytes = out_rate_control (pSound, lBytes, queued,
+				settings.frequency / 25 + settings.frequency / 60, &pSound);
+
+     out_ring_write (&ring, pSound, lBytes / 4);
 }
 
 void out_register_pulse(struct out_driver *drv)
@@ -0,0 +1,130 @@
+/*
+ * Records the calls the emu makes into the SPU so that they can be
+ * replayed without the emu by test_replay. Enabled by setting
+ * SPU_RECORD=<file> in the environment, the recording then starts from
+ * SPUinit() and ends on SPUshutdown(). When started later, it begins on
+ * the next SPUasync() with a snapshot of the state, which can't capture
+ * everything, so the replay will sound a bit different from the original.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stddef.h>
+#include "stdafx.h"
+
+#define _IN_RECORD
+
+#include "externals.h"
+#include "spu_config.h"
+#include "record.h"
+
+struct spu_rec spu_rec;
+
+#ifndef NO_OS
+
+static SPUConfig last_config;
+
+static void write_header(unsigned int cycles, int with_state);
+
+int spu_rec_start(const char *fname, int from_init)
+{
+ spu_rec_stop();
+
+ spu_rec.f = fopen(fname, "wb");
+ if (spu_rec.f == NULL) {
+  perror(fname);
+  return -1;
+ }
+ spu_rec.started = 0;
+ if (from_init)
+  write_header(0, 0);
+ return 0;
+}
+
+void spu_rec_stop(void)
+{
+ if (spu_rec.f == NULL)
+  return;
+ fclose(spu_rec.f);
+ spu_rec.f = NULL;
+}
+
+static void write_header(unsigned int cycles, int with_state)
+{
+ struct spu_rec_header hdr;
+ unsigned int size = 0;
+ void *state = NULL;
+
+ if (with_state) {
+  // mute the SPUfreeze() this does
+  spu_rec.mute++;
+  state = spu_state_save(cycles, &size);
+  spu_rec.mute--;
+  if (state == NULL) {
+   spu_rec_stop();
+   return;
+  }
+ }
+
+ memcpy(hdr.magic, SPU_REC_MAGIC, sizeof(hdr.magic));
+ hdr.version = SPU_REC_VERSION;
+ hdr.config_size = sizeof(spu_config);
+ hdr.state_size = size;
+ hdr.cycles = cycles;
+ fwrite(&hdr, 1, sizeof(hdr), spu_rec.f);
+ fwrite(&spu_config, 1, sizeof(spu_config), spu_rec.f);
+ fwrite(state, 1, size, spu_rec.f);
+ free(state);
+
+ last_config = spu_config;
+ spu_rec.started = 1;
+}
+
+void spu_rec_event(int type, unsigned int cycles, unsigned int a,
+ unsigned int b, const void *data, unsigned int size)
+{
+ struct spu_rec_event ev;
+
+ if (!spu_rec.started) {
+  // need a cycle count for the snapshot and SPUasync always has one
+  if (type != SPU_REC_ASYNC)
+   return;
+  write_header(cycles, 1);
+  if (spu_rec.f == NULL)
+   return;
+ }
+
+ // the frontend may change settings at any time
+ if (type == SPU_REC_ASYNC && memcmp(&last_config, &spu_config, sizeof(spu_config))) {
+  last_config = spu_config;
+  spu_rec_event(SPU_REC_CONFIG, cycles, 0, 0, &last_config, sizeof(last_config));
+ }
+
+ if (type == SPU_REC_XA) {
+  // most of pcm[] is unused
+  const xa_decode_t *xap = data;
+  size = xap->nsamples * (xap->stereo ? 2 : 1) + 16;
+  if (size > sizeof(xap->pcm) / sizeof(xap->pcm[0]))
+   size = sizeof(xap->pcm) / sizeof(xap->pcm[0]);
+  size = offsetof(xa_decode_t, pcm) + size * sizeof(xap->pcm[0]);
+ }
+
+ ev.type = type;
+ ev.cycles = cycles;
+ ev.a = a;
+ ev.b = b;
+ ev.size = size;
+ fwrite(&ev, 1, sizeof(ev), spu_rec.f);
+ if (size)
+  fwrite(data, 1, size, spu_rec.f);
+
+ spu_rec.cycles = cycles;
+}
+
+#endif // NO_OS
+
+// vim:shiftwidth=1:expandtab
@@ -0,0 +1,73 @@
+#ifndef __P_RECORD_H__
+#define __P_RECORD_H__
+
+// recording of everything the emu feeds to the SPU, see test_replay.c
+
+#define SPU_REC_MAGIC   "SPUR"
+#define SPU_REC_VERSION 1
+
+enum spu_rec_type {
+ SPU_REC_WRITE_REG = 1,  // a: reg, b: val
+ SPU_REC_READ_DATA,      // H_SPUdata read, moves spuAddr
+ SPU_REC_WRITE_DMA,      // b: val
+ SPU_REC_READ_DMA,
+ SPU_REC_WRITE_DMA_MEM,  // data: the halfwords
+ SPU_REC_READ_DMA_MEM,   // a: halfword count
+ SPU_REC_ASYNC,          // a: flags
+ SPU_REC_XA,             // data: xa_decode_t up to the last used sample
+ SPU_REC_CDDA,           // data: pcm
+ SPU_REC_LOAD,           // data: SPUfreeze() state
+ SPU_REC_CONFIG,         // data: SPUConfig, when it changes
+ SPU_REC_TYPE_CNT
+};
+
+// file header, followed by SPUConfig and the starting SPUfreeze() state,
+// no state means the recording started right from SPUinit()
+struct spu_rec_header {
+ char magic[4];
+ unsigned int version;
+ unsigned int config_size;
+ unsigned int state_size;
+ unsigned int cycles;
+};
+
+// followed by 'size' bytes of data
+struct spu_rec_event {
+ unsigned int type;
+ unsigned int cycles;    // last seen ones for calls that don't pass them
+ unsigned int a, b;
+ unsigned int size;
+};
+
+struct spu_rec {
+ FILE *f;
+ int started;            // header written
+ int mute;               // inside SPUfreeze() load, don't record nested calls
+ unsigned int cycles;
+};
+
+extern struct spu_rec spu_rec;
+
+#ifndef NO_OS
+
+#define spu_rec_active() \
+ (spu_rec.f != NULL && !spu_rec.mute)
+
+int  spu_rec_start(const char *fname, int from_init);
+void spu_rec_stop(void);
+void spu_rec_event(int type, unsigned int cycles, unsigned int a,
+ unsigned int b, const void *data, unsigned int size);
+
+#else
+
+#define spu_rec_active() 0
+#define spu_rec_stop()
+#define spu_rec_event(type, cycles, a, b, data, size)
+
+#endif
+
+// freeze.c
+void *spu_state_save(unsigned int cycles, unsigned int *size);
+void spu_state_load(void *state, unsigned int size, unsigned int cycles);
+
+#endif /* __P_RECORD_H__ */
@@ -21,6 +21,7 @@
 
 #include "externals.h"
 #include "registers.h"
+#include "record.h"
 #include "spu_config.h"
 
 static void SoundOn(int start,int end,unsigned short val);
@@ -49,6 +50,10 @@ void CALLBACK SPUwriteRegister(unsigned long reg, unsigned short val,
  int r = reg & 0xfff;
  int rofs = (r - 0xc00) >> 1;
  int changed = spu.regArea[rofs] != val;
+
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_WRITE_REG, cycles, reg, val, NULL, 0);
+
  spu.regArea[rofs] = val;
 
  if (!changed && (ignore_dupe[rofs >> 5] & (1 << (rofs & 0x1f))))
@@ -127,6 +132,7 @@ void CALLBACK SPUwriteRegister(unsigned long reg, unsigned short val,
     //-------------------------------------------------//
     case H_SPUdata:
       *(unsigned short *)(spu.spuMemC + spu.spuAddr) = val;
+      adpcm_cache_invalidate(spu.spuAddr, 2);
       spu.spuAddr += 2;
       spu.spuAddr &= 0x7fffe;
       break;
@@ -323,6 +329,8 @@ unsigned short CALLBACK SPUreadRegister(unsigned long reg)
     case H_SPUdata:
      {
       unsigned short s = *(unsigned short *)(spu.spuMemC + spu.spuAddr);
+      if (spu_rec_active())
+       spu_rec_event(SPU_REC_READ_DATA, spu_rec.cycles, 0, 0, NULL, 0);
       spu.spuAddr += 2;
       spu.spuAddr &= 0x7fffe;
       return s;
@@ -156,5 +156,6 @@
 ///////////////////////////////////////////////////////////
 
 void CALLBACK SPUwriteRegister(unsigned long reg, unsigned short val, unsigned int cycles);
+unsigned short CALLBACK SPUreadRegister(unsigned long reg);
 
 #endif /* __P_REGISTERS_H__ */
@@ -48,129 +48,425 @@ INLINE int rvb2ram_offs(int curr, int space, int iOff)
  return iOff;
 }
 
-// get_buffer content helper: takes care about wraps
-#define g_buffer(var) \
- ((int)(signed short)spu.spuMem[rvb2ram_offs(curr_addr, space, rvb->var)])
+// reverb buffer tap pointers for a run of samples where none of them
+// (nor the work address) wraps, so they can be simply indexed
+struct rvb_span {
+ const short *iir_src[4];    // A0 A1 B0 B1
+ const short *iir_dest[4];
+ short *iir_dest1[4];        // IIR_DEST + 1 sample, written
+ const short *acc_src[8];    // A0 A1 B0 B1 C0 C1 D0 D1
+ const short *fb_src[4];     // A0 A1 B0 B1
+ short *mix_dest[4];
+};
+
+// resolve all taps for curr_addr, returns how many of count
+// samples can be done before one of them has to wrap
+static int rvb_span_prep(struct rvb_span *s, int curr_addr, int count,
+ int full)
+{
+ const REVERBInfo *rvb = spu.rvb;
+ short *mem = (short *)spu.spuMem;
+ int space = 0x40000 - rvb->StartAddr;
+ int n = 0x40000 - curr_addr;
+ int a;
+
+ if (n > count)
+  n = count;
+
+ #define tap(p, var, add) \
+  a = rvb2ram_offs(curr_addr, space, rvb->var + add); \
+  if (0x40000 - a < n) \
+   n = 0x40000 - a; \
+  s->p = mem + a
+
+ tap(mix_dest[0], MIX_DEST_A0, 0);
+ tap(mix_dest[1], MIX_DEST_A1, 0);
+ tap(mix_dest[2], MIX_DEST_B0, 0);
+ tap(mix_dest[3], MIX_DEST_B1, 0);
+ if (full) {
+  tap(iir_src[0], IIR_SRC_A0, 0);
+  tap(iir_src[1], IIR_SRC_A1, 0);
+  tap(iir_src[2], IIR_SRC_B0, 0);
+  tap(iir_src[3], IIR_SRC_B1, 0);
+  tap(iir_dest[0], IIR_DEST_A0, 0);
+  tap(iir_dest[1], IIR_DEST_A1, 0);
+  tap(iir_dest[2], IIR_DEST_B0, 0);
+  tap(iir_dest[3], IIR_DEST_B1, 0);
+  tap(iir_dest1[0], IIR_DEST_A0, 1);
+  tap(iir_dest1[1], IIR_DEST_A1, 1);
+  tap(iir_dest1[2], IIR_DEST_B0, 1);
+  tap(iir_dest1[3], IIR_DEST_B1, 1);
+  tap(acc_src[0], ACC_SRC_A0, 0);
+  tap(acc_src[1], ACC_SRC_A1, 0);
+  tap(acc_src[2], ACC_SRC_B0, 0);
+  tap(acc_src[3], ACC_SRC_B1, 0);
+  tap(acc_src[4], ACC_SRC_C0, 0);
+  tap(acc_src[5], ACC_SRC_C1, 0);
+  tap(acc_src[6], ACC_SRC_D0, 0);
+  tap(acc_src[7], ACC_SRC_D1, 0);
+  tap(fb_src[0], FB_SRC_A0, 0);
+  tap(fb_src[1], FB_SRC_A1, 0);
+  tap(fb_src[2], FB_SRC_B0, 0);
+  tap(fb_src[3], FB_SRC_B1, 0);
+ }
+ #undef tap
 
-// saturate iVal and store it as var
-#define s_buffer(var, iVal) \
- ssat32_to_16(iVal); \
- spu.spuMem[rvb2ram_offs(curr_addr, space, rvb->var)] = iVal
+ return n;
+}
 
-#define s_buffer1(var, iVal) \
- ssat32_to_16(iVal); \
- spu.spuMem[rvb2ram_offs(curr_addr, space, rvb->var + 1)] = iVal
+INLINE int rvb_span_next(int curr_addr, int n)
+{
+ curr_addr += n;
+ if (curr_addr >= 0x40000) curr_addr = spu.rvb->StartAddr;
+ return curr_addr;
+}
 
-////////////////////////////////////////////////////////////////////////
+// saturate iVal and store it to the tap
+#define s_buffer(p, iVal) \
+ ssat32_to_16(iVal); \
+ s->p[i] = iVal
 
 // portions based on spu2-x from PCSX2
-static void MixREVERB(int *SSumLR, int *RVB, int ns_to, int curr_addr)
+
+// IIR stage of sample i, each sample reads back what the previous
+// one wrote to IIR_DEST + 1, so this has to be done strictly in order
+INLINE void rvb_iir(const REVERBInfo *rvb, const struct rvb_span *s,
+ const int *RVB, int i)
 {
- const REVERBInfo *rvb = spu.rvb;
  int IIR_ALPHA = rvb->IIR_ALPHA;
  int IIR_COEF = rvb->IIR_COEF;
- int space = 0x40000 - rvb->StartAddr;
- int l, r, ns;
 
- for (ns = 0; ns < ns_to * 2; )
+ int input_L = RVB[i*4]   * rvb->IN_COEF_L;
+ int input_R = RVB[i*4+1] * rvb->IN_COEF_R;
+
+ int IIR_INPUT_A0 = ((s->iir_src[0][i] * IIR_COEF) + input_L) >> 15;
+ int IIR_INPUT_A1 = ((s->iir_src[1][i] * IIR_COEF) + input_R) >> 15;
+ int IIR_INPUT_B0 = ((s->iir_src[2][i] * IIR_COEF) + input_L) >> 15;
+ int IIR_INPUT_B1 = ((s->iir_src[3][i] * IIR_COEF) + input_R) >> 15;
+
+ int iir_dest_a0 = s->iir_dest[0][i];
+ int iir_dest_a1 = s->iir_dest[1][i];
+ int iir_dest_b0 = s->iir_dest[2][i];
+ int iir_dest_b1 = s->iir_dest[3][i];
+
+ int IIR_A0 = iir_dest_a0 + ((IIR_INPUT_A0 - iir_dest_a0) * IIR_ALPHA >> 15);
+ int IIR_A1 = iir_dest_a1 + ((IIR_INPUT_A1 - iir_dest_a1) * IIR_ALPHA >> 15);
+ int IIR_B0 = iir_dest_b0 + ((IIR_INPUT_B0 - iir_dest_b0) * IIR_ALPHA >> 15);
+ int IIR_B1 = iir_dest_b1 + ((IIR_INPUT_B1 - iir_dest_b1) * IIR_ALPHA >> 15);
+
+ preload(RVB + i*4 + 64*2/4 - 4);
+
+ s_buffer(iir_dest1[0], IIR_A0);
+ s_buffer(iir_dest1[1], IIR_A1);
+ s_buffer(iir_dest1[2], IIR_B0);
+ s_buffer(iir_dest1[3], IIR_B1);
+}
+
+// ACC/FB stage of sample i, writes MIX_DEST and mixes the result
+INLINE void rvb_mix(const REVERBInfo *rvb, const struct rvb_span *s,
+ int *SSumLR, int i)
+{
+ int ACC0, ACC1, FB_A0, FB_A1, FB_B0, FB_B1;
+ int mix_dest_a0, mix_dest_a1, mix_dest_b0, mix_dest_b1;
+ int l, r;
+
+ preload(SSumLR + i*4 + 64*2/4 - 4);
+
+ ACC0 = (s->acc_src[0][i] * rvb->ACC_COEF_A +
+         s->acc_src[2][i] * rvb->ACC_COEF_B +
+         s->acc_src[4][i] * rvb->ACC_COEF_C +
+         s->acc_src[6][i] * rvb->ACC_COEF_D) >> 15;
+ ACC1 = (s->acc_src[1][i] * rvb->ACC_COEF_A +
+         s->acc_src[3][i] * rvb->ACC_COEF_B +
+         s->acc_src[5][i] * rvb->ACC_COEF_C +
+         s->acc_src[7][i] * rvb->ACC_COEF_D) >> 15;
+
+ FB_A0 = s->fb_src[0][i];
+ FB_A1 = s->fb_src[1][i];
+ FB_B0 = s->fb_src[2][i];
+ FB_B1 = s->fb_src[3][i];
+
+ mix_dest_a0 = ACC0 - ((FB_A0 * rvb->FB_ALPHA) >> 15);
+ mix_dest_a1 = ACC1 - ((FB_A1 * rvb->FB_ALPHA) >> 15);
+
+ mix_dest_b0 = FB_A0 + (((ACC0 - FB_A0) * rvb->FB_ALPHA - FB_B0 * rvb->FB_X) >> 15);
+ mix_dest_b1 = FB_A1 + (((ACC1 - FB_A1) * rvb->FB_ALPHA - FB_B1 * rvb->FB_X) >> 15);
+
+ s_buffer(mix_dest[0], mix_dest_a0);
+ s_buffer(mix_dest[1], mix_dest_a1);
+ s_buffer(mix_dest[2], mix_dest_b0);
+ s_buffer(mix_dest[3], mix_dest_b1);
+
+ l = (mix_dest_a0 + mix_dest_b0) / 2;
+ r = (mix_dest_a1 + mix_dest_b1) / 2;
+
+ l = (l * rvb->VolLeft)  >> 15; // 15?
+ r = (r * rvb->VolRight) >> 15;
+
+ SSumLR[i*4]   += l;
+ SSumLR[i*4+1] += r;
+ SSumLR[i*4+2] += l;
+ SSumLR[i*4+3] += r;
+}
+
+#undef s_buffer
+
+static void MixREVERB(int *SSumLR, int *RVB, int ns_to, int curr_addr)
+{
+ const REVERBInfo *rvb = spu.rvb;
+ int count = (ns_to + 1) / 2;
+ struct rvb_span s;
+ int i, n;
+
+ for (; count > 0; count -= n, SSumLR += n * 4, RVB += n * 4)
   {
-   int ACC0, ACC1, FB_A0, FB_A1, FB_B0, FB_B1;
-   int mix_dest_a0, mix_dest_a1, mix_dest_b0, mix_dest_b1;
-
-   int input_L = RVB[ns]   * rvb->IN_COEF_L;
-   int input_R = RVB[ns+1] * rvb->IN_COEF_R;
-
-   int IIR_INPUT_A0 = ((g_buffer(IIR_SRC_A0) * IIR_COEF) + input_L) >> 15;
-   int IIR_INPUT_A1 = ((g_buffer(IIR_SRC_A1) * IIR_COEF) + input_R) >> 15;
-   int IIR_INPUT_B0 = ((g_buffer(IIR_SRC_B0) * IIR_COEF) + input_L) >> 15;
-   int IIR_INPUT_B1 = ((g_buffer(IIR_SRC_B1) * IIR_COEF) + input_R) >> 15;
-
-   int iir_dest_a0 = g_buffer(IIR_DEST_A0);
-   int iir_dest_a1 = g_buffer(IIR_DEST_A1);
-   int iir_dest_b0 = g_buffer(IIR_DEST_B0);
-   int iir_dest_b1 = g_buffer(IIR_DEST_B1);
-
-   int IIR_A0 = iir_dest_a0 + ((IIR_INPUT_A0 - iir_dest_a0) * IIR_ALPHA >> 15);
-   int IIR_A1 = iir_dest_a1 + ((IIR_INPUT_A1 - iir_dest_a1) * IIR_ALPHA >> 15);
-   int IIR_B0 = iir_dest_b0 + ((IIR_INPUT_B0 - iir_dest_b0) * IIR_ALPHA >> 15);
-   int IIR_B1 = iir_dest_b1 + ((IIR_INPUT_B1 - iir_dest_b1) * IIR_ALPHA >> 15);
-
-   preload(SSumLR + ns + 64*2/4 - 4);
-
-   s_buffer1(IIR_DEST_A0, IIR_A0);
-   s_buffer1(IIR_DEST_A1, IIR_A1);
-   s_buffer1(IIR_DEST_B0, IIR_B0);
-   s_buffer1(IIR_DEST_B1, IIR_B1);
-
-   preload(RVB + ns + 64*2/4 - 4);
-
-   ACC0 = (g_buffer(ACC_SRC_A0) * rvb->ACC_COEF_A +
-           g_buffer(ACC_SRC_B0) * rvb->ACC_COEF_B +
-           g_buffer(ACC_SRC_C0) * rvb->ACC_COEF_C +
-           g_buffer(ACC_SRC_D0) * rvb->ACC_COEF_D) >> 15;
-   ACC1 = (g_buffer(ACC_SRC_A1) * rvb->ACC_COEF_A +
-           g_buffer(ACC_SRC_B1) * rvb->ACC_COEF_B +
-           g_buffer(ACC_SRC_C1) * rvb->ACC_COEF_C +
-           g_buffer(ACC_SRC_D1) * rvb->ACC_COEF_D) >> 15;
-
-   FB_A0 = g_buffer(FB_SRC_A0);
-   FB_A1 = g_buffer(FB_SRC_A1);
-   FB_B0 = g_buffer(FB_SRC_B0);
-   FB_B1 = g_buffer(FB_SRC_B1);
-
-   mix_dest_a0 = ACC0 - ((FB_A0 * rvb->FB_ALPHA) >> 15);
-   mix_dest_a1 = ACC1 - ((FB_A1 * rvb->FB_ALPHA) >> 15);
-
-   mix_dest_b0 = FB_A0 + (((ACC0 - FB_A0) * rvb->FB_ALPHA - FB_B0 * rvb->FB_X) >> 15);
-   mix_dest_b1 = FB_A1 + (((ACC1 - FB_A1) * rvb->FB_ALPHA - FB_B1 * rvb->FB_X) >> 15);
-
-   s_buffer(MIX_DEST_A0, mix_dest_a0);
-   s_buffer(MIX_DEST_A1, mix_dest_a1);
-   s_buffer(MIX_DEST_B0, mix_dest_b0);
-   s_buffer(MIX_DEST_B1, mix_dest_b1);
-
-   l = (mix_dest_a0 + mix_dest_b0) / 2;
-   r = (mix_dest_a1 + mix_dest_b1) / 2;
-
-   l = (l * rvb->VolLeft)  >> 15; // 15?
-   r = (r * rvb->VolRight) >> 15;
-
-   SSumLR[ns++] += l;
-   SSumLR[ns++] += r;
-   SSumLR[ns++] += l;
-   SSumLR[ns++] += r;
-
-   curr_addr++;
-   if (curr_addr >= 0x40000) curr_addr = rvb->StartAddr;
+   n = rvb_span_prep(&s, curr_addr, count, 1);
+   curr_addr = rvb_span_next(curr_addr, n);
+
+   for (i = 0; i < n; i++)
+    {
+     rvb_iir(rvb, &s, RVB, i);
+     rvb_mix(rvb, &s, SSumLR, i);
+    }
   }
 }
 
 static void MixREVERB_off(int *SSumLR, int ns_to, int curr_addr)
 {
  const REVERBInfo *rvb = spu.rvb;
- int space = 0x40000 - rvb->StartAddr;
- int l, r, ns;
+ int count = (ns_to + 1) / 2;
+ struct rvb_span s;
+ int l, r, i, n;
 
- for (ns = 0; ns < ns_to * 2; )
+ for (; count > 0; count -= n, SSumLR += n * 4)
   {
-   preload(SSumLR + ns + 64*2/4 - 4);
+   n = rvb_span_prep(&s, curr_addr, count, 0);
+   curr_addr = rvb_span_next(curr_addr, n);
 
-   l = (g_buffer(MIX_DEST_A0) + g_buffer(MIX_DEST_B0)) / 2;
-   r = (g_buffer(MIX_DEST_A1) + g_buffer(MIX_DEST_B1)) / 2;
+   for (i = 0; i < n; i++)
+    {
+     preload(SSumLR + i*4 + 64*2/4 - 4);
 
-   l = (l * rvb->VolLeft)  >> 15;
-   r = (r * rvb->VolRight) >> 15;
+     l = (s.mix_dest[0][i] + s.mix_dest[2][i]) / 2;
+     r = (s.mix_dest[1][i] + s.mix_dest[3][i]) / 2;
 
-   SSumLR[ns++] += l;
-   SSumLR[ns++] += r;
-   SSumLR[ns++] += l;
-   SSumLR[ns++] += r;
+     l = (l * rvb->VolLeft)  >> 15;
+     r = (r * rvb->VolRight) >> 15;
 
-   curr_addr++;
-   if (curr_addr >= 0x40000) curr_addr = rvb->StartAddr;
+     SSumLR[i*4]   += l;
+     SSumLR[i*4+1] += r;
+     SSumLR[i*4+2] += l;
+     SSumLR[i*4+3] += r;
+    }
   }
 }
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+// Batched MixREVERB(): first the IIR stage for up to rvb->batch samples,
+// one sample per iteration with the A0 A1 B0 B1 lanes in a vector, then
+// the ACC/FB stage for 4 samples per iteration straight from the taps.
+static inline int32x4_t rvb_gather4(const short * const *p, int i)
+{
+ int32x4_t v = vdupq_n_s32(p[0][i]);
+ v = vsetq_lane_s32(p[1][i], v, 1);
+ v = vsetq_lane_s32(p[2][i], v, 2);
+ v = vsetq_lane_s32(p[3][i], v, 3);
+ return v;
+}
+
+static inline int32x4_t rvb_vec4(int a, int b, int c, int d)
+{
+ int v[4] = { a, b, c, d };
+ return vld1q_s32(v);
+}
+
+static void MixREVERB_neon(int *SSumLR, int *RVB, int ns_to, int curr_addr)
+{
+ const REVERBInfo *rvb = spu.rvb;
+ const int32x4_t in_coef = rvb_vec4(rvb->IN_COEF_L, rvb->IN_COEF_R,
+                                    rvb->IN_COEF_L, rvb->IN_COEF_R);
+ const int32x4_t iir_coef = vdupq_n_s32(rvb->IIR_COEF);
+ const int32x4_t iir_alpha = vdupq_n_s32(rvb->IIR_ALPHA);
+ const int32x4_t fb_alpha = vdupq_n_s32(rvb->FB_ALPHA);
+ const int32x4_t vol_l = vdupq_n_s32(rvb->VolLeft);
+ const int32x4_t vol_r = vdupq_n_s32(rvb->VolRight);
+ int count = (ns_to + 1) / 2;
+ struct rvb_span s;
+ int i, n;
+
+ if (rvb->batch < 4) {
+  MixREVERB(SSumLR, RVB, ns_to, curr_addr);
+  return;
+ }
+
+ for (; count > 0; count -= n, SSumLR += n * 4, RVB += n * 4)
+  {
+   n = rvb_span_prep(&s, curr_addr,
+         count < rvb->batch ? count : rvb->batch, 1);
+   curr_addr = rvb_span_next(curr_addr, n);
+
+   for (i = 0; i < n; i++)
+    {
+     int32x4_t in, src, dest, iir;
+     int32x2_t rv;
+     int16x4_t out;
+
+     rv = vld1_s32(&RVB[i*4]);
+     in = vmulq_s32(vcombine_s32(rv, rv), in_coef);
+     src = rvb_gather4(s.iir_src, i);
+     dest = rvb_gather4(s.iir_dest, i);
+     iir = vshrq_n_s32(vmlaq_s32(in, src, iir_coef), 15);
+     iir = vaddq_s32(dest,
+             vshrq_n_s32(vmulq_s32(vsubq_s32(iir, dest), iir_alpha), 15));
+     out = vqmovn_s32(iir);
+     s.iir_dest1[0][i] = vget_lane_s16(out, 0);
+     s.iir_dest1[1][i] = vget_lane_s16(out, 1);
+     s.iir_dest1[2][i] = vget_lane_s16(out, 2);
+     s.iir_dest1[3][i] = vget_lane_s16(out, 3);
+    }
+
+   for (i = 0; i + 4 <= n; i += 4)
+    {
+     int16x4_t fa0, fa1, fb0, fb1, ma0, ma1, mb0, mb1;
+     int32x4_t acc0, acc1, m0, m1, l, r;
+     int32x4x2_t lr;
+
+     #define ld4(p) vld1_s16(&(p)[i])
+     acc0 = vmull_n_s16(ld4(s.acc_src[0]), rvb->ACC_COEF_A);
+     acc0 = vmlal_n_s16(acc0, ld4(s.acc_src[2]), rvb->ACC_COEF_B);
+     acc0 = vmlal_n_s16(acc0, ld4(s.acc_src[4]), rvb->ACC_COEF_C);
+     acc0 = vmlal_n_s16(acc0, ld4(s.acc_src[6]), rvb->ACC_COEF_D);
+     acc0 = vshrq_n_s32(acc0, 15);
+     acc1 = vmull_n_s16(ld4(s.acc_src[1]), rvb->ACC_COEF_A);
+     acc1 = vmlal_n_s16(acc1, ld4(s.acc_src[3]), rvb->ACC_COEF_B);
+     acc1 = vmlal_n_s16(acc1, ld4(s.acc_src[5]), rvb->ACC_COEF_C);
+     acc1 = vmlal_n_s16(acc1, ld4(s.acc_src[7]), rvb->ACC_COEF_D);
+     acc1 = vshrq_n_s32(acc1, 15);
+     fa0 = ld4(s.fb_src[0]);
+     fa1 = ld4(s.fb_src[1]);
+     fb0 = ld4(s.fb_src[2]);
+     fb1 = ld4(s.fb_src[3]);
+     #undef ld4
+
+     m0 = vsubq_s32(acc0, vshrq_n_s32(vmull_n_s16(fa0, rvb->FB_ALPHA), 15));
+     m1 = vsubq_s32(acc1, vshrq_n_s32(vmull_n_s16(fa1, rvb->FB_ALPHA), 15));
+     ma0 = vqmovn_s32(m0);
+     ma1 = vqmovn_s32(m1);
+     m0 = vmulq_s32(vsubq_s32(acc0, vmovl_s16(fa0)), fb_alpha);
+     m1 = vmulq_s32(vsubq_s32(acc1, vmovl_s16(fa1)), fb_alpha);
+     m0 = vshrq_n_s32(vsubq_s32(m0, vmull_n_s16(fb0, rvb->FB_X)), 15);
+     m1 = vshrq_n_s32(vsubq_s32(m1, vmull_n_s16(fb1, rvb->FB_X)), 15);
+     mb0 = vqmovn_s32(vaddw_s16(m0, fa0));
+     mb1 = vqmovn_s32(vaddw_s16(m1, fa1));
+     vst1_s16(&s.mix_dest[0][i], ma0);
+     vst1_s16(&s.mix_dest[1][i], ma1);
+     vst1_s16(&s.mix_dest[2][i], mb0);
+     vst1_s16(&s.mix_dest[3][i], mb1);
+
+     // (a + b) / 2, rounding towards 0 like C
+     l = vaddl_s16(ma0, mb0);
+     r = vaddl_s16(ma1, mb1);
+     l = vshrq_n_s32(vaddq_s32(l, vreinterpretq_s32_u32(
+           vshrq_n_u32(vreinterpretq_u32_s32(l), 31))), 1);
+     r = vshrq_n_s32(vaddq_s32(r, vreinterpretq_s32_u32(
+           vshrq_n_u32(vreinterpretq_u32_s32(r), 31))), 1);
+     l = vshrq_n_s32(vmulq_s32(l, vol_l), 15);
+     r = vshrq_n_s32(vmulq_s32(r, vol_r), 15);
+
+     lr = vzipq_s32(l, r);
+     #define mix2(o, v) \
+      vst1q_s32(&SSumLR[(i+o)*4], vaddq_s32(vld1q_s32(&SSumLR[(i+o)*4]), \
+        vcombine_s32(v, v)))
+     mix2(0, vget_low_s32(lr.val[0]));
+     mix2(1, vget_high_s32(lr.val[0]));
+     mix2(2, vget_low_s32(lr.val[1]));
+     mix2(3, vget_high_s32(lr.val[1]));
+     #undef mix2
+    }
+   for (; i < n; i++)
+    rvb_mix(rvb, &s, SSumLR, i);
+  }
+}
+
+#define MixREVERB_p MixREVERB_neon
+
+#elif defined(HAVE_SPU_X86)
+// may be replaced by a SIMD version, see init_spu_x86()
+static void (*MixREVERB_p)(int *SSumLR, int *RVB, int ns_to,
+ int curr_addr) = MixREVERB;
+#else
+#define MixREVERB_p MixREVERB
+#endif
+
+// distance from tap b forward to tap a, in samples
+static int rvb_tap_dist(int a, int b, int space)
+{
+ int d = (a - b) % space;
+ if (d < 0)
+  d += space;
+ return d ? d : space;
+}
+
+// The batched versions of MixREVERB do the IIR stage of several samples
+// before the ACC/FB stage of any of them, and the latter in groups of 4.
+// Find how many samples can be done like that without changing the
+// order in which any buffer location is written and read back.
+static void REVERBPrepBatch(REVERBInfo *rvb)
+{
+ const int iir_rd[8] = {
+  rvb->IIR_SRC_A0, rvb->IIR_SRC_A1, rvb->IIR_SRC_B0, rvb->IIR_SRC_B1,
+  rvb->IIR_DEST_A0, rvb->IIR_DEST_A1, rvb->IIR_DEST_B0, rvb->IIR_DEST_B1,
+ };
+ const int iir_wr[4] = {
+  rvb->IIR_DEST_A0 + 1, rvb->IIR_DEST_A1 + 1,
+  rvb->IIR_DEST_B0 + 1, rvb->IIR_DEST_B1 + 1,
+ };
+ const int mix_rd[12] = {
+  rvb->ACC_SRC_A0, rvb->ACC_SRC_A1, rvb->ACC_SRC_B0, rvb->ACC_SRC_B1,
+  rvb->ACC_SRC_C0, rvb->ACC_SRC_C1, rvb->ACC_SRC_D0, rvb->ACC_SRC_D1,
+  rvb->FB_SRC_A0, rvb->FB_SRC_A1, rvb->FB_SRC_B0, rvb->FB_SRC_B1,
+ };
+ const int mix_wr[4] = {
+  rvb->MIX_DEST_A0, rvb->MIX_DEST_A1, rvb->MIX_DEST_B0, rvb->MIX_DEST_B1,
+ };
+ int space = 0x40000 - rvb->StartAddr;
+ int n = space, i, j, d;
+
+ #define limit(a, b) \
+  d = rvb_tap_dist(a, b, space); \
+  if (d < n) n = d
+
+ for (i = 0; i < 4; i++)
+  {
+   // IIR of a later sample must not read what ACC/FB of an earlier one
+   // writes, nor overwrite it
+   for (j = 0; j < 8; j++) { limit(mix_wr[i], iir_rd[j]); }
+   for (j = 0; j < 4; j++) { limit(mix_wr[i], iir_wr[j]); }
+  }
+ for (i = 0; i < 12; i++)
+  {
+   // ACC/FB must not see IIR output of a later sample
+   for (j = 0; j < 4; j++) { limit(mix_rd[i], iir_wr[j]); }
+  }
+ #undef limit
+
+ // within a group of 4, everything is read before anything is written
+ for (i = 0; i < 4; i++)
+  {
+   for (j = 0; j < 12; j++)
+    if (rvb_tap_dist(mix_wr[i], mix_rd[j], space) < 4)
+     n = 0;
+   for (j = 0; j < 4; j++)
+    if (j != i && rvb_tap_dist(mix_wr[i], mix_wr[j], space) < 4)
+     n = 0;
+  }
+
+ rvb->batch = n;
+}
+
 static void REVERBPrep(void)
 {
  REVERBInfo *rvb = spu.rvb;
@@ -225,6 +521,7 @@ static void REVERBPrep(void)
 
 #undef prep_offs
 #undef prep_offs2
+ REVERBPrepBatch(rvb);
  rvb->dirty = 0;
 }
 
@@ -232,7 +529,7 @@ INLINE void REVERBDo(int *SSumLR, int *RVB, int ns_to, int curr_addr)
 {
  if (spu.spuCtrl & 0x80)                               // -> reverb on? oki
  {
-  MixREVERB(SSumLR, RVB, ns_to, curr_addr);
+  MixREVERB_p(SSumLR, RVB, ns_to, curr_addr);
  }
  else if (spu.rvb->VolLeft || spu.rvb->VolRight)
  {
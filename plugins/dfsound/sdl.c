@@ -17,31 +17,22 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <SDL.h>
 #include "out.h"
 
-#define BUFFER_SIZE		22050
+#define RING_FRAMES		4096
 
-short			*pSndBuffer = NULL;
-int				iBufSize = 0;
-volatile int	iReadPos = 0, iWritePos = 0;
+static struct out_ring ring;
+static int dev_frames;
 
 static void SOUND_FillAudio(void *unused, Uint8 *stream, int len) {
-	short *p = (short *)stream;
+	int got;
 
-	len /= sizeof(short);
-
-	while (iReadPos != iWritePos && len > 0) {
-		*p++ = pSndBuffer[iReadPos++];
-		if (iReadPos >= iBufSize) iReadPos = 0;
-		--len;
-	}
+	got = out_ring_read(&ring, stream, len / 4);
 
 	// Fill remaining space with zero
-	while (len > 0) {
-		*p++ = 0;
-		--len;
-	}
+	memset(stream + got * 4, 0, len - got * 4);
 }
 
 static void InitSDL() {
@@ -63,7 +54,7 @@ static void DestroySDL() {
 static int sdl_init(void) {
 	SDL_AudioSpec				spec;
 
-	if (pSndBuffer != NULL) return -1;
+	if (ring.buf != NULL) return -1;
 
 	InitSDL();
 
@@ -73,64 +64,52 @@ static int sdl_init(void) {
 	spec.samples = 512;
 	spec.callback = SOUND_FillAudio;
 
-	if (SDL_OpenAudio(&spec, NULL) < 0) {
+	if (out_ring_init(&ring, RING_FRAMES) != 0) {
 		DestroySDL();
 		return -1;
 	}
 
-	iBufSize = BUFFER_SIZE;
-
-	pSndBuffer = (short *)malloc(iBufSize * sizeof(short));
-	if (pSndBuffer == NULL) {
-		SDL_CloseAudio();
+	if (SDL_OpenAudio(&spec, NULL) < 0) {
+		out_ring_free(&ring);
+		DestroySDL();
 		return -1;
 	}
 
-	iReadPos = 0;
-	iWritePos = 0;
+	// the device may have picked a different size
+	dev_frames = spec.samples;
+	out_rate_reset();
 
 	SDL_PauseAudio(0);
 	return 0;
 }
 
 static void sdl_finish(void) {
-	if (pSndBuffer == NULL) return;
+	if (ring.buf == NULL) return;
 
 	SDL_CloseAudio();
 	DestroySDL();
 
-	free(pSndBuffer);
-	pSndBuffer = NULL;
+	out_ring_free(&ring);
 }
 
 static int sdl_busy(void) {
-	int size;
-
-	if (pSndBuffer == NULL) return 1;
-
-	size = iReadPos - iWritePos;
-	if (size <= 0) size += iBufSize;
+	if (ring.buf == NULL) return 1;
 
-	if (size < iBufSize / 2) return 1;
+	if (out_ring_used(&ring) > RING_FRAMES / 2) return 1;
 
 	return 0;
 }
 
 static void sdl_feed(void *pSound, int lBytes) {
-	short *p = (short *)pSound;
+	int queued;
 
-	if (pSndBuffer == NULL) return;
+	if (ring.buf == NULL) return;
 
-	while (lBytes > 0) {
-		if (((iWritePos + 1) % iBufSize) == iReadPos) break;
+	// what's in the ring plays after the device's buffer
+	queued = out_ring_used(&ring) + dev_frames;
+	lBytes = out_rate_control(pSound, lBytes, queued, dev_frames * 3, &pSound);
 
-		pSndBuffer[iWritePos] = *p++;
-
-		++iWritePos;
-		if (iWritePos >= iBufSize) iWritePos = 0;
-
-		lBytes -= sizeof(short);
-	}
+	out_ring_write(&ring, pSound, lBytes / 4);
 }
 
 void out_register_sdl(struct out_driver *drv)
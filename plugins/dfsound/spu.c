@@ -30,11 +30,17 @@
 #include "registers.h"
 #include "out.h"
 #include "spu_config.h"
+#include "record.h"
 
 #ifdef __arm__
 #include "arm_features.h"
 #endif
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+ && !defined(C64X_DSP)
+#define HAVE_SPU_X86
+#endif
+
 #ifdef HAVE_ARMV7
  #define ssat32_to_16(v) \
   asm("ssat %0,#16,%1" : "=r" (v) : "r" (v))
@@ -47,8 +53,9 @@
 
 #define PSXCLK	33868800	/* 33.8688 MHz */
 
-// intended to be ~1 frame
-#define IRQ_NEAR_BLOCKS 32
+// irqs are scheduled up to ~1 frame ahead
+#define IRQ_SCHED_WINDOW (44100 / 50)
+#define IRQ_SCHED_NEVER  (1 << 24)
 
 /*
 #if defined (USEMACOSX)
@@ -221,6 +228,25 @@ static int check_irq(int ch, unsigned char *pos)
  return 0;
 }
 
+// per voice prediction of when it reaches pSpuIrq, in samples played,
+// kept in a min-heap so that schedule_next_irq() only has to look at
+// the top and rescan the voices that changed since the last time
+struct irq_pred {
+ unsigned int at;             // irq, or earliest time one is possible
+ unsigned char *loop;         // what the prediction assumed
+ int sinc;
+ unsigned char hit;
+ unsigned char heap_pos;
+};
+
+static struct {
+ unsigned int now;
+ unsigned int dirty;          // voices to rescan
+ unsigned char *irq;
+ unsigned char heap[MAXCHAN];
+ struct irq_pred v[MAXCHAN];
+} irq_sched;
+
 ////////////////////////////////////////////////////////////////////////
 // START SOUND... called by main thread to setup a new sound on a channel
 ////////////////////////////////////////////////////////////////////////
@@ -250,6 +276,7 @@ static void StartSoundMain(int ch)
  spu.dwNewChannel&=~(1<<ch);                           // clear new channel bit
  spu.dwChannelOn|=1<<ch;
  spu.dwChannelDead&=~(1<<ch);
+ irq_sched.dirty|=1<<ch;
 }
 
 static void StartSound(int ch)
@@ -262,12 +289,12 @@ static void StartSound(int ch)
 // ALL KIND OF HELPERS
 ////////////////////////////////////////////////////////////////////////
 
-INLINE int FModChangeFrequency(int *SB, int pitch, int ns)
+INLINE int FModChangeFrequency(int *fmod, int *SB, int pitch, int ns)
 {
  unsigned int NP=pitch;
  int sinc;
 
- NP=((32768L+iFMod[ns])*NP)>>15;
+ NP=((32768L+fmod[ns])*NP)>>15;
 
  if(NP>0x3fff) NP=0x3fff;
  if(NP<0x1)    NP=0x1;
@@ -275,7 +302,7 @@ INLINE int FModChangeFrequency(int *SB, int pitch, int ns)
  sinc=NP<<4;                                           // calc frequency
  if(spu_config.iUseInterpolation==1)                   // freq change in simple interpolation mode
   SB[32]=1;
- iFMod[ns]=0;
+ fmod[ns]=0;
 
  return sinc;
 }                    
@@ -405,12 +432,158 @@ static void decode_block_data(int *dest, const unsigned char *src, int predict_n
  }
 }
 
+#ifdef HAVE_SPU_X86
+// may be replaced by a SIMD version, see init_spu_x86()
+static void (*decode_block_data_p)(int *dest, const unsigned char *src,
+ int predict_nr, int shift_factor) = decode_block_data;
+#else
+#define decode_block_data_p decode_block_data
+#endif
+
+// decoded block cache, direct mapped by SPU RAM block address.
+// External writes to SPU RAM mark blocks in the dirty bitmap (may happen
+// while the worker is decoding), adpcm_cache_sync() drops them later.
+#define ADPCM_CACHE_SIZE 1024
+#define ADPCM_DIRTY_WORDS (0x80000 / 16 / 32)
+
+struct adpcm_cache_entry {
+ int block;                                // SPU RAM offset / 16, -1: empty
+ int s_1, s_2;                             // history it was decoded with
+ int data[28];
+};
+
+struct adpcm_cache {
+ unsigned int dirty[ADPCM_DIRTY_WORDS];
+ unsigned int dirty_any;
+ int rvb_start;                            // reverb work area, not cached
+ unsigned int hits, misses;
+ struct adpcm_cache_entry e[ADPCM_CACHE_SIZE];
+};
+
+static struct adpcm_cache *adpcm_cache;
+
+#ifdef THREAD_ENABLED
+#define adpcm_dirty_or(p, v)  __atomic_fetch_or(p, v, __ATOMIC_RELEASE)
+#define adpcm_dirty_xchg(p)   __atomic_exchange_n(p, 0, __ATOMIC_ACQUIRE)
+#else
+#define adpcm_dirty_or(p, v)  *(p) |= (v)
+static unsigned int adpcm_dirty_xchg(unsigned int *p)
+{
+ unsigned int v = *p;
+ *p = 0;
+ return v;
+}
+#endif
+
+// called by everything that writes SPU RAM except the SPU itself
+void adpcm_cache_invalidate(unsigned int addr, unsigned int size)
+{
+ struct adpcm_cache *c = adpcm_cache;
+ unsigned int b, end, lo, n, m;
+
+ irq_sched.dirty = ~0;                   // block flags may have changed
+
+ if (c == NULL || size == 0)
+  return;
+ if (size > 0x80000)
+  size = 0x80000;
+
+ b = (addr & 0x7ffff) >> 4;
+ end = ((addr & 0x7ffff) + size + 15) >> 4;  // may go past the end, wraps
+ while (b < end) {
+  lo = b & 31;
+  n = end - b;
+  m = n >= 32 - lo ? ~0u << lo : ((1u << n) - 1) << lo;
+  adpcm_dirty_or(&c->dirty[(b >> 5) % ADPCM_DIRTY_WORDS], m);
+  b += 32 - lo;
+ }
+ adpcm_dirty_or(&c->dirty_any, 1);
+}
+
+// drop the blocks written since the last call,
+// only to be called when nothing can be decoding
+static void adpcm_cache_sync(void)
+{
+ struct adpcm_cache *c = adpcm_cache;
+ unsigned int i, j, m;
+ int rvb_start;
+
+ if (c == NULL)
+  return;
+
+ rvb_start = spu.rvb->StartAddr ? spu.rvb->StartAddr * 2 : 0x80000;
+ if (rvb_start < c->rvb_start) {
+  // reverb doesn't go through the bitmap, forget what it may overwrite
+  for (i = 0; i < ADPCM_CACHE_SIZE; i++)
+   if (c->e[i].block >= rvb_start >> 4)
+    c->e[i].block = -1;
+ }
+ c->rvb_start = rvb_start;
+
+ if (!adpcm_dirty_xchg(&c->dirty_any))
+  return;
+
+ for (i = 0; i < ADPCM_DIRTY_WORDS; i++) {
+  if (c->dirty[i] == 0)
+   continue;
+  m = adpcm_dirty_xchg(&c->dirty[i]);
+  for (j = 0; m != 0; j++, m >>= 1) {
+   int block = i * 32 + j;
+   if ((m & 1) && c->e[block % ADPCM_CACHE_SIZE].block == block)
+    c->e[block % ADPCM_CACHE_SIZE].block = -1;
+  }
+ }
+}
+
+static void adpcm_cache_init(void)
+{
+ int i;
+
+ adpcm_cache = calloc(1, sizeof(*adpcm_cache));
+ if (adpcm_cache == NULL)
+  return;
+ adpcm_cache->rvb_start = 0x80000;
+ for (i = 0; i < ADPCM_CACHE_SIZE; i++)
+  adpcm_cache->e[i].block = -1;
+}
+
+// decode the block at SPU RAM offset 'start', the result is reused as long
+// as the block isn't written and is played with the same predictor history
+static void decode_block_cached(struct adpcm_cache *c, int *dest, int start)
+{
+ const unsigned char *src = spu.spuMemC + start;
+ int predict_nr = src[0] >> 4, shift_factor = src[0] & 0xf;
+ struct adpcm_cache_entry *e;
+ int s_1 = dest[27], s_2 = dest[26];
+
+ // the capture buffers at 0-0xfff are written by the SPU itself
+ if (c == NULL || start < 0x1000 || start >= c->rvb_start) {
+  decode_block_data_p(dest, src + 2, predict_nr, shift_factor);
+  return;
+ }
+
+ e = &c->e[(start >> 4) % ADPCM_CACHE_SIZE];
+ // filters 0 and 5-15 don't use the history
+ if (e->block == start >> 4 && ((unsigned int)predict_nr - 1 >= 4
+     || (e->s_1 == s_1 && e->s_2 == s_2))) {
+  memcpy(dest, e->data, sizeof(e->data));
+  c->hits++;
+  return;
+ }
+
+ decode_block_data_p(dest, src + 2, predict_nr, shift_factor);
+ memcpy(e->data, dest, sizeof(e->data));
+ e->block = start >> 4;
+ e->s_1 = s_1;
+ e->s_2 = s_2;
+ c->misses++;
+}
+
 static int decode_block(void *unused, int ch, int *SB)
 {
  SPUCHAN *s_chan = &spu.s_chan[ch];
  unsigned char *start;
- int predict_nr, shift_factor, flags;
- int ret = 0;
+ int flags, ret = 0;
 
  start = s_chan->pCurr;                    // set up the current pos
  if (start == spu.spuMemC)                 // ?
@@ -426,11 +599,7 @@ static int decode_block(void *unused, int ch, int *SB)
  else
   check_irq(ch, start);                    // hack, see check_irq below..
 
- predict_nr = start[0];
- shift_factor = predict_nr & 0xf;
- predict_nr >>= 4;
-
- decode_block_data(SB, start + 2, predict_nr, shift_factor);
+ decode_block_cached(adpcm_cache, SB, start - spu.spuMemC);
 
  flags = start[1];
  if (flags & 4)
@@ -527,10 +696,117 @@ static void scan_for_irq(int ch, unsigned int *upd_samples)
  }
 }
 
+static int irq_heap_less(int a, int b)
+{
+ return (int)(irq_sched.v[a].at - irq_sched.v[b].at) < 0;
+}
+
+static void irq_heap_fix(int i)
+{
+ unsigned char *heap = irq_sched.heap;
+ int ch = heap[i], c;
+
+ while (i > 0 && irq_heap_less(ch, heap[(i - 1) / 2]))
+ {
+  heap[i] = heap[(i - 1) / 2];
+  irq_sched.v[heap[i]].heap_pos = i;
+  i = (i - 1) / 2;
+ }
+ for (;;)
+ {
+  c = i * 2 + 1;
+  if (c >= MAXCHAN)
+   break;
+  if (c + 1 < MAXCHAN && irq_heap_less(heap[c + 1], heap[c]))
+   c++;
+  if (!irq_heap_less(heap[c], ch))
+   break;
+  heap[i] = heap[c];
+  irq_sched.v[heap[i]].heap_pos = i;
+  i = c;
+ }
+ heap[i] = ch;
+ irq_sched.v[ch].heap_pos = i;
+}
+
+static void irq_sched_reset(void)
+{
+ int ch;
+
+ for (ch = 0; ch < MAXCHAN; ch++)
+ {
+  irq_sched.heap[ch] = ch;
+  irq_sched.v[ch].heap_pos = ch;
+  irq_sched.v[ch].at = irq_sched.now;
+ }
+ irq_sched.dirty = ~0;
+}
+
+static void irq_sched_scan(int ch)
+{
+ SPUCHAN *s_chan = &spu.s_chan[ch];
+ struct irq_pred *p = &irq_sched.v[ch];
+ unsigned int samples = IRQ_SCHED_NEVER;
+ unsigned long dc, dl, d;
+ uint64_t lb;
+
+ p->loop = s_chan->pLoop;
+ p->sinc = s_chan->sinc;
+ p->hit = 0;
+
+ // only moves forward, or back to pLoop
+ dc = spu.pSpuIrq - s_chan->pCurr;
+ dl = spu.pSpuIrq - s_chan->pLoop;
+ d = dc < dl ? dc : dl;
+ if (!(spu.dwChannelDead & (1 << ch)) && s_chan->sinc > 0 && d < 0x80000)
+ {
+  // can't get there without going through all the blocks in between
+  lb = d >= 32 ? ((uint64_t)(d / 16 - 1) * 28 << 16) / s_chan->sinc : 0;
+  if (lb >= IRQ_SCHED_WINDOW)
+   samples = lb < IRQ_SCHED_NEVER ? lb : IRQ_SCHED_NEVER;
+  else
+  {
+   samples = IRQ_SCHED_WINDOW;
+   scan_for_irq(ch, &samples);
+   p->hit = samples < IRQ_SCHED_WINDOW;
+   if (p->hit && samples > 1)
+    samples--;                   // err on the early side, sinc_inv rounds
+  }
+ }
+
+ p->at = irq_sched.now + samples;
+ irq_heap_fix(p->heap_pos);
+}
+
+static void irq_sched_update(void)
+{
+ unsigned int dirty = irq_sched.dirty | spu.dwNewChannel;
+ SPUCHAN *s_chan;
+ int ch;
+
+ if (irq_sched.irq != spu.pSpuIrq)
+ {
+  irq_sched.irq = spu.pSpuIrq;
+  dirty = ~0;
+ }
+ irq_sched.dirty = 0;
+
+ // pitch/loop writes, loop flags and fmod (changes pitch all the time)
+ for (ch = 0; ch < MAXCHAN; ch++)
+ {
+  s_chan = &spu.s_chan[ch];
+  if ((dirty & (1 << ch)) || s_chan->bFMod == 1
+      || irq_sched.v[ch].loop != s_chan->pLoop
+      || irq_sched.v[ch].sinc != s_chan->sinc)
+   irq_sched_scan(ch);
+ }
+}
+
 #define make_do_samples(name, fmod_code, interp_start, interp1_code, interp2_code, interp_end) \
 static noinline int do_samples_##name( \
  int (*decode_f)(void *context, int ch, int *SB), void *ctx, \
- int ch, int ns_to, int *SB, int sinc, int *spos, int *sbpos) \
+ int ch, int ns_to, int *SB, int sinc, int *spos, int *sbpos, \
+ int *dst, int *fmod) \
 {                                            \
  int ns, d, fa;                              \
  int ret = ns_to;                            \
@@ -565,13 +841,13 @@ static noinline int do_samples_##name( \
 }
 
 #define fmod_recv_check \
-  if(spu.s_chan[ch].bFMod==1 && iFMod[ns]) \
-    sinc = FModChangeFrequency(SB, spu.s_chan[ch].iRawPitch, ns)
+  if(spu.s_chan[ch].bFMod==1 && fmod[ns]) \
+    sinc = FModChangeFrequency(fmod, SB, spu.s_chan[ch].iRawPitch, ns)
 
 make_do_samples(default, fmod_recv_check, ,
   StoreInterpolationVal(SB, sinc, fa, spu.s_chan[ch].bFMod==2),
-  ChanBuf[ns] = iGetInterpolationVal(SB, sinc, *spos, spu.s_chan[ch].bFMod==2), )
-make_do_samples(noint, , fa = SB[29], , ChanBuf[ns] = fa, SB[29] = fa)
+  dst[ns] = iGetInterpolationVal(SB, sinc, *spos, spu.s_chan[ch].bFMod==2), )
+make_do_samples(noint, , fa = SB[29], , dst[ns] = fa, SB[29] = fa)
 
 #define simple_interp_store \
   SB[28] = 0; \
@@ -584,11 +860,94 @@ make_do_samples(noint, , fa = SB[29], , ChanBuf[ns] = fa, SB[29] = fa)
   if(sinc<0x10000)                /* -> upsampling? */ \
        InterpolateUp(SB, sinc);   /* --> interpolate up */ \
   else InterpolateDown(SB, sinc); /* --> else down */ \
-  ChanBuf[ns] = SB[29]
+  dst[ns] = SB[29]
 
 make_do_samples(simple, , ,
   simple_interp_store, simple_interp_get, )
 
+#ifdef HAVE_SPU_X86
+
+static void gauss_interp_c(int *dst, const int *hist,
+ const int *hidx, const int *gidx, int count)
+{
+ int ns, vr;
+
+ for (ns = 0; ns < count; ns++)
+ {
+  const int *h = hist + hidx[ns];
+  const int *g = gauss + gidx[ns];
+
+  vr  = (g[0] * h[0]) >> 15;
+  vr += (g[1] * h[1]) >> 15;
+  vr += (g[2] * h[2]) >> 15;
+  vr += (g[3] * h[3]) >> 15;
+  dst[ns] = vr;
+ }
+}
+
+static void (*gauss_interp_p)(int *dst, const int *hist,
+ const int *hidx, const int *gidx, int count) = gauss_interp_c;
+
+// same as do_samples_default() with gauss interpolation, but first
+// collects the input samples and table offsets for every output
+// sample so that the filter itself can run vectorized
+static noinline int do_samples_gauss(
+ int (*decode_f)(void *context, int ch, int *SB), void *ctx,
+ int ch, int ns_to, int *SB, int sinc, int *spos, int *sbpos,
+ int *dst, int *fmod)
+{
+ int hist[4 + NSSIZE * 4];
+ int hidx[NSSIZE], gidx[NSSIZE];
+ int ns, d, fa, gpos, n;
+ int ret = ns_to;
+
+ // pitch is limited to 0x3fff, so that's at most 4 inputs per output
+ if (sinc >= 0x40000)
+  return do_samples_default(decode_f, ctx, ch, ns_to, SB, sinc,
+          spos, sbpos, dst, fmod);
+
+ gpos = SB[28];
+ for (n = 0; n < 4; n++)
+  hist[n] = gval(n);
+
+ for (ns = 0; ns < ns_to; ns++)
+ {
+  fmod_recv_check;
+
+  *spos += sinc;
+  while (*spos >= 0x10000)
+  {
+   fa = SB[(*sbpos)++];
+   if (*sbpos >= 28)
+   {
+    *sbpos = 0;
+    d = decode_f(ctx, ch, SB);
+    if (d && ns < ret)
+     ret = ns;
+   }
+
+   ssat32_to_16(fa);
+   hist[n++] = fa;
+   *spos -= 0x10000;
+  }
+
+  hidx[ns] = n - 4;
+  gidx[ns] = (*spos >> 6) & ~3;
+ }
+
+ // leave the history where StoreInterpolationVal() would have
+ gpos = (SB[28] + n - 4) & 3;
+ for (d = 0; d < 4; d++)
+  ((short *)&SB[29])[(gpos + d) & 3] = hist[n - 4 + d];
+ SB[28] = gpos;
+
+ gauss_interp_p(dst, hist, hidx, gidx, ns_to);
+
+ return ret;
+}
+
+#endif // HAVE_SPU_X86
+
 static int do_samples_skip(int ch, int ns_to)
 {
  SPUCHAN *s_chan = &spu.s_chan[ch];
@@ -616,7 +975,7 @@ static int do_samples_skip(int ch, int ns_to)
  return ret;
 }
 
-static void do_lsfr_samples(int ns_to, int ctrl,
+static void do_lsfr_samples(int *dst, int ns_to, int ctrl,
  unsigned int *dwNoiseCount, unsigned int *dwNoiseVal)
 {
  unsigned int counter = *dwNoiseCount;
@@ -640,7 +999,7 @@ static void do_lsfr_samples(int ns_to, int ctrl,
    val = (val << 1) | bit;
   }
 
-  ChanBuf[ns] = (signed short)val;
+  dst[ns] = (signed short)val;
  }
 
  *dwNoiseCount = counter;
@@ -653,19 +1012,15 @@ static int do_samples_noise(int ch, int ns_to)
 
  ret = do_samples_skip(ch, ns_to);
 
- do_lsfr_samples(ns_to, spu.spuCtrl, &spu.dwNoiseCount, &spu.dwNoiseVal);
+ do_lsfr_samples(ChanBuf, ns_to, spu.spuCtrl, &spu.dwNoiseCount, &spu.dwNoiseVal);
 
  return ret;
 }
 
-#ifdef HAVE_ARMV5
-// asm code; lv and rv must be 0-3fff
-extern void mix_chan(int *SSumLR, int count, int lv, int rv);
-extern void mix_chan_rvb(int *SSumLR, int count, int lv, int rv, int *rvb);
-#else
-static void mix_chan(int *SSumLR, int count, int lv, int rv)
+// C versions take the source buffer so that voice helper threads
+// can mix their own ChanBuf copies, asm always uses the global one
+static void mix_chan_c(const int *src, int *SSumLR, int count, int lv, int rv)
 {
- const int *src = ChanBuf;
  int l, r;
 
  while (count--)
@@ -679,9 +1034,9 @@ static void mix_chan(int *SSumLR, int count, int lv, int rv)
   }
 }
 
-static void mix_chan_rvb(int *SSumLR, int count, int lv, int rv, int *rvb)
+static void mix_chan_rvb_c(const int *src, int *SSumLR, int count,
+ int lv, int rv, int *rvb)
 {
- const int *src = ChanBuf;
  int *dst = SSumLR;
  int *drvb = rvb;
  int l, r;
@@ -698,15 +1053,70 @@ static void mix_chan_rvb(int *SSumLR, int count, int lv, int rv, int *rvb)
    *drvb++ += r;
   }
 }
+
+#ifdef HAVE_ARMV5
+// asm code; lv and rv must be 0-3fff
+extern void mix_chan(int *SSumLR, int count, int lv, int rv);
+extern void mix_chan_rvb(int *SSumLR, int count, int lv, int rv, int *rvb);
+#define mix_chan_src(src, SSumLR, count, lv, rv) \
+ ((src) == ChanBuf ? mix_chan(SSumLR, count, lv, rv) \
+  : mix_chan_c(src, SSumLR, count, lv, rv))
+#define mix_chan_rvb_src(src, SSumLR, count, lv, rv, rvb) \
+ ((src) == ChanBuf ? mix_chan_rvb(SSumLR, count, lv, rv, rvb) \
+  : mix_chan_rvb_c(src, SSumLR, count, lv, rv, rvb))
+#else
+#ifdef HAVE_SPU_X86
+static void (*mix_chan_p)(const int *src, int *SSumLR, int count,
+ int lv, int rv) = mix_chan_c;
+static void (*mix_chan_rvb_p)(const int *src, int *SSumLR, int count,
+ int lv, int rv, int *rvb) = mix_chan_rvb_c;
+#define mix_chan_src mix_chan_p
+#define mix_chan_rvb_src mix_chan_rvb_p
+#else
+#define mix_chan_src mix_chan_c
+#define mix_chan_rvb_src mix_chan_rvb_c
+#endif
+#define mix_chan(SSumLR, count, lv, rv) \
+ mix_chan_src(ChanBuf, SSumLR, count, lv, rv)
+#define mix_chan_rvb(SSumLR, count, lv, rv, rvb) \
+ mix_chan_rvb_src(ChanBuf, SSumLR, count, lv, rv, rvb)
+#endif
+
+#ifdef HAVE_SPU_X86
+
+#include "spu_x86.c"
+
+static void init_spu_x86(void)
+{
+ __builtin_cpu_init();
+ if (__builtin_cpu_supports("sse2")) {
+  decode_block_data_p = decode_block_data_sse2;
+  gauss_interp_p = gauss_interp_sse2;
+  mix_chan_p = mix_chan_sse2;
+  mix_chan_rvb_p = mix_chan_rvb_sse2;
+  MixREVERB_p = MixREVERB_sse2;
+ }
+ if (__builtin_cpu_supports("avx2")) {
+  gauss_interp_p = gauss_interp_avx2;
+  mix_chan_p = mix_chan_avx2;
+  mix_chan_rvb_p = mix_chan_rvb_avx2;
+ }
+}
+
+#else
+
+static void init_spu_x86(void)
+{
+}
+
 #endif
 
 // 0x0800-0x0bff  Voice 1
 // 0x0c00-0x0fff  Voice 3
 static noinline void do_decode_bufs(unsigned short *mem, int which,
- int count, int decode_pos)
+ int count, int decode_pos, const int *src)
 {
  unsigned short *dst = &mem[0x800/2 + which*0x400/2];
- const int *src = ChanBuf;
  int cursor = decode_pos;
 
  while (count-- > 0)
@@ -768,6 +1178,8 @@ static void do_channels(int ns_to)
  if (do_rvb)
   memset(RVB, 0, ns_to * sizeof(RVB[0]) * 2);
 
+ adpcm_cache_sync();
+
  mask = spu.dwNewChannel & 0xffffff;
  for (ch = 0; mask != 0; ch++, mask >>= 1) {
   if (mask & 1)
@@ -788,15 +1200,20 @@ static void do_channels(int ns_to)
    else if (s_chan->bFMod == 2
          || (s_chan->bFMod == 0 && spu_config.iUseInterpolation == 0))
     d = do_samples_noint(decode_block, NULL, ch, ns_to,
-          SB, sinc, &s_chan->spos, &s_chan->iSBPos);
+          SB, sinc, &s_chan->spos, &s_chan->iSBPos, ChanBuf, iFMod);
    else if (s_chan->bFMod == 0 && spu_config.iUseInterpolation == 1)
     d = do_samples_simple(decode_block, NULL, ch, ns_to,
-          SB, sinc, &s_chan->spos, &s_chan->iSBPos);
+          SB, sinc, &s_chan->spos, &s_chan->iSBPos, ChanBuf, iFMod);
+#ifdef HAVE_SPU_X86
+   else if (spu_config.iUseInterpolation == 2)
+    d = do_samples_gauss(decode_block, NULL, ch, ns_to,
+          SB, sinc, &s_chan->spos, &s_chan->iSBPos, ChanBuf, iFMod);
+#endif
    else
     d = do_samples_default(decode_block, NULL, ch, ns_to,
-          SB, sinc, &s_chan->spos, &s_chan->iSBPos);
+          SB, sinc, &s_chan->spos, &s_chan->iSBPos, ChanBuf, iFMod);
 
-   d = MixADSR(&s_chan->ADSRX, d);
+   d = MixADSR(ChanBuf, &s_chan->ADSRX, d);
    if (d < ns_to) {
     spu.dwChannelOn &= ~(1 << ch);
     s_chan->ADSRX.EnvelopeVol = 0;
@@ -805,7 +1222,7 @@ static void do_channels(int ns_to)
 
    if (ch == 1 || ch == 3)
     {
-     do_decode_bufs(spu.spuMem, ch/2, ns_to, spu.decode_pos);
+     do_decode_bufs(spu.spuMem, ch/2, ns_to, spu.decode_pos, ChanBuf);
      spu.decode_dirty_ch |= 1 << ch;
     }
 
@@ -887,19 +1304,16 @@ static void thread_work_wait_sync(struct work_item *work, int force);
 static void thread_sync_caches(void);
 static int  thread_get_i_done(void);
 
-static int decode_block_work(void *context, int ch, int *SB)
+static inline int decode_block_work_(void *context, int ch, int *SB,
+ struct adpcm_cache *cache)
 {
  const unsigned char *ram = spu.spuMemC;
- int predict_nr, shift_factor, flags;
  struct work_item *work = context;
  int start = work->ch[ch].start;
  int loop = work->ch[ch].loop;
+ int flags;
 
- predict_nr = ram[start];
- shift_factor = predict_nr & 0xf;
- predict_nr >>= 4;
-
- decode_block_data(SB, ram + start + 2, predict_nr, shift_factor);
+ decode_block_cached(cache, SB, start);
 
  flags = ram[start + 1];
  if (flags & 4)
@@ -916,6 +1330,17 @@ static int decode_block_work(void *context, int ch, int *SB)
  return 0;
 }
 
+static int decode_block_work(void *context, int ch, int *SB)
+{
+ return decode_block_work_(context, ch, SB, adpcm_cache);
+}
+
+// for voice helpers, the cache is only used by one thread
+static int decode_block_work_nc(void *context, int ch, int *SB)
+{
+ return decode_block_work_(context, ch, SB, NULL);
+}
+
 static void queue_channel_work(int ns_to, unsigned int silentch)
 {
  struct work_item *work;
@@ -979,26 +1404,35 @@ static void queue_channel_work(int ns_to, unsigned int silentch)
  thread_work_start();
 }
 
-static void do_channel_work(struct work_item *work)
+static void do_channel_work_start(struct work_item *work)
 {
  unsigned int mask;
- unsigned int decode_dirty_ch = 0;
- const SPUCHAN *s_chan;
- int *SB, sinc, spos, sbpos;
- int d, ch, ns_to;
-
- ns_to = work->ns_to;
+ int ch;
 
  if (work->rvb_addr)
-  memset(RVB, 0, ns_to * sizeof(RVB[0]) * 2);
+  memset(RVB, 0, work->ns_to * sizeof(RVB[0]) * 2);
+
+ // voice helpers aren't running yet
+ adpcm_cache_sync();
 
  mask = work->channels_new;
  for (ch = 0; mask != 0; ch++, mask >>= 1) {
   if (mask & 1)
    StartSoundSB(spu.SB + ch * SB_SIZE);
  }
+}
+
+// render the voices in mask, mixing into SSumLR/rvb
+static void do_channel_group(struct work_item *work, unsigned int mask,
+ int *chan_buf, int *fmod, int *SSumLR, int *rvb,
+ int (*decode_f)(void *context, int ch, int *SB))
+{
+ const SPUCHAN *s_chan;
+ int *SB, sinc, spos, sbpos;
+ int d, ch, ns_to;
+
+ ns_to = work->ns_to;
 
- mask = work->channels_on;
  for (ch = 0; mask != 0; ch++, mask >>= 1)
   {
    if (!(mask & 1)) continue;
@@ -1012,38 +1446,50 @@ static void do_channel_work(struct work_item *work)
    SB = spu.SB + ch * SB_SIZE;
 
    if (s_chan->bNoise)
-    do_lsfr_samples(d, work->ctrl, &spu.dwNoiseCount, &spu.dwNoiseVal);
+    do_lsfr_samples(chan_buf, d, work->ctrl, &spu.dwNoiseCount, &spu.dwNoiseVal);
    else if (s_chan->bFMod == 2
          || (s_chan->bFMod == 0 && spu_config.iUseInterpolation == 0))
-    do_samples_noint(decode_block_work, work, ch, d, SB, sinc, &spos, &sbpos);
+    do_samples_noint(decode_f, work, ch, d, SB, sinc, &spos, &sbpos,
+      chan_buf, fmod);
    else if (s_chan->bFMod == 0 && spu_config.iUseInterpolation == 1)
-    do_samples_simple(decode_block_work, work, ch, d, SB, sinc, &spos, &sbpos);
+    do_samples_simple(decode_f, work, ch, d, SB, sinc, &spos, &sbpos,
+      chan_buf, fmod);
+#ifdef HAVE_SPU_X86
+   else if (spu_config.iUseInterpolation == 2)
+    do_samples_gauss(decode_f, work, ch, d, SB, sinc, &spos, &sbpos,
+      chan_buf, fmod);
+#endif
    else
-    do_samples_default(decode_block_work, work, ch, d, SB, sinc, &spos, &sbpos);
+    do_samples_default(decode_f, work, ch, d, SB, sinc, &spos, &sbpos,
+      chan_buf, fmod);
 
-   d = MixADSR(&work->ch[ch].adsr, d);
+   d = MixADSR(chan_buf, &work->ch[ch].adsr, d);
    if (d < ns_to) {
     work->ch[ch].adsr.EnvelopeVol = 0;
-    memset(&ChanBuf[d], 0, (ns_to - d) * sizeof(ChanBuf[0]));
+    memset(&chan_buf[d], 0, (ns_to - d) * sizeof(chan_buf[0]));
    }
 
    if (ch == 1 || ch == 3)
-    {
-     do_decode_bufs(spu.spuMem, ch/2, ns_to, work->decode_pos);
-     decode_dirty_ch |= 1 << ch;
-    }
+    do_decode_bufs(spu.spuMem, ch/2, ns_to, work->decode_pos, chan_buf);
 
    if (s_chan->bFMod == 2)                         // fmod freq channel
-    memcpy(iFMod, &ChanBuf, ns_to * sizeof(iFMod[0]));
+    memcpy(fmod, chan_buf, ns_to * sizeof(fmod[0]));
    if (s_chan->bRVBActive && work->rvb_addr)
-    mix_chan_rvb(work->SSumLR, ns_to,
-      work->ch[ch].vol_l, work->ch[ch].vol_r, RVB);
+    mix_chan_rvb_src(chan_buf, SSumLR, ns_to,
+      work->ch[ch].vol_l, work->ch[ch].vol_r, rvb);
    else
-    mix_chan(work->SSumLR, ns_to, work->ch[ch].vol_l, work->ch[ch].vol_r);
+    mix_chan_src(chan_buf, SSumLR, ns_to, work->ch[ch].vol_l, work->ch[ch].vol_r);
   }
+}
 
-  if (work->rvb_addr)
-   REVERBDo(work->SSumLR, RVB, ns_to, work->rvb_addr);
+static void do_channel_work(struct work_item *work)
+{
+ do_channel_work_start(work);
+ do_channel_group(work, work->channels_on, ChanBuf, iFMod, work->SSumLR, RVB,
+  decode_block_work);
+
+ if (work->rvb_addr)
+  REVERBDo(work->SSumLR, RVB, work->ns_to, work->rvb_addr);
 }
 
 static void sync_worker_thread(int force)
@@ -1163,8 +1609,11 @@ void do_samples(unsigned int cycles_to, int do_direct)
   // (all chans are always playing on the real thing..)
   if (spu.spuCtrl & CTRL_IRQ)
    do_silent_chans(ns_to, silentch);
+  else
+   irq_sched.dirty = ~0;                 // not kept up to date
 
   spu.cycles_played += ns_to * 768;
+  irq_sched.now += ns_to;
   spu.decode_pos = (spu.decode_pos + ns_to) & 0x1ff;
 }
 
@@ -1213,23 +1662,29 @@ static void do_samples_finish(int *SSumLR, int ns_to,
 
 void schedule_next_irq(void)
 {
- unsigned int upd_samples;
- int ch;
+ unsigned int upd_samples = IRQ_SCHED_WINDOW;
+ struct irq_pred *p;
+ int ch, d;
 
  if (spu.scheduleCallback == NULL)
   return;
 
- upd_samples = 44100 / 50;
+ irq_sched_update();
 
- for (ch = 0; ch < MAXCHAN; ch++)
+ // each rescan either finds an irq or moves the voice out of the window
+ for (;;)
  {
-  if (spu.dwChannelDead & (1 << ch))
-   continue;
-  if ((unsigned long)(spu.pSpuIrq - spu.s_chan[ch].pCurr) > IRQ_NEAR_BLOCKS * 16
-    && (unsigned long)(spu.pSpuIrq - spu.s_chan[ch].pLoop) > IRQ_NEAR_BLOCKS * 16)
-   continue;
-
-  scan_for_irq(ch, &upd_samples);
+  ch = irq_sched.heap[0];
+  p = &irq_sched.v[ch];
+  d = p->at - irq_sched.now;
+  if (d >= IRQ_SCHED_WINDOW)
+   break;
+  if (p->hit && d > 0 && !(spu.dwChannelDead & (1 << ch)))
+  {
+   upd_samples = d;
+   break;
+  }
+  irq_sched_scan(ch);
  }
 
  if (unlikely(spu.pSpuIrq < spu.spuMemC + 0x1000))
@@ -1242,7 +1697,7 @@ void schedule_next_irq(void)
   }
  }
 
- if (upd_samples < 44100 / 50)
+ if (upd_samples < IRQ_SCHED_WINDOW)
   spu.scheduleCallback(upd_samples * 768);
 }
 
@@ -1253,6 +1708,9 @@ void schedule_next_irq(void)
 
 void CALLBACK SPUasync(unsigned int cycle, unsigned int flags)
 {
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_ASYNC, cycle, flags, 0, NULL, 0);
+
  do_samples(cycle, spu_config.iUseFixedUpdates);
 
  if (spu.spuCtrl & CTRL_IRQ)
@@ -1291,6 +1749,9 @@ void CALLBACK SPUplayADPCMchannel(xa_decode_t *xap)
  if(!xap)       return;
  if(!xap->freq) return;                                // no xa freq ? bye
 
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_XA, spu_rec.cycles, 0, 0, xap, 0);
+
  FeedXA(xap);                                          // call main XA feeder
 }
 
@@ -1300,6 +1761,9 @@ int CALLBACK SPUplayCDDAchannel(short *pcm, int nbytes)
  if (!pcm)      return -1;
  if (nbytes<=0) return -1;
 
+ if (spu_rec_active())
+  spu_rec_event(SPU_REC_CDDA, spu_rec.cycles, 0, 0, pcm, nbytes);
+
  return FeedCDDA((unsigned char *)pcm, nbytes);
 }
 
@@ -1308,6 +1772,7 @@ void ClearWorkingState(void)
 {
  memset(iFMod, 0, sizeof(iFMod));
  spu.pS=(short *)spu.pSpuBuffer;                       // setup soundbuffer pointer
+ irq_sched_reset();
 }
 
 // SETUPSTREAMS: init most of the spu buffers
@@ -1355,10 +1820,29 @@ static void RemoveStreams(void)
 #include <semaphore.h>
 #include <unistd.h>
 
+// voices may be further split across helper threads, the worker thread
+// renders one group itself and sums the helpers' partial mixes
+#define VOICE_THREADS_MAX 4
+
+struct voice_helper {
+ pthread_t thread;
+ sem_t sem_go;
+ struct work_item *work;
+ unsigned int mask;
+ int ChanBuf[NSSIZE];
+ int iFMod[NSSIZE]; // only touched if bFMod changes under us
+ int SSumLR[NSSIZE * 2];
+ int RVB[NSSIZE * 2];
+};
+
 static struct {
  pthread_t thread;
  sem_t sem_avail;
  sem_t sem_done;
+ sem_t sem_helpers;
+ struct voice_helper *helpers;
+ int helper_cnt;
+ int auto_cnt;
 } t;
 
 /* generic pthread implementation */
@@ -1382,6 +1866,115 @@ static void thread_sync_caches(void)
 {
 }
 
+static void *spu_voice_helper(void *arg)
+{
+ struct voice_helper *h = arg;
+ struct work_item *work;
+
+ while (1) {
+  sem_wait(&h->sem_go);
+  if (worker->exit_thread)
+   break;
+
+  work = h->work;
+  memset(h->SSumLR, 0, work->ns_to * sizeof(h->SSumLR[0]) * 2);
+  if (work->rvb_addr)
+   memset(h->RVB, 0, work->ns_to * sizeof(h->RVB[0]) * 2);
+
+  do_channel_group(work, h->mask, h->ChanBuf, h->iFMod, h->SSumLR, h->RVB,
+   decode_block_work_nc);
+
+  sem_post(&t.sem_helpers);
+ }
+
+ return NULL;
+}
+
+// split the playing voices into up to 'count' groups. Noise voices share
+// the LFSR state and fmod voices pass data through iFMod (also between
+// unrelated pairs when a voice of a pair is off), so all of those stay
+// in group 0 and are rendered in channel order like before.
+static int split_channel_work(const struct work_item *work,
+ unsigned int *masks, int count)
+{
+ unsigned int mask = work->channels_on;
+ int load[VOICE_THREADS_MAX];
+ int i, ch, best, active;
+
+ for (active = 0, ch = 0; ch < MAXCHAN; ch++)
+  active += (mask >> ch) & 1;
+ // not worth the sync for just a few voices
+ if (count > active / 4)
+  count = active / 4;
+ if (count <= 1) {
+  masks[0] = mask;
+  return 1;
+ }
+
+ for (i = 0; i < count; i++)
+  masks[i] = load[i] = 0;
+
+ for (ch = 0; ch < MAXCHAN; ch++)
+  {
+   if (!(mask & (1u << ch))) continue;
+
+   best = 0;
+   if (!spu.s_chan[ch].bNoise && !spu.s_chan[ch].bFMod) {
+    for (i = 1; i < count; i++)
+     if (load[i] < load[best])
+      best = i;
+   }
+   masks[best] |= 1u << ch;
+   load[best]++;
+  }
+
+ return count;
+}
+
+static void thread_channel_work(struct work_item *work)
+{
+ unsigned int masks[VOICE_THREADS_MAX];
+ int i, ns, count;
+
+ count = spu_config.iThreadCount;
+ if (count <= 0)
+  count = t.auto_cnt;
+ else if (count > t.helper_cnt + 1)
+  count = t.helper_cnt + 1;
+ count = split_channel_work(work, masks, count);
+ if (count <= 1) {
+  do_channel_work(work);
+  return;
+ }
+
+ do_channel_work_start(work);
+
+ for (i = 1; i < count; i++) {
+  t.helpers[i - 1].work = work;
+  t.helpers[i - 1].mask = masks[i];
+  sem_post(&t.helpers[i - 1].sem_go);
+ }
+
+ do_channel_group(work, masks[0], ChanBuf, iFMod, work->SSumLR, RVB,
+  decode_block_work);
+
+ for (i = 1; i < count; i++)
+  sem_wait(&t.sem_helpers);
+
+ // integer sums, so the result doesn't depend on how voices were split
+ for (i = 1; i < count; i++) {
+  const struct voice_helper *h = &t.helpers[i - 1];
+  for (ns = 0; ns < work->ns_to * 2; ns++)
+   work->SSumLR[ns] += h->SSumLR[ns];
+  if (work->rvb_addr)
+   for (ns = 0; ns < work->ns_to * 2; ns++)
+    RVB[ns] += h->RVB[ns];
+ }
+
+ if (work->rvb_addr)
+  REVERBDo(work->SSumLR, RVB, work->ns_to, work->rvb_addr);
+}
+
 static void *spu_worker_thread(void *unused)
 {
  struct work_item *work;
@@ -1392,7 +1985,7 @@ static void *spu_worker_thread(void *unused)
    break;
 
   work = &worker->i[worker->i_done & WORK_I_MASK];
-  do_channel_work(work);
+  thread_channel_work(work);
   worker->i_done++;
 
   sem_post(&t.sem_done);
@@ -1401,11 +1994,65 @@ static void *spu_worker_thread(void *unused)
  return NULL;
 }
 
+static void init_voice_helpers(int ncpu)
+{
+ int i, cnt;
+
+ // leave a core for the emu thread and one for the worker
+ cnt = ncpu - 2;
+ if (cnt > VOICE_THREADS_MAX - 1)
+  cnt = VOICE_THREADS_MAX - 1;
+ if (cnt <= 0)
+  return;
+ if (sem_init(&t.sem_helpers, 0, 0) != 0)
+  return;
+ t.helpers = calloc(cnt, sizeof(t.helpers[0]));
+ if (t.helpers == NULL)
+  goto fail;
+
+ for (i = 0; i < cnt; i++) {
+  if (sem_init(&t.helpers[i].sem_go, 0, 0) != 0)
+   break;
+  if (pthread_create(&t.helpers[i].thread, NULL, spu_voice_helper,
+        &t.helpers[i]) != 0) {
+   sem_destroy(&t.helpers[i].sem_go);
+   break;
+  }
+ }
+ t.helper_cnt = i;
+ if (i > 0)
+  return;
+
+ free(t.helpers);
+ t.helpers = NULL;
+fail:
+ sem_destroy(&t.sem_helpers);
+}
+
+static void exit_voice_helpers(void)
+{
+ int i;
+
+ if (t.helpers == NULL)
+  return;
+ for (i = 0; i < t.helper_cnt; i++) {
+  sem_post(&t.helpers[i].sem_go);
+  pthread_join(t.helpers[i].thread, NULL);
+  sem_destroy(&t.helpers[i].sem_go);
+ }
+ sem_destroy(&t.sem_helpers);
+ free(t.helpers);
+ t.helpers = NULL;
+ t.helper_cnt = 0;
+}
+
 static void init_spu_thread(void)
 {
+ long ncpu;
  int ret;
 
- if (sysconf(_SC_NPROCESSORS_ONLN) <= 1)
+ ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+ if (ncpu <= 1)
   return;
 
  worker = calloc(1, sizeof(*worker));
@@ -1422,6 +2069,12 @@ static void init_spu_thread(void)
  if (ret != 0)
   goto fail_thread;
 
+ init_voice_helpers(ncpu);
+ // by default use about half of the cores for voices
+ t.auto_cnt = ncpu / 2;
+ if (t.auto_cnt > t.helper_cnt + 1)
+  t.auto_cnt = t.helper_cnt + 1;
+
  spu_config.iThreadAvail = 1;
  return;
 
@@ -1442,6 +2095,7 @@ static void exit_spu_thread(void)
  worker->exit_thread = 1;
  sem_post(&t.sem_avail);
  pthread_join(t.thread, NULL);
+ exit_voice_helpers();
  sem_destroy(&t.sem_done);
  sem_destroy(&t.sem_avail);
  free(worker);
@@ -1467,10 +2121,12 @@ long CALLBACK SPUinit(void)
 
  spu.spuMemC = calloc(1, 512 * 1024);
  InitADSR();
+ init_spu_x86();
 
  spu.s_chan = calloc(MAXCHAN+1, sizeof(spu.s_chan[0])); // channel + 1 infos (1 is security for fmod handling)
  spu.rvb = calloc(1, sizeof(REVERBInfo));
  spu.SB = calloc(MAXCHAN, sizeof(spu.SB[0]) * SB_SIZE);
+ adpcm_cache_init();
 
  spu.spuAddr = 0;
  spu.decode_pos = 0;
@@ -1483,6 +2139,11 @@ long CALLBACK SPUinit(void)
 
  init_spu_thread();
 
+#ifndef NO_OS
+ if (getenv("SPU_RECORD"))
+  spu_rec_start(getenv("SPU_RECORD"), 1);
+#endif
+
  for (i = 0; i < MAXCHAN; i++)                         // loop sound channels
   {
    spu.s_chan[i].ADSRX.SustainLevel = 0xf;             // -> init sustain
@@ -1520,12 +2181,19 @@ long CALLBACK SPUclose(void)
  return 0;
 }
 
+// SPUGETRAM: the sound RAM, for emus tracking its pages themselves
+void * CALLBACK SPUgetRam(void)
+{
+ return spu.spuMemC;
+}
+
 // SPUSHUTDOWN: called by main emu on final exit
 long CALLBACK SPUshutdown(void)
 {
  SPUclose();
 
  exit_spu_thread();
+ spu_rec_stop();
 
  free(spu.spuMemC);
  spu.spuMemC = NULL;
@@ -1535,6 +2203,8 @@ long CALLBACK SPUshutdown(void)
  spu.s_chan = NULL;
  free(spu.rvb);
  spu.rvb = NULL;
+ free(adpcm_cache);
+ adpcm_cache = NULL;
 
  RemoveStreams();                                      // no more streaming
  spu.bSpuInit=0;
@@ -1611,10 +2281,14 @@ char * SPUgetLibInfos(void)
 */
 
 // debug
-void spu_get_debug_info(int *chans_out, int *run_chans, int *fmod_chans_out, int *noise_chans_out)
+void spu_get_debug_info(int *chans_out, int *run_chans, int *fmod_chans_out, int *noise_chans_out,
+ int *adpcm_hit_pct)
 {
+ static unsigned int last_hits, last_misses;
  int ch = 0, fmod_chans = 0, noise_chans = 0, irq_chans = 0;
+ unsigned int hits, misses;
 
+ *adpcm_hit_pct = -1;                      // since the last call, -1: no data
  if (spu.s_chan == NULL)
   return;
 
@@ -1634,6 +2308,15 @@ void spu_get_debug_info(int *chans_out, int *run_chans, int *fmod_chans_out, int
  *run_chans = ~spu.dwChannelOn & ~spu.dwChannelDead & irq_chans;
  *fmod_chans_out = fmod_chans;
  *noise_chans_out = noise_chans;
+
+ if (adpcm_cache == NULL)
+  return;
+ hits = adpcm_cache->hits - last_hits;
+ misses = adpcm_cache->misses - last_misses;
+ last_hits += hits;
+ last_misses += misses;
+ if (hits + misses)
+  *adpcm_hit_pct = (unsigned long long)hits * 100 / (hits + misses);
 }
 
 // vim:shiftwidth=1:expandtab
@@ -21,5 +21,6 @@
 void ClearWorkingState(void);
 void CALLBACK SPUplayADPCMchannel(xa_decode_t *xap);
 int  CALLBACK SPUplayCDDAchannel(short *pcm, int bytes);
+void * CALLBACK SPUgetRam(void);
 
 #endif /* __P_SPU_H__ */
@@ -12,6 +12,7 @@ typedef struct
  int        iTempo;
  int        idiablofix;
  int        iUseThread;
+ int        iThreadCount;      // threads rendering voices, 0 = auto
  int        iUseFixedUpdates;  // output fixed number of samples/frame
 
  // status
@@ -0,0 +1,371 @@
+/*
+ * SSE2/AVX2 versions of the hot SPU loops, selected at runtime.
+ * The C code in spu.c is the reference, all of these must produce
+ * exactly the same output (see test_simd.c).
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+// will be included from spu.c
+
+#include <immintrin.h>
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+// low 32 bits of a 32x32 multiply, SSE4.1 pmulld without SSE4.1
+static inline TARGET_SSE2 __m128i mullo32_sse2(__m128i a, __m128i b)
+{
+ __m128i even = _mm_mul_epu32(a, b);
+ __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+ even = _mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0));
+ odd = _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0));
+ return _mm_unpacklo_epi32(even, odd);
+}
+
+// {sum(a), sum(b), sum(c), sum(d)}
+static inline TARGET_SSE2 __m128i hsum4x4_sse2(__m128i a, __m128i b,
+ __m128i c, __m128i d)
+{
+ __m128i ab = _mm_add_epi32(_mm_unpacklo_epi32(a, b), _mm_unpackhi_epi32(a, b));
+ __m128i cd = _mm_add_epi32(_mm_unpacklo_epi32(c, d), _mm_unpackhi_epi32(c, d));
+ return _mm_add_epi32(_mm_unpacklo_epi64(ab, cd), _mm_unpackhi_epi64(ab, cd));
+}
+
+static inline TARGET_AVX2 __m256i hsum4x4_avx2(__m256i a, __m256i b,
+ __m256i c, __m256i d)
+{
+ __m256i ab = _mm256_add_epi32(_mm256_unpacklo_epi32(a, b),
+                _mm256_unpackhi_epi32(a, b));
+ __m256i cd = _mm256_add_epi32(_mm256_unpacklo_epi32(c, d),
+                _mm256_unpackhi_epi32(c, d));
+ return _mm256_add_epi32(_mm256_unpacklo_epi64(ab, cd),
+          _mm256_unpackhi_epi64(ab, cd));
+}
+
+////////////////////////////////////////////////////////////////////////
+// adpcm
+
+// only the nibble expansion is vectorized, the prediction filter
+// is a recurrence (with rounding per term) and stays scalar
+static TARGET_SSE2 void decode_block_data_sse2(int *dest,
+ const unsigned char *src, int predict_nr, int shift_factor)
+{
+ static const int f[16][2] = {
+    {    0,  0  },
+    {   60,  0  },
+    {  115, -52 },
+    {   98, -55 },
+    {  122, -60 }
+ };
+ const __m128i mask = _mm_set1_epi8(0x0f);
+ const __m128i zero = _mm_setzero_si128();
+ const __m128i shift = _mm_cvtsi32_si128(shift_factor);
+ unsigned char buf[16];
+ __m128i b, lo, hi, n0, n1, w[4];
+ int s_1, s_2, f0, f1, i;
+
+ // 14 bytes, don't read past the end of spu ram
+ memcpy(buf, src, 14);
+ buf[14] = buf[15] = 0;
+ b = _mm_loadu_si128((const void *)buf);
+
+ lo = _mm_and_si128(b, mask);
+ hi = _mm_and_si128(_mm_srli_epi16(b, 4), mask);
+ n0 = _mm_slli_epi16(_mm_unpacklo_epi8(lo, hi), 4);
+ n1 = _mm_slli_epi16(_mm_unpackhi_epi8(lo, hi), 4);
+ // (signed short)(nibble << 12) >> shift_factor
+ w[0] = _mm_sra_epi16(_mm_unpacklo_epi8(zero, n0), shift);
+ w[1] = _mm_sra_epi16(_mm_unpackhi_epi8(zero, n0), shift);
+ w[2] = _mm_sra_epi16(_mm_unpacklo_epi8(zero, n1), shift);
+ w[3] = _mm_sra_epi16(_mm_unpackhi_epi8(zero, n1), shift);
+
+ s_1 = dest[27];
+ s_2 = dest[26];
+
+ for (i = 0; i < 3; i++) {
+  _mm_storeu_si128((void *)&dest[i * 8],
+    _mm_srai_epi32(_mm_unpacklo_epi16(w[i], w[i]), 16));
+  _mm_storeu_si128((void *)&dest[i * 8 + 4],
+    _mm_srai_epi32(_mm_unpackhi_epi16(w[i], w[i]), 16));
+ }
+ _mm_storeu_si128((void *)&dest[24],
+   _mm_srai_epi32(_mm_unpacklo_epi16(w[3], w[3]), 16));
+
+ f0 = f[predict_nr][0];
+ f1 = f[predict_nr][1];
+ if (f0 == 0 && f1 == 0)
+  return;
+
+ for (i = 0; i < 28; i++) {
+  int fa = dest[i] + ((s_1 * f0) >> 6) + ((s_2 * f1) >> 6);
+  s_2 = s_1;
+  s_1 = fa;
+  dest[i] = fa;
+ }
+}
+
+////////////////////////////////////////////////////////////////////////
+// gauss interpolation, see do_samples_gauss()
+
+static TARGET_SSE2 void gauss_interp_sse2(int *dst, const int *hist,
+ const int *hidx, const int *gidx, int count)
+{
+ __m128i p[4];
+ int ns, i;
+
+ for (ns = 0; ns + 4 <= count; ns += 4) {
+  for (i = 0; i < 4; i++) {
+   __m128i h = _mm_loadu_si128((const void *)&hist[hidx[ns + i]]);
+   __m128i g = _mm_loadu_si128((const void *)&gauss[gidx[ns + i]]);
+   p[i] = _mm_srai_epi32(mullo32_sse2(g, h), 15);
+  }
+  _mm_storeu_si128((void *)&dst[ns], hsum4x4_sse2(p[0], p[1], p[2], p[3]));
+ }
+ gauss_interp_c(dst + ns, hist, hidx + ns, gidx + ns, count - ns);
+}
+
+static TARGET_AVX2 void gauss_interp_avx2(int *dst, const int *hist,
+ const int *hidx, const int *gidx, int count)
+{
+ __m256i p[4];
+ int ns, i;
+
+ for (ns = 0; ns + 8 <= count; ns += 8) {
+  for (i = 0; i < 4; i++) {
+   __m256i h = _mm256_inserti128_si256(_mm256_castsi128_si256(
+     _mm_loadu_si128((const void *)&hist[hidx[ns + i]])),
+     _mm_loadu_si128((const void *)&hist[hidx[ns + i + 4]]), 1);
+   __m256i g = _mm256_inserti128_si256(_mm256_castsi128_si256(
+     _mm_loadu_si128((const void *)&gauss[gidx[ns + i]])),
+     _mm_loadu_si128((const void *)&gauss[gidx[ns + i + 4]]), 1);
+   p[i] = _mm256_srai_epi32(_mm256_mullo_epi32(g, h), 15);
+  }
+  _mm256_storeu_si256((void *)&dst[ns], hsum4x4_avx2(p[0], p[1], p[2], p[3]));
+ }
+ gauss_interp_c(dst + ns, hist, hidx + ns, gidx + ns, count - ns);
+}
+
+////////////////////////////////////////////////////////////////////////
+// mixing
+
+static TARGET_SSE2 void mix_chan_sse2(const int *src, int *SSumLR,
+ int count, int lv, int rv)
+{
+ const __m128i m = _mm_setr_epi32(lv, rv, lv, rv);
+ __m128i s, l, h;
+
+ for (; count >= 4; count -= 4, src += 4, SSumLR += 8) {
+  s = _mm_loadu_si128((const void *)src);
+  l = _mm_srai_epi32(mullo32_sse2(_mm_unpacklo_epi32(s, s), m), 14);
+  h = _mm_srai_epi32(mullo32_sse2(_mm_unpackhi_epi32(s, s), m), 14);
+  _mm_storeu_si128((void *)&SSumLR[0],
+    _mm_add_epi32(_mm_loadu_si128((const void *)&SSumLR[0]), l));
+  _mm_storeu_si128((void *)&SSumLR[4],
+    _mm_add_epi32(_mm_loadu_si128((const void *)&SSumLR[4]), h));
+ }
+ if (count > 0)
+  mix_chan_c(src, SSumLR, count, lv, rv);
+}
+
+static TARGET_SSE2 void mix_chan_rvb_sse2(const int *src, int *SSumLR,
+ int count, int lv, int rv, int *rvb)
+{
+ const __m128i m = _mm_setr_epi32(lv, rv, lv, rv);
+ __m128i s, l, h;
+
+ for (; count >= 4; count -= 4, src += 4, SSumLR += 8, rvb += 8) {
+  s = _mm_loadu_si128((const void *)src);
+  l = _mm_srai_epi32(mullo32_sse2(_mm_unpacklo_epi32(s, s), m), 14);
+  h = _mm_srai_epi32(mullo32_sse2(_mm_unpackhi_epi32(s, s), m), 14);
+  _mm_storeu_si128((void *)&SSumLR[0],
+    _mm_add_epi32(_mm_loadu_si128((const void *)&SSumLR[0]), l));
+  _mm_storeu_si128((void *)&SSumLR[4],
+    _mm_add_epi32(_mm_loadu_si128((const void *)&SSumLR[4]), h));
+  _mm_storeu_si128((void *)&rvb[0],
+    _mm_add_epi32(_mm_loadu_si128((const void *)&rvb[0]), l));
+  _mm_storeu_si128((void *)&rvb[4],
+    _mm_add_epi32(_mm_loadu_si128((const void *)&rvb[4]), h));
+ }
+ if (count > 0)
+  mix_chan_rvb_c(src, SSumLR, count, lv, rv, rvb);
+}
+
+static TARGET_AVX2 void mix_chan_avx2(const int *src, int *SSumLR,
+ int count, int lv, int rv)
+{
+ const __m256i m = _mm256_setr_epi32(lv, rv, lv, rv, lv, rv, lv, rv);
+ const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+ __m256i l, h;
+
+ for (; count >= 8; count -= 8, src += 8, SSumLR += 16) {
+  l = _mm256_castsi128_si256(_mm_loadu_si128((const void *)&src[0]));
+  h = _mm256_castsi128_si256(_mm_loadu_si128((const void *)&src[4]));
+  l = _mm256_srai_epi32(_mm256_mullo_epi32(
+        _mm256_permutevar8x32_epi32(l, dup), m), 14);
+  h = _mm256_srai_epi32(_mm256_mullo_epi32(
+        _mm256_permutevar8x32_epi32(h, dup), m), 14);
+  _mm256_storeu_si256((void *)&SSumLR[0],
+    _mm256_add_epi32(_mm256_loadu_si256((const void *)&SSumLR[0]), l));
+  _mm256_storeu_si256((void *)&SSumLR[8],
+    _mm256_add_epi32(_mm256_loadu_si256((const void *)&SSumLR[8]), h));
+ }
+ if (count > 0)
+  mix_chan_c(src, SSumLR, count, lv, rv);
+}
+
+static TARGET_AVX2 void mix_chan_rvb_avx2(const int *src, int *SSumLR,
+ int count, int lv, int rv, int *rvb)
+{
+ const __m256i m = _mm256_setr_epi32(lv, rv, lv, rv, lv, rv, lv, rv);
+ const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+ __m256i l, h;
+
+ for (; count >= 8; count -= 8, src += 8, SSumLR += 16, rvb += 16) {
+  l = _mm256_castsi128_si256(_mm_loadu_si128((const void *)&src[0]));
+  h = _mm256_castsi128_si256(_mm_loadu_si128((const void *)&src[4]));
+  l = _mm256_srai_epi32(_mm256_mullo_epi32(
+        _mm256_permutevar8x32_epi32(l, dup), m), 14);
+  h = _mm256_srai_epi32(_mm256_mullo_epi32(
+        _mm256_permutevar8x32_epi32(h, dup), m), 14);
+  _mm256_storeu_si256((void *)&SSumLR[0],
+    _mm256_add_epi32(_mm256_loadu_si256((const void *)&SSumLR[0]), l));
+  _mm256_storeu_si256((void *)&SSumLR[8],
+    _mm256_add_epi32(_mm256_loadu_si256((const void *)&SSumLR[8]), h));
+  _mm256_storeu_si256((void *)&rvb[0],
+    _mm256_add_epi32(_mm256_loadu_si256((const void *)&rvb[0]), l));
+  _mm256_storeu_si256((void *)&rvb[8],
+    _mm256_add_epi32(_mm256_loadu_si256((const void *)&rvb[8]), h));
+ }
+ if (count > 0)
+  mix_chan_rvb_c(src, SSumLR, count, lv, rv, rvb);
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// reverb
+
+static inline TARGET_SSE2 __m128i rvb_gather4_sse2(const short * const *p,
+ int i)
+{
+ return _mm_setr_epi32(p[0][i], p[1][i], p[2][i], p[3][i]);
+}
+
+// see MixREVERB_neon() in reverb.c, 16bit taps times 16bit coefs are
+// done with pmaddwd, against coefs zero-extended to 32bit where needed
+static TARGET_SSE2 void MixREVERB_sse2(int *SSumLR, int *RVB, int ns_to,
+ int curr_addr)
+{
+ #define c16(c) ((c) & 0xffff)
+ const REVERBInfo *rvb = spu.rvb;
+ const __m128i in_coef = _mm_setr_epi32(rvb->IN_COEF_L, rvb->IN_COEF_R,
+                                        rvb->IN_COEF_L, rvb->IN_COEF_R);
+ const __m128i iir_coef = _mm_set1_epi32(c16(rvb->IIR_COEF));
+ const __m128i iir_alpha = _mm_set1_epi32(rvb->IIR_ALPHA);
+ const __m128i acc_coef_ab = _mm_set1_epi32(c16(rvb->ACC_COEF_A)
+                                            | ((unsigned)rvb->ACC_COEF_B << 16));
+ const __m128i acc_coef_cd = _mm_set1_epi32(c16(rvb->ACC_COEF_C)
+                                            | ((unsigned)rvb->ACC_COEF_D << 16));
+ const __m128i fb_alpha = _mm_set1_epi32(rvb->FB_ALPHA);
+ const __m128i fb_alpha16 = _mm_set1_epi32(c16(rvb->FB_ALPHA));
+ const __m128i fb_x16 = _mm_set1_epi32(c16(rvb->FB_X));
+ const __m128i vol_l = _mm_set1_epi32(rvb->VolLeft);
+ const __m128i vol_r = _mm_set1_epi32(rvb->VolRight);
+ int count = (ns_to + 1) / 2;
+ struct rvb_span s;
+ int i, n;
+ #undef c16
+
+ if (rvb->batch < 4) {
+  MixREVERB(SSumLR, RVB, ns_to, curr_addr);
+  return;
+ }
+
+ for (; count > 0; count -= n, SSumLR += n * 4, RVB += n * 4) {
+  n = rvb_span_prep(&s, curr_addr, count < rvb->batch ? count : rvb->batch, 1);
+  curr_addr = rvb_span_next(curr_addr, n);
+
+  for (i = 0; i < n; i++) {
+   __m128i in, src, dest, iir;
+
+   in = _mm_loadl_epi64((const void *)&RVB[i*4]);
+   in = mullo32_sse2(_mm_unpacklo_epi64(in, in), in_coef);
+   src = rvb_gather4_sse2(s.iir_src, i);
+   dest = rvb_gather4_sse2(s.iir_dest, i);
+   iir = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(src, iir_coef), in), 15);
+   iir = _mm_add_epi32(dest, _mm_srai_epi32(
+           mullo32_sse2(_mm_sub_epi32(iir, dest), iir_alpha), 15));
+   iir = _mm_packs_epi32(iir, iir);
+   s.iir_dest1[0][i] = _mm_extract_epi16(iir, 0);
+   s.iir_dest1[1][i] = _mm_extract_epi16(iir, 1);
+   s.iir_dest1[2][i] = _mm_extract_epi16(iir, 2);
+   s.iir_dest1[3][i] = _mm_extract_epi16(iir, 3);
+  }
+
+  for (i = 0; i + 4 <= n; i += 4) {
+   __m128i acc0, acc1, fa0, fa1, fb0, fb1, ma0, ma1, mb0, mb1, l, r, lr;
+
+   #define ld4(p) _mm_loadl_epi64((const void *)&(p)[i])
+   #define sext(v) _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)
+   // {A*a + B*b, ..} from {A, B, A, B, ..}
+   acc0 = _mm_add_epi32(
+     _mm_madd_epi16(_mm_unpacklo_epi16(ld4(s.acc_src[0]), ld4(s.acc_src[2])), acc_coef_ab),
+     _mm_madd_epi16(_mm_unpacklo_epi16(ld4(s.acc_src[4]), ld4(s.acc_src[6])), acc_coef_cd));
+   acc1 = _mm_add_epi32(
+     _mm_madd_epi16(_mm_unpacklo_epi16(ld4(s.acc_src[1]), ld4(s.acc_src[3])), acc_coef_ab),
+     _mm_madd_epi16(_mm_unpacklo_epi16(ld4(s.acc_src[5]), ld4(s.acc_src[7])), acc_coef_cd));
+   acc0 = _mm_srai_epi32(acc0, 15);
+   acc1 = _mm_srai_epi32(acc1, 15);
+   fa0 = sext(ld4(s.fb_src[0]));
+   fa1 = sext(ld4(s.fb_src[1]));
+   fb0 = sext(ld4(s.fb_src[2]));
+   fb1 = sext(ld4(s.fb_src[3]));
+   #undef ld4
+
+   ma0 = _mm_sub_epi32(acc0, _mm_srai_epi32(_mm_madd_epi16(fa0, fb_alpha16), 15));
+   ma1 = _mm_sub_epi32(acc1, _mm_srai_epi32(_mm_madd_epi16(fa1, fb_alpha16), 15));
+   mb0 = _mm_sub_epi32(mullo32_sse2(_mm_sub_epi32(acc0, fa0), fb_alpha),
+                       _mm_madd_epi16(fb0, fb_x16));
+   mb1 = _mm_sub_epi32(mullo32_sse2(_mm_sub_epi32(acc1, fa1), fb_alpha),
+                       _mm_madd_epi16(fb1, fb_x16));
+   mb0 = _mm_add_epi32(fa0, _mm_srai_epi32(mb0, 15));
+   mb1 = _mm_add_epi32(fa1, _mm_srai_epi32(mb1, 15));
+   ma0 = _mm_packs_epi32(ma0, ma0);
+   ma1 = _mm_packs_epi32(ma1, ma1);
+   mb0 = _mm_packs_epi32(mb0, mb0);
+   mb1 = _mm_packs_epi32(mb1, mb1);
+   _mm_storel_epi64((void *)&s.mix_dest[0][i], ma0);
+   _mm_storel_epi64((void *)&s.mix_dest[1][i], ma1);
+   _mm_storel_epi64((void *)&s.mix_dest[2][i], mb0);
+   _mm_storel_epi64((void *)&s.mix_dest[3][i], mb1);
+
+   // (a + b) / 2, rounding towards 0 like C
+   l = _mm_add_epi32(sext(ma0), sext(mb0));
+   r = _mm_add_epi32(sext(ma1), sext(mb1));
+   #undef sext
+   l = _mm_srai_epi32(_mm_add_epi32(l, _mm_srli_epi32(l, 31)), 1);
+   r = _mm_srai_epi32(_mm_add_epi32(r, _mm_srli_epi32(r, 31)), 1);
+   l = _mm_srai_epi32(mullo32_sse2(l, vol_l), 15);
+   r = _mm_srai_epi32(mullo32_sse2(r, vol_r), 15);
+
+   #define mix2(o, v) \
+    _mm_storeu_si128((void *)&SSumLR[(i+o)*4], _mm_add_epi32( \
+      _mm_loadu_si128((const void *)&SSumLR[(i+o)*4]), v))
+   lr = _mm_unpacklo_epi32(l, r);
+   mix2(0, _mm_unpacklo_epi64(lr, lr));
+   mix2(1, _mm_unpackhi_epi64(lr, lr));
+   lr = _mm_unpackhi_epi32(l, r);
+   mix2(2, _mm_unpacklo_epi64(lr, lr));
+   mix2(3, _mm_unpackhi_epi64(lr, lr));
+   #undef mix2
+  }
+  for (; i < n; i++)
+   rvb_mix(rvb, &s, SSumLR, i);
+ }
+}
+
+// vim:shiftwidth=1:expandtab
@@ -0,0 +1,312 @@
+/*
+ * replays a recording made with SPU_RECORD=<file> (see record.c),
+ * reports the speed and optionally compares the output to a golden file
+ *
+ * The worker thread reads some voice state while the main thread changes
+ * it, so the output is only repeatable with it disabled (the default).
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "spu.c"
+#include "dma.h"
+
+static const char * const type_names[SPU_REC_TYPE_CNT] = {
+	[SPU_REC_WRITE_REG]     = "SPUwriteRegister",
+	[SPU_REC_READ_DATA]     = "SPUreadRegister",
+	[SPU_REC_WRITE_DMA]     = "SPUwriteDMA",
+	[SPU_REC_READ_DMA]      = "SPUreadDMA",
+	[SPU_REC_WRITE_DMA_MEM] = "SPUwriteDMAMem",
+	[SPU_REC_READ_DMA_MEM]  = "SPUreadDMAMem",
+	[SPU_REC_ASYNC]         = "SPUasync",
+	[SPU_REC_XA]            = "SPUplayADPCMchannel",
+	[SPU_REC_CDDA]          = "SPUplayCDDAchannel",
+	[SPU_REC_LOAD]          = "SPUfreeze",
+	[SPU_REC_CONFIG]        = "config",
+};
+
+static int interp = -1, reverb = -1, threads = -1;
+
+static struct {
+	unsigned int count;
+	unsigned long long ns;
+} stats[SPU_REC_TYPE_CNT];
+
+static unsigned char *pcm;
+static size_t pcm_size, pcm_alloc;
+
+static unsigned long long get_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *load_file(const char *fname, size_t *size)
+{
+	FILE *f;
+	void *buf;
+	long len;
+
+	f = fopen(fname, "rb");
+	if (f == NULL) {
+		perror(fname);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc(len > 0 ? len : 1);
+	if (buf != NULL && fread(buf, 1, len, f) != (size_t)len) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	if (buf == NULL)
+		fprintf(stderr, "%s: read failed\n", fname);
+	*size = len;
+	return buf;
+}
+
+static void feed(void *data, int bytes)
+{
+	if (pcm_size + bytes > pcm_alloc) {
+		pcm_alloc = (pcm_size + bytes) * 2;
+		pcm = realloc(pcm, pcm_alloc);
+		if (pcm == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	memcpy(pcm + pcm_size, data, bytes);
+	pcm_size += bytes;
+}
+
+static void set_config(const void *config, unsigned int size)
+{
+	int use_thread = spu_config.iUseThread;
+	int thread_cnt = spu_config.iThreadCount;
+
+	memcpy(&spu_config, config,
+		size < sizeof(spu_config) ? size : sizeof(spu_config));
+	if (interp >= 0)
+		spu_config.iUseInterpolation = interp;
+	if (reverb >= 0)
+		spu_config.iUseReverb = reverb;
+	spu_config.iUseThread = use_thread;
+	spu_config.iThreadCount = thread_cnt;
+	spu_config.iTempo = 0; // depends on the audio device
+}
+
+static void CALLBACK irq_cb(void) {}
+static void CALLBACK cddav_cb(unsigned short l, unsigned short r) {}
+static void CALLBACK schedule_cb(unsigned int cycles) {}
+
+static int replay(const unsigned char *rec, size_t size)
+{
+	const struct spu_rec_header *hdr = (const void *)rec;
+	const struct spu_rec_event *ev;
+	static unsigned short tmp[0x40000];
+	unsigned int cycles = hdr->cycles;
+	unsigned long long t;
+	size_t pos;
+
+	pos = sizeof(*hdr) + hdr->config_size;
+	if (hdr->state_size)
+		spu_state_load((void *)(rec + pos), hdr->state_size, hdr->cycles);
+	pos += hdr->state_size;
+
+	while (pos + sizeof(*ev) <= size) {
+		ev = (const void *)(rec + pos);
+		pos += sizeof(*ev);
+		if (ev->type >= SPU_REC_TYPE_CNT || pos + ev->size > size) {
+			fprintf(stderr, "bad event at %zu\n", pos - sizeof(*ev));
+			return -1;
+		}
+
+		t = get_ns();
+		switch (ev->type) {
+		case SPU_REC_WRITE_REG:
+			SPUwriteRegister(ev->a, ev->b, ev->cycles);
+			break;
+		case SPU_REC_READ_DATA:
+			SPUreadRegister(H_SPUdata);
+			break;
+		case SPU_REC_WRITE_DMA:
+			SPUwriteDMA(ev->b);
+			break;
+		case SPU_REC_READ_DMA:
+			SPUreadDMA();
+			break;
+		case SPU_REC_WRITE_DMA_MEM:
+			SPUwriteDMAMem((unsigned short *)(rec + pos), ev->size / 2,
+				ev->cycles);
+			break;
+		case SPU_REC_READ_DMA_MEM:
+			SPUreadDMAMem(tmp, ev->a < 0x40000 ? ev->a : 0x40000, ev->cycles);
+			break;
+		case SPU_REC_ASYNC:
+			SPUasync(ev->cycles, ev->a);
+			break;
+		case SPU_REC_XA: {
+			// the unrecorded part of pcm[] is never read
+			static xa_decode_t xa;
+			memcpy(&xa, rec + pos, ev->size);
+			SPUplayADPCMchannel(&xa);
+			break;
+		}
+		case SPU_REC_CDDA:
+			SPUplayCDDAchannel((short *)(rec + pos), ev->size);
+			break;
+		case SPU_REC_LOAD:
+			spu_state_load((void *)(rec + pos), ev->size, ev->cycles);
+			break;
+		case SPU_REC_CONFIG:
+			set_config(rec + pos, ev->size);
+			break;
+		}
+		stats[ev->type].ns += get_ns() - t;
+		stats[ev->type].count++;
+		pos += ev->size;
+		cycles = ev->cycles;
+	}
+
+	// flush whatever the worker thread still has
+	do_samples(cycles, 1);
+	feed(spu.pSpuBuffer, (unsigned char *)spu.pS - spu.pSpuBuffer);
+	spu.pS = (short *)spu.pSpuBuffer;
+
+	return 0;
+}
+
+static int compare(const char *fname)
+{
+	const short *a = (const short *)pcm, *b;
+	size_t size, i, cnt, first = 0;
+	int diff, max_diff = 0;
+
+	b = load_file(fname, &size);
+	if (b == NULL)
+		return -1;
+
+	if (size != pcm_size)
+		printf("size mismatch: %zu vs golden %zu bytes\n", pcm_size, size);
+	if (size > pcm_size)
+		size = pcm_size;
+
+	for (i = cnt = 0; i < size / 2; i++) {
+		if (a[i] == b[i])
+			continue;
+		if (cnt++ == 0)
+			first = i;
+		diff = abs(a[i] - b[i]);
+		if (diff > max_diff)
+			max_diff = diff;
+	}
+	if (cnt)
+		printf("%zu of %zu samples differ, first at frame %zu, max diff %d\n",
+			cnt, size / 2, first / 2, max_diff);
+	else if (size == pcm_size)
+		printf("matches %s\n", fname);
+
+	free((void *)b);
+	return (cnt || size != pcm_size) ? 1 : 0;
+}
+
+static void usage(const char *argv0)
+{
+	printf("usage:\n%s [-i interpolation] [-r reverb] [-t threads] "
+		"<recording> [pcm_out] [golden_pcm]\n"
+		" -i, -r: override the recorded settings\n"
+		" -t: -1 - no worker thread (default), 0 - auto, n - voice threads\n",
+		argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	const struct spu_rec_header *hdr;
+	unsigned long long t, total = 0;
+	unsigned char *rec;
+	size_t size, frames;
+	FILE *f;
+	int i, ret = 0;
+
+	while ((i = getopt(argc, argv, "i:r:t:")) != -1) {
+		switch (i) {
+		case 'i': interp = atoi(optarg); break;
+		case 'r': reverb = atoi(optarg); break;
+		case 't': threads = atoi(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc || argc - optind > 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	rec = load_file(argv[optind], &size);
+	if (rec == NULL)
+		return 1;
+	hdr = (const void *)rec;
+	if (size < sizeof(*hdr) || memcmp(hdr->magic, SPU_REC_MAGIC, 4)
+	    || hdr->version != SPU_REC_VERSION
+	    || size < sizeof(*hdr) + hdr->config_size + hdr->state_size) {
+		fprintf(stderr, "%s: not a recording or a different version\n",
+			argv[optind]);
+		return 1;
+	}
+
+	spu_config.iUseThread = threads >= 0;
+	spu_config.iThreadCount = threads;
+	set_config(rec + sizeof(*hdr), hdr->config_size);
+
+	SPUinit();
+	spu_rec_stop(); // in case SPU_RECORD is set
+	SPUregisterCallback(irq_cb);
+	SPUregisterCDDAVolume(cddav_cb);
+	SPUregisterScheduleCb(schedule_cb);
+	SPUopen();
+	out_current->feed = feed;
+
+	t = get_ns();
+	if (replay(rec, size))
+		ret = 1;
+	t = get_ns() - t;
+
+	frames = pcm_size / 4;
+	printf("%zu samples in %.3f s, %.0f samples/s, %.1fx realtime\n",
+		frames, t / 1e9, frames / (t / 1e9), frames / 44100.0 / (t / 1e9));
+	for (i = 1; i < SPU_REC_TYPE_CNT; i++)
+		total += stats[i].ns;
+	printf("%-20s %8s %10s %8s %6s\n", "", "calls", "total ms", "avg us", "%");
+	for (i = 1; i < SPU_REC_TYPE_CNT; i++) {
+		if (stats[i].count == 0)
+			continue;
+		printf("%-20s %8u %10.3f %8.3f %6.1f\n", type_names[i],
+			stats[i].count, stats[i].ns / 1e6,
+			stats[i].ns / 1e3 / stats[i].count,
+			total ? stats[i].ns * 100.0 / total : 0.0);
+	}
+
+	if (argc - optind >= 2 && strcmp(argv[optind + 1], "-") != 0) {
+		f = fopen(argv[optind + 1], "wb");
+		if (f == NULL) {
+			perror(argv[optind + 1]);
+			return 1;
+		}
+		fwrite(pcm, 1, pcm_size, f);
+		fclose(f);
+	}
+	if (argc - optind >= 3 && compare(argv[optind + 2]))
+		ret = 1;
+
+	SPUshutdown();
+	free(rec);
+	return ret;
+}
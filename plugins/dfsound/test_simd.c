@@ -0,0 +1,442 @@
+/*
+ * checks the x86 and NEON SIMD kernels against the C reference code
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "spu.c"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define HAVE_SPU_NEON
+#endif
+
+#if defined(HAVE_SPU_X86) || defined(HAVE_SPU_NEON)
+
+static unsigned int seed = 0x12345678;
+static int failed;
+
+static unsigned int rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static void fail(const char *name, int iter)
+{
+	if (failed++ < 16)
+		printf("%s: mismatch on iteration %d\n", name, iter);
+}
+
+static void check(const char *name, const void *a, const void *b,
+	size_t size, int iter)
+{
+	if (memcmp(a, b, size) != 0)
+		fail(name, iter);
+}
+
+#ifdef HAVE_SPU_X86
+
+static void test_decode(void)
+{
+	void (*funcs[])(int *, const unsigned char *, int, int) = {
+		decode_block_data_sse2,
+	};
+	unsigned char src[14];
+	int ref[SB_SIZE], out[SB_SIZE];
+	int i, j, f;
+
+	for (i = 0; i < 100000; i++) {
+		int predict_nr = rnd() & 15, shift_factor = rnd() & 15;
+		for (j = 0; j < 14; j++)
+			src[j] = rnd();
+		for (j = 0; j < SB_SIZE; j++)
+			ref[j] = (int)(rnd() << 8) >> 16;
+		for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+			memcpy(out, ref, sizeof(out));
+			funcs[f](out, src, predict_nr, shift_factor);
+			if (f == 0)
+				decode_block_data(ref, src, predict_nr, shift_factor);
+			check("decode_block_data", ref, out, sizeof(ref), i);
+		}
+	}
+}
+
+static void test_gauss(int avx2)
+{
+	void (*func)(int *, const int *, const int *, const int *, int) =
+		avx2 ? gauss_interp_avx2 : gauss_interp_sse2;
+	static int hist[4 + NSSIZE * 4];
+	int hidx[NSSIZE], gidx[NSSIZE], ref[NSSIZE], out[NSSIZE];
+	int i, j, count;
+
+	for (i = 0; i < 2000; i++) {
+		count = rnd() % (NSSIZE + 1);
+		for (j = 0; j < 4 + NSSIZE * 4; j++)
+			hist[j] = (short)rnd();
+		for (j = 0; j < count; j++) {
+			hidx[j] = rnd() % (NSSIZE * 4 + 1);
+			gidx[j] = rnd() & 0x3fc;
+		}
+		gauss_interp_c(ref, hist, hidx, gidx, count);
+		func(out, hist, hidx, gidx, count);
+		check(avx2 ? "gauss_interp_avx2" : "gauss_interp_sse2",
+			ref, out, count * sizeof(ref[0]), i);
+	}
+}
+
+static void test_mix(int avx2)
+{
+	void (*mix)(const int *, int *, int, int, int) =
+		avx2 ? mix_chan_avx2 : mix_chan_sse2;
+	void (*mix_rvb)(const int *, int *, int, int, int, int *) =
+		avx2 ? mix_chan_rvb_avx2 : mix_chan_rvb_sse2;
+	static int src[NSSIZE], ref[NSSIZE * 2], out[NSSIZE * 2];
+	static int ref_rvb[NSSIZE * 2], out_rvb[NSSIZE * 2];
+	int i, j, count, lv, rv;
+
+	for (i = 0; i < 2000; i++) {
+		count = rnd() % (NSSIZE + 1);
+		lv = rnd() & 0x3fff;
+		rv = rnd() & 0x3fff;
+		for (j = 0; j < NSSIZE; j++)
+			src[j] = (int)(rnd() << 8) >> 14;
+		for (j = 0; j < NSSIZE * 2; j++) {
+			ref[j] = out[j] = rnd();
+			ref_rvb[j] = out_rvb[j] = rnd();
+		}
+
+		mix_chan_c(src, ref, count, lv, rv);
+		mix(src, out, count, lv, rv);
+		check(avx2 ? "mix_chan_avx2" : "mix_chan_sse2",
+			ref, out, sizeof(ref), i);
+
+		mix_chan_rvb_c(src, ref, count, lv, rv, ref_rvb);
+		mix_rvb(src, out, count, lv, rv, out_rvb);
+		check(avx2 ? "mix_chan_rvb_avx2" : "mix_chan_rvb_sse2",
+			ref, out, sizeof(ref), i);
+		check(avx2 ? "mix_chan_rvb_avx2 (rvb)" : "mix_chan_rvb_sse2 (rvb)",
+			ref_rvb, out_rvb, sizeof(ref_rvb), i);
+	}
+}
+
+// feeds random adpcm through decode_block_data
+static int decode_random(void *context, int ch, int *SB)
+{
+	unsigned char src[14];
+	int j;
+
+	for (j = 0; j < 14; j++)
+		src[j] = rnd();
+	decode_block_data(SB, src, rnd() % 5, rnd() % 13);
+	return (rnd() & 63) == 0;
+}
+
+// whole gauss sample loop against do_samples_default()
+static void test_do_samples_gauss(void)
+{
+	int SB_ref[SB_SIZE], SB_out[SB_SIZE];
+	int ref[NSSIZE], out[NSSIZE];
+	int fmod_ref[NSSIZE], fmod_out[NSSIZE];
+	int spos_ref, spos_out, sbpos_ref, sbpos_out;
+	int i, j, ns_to, sinc, r_ref, r_out;
+	unsigned int saved_seed;
+
+	spu_config.iUseInterpolation = 2;
+	spu.s_chan = calloc(MAXCHAN + 1, sizeof(spu.s_chan[0]));
+
+	for (i = 0; i < 5000; i++) {
+		ns_to = rnd() % (NSSIZE + 1);
+		sinc = ((rnd() & 0x3fff) << 4) | 8;
+		spu.s_chan[0].bFMod = (rnd() & 3) == 0;
+		spu.s_chan[0].iRawPitch = rnd() & 0x3fff;
+		for (j = 0; j < SB_SIZE; j++)
+			SB_ref[j] = (short)rnd();
+		SB_ref[28] = rnd() & 3;
+		memcpy(SB_out, SB_ref, sizeof(SB_out));
+		for (j = 0; j < NSSIZE; j++)
+			fmod_ref[j] = fmod_out[j] = (rnd() & 3) ? 0 : (short)rnd();
+		spos_ref = spos_out = rnd() & 0xffff;
+		sbpos_ref = sbpos_out = rnd() % 28;
+
+		// both must see the same adpcm data
+		saved_seed = seed;
+		r_ref = do_samples_default(decode_random, NULL, 0, ns_to, SB_ref,
+			sinc, &spos_ref, &sbpos_ref, ref, fmod_ref);
+		seed = saved_seed;
+		r_out = do_samples_gauss(decode_random, NULL, 0, ns_to, SB_out,
+			sinc, &spos_out, &sbpos_out, out, fmod_out);
+
+		check("do_samples_gauss", ref, out, ns_to * sizeof(ref[0]), i);
+		check("do_samples_gauss (SB)", SB_ref, SB_out, 33 * sizeof(SB_ref[0]), i);
+		check("do_samples_gauss (fmod)", fmod_ref, fmod_out, sizeof(fmod_ref), i);
+		if (r_ref != r_out || spos_ref != spos_out || sbpos_ref != sbpos_out)
+			fail("do_samples_gauss (pos)", i);
+	}
+}
+
+#endif // HAVE_SPU_X86
+
+// MixREVERB() before it was split into spans and stages, for reference
+#define g_buffer(var) \
+	((int)(signed short)spu.spuMem[rvb2ram_offs(curr_addr, space, rvb->var)])
+#define s_buffer(var, iVal) \
+	ssat32_to_16(iVal); \
+	spu.spuMem[rvb2ram_offs(curr_addr, space, rvb->var)] = iVal
+#define s_buffer1(var, iVal) \
+	ssat32_to_16(iVal); \
+	spu.spuMem[rvb2ram_offs(curr_addr, space, rvb->var + 1)] = iVal
+
+static void MixREVERB_ref(int *SSumLR, int *RVB, int ns_to, int curr_addr)
+{
+	const REVERBInfo *rvb = spu.rvb;
+	int IIR_ALPHA = rvb->IIR_ALPHA;
+	int IIR_COEF = rvb->IIR_COEF;
+	int space = 0x40000 - rvb->StartAddr;
+	int l, r, ns;
+
+	for (ns = 0; ns < ns_to * 2; ) {
+		int ACC0, ACC1, FB_A0, FB_A1, FB_B0, FB_B1;
+		int mix_dest_a0, mix_dest_a1, mix_dest_b0, mix_dest_b1;
+
+		int input_L = RVB[ns]   * rvb->IN_COEF_L;
+		int input_R = RVB[ns+1] * rvb->IN_COEF_R;
+
+		int IIR_INPUT_A0 = ((g_buffer(IIR_SRC_A0) * IIR_COEF) + input_L) >> 15;
+		int IIR_INPUT_A1 = ((g_buffer(IIR_SRC_A1) * IIR_COEF) + input_R) >> 15;
+		int IIR_INPUT_B0 = ((g_buffer(IIR_SRC_B0) * IIR_COEF) + input_L) >> 15;
+		int IIR_INPUT_B1 = ((g_buffer(IIR_SRC_B1) * IIR_COEF) + input_R) >> 15;
+
+		int iir_dest_a0 = g_buffer(IIR_DEST_A0);
+		int iir_dest_a1 = g_buffer(IIR_DEST_A1);
+		int iir_dest_b0 = g_buffer(IIR_DEST_B0);
+		int iir_dest_b1 = g_buffer(IIR_DEST_B1);
+
+		int IIR_A0 = iir_dest_a0 + ((IIR_INPUT_A0 - iir_dest_a0) * IIR_ALPHA >> 15);
+		int IIR_A1 = iir_dest_a1 + ((IIR_INPUT_A1 - iir_dest_a1) * IIR_ALPHA >> 15);
+		int IIR_B0 = iir_dest_b0 + ((IIR_INPUT_B0 - iir_dest_b0) * IIR_ALPHA >> 15);
+		int IIR_B1 = iir_dest_b1 + ((IIR_INPUT_B1 - iir_dest_b1) * IIR_ALPHA >> 15);
+
+		s_buffer1(IIR_DEST_A0, IIR_A0);
+		s_buffer1(IIR_DEST_A1, IIR_A1);
+		s_buffer1(IIR_DEST_B0, IIR_B0);
+		s_buffer1(IIR_DEST_B1, IIR_B1);
+
+		ACC0 = (g_buffer(ACC_SRC_A0) * rvb->ACC_COEF_A +
+			g_buffer(ACC_SRC_B0) * rvb->ACC_COEF_B +
+			g_buffer(ACC_SRC_C0) * rvb->ACC_COEF_C +
+			g_buffer(ACC_SRC_D0) * rvb->ACC_COEF_D) >> 15;
+		ACC1 = (g_buffer(ACC_SRC_A1) * rvb->ACC_COEF_A +
+			g_buffer(ACC_SRC_B1) * rvb->ACC_COEF_B +
+			g_buffer(ACC_SRC_C1) * rvb->ACC_COEF_C +
+			g_buffer(ACC_SRC_D1) * rvb->ACC_COEF_D) >> 15;
+
+		FB_A0 = g_buffer(FB_SRC_A0);
+		FB_A1 = g_buffer(FB_SRC_A1);
+		FB_B0 = g_buffer(FB_SRC_B0);
+		FB_B1 = g_buffer(FB_SRC_B1);
+
+		mix_dest_a0 = ACC0 - ((FB_A0 * rvb->FB_ALPHA) >> 15);
+		mix_dest_a1 = ACC1 - ((FB_A1 * rvb->FB_ALPHA) >> 15);
+
+		mix_dest_b0 = FB_A0 + (((ACC0 - FB_A0) * rvb->FB_ALPHA - FB_B0 * rvb->FB_X) >> 15);
+		mix_dest_b1 = FB_A1 + (((ACC1 - FB_A1) * rvb->FB_ALPHA - FB_B1 * rvb->FB_X) >> 15);
+
+		s_buffer(MIX_DEST_A0, mix_dest_a0);
+		s_buffer(MIX_DEST_A1, mix_dest_a1);
+		s_buffer(MIX_DEST_B0, mix_dest_b0);
+		s_buffer(MIX_DEST_B1, mix_dest_b1);
+
+		l = (mix_dest_a0 + mix_dest_b0) / 2;
+		r = (mix_dest_a1 + mix_dest_b1) / 2;
+
+		l = (l * rvb->VolLeft)  >> 15;
+		r = (r * rvb->VolRight) >> 15;
+
+		SSumLR[ns++] += l;
+		SSumLR[ns++] += r;
+		SSumLR[ns++] += l;
+		SSumLR[ns++] += r;
+
+		curr_addr++;
+		if (curr_addr >= 0x40000) curr_addr = rvb->StartAddr;
+	}
+}
+
+static void MixREVERB_off_ref(int *SSumLR, int ns_to, int curr_addr)
+{
+	const REVERBInfo *rvb = spu.rvb;
+	int space = 0x40000 - rvb->StartAddr;
+	int l, r, ns;
+
+	for (ns = 0; ns < ns_to * 2; ) {
+		l = (g_buffer(MIX_DEST_A0) + g_buffer(MIX_DEST_B0)) / 2;
+		r = (g_buffer(MIX_DEST_A1) + g_buffer(MIX_DEST_B1)) / 2;
+
+		l = (l * rvb->VolLeft)  >> 15;
+		r = (r * rvb->VolRight) >> 15;
+
+		SSumLR[ns++] += l;
+		SSumLR[ns++] += r;
+		SSumLR[ns++] += l;
+		SSumLR[ns++] += r;
+
+		curr_addr++;
+		if (curr_addr >= 0x40000) curr_addr = rvb->StartAddr;
+	}
+}
+
+#undef g_buffer
+#undef s_buffer
+#undef s_buffer1
+
+static void test_reverb(void)
+{
+	static unsigned short mem_in[0x40000], mem_ref[0x40000], mem_out[0x40000];
+	static int rvb_in[NSSIZE * 2 + 4], sum_in[NSSIZE * 2 + 4];
+	static int ref[NSSIZE * 2 + 4], out[NSSIZE * 2 + 4];
+	static const struct {
+		const char *name;
+		void (*func)(int *, int *, int, int);
+	} funcs[] = {
+		{ "MixREVERB", MixREVERB },
+#ifdef HAVE_SPU_X86
+		{ "MixREVERB_sse2", MixREVERB_sse2 },
+#endif
+#ifdef HAVE_SPU_NEON
+		{ "MixREVERB_neon", MixREVERB_neon },
+#endif
+	};
+	REVERBInfo *rvb = spu.rvb;
+	int *offs[] = {
+		&rvb->IIR_SRC_A0, &rvb->IIR_SRC_A1, &rvb->IIR_SRC_B0, &rvb->IIR_SRC_B1,
+		&rvb->IIR_DEST_A0, &rvb->IIR_DEST_A1, &rvb->IIR_DEST_B0, &rvb->IIR_DEST_B1,
+		&rvb->ACC_SRC_A0, &rvb->ACC_SRC_A1, &rvb->ACC_SRC_B0, &rvb->ACC_SRC_B1,
+		&rvb->ACC_SRC_C0, &rvb->ACC_SRC_C1, &rvb->ACC_SRC_D0, &rvb->ACC_SRC_D1,
+		&rvb->MIX_DEST_A0, &rvb->MIX_DEST_A1, &rvb->MIX_DEST_B0, &rvb->MIX_DEST_B1,
+		&rvb->FB_SRC_A0, &rvb->FB_SRC_A1, &rvb->FB_SRC_B0, &rvb->FB_SRC_B1,
+	};
+	int i, j, f, ns_to, space, base, curr_addr, batched = 0;
+
+	for (j = 0; j < 0x40000; j++)
+		mem_in[j] = rnd();
+
+	for (i = 0; i < 20000; i++) {
+		// small buffers too, to get lots of wrapping
+		space = (rnd() & 1) ? rnd() % 64 + 1 : rnd() % 0x3fe00 + 1;
+		rvb->StartAddr = 0x40000 - space;
+		base = rnd() % space;
+		for (j = 0; j < sizeof(offs) / sizeof(offs[0]); j++) {
+			switch (rnd() & 3) {
+			case 0: *offs[j] = space - 1; break;
+			case 1: *offs[j] = (base + rnd() % 48) % space; break;
+			default: *offs[j] = rnd() % space; break;
+			}
+		}
+		// move some taps close to the written ones, limits the batching
+		for (j = rnd() % 4; j > 0; j--) {
+			int *w = offs[(rnd() & 1) ? 4 + (rnd() & 3) : 16 + (rnd() & 3)];
+			*offs[rnd() % (sizeof(offs) / sizeof(offs[0]))] =
+				(*w + space * 64 + rnd() % 64 - 32) % space;
+		}
+		// the usual presets overlap these
+		if (rnd() & 1)
+			rvb->IIR_SRC_B0 = rvb->IIR_DEST_B0;
+		REVERBPrepBatch(rvb);
+		batched += rvb->batch >= 4;
+
+		rvb->IIR_ALPHA = (short)rnd();
+		rvb->IIR_COEF = (short)rnd();
+		rvb->ACC_COEF_A = (short)rnd();
+		rvb->ACC_COEF_B = (short)rnd();
+		rvb->ACC_COEF_C = (short)rnd();
+		rvb->ACC_COEF_D = (short)rnd();
+		rvb->FB_ALPHA = (short)rnd();
+		rvb->FB_X = (short)rnd();
+		rvb->IN_COEF_L = (short)rnd();
+		rvb->IN_COEF_R = (short)rnd();
+		rvb->VolLeft = rnd() & 0xffff;
+		rvb->VolRight = rnd() & 0xffff;
+		ns_to = rnd() % (NSSIZE + 1);
+		curr_addr = rvb->StartAddr + rnd() % space;
+		for (j = 0; j < NSSIZE * 2 + 4; j++) {
+			rvb_in[j] = (int)(rnd() << 8) >> (rnd() & 15);
+			sum_in[j] = rnd();
+		}
+		// keep the memory changing between iterations
+		for (j = 0; j < 64; j++)
+			mem_in[rnd() % 0x40000] = rnd();
+
+		spu.spuMem = mem_ref;
+		memcpy(mem_ref, mem_in, sizeof(mem_ref));
+		memcpy(ref, sum_in, sizeof(ref));
+		MixREVERB_off_ref(ref, ns_to, curr_addr);
+		spu.spuMem = mem_out;
+		memcpy(mem_out, mem_in, sizeof(mem_out));
+		memcpy(out, sum_in, sizeof(out));
+		MixREVERB_off(out, ns_to, curr_addr);
+		check("MixREVERB_off", ref, out, sizeof(ref), i);
+
+		spu.spuMem = mem_ref;
+		memcpy(ref, sum_in, sizeof(ref));
+		MixREVERB_ref(ref, rvb_in, ns_to, curr_addr);
+		for (f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+			spu.spuMem = mem_out;
+			memcpy(mem_out, mem_in, sizeof(mem_out));
+			memcpy(out, sum_in, sizeof(out));
+			funcs[f].func(out, rvb_in, ns_to, curr_addr);
+			check(funcs[f].name, ref, out, sizeof(ref), i);
+			if (memcmp(mem_ref, mem_out, sizeof(mem_ref)) != 0)
+				fail(funcs[f].name, i);
+		}
+		memcpy(mem_in, mem_ref, sizeof(mem_in));
+	}
+	spu.spuMem = NULL;
+	if (batched < i / 4)
+		fail("MixREVERB (too few batched)", batched);
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef HAVE_SPU_X86
+	int have_avx2;
+
+	__builtin_cpu_init();
+	have_avx2 = __builtin_cpu_supports("avx2");
+	if (!__builtin_cpu_supports("sse2")) {
+		printf("no SSE2, nothing to test\n");
+		return 0;
+	}
+
+	init_spu_x86();
+	test_decode();
+	test_gauss(0);
+	test_mix(0);
+	if (have_avx2) {
+		test_gauss(1);
+		test_mix(1);
+	}
+	else
+		printf("no AVX2, only SSE2 tested\n");
+	test_do_samples_gauss();
+#endif
+
+	spu.rvb = calloc(1, sizeof(*spu.rvb));
+	test_reverb();
+
+	printf("%s\n", failed ? "FAILED" : "ok");
+	return failed != 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+	printf("no x86 or NEON kernels in this build, nothing to test\n");
+	return 0;
+}
+
+#endif
@@ -18,6 +18,20 @@
 
 #include "common.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+ && !defined(NEON_BUILD)
+#define HAVE_PSX_GPU_X86
+
+#define X86_LEVEL_C     0
+#define X86_LEVEL_SSE2  1
+#define X86_LEVEL_SSSE3 2
+#define X86_LEVEL_AVX2  3
+#define X86_LEVELS      4
+
+// see psx_gpu_x86.c
+static u32 psx_gpu_x86_init(u32 max_level);
+#endif
+
 u32 span_pixels = 0;
 u32 span_pixel_blocks = 0;
 u32 spans = 0;
@@ -791,7 +805,7 @@ void compute_all_gradients(psx_gpu_struct *psx_gpu, vertex_struct *a,
   vec_2x64s alternate_x;                                                       \
   vec_2x64s alternate_dx_dy;                                                   \
   vec_4x32s alternate_x_32;                                                    \
-  vec_2x32s alternate_x_16;                                                    \
+  vec_4x16s alternate_x_16;                                                    \
                                                                                \
   vec_4x16u alternate_select;                                                  \
   vec_4x16s y_mid_point;                                                       \
@@ -3339,7 +3353,7 @@ void texture_sprite_blocks_8bpp(psx_gpu_struct *psx_gpu)
 
 #define setup_sprite_tile_half_8bpp(edge)                                      \
 {                                                                              \
-  setup_sprite_tile_add_blocks(sub_tile_height * 2);                           \
+  setup_sprite_tile_add_blocks(sub_tile_height);                               \
                                                                                \
   while(sub_tile_height)                                                       \
   {                                                                            \
@@ -4367,6 +4381,15 @@ void render_sprite(psx_gpu_struct *psx_gpu, s32 x, s32 y, u32 u, u32 v,
   color_b = (color >> 16) & 0xFF;                                              \
 }                                                                              \
 
+#define draw_pixel_line_skip_shaded()                                          \
+{                                                                              \
+  current_r += gradient_r;                                                     \
+  current_g += gradient_g;                                                     \
+  current_b += gradient_b;                                                     \
+}                                                                              \
+
+#define draw_pixel_line_skip_unshaded()                                        \
+
 
 #define draw_pixel_line_dithered(_x, _y)                                       \
 {                                                                              \
@@ -4464,10 +4487,14 @@ void render_sprite(psx_gpu_struct *psx_gpu, s32 x, s32 y, u32 u, u32 v,
 
 #define draw_pixel_line(_x, _y, shading, blending, dithering, mask_evaluate,   \
  blend_mode)                                                                   \
-  if((_x >= psx_gpu->viewport_start_x) && (_y >= psx_gpu->viewport_start_y) && \
-   (_x <= psx_gpu->viewport_end_x) && (_y <= psx_gpu->viewport_end_y))         \
+  if((_x >= psx_gpu->viewport_start_x) && (_y >= viewport_start_y) &&          \
+   (_x <= psx_gpu->viewport_end_x) && (_y <= viewport_end_y))                  \
   {                                                                            \
-    draw_pixel_line_mask_evaluate_##mask_evaluate()                            \
+    if((_y < band_start_y) || (_y > band_end_y))                               \
+    {                                                                          \
+      draw_pixel_line_skip_##shading();                                        \
+    }                                                                          \
+    else draw_pixel_line_mask_evaluate_##mask_evaluate()                       \
     {                                                                          \
       draw_pixel_line_##shading();                                             \
       draw_pixel_line_##dithering(_x, _y);                                     \
@@ -4636,6 +4663,12 @@ void render_line(psx_gpu_struct *psx_gpu, vertex_struct *vertexes, u32 flags,
 
   u16 *vram_ptr;
 
+  // the rows of other threads only step the shading, see psx_gpu_bands.c
+  s32 viewport_start_y = psx_gpu->viewport_start_y;
+  s32 viewport_end_y = psx_gpu->viewport_end_y;
+  s32 band_start_y = viewport_start_y;
+  s32 band_end_y = viewport_end_y;
+
   flush_render_block_buffer(psx_gpu);
   psx_gpu->primitive_type = PRIMITIVE_TYPE_LINE;
 
@@ -4675,6 +4708,18 @@ void render_line(psx_gpu_struct *psx_gpu, vertex_struct *vertexes, u32 flags,
     delta_y *= 2;
   }
 
+  if((psx_gpu->band_start_y != 0 || psx_gpu->band_end_y != 511) &&
+   (flags & RENDER_FLAGS_SHADE))
+  {
+    viewport_start_y = psx_gpu->area_start_y;
+    viewport_end_y = psx_gpu->area_end_y;
+    if(double_resolution)
+    {
+      viewport_start_y *= 2;
+      viewport_end_y = viewport_end_y * 2 + 1;
+    }
+  }
+
   flags &= ~RENDER_FLAGS_TEXTURE_MAP;
 
   vram_ptr = psx_gpu->vram_out_ptr + (y_a * 1024) + x_a;
@@ -5077,6 +5122,15 @@ void initialize_psx_gpu(psx_gpu_struct *psx_gpu, u16 *vram)
   psx_gpu->primitive_type = PRIMITIVE_TYPE_UNKNOWN;
 
   psx_gpu->enhancement_x_threshold = 256;
+
+  psx_gpu->band_start_y = 0;
+  psx_gpu->band_end_y = 511;
+  psx_gpu->area_start_y = psx_gpu->viewport_start_y;
+  psx_gpu->area_end_y = psx_gpu->viewport_end_y;
+
+#ifdef HAVE_PSX_GPU_X86
+  psx_gpu_x86_init(X86_LEVEL_AVX2);
+#endif
 }
 
 u64 get_us(void)
@@ -5142,3 +5196,7 @@ void triangle_benchmark(psx_gpu_struct *psx_gpu)
 #endif
 
 #include "psx_gpu_4x.c"
+
+#ifdef HAVE_PSX_GPU_X86
+#include "psx_gpu_x86.c"
+#endif
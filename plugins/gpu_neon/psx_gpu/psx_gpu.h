@@ -208,6 +208,13 @@ typedef struct
   u8 texture_8bpp_even_cache[16][256 * 256];
   u8 texture_8bpp_odd_cache[16][256 * 256];
   int use_dithering;
+
+  // Rows this instance draws when rendering is split over threads, the
+  // viewport is the draw area (area_*) clipped to them.
+  s16 band_start_y;
+  s16 band_end_y;
+  s16 area_start_y;
+  s16 area_end_y;
 } psx_gpu_struct;
 
 typedef struct __attribute__((aligned(16)))
@@ -153,6 +153,84 @@ void set_triangle_color(psx_gpu_struct *psx_gpu, u32 triangle_color)
   }
 }
 
+// Clips count rows at *y, *y + step, .. to the rows of this instance's band,
+// moving *y to the first one left. Returns the number of rows left.
+static s32 band_clip_rows(psx_gpu_struct *psx_gpu, s32 *y, s32 count,
+ s32 step)
+{
+  s32 first = 0, last = count - 1;
+
+  if(*y < psx_gpu->band_start_y)
+    first = (psx_gpu->band_start_y - *y + step - 1) / step;
+
+  if(*y + last * step > psx_gpu->band_end_y)
+  {
+    if(*y > psx_gpu->band_end_y)
+      last = -1;
+    else
+      last = (psx_gpu->band_end_y - *y) / step;
+  }
+
+  *y += first * step;
+  return last - first + 1;
+}
+
+static void render_block_fill_band(psx_gpu_struct *psx_gpu, u32 color,
+ u32 x, u32 y, u32 width, u32 height)
+{
+  s32 first_y = y, count = height, step = 1;
+  s32 band_y, rows;
+
+  if(psx_gpu->render_mode & RENDER_INTERLACE_ENABLED)
+  {
+    step = 2;
+    count = height / 2;
+    if(psx_gpu->render_mode & RENDER_INTERLACE_ODD)
+      first_y++;
+  }
+
+  band_y = first_y;
+  rows = band_clip_rows(psx_gpu, &band_y, count, step);
+  if(rows == count)
+    render_block_fill(psx_gpu, color, x, y, width, height);
+  else if(rows > 0)
+  {
+    render_block_fill(psx_gpu, color, x, y + band_y - first_y, width,
+     rows * step);
+  }
+}
+
+static void update_viewport_y(psx_gpu_struct *psx_gpu)
+{
+  s16 viewport_start_y = psx_gpu->area_start_y;
+  s16 viewport_end_y = psx_gpu->area_end_y;
+
+  if(viewport_start_y < psx_gpu->band_start_y)
+    viewport_start_y = psx_gpu->band_start_y;
+  if(viewport_end_y > psx_gpu->band_end_y)
+    viewport_end_y = psx_gpu->band_end_y;
+
+  psx_gpu->viewport_start_y = viewport_start_y;
+  psx_gpu->viewport_end_y = viewport_end_y;
+
+#ifdef TEXTURE_CACHE_4BPP
+  psx_gpu->viewport_mask =
+   texture_region_mask(psx_gpu->viewport_start_x,
+   psx_gpu->viewport_start_y, psx_gpu->viewport_end_x,
+   psx_gpu->viewport_end_y);
+
+  // none of the area is in the band, reject everything early
+  if(viewport_start_y > viewport_end_y &&
+   psx_gpu->area_start_y <= psx_gpu->area_end_y)
+  {
+    psx_gpu->viewport_mask = 0;
+  }
+#endif
+}
+
+#define band_has_all_rows(psx_gpu)                                             \
+  ((psx_gpu)->band_start_y == 0 && (psx_gpu)->band_end_y == 511)               \
+
 static void do_fill(psx_gpu_struct *psx_gpu, u32 x, u32 y,
  u32 width, u32 height, u32 color)
 {
@@ -171,15 +249,15 @@ static void do_fill(psx_gpu_struct *psx_gpu, u32 x, u32 y,
       u32 height_a = 512 - y;
       u32 height_b = height - height_a;
 
-      render_block_fill(psx_gpu, color, x, y, width_a, height_a);
-      render_block_fill(psx_gpu, color, 0, y, width_b, height_a);
-      render_block_fill(psx_gpu, color, x, 0, width_a, height_b);
-      render_block_fill(psx_gpu, color, 0, 0, width_b, height_b);
+      render_block_fill_band(psx_gpu, color, x, y, width_a, height_a);
+      render_block_fill_band(psx_gpu, color, 0, y, width_b, height_a);
+      render_block_fill_band(psx_gpu, color, x, 0, width_a, height_b);
+      render_block_fill_band(psx_gpu, color, 0, 0, width_b, height_b);
     }
     else
     {
-      render_block_fill(psx_gpu, color, x, y, width_a, height);
-      render_block_fill(psx_gpu, color, 0, y, width_b, height);
+      render_block_fill_band(psx_gpu, color, x, y, width_a, height);
+      render_block_fill_band(psx_gpu, color, 0, y, width_b, height);
     }
   }
   else
@@ -189,12 +267,12 @@ static void do_fill(psx_gpu_struct *psx_gpu, u32 x, u32 y,
       u32 height_a = 512 - y;
       u32 height_b = height - height_a;
 
-      render_block_fill(psx_gpu, color, x, y, width, height_a);
-      render_block_fill(psx_gpu, color, x, 0, width, height_b);
+      render_block_fill_band(psx_gpu, color, x, y, width, height_a);
+      render_block_fill_band(psx_gpu, color, x, 0, width, height_b);
     }
     else
     {
-      render_block_fill(psx_gpu, color, x, y, width, height);
+      render_block_fill_band(psx_gpu, color, x, y, width, height);
     }
   }
 }
@@ -250,10 +328,9 @@ static void do_fill(psx_gpu_struct *psx_gpu, u32 x, u32 y,
 #define SET_Ex(r, v)
 #endif
 
-vertex_struct vertexes[4] __attribute__((aligned(32)));
-
 u32 gpu_parse(psx_gpu_struct *psx_gpu, u32 *list, u32 size, u32 *last_command)
 {
+  vertex_struct vertexes[4] __attribute__((aligned(32)));
   u32 current_command = 0, command_length;
 
   u32 *list_start = list;
@@ -618,6 +695,8 @@ u32 gpu_parse(psx_gpu_struct *psx_gpu, u32 *list, u32 size, u32 *last_command)
 
         if (sx == dx && sy == dy && psx_gpu->mask_msb == 0)
           break;
+        if (!band_has_all_rows(psx_gpu))
+          break;
 
         render_block_move(psx_gpu, sx, sy, dx, dy, w, h);
         break;
@@ -702,20 +781,15 @@ u32 gpu_parse(psx_gpu_struct *psx_gpu, u32 *list, u32 size, u32 *last_command)
         s16 viewport_start_y = (list[0] >> 10) & 0x1FF;
 
         if(viewport_start_x == psx_gpu->viewport_start_x &&
-         viewport_start_y == psx_gpu->viewport_start_y)
+         viewport_start_y == psx_gpu->area_start_y)
         {
           break;
         }
   
         psx_gpu->viewport_start_x = viewport_start_x;
-        psx_gpu->viewport_start_y = viewport_start_y;
+        psx_gpu->area_start_y = viewport_start_y;
+        update_viewport_y(psx_gpu);
 
-#ifdef TEXTURE_CACHE_4BPP
-        psx_gpu->viewport_mask =
-         texture_region_mask(psx_gpu->viewport_start_x,
-         psx_gpu->viewport_start_y, psx_gpu->viewport_end_x,
-         psx_gpu->viewport_end_y);
-#endif
         SET_Ex(3, list[0]);
         break;
       }
@@ -726,20 +800,15 @@ u32 gpu_parse(psx_gpu_struct *psx_gpu, u32 *list, u32 size, u32 *last_command)
         s16 viewport_end_y = (list[0] >> 10) & 0x1FF;
 
         if(viewport_end_x == psx_gpu->viewport_end_x &&
-         viewport_end_y == psx_gpu->viewport_end_y)
+         viewport_end_y == psx_gpu->area_end_y)
         {
           break;
         }
 
         psx_gpu->viewport_end_x = viewport_end_x;
-        psx_gpu->viewport_end_y = viewport_end_y;
+        psx_gpu->area_end_y = viewport_end_y;
+        update_viewport_y(psx_gpu);
 
-#ifdef TEXTURE_CACHE_4BPP
-        psx_gpu->viewport_mask =
-         texture_region_mask(psx_gpu->viewport_start_x,
-         psx_gpu->viewport_start_y, psx_gpu->viewport_end_x,
-         psx_gpu->viewport_end_y);
-#endif
         SET_Ex(4, list[0]);
         break;
       }
@@ -870,13 +939,13 @@ extern void scale2x_tiles8(void *dst, const void *src, int w8, int h);
 // TODO?
 void scale2x_tiles8(void *dst, const void *src, int w8, int h)
 {
-  uint16_t* d = (uint16_t*)dst;
-  const uint16_t* s = (const uint16_t*)src;
+  u16 *d = (u16 *)dst;
+  const u16 *s = (const u16 *)src;
 
   while ( h-- )
   {
-    uint16_t* d_save = d;
-    const uint16_t* s_save = s;
+    u16 *d_save = d;
+    const u16 *s_save = s;
     int w = w8;
 
     while ( w-- )
@@ -1062,6 +1131,7 @@ static void do_sprite_enhanced(psx_gpu_struct *psx_gpu, int x, int y,
 u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
  u32 *last_command)
 {
+  vertex_struct vertexes[4] __attribute__((aligned(32)));
   u32 current_command = 0, command_length;
 
   u32 *list_start = list;
@@ -1097,12 +1167,23 @@ u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
         u32 width = list_s16[4] & 0x3FF;
         u32 height = list_s16[5] & 0x1FF;
         u32 color = list[0] & 0xFFFFFF;
+        s32 band_y, rows;
 
         x &= ~0xF;
         width = ((width + 0xF) & ~0xF);
 
         do_fill(psx_gpu, x, y, width, height, color);
 
+        band_y = y;
+        rows = band_clip_rows(psx_gpu, &band_y, height, 1);
+        if(rows < (s32)height)
+        {
+          if(rows <= 0)
+            break;
+          y = band_y;
+          height = rows;
+        }
+
         psx_gpu->vram_out_ptr = select_enhancement_buf_ptr(psx_gpu, x);
         x *= 2;
         y *= 2;
@@ -1460,6 +1541,8 @@ u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
 
         if (sx == dx && sy == dy && psx_gpu->mask_msb == 0)
           break;
+        if (!band_has_all_rows(psx_gpu))
+          break;
 
         render_block_move(psx_gpu, sx, sy, dx, dy, w, h);
         if (dy + h > 512)
@@ -1532,14 +1615,15 @@ u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
         s32 d;
 
         if(viewport_start_x == psx_gpu->viewport_start_x &&
-         viewport_start_y == psx_gpu->viewport_start_y)
+         viewport_start_y == psx_gpu->area_start_y)
         {
           break;
         }
         psx_gpu->viewport_start_x = viewport_start_x;
-        psx_gpu->viewport_start_y = viewport_start_y;
+        psx_gpu->area_start_y = viewport_start_y;
+        update_viewport_y(psx_gpu);
         psx_gpu->saved_viewport_start_x = viewport_start_x;
-        psx_gpu->saved_viewport_start_y = viewport_start_y;
+        psx_gpu->saved_viewport_start_y = psx_gpu->viewport_start_y;
 
         w = (u32)psx_gpu->viewport_end_x - (u32)viewport_start_x + 1;
         d = psx_gpu->enhancement_x_threshold - w;
@@ -1549,13 +1633,6 @@ u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
            viewport_start_x, w);
         }
         select_enhancement_buf(psx_gpu);
-
-#ifdef TEXTURE_CACHE_4BPP
-        psx_gpu->viewport_mask =
-         texture_region_mask(psx_gpu->viewport_start_x,
-         psx_gpu->viewport_start_y, psx_gpu->viewport_end_x,
-         psx_gpu->viewport_end_y);
-#endif
         SET_Ex(3, list[0]);
         break;
       }
@@ -1568,15 +1645,16 @@ u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
         s32 d;
 
         if(viewport_end_x == psx_gpu->viewport_end_x &&
-         viewport_end_y == psx_gpu->viewport_end_y)
+         viewport_end_y == psx_gpu->area_end_y)
         {
           break;
         }
 
         psx_gpu->viewport_end_x = viewport_end_x;
-        psx_gpu->viewport_end_y = viewport_end_y;
+        psx_gpu->area_end_y = viewport_end_y;
+        update_viewport_y(psx_gpu);
         psx_gpu->saved_viewport_end_x = viewport_end_x;
-        psx_gpu->saved_viewport_end_y = viewport_end_y;
+        psx_gpu->saved_viewport_end_y = psx_gpu->viewport_end_y;
 
         w = (u32)viewport_end_x - (u32)psx_gpu->viewport_start_x + 1;
         d = psx_gpu->enhancement_x_threshold - w;
@@ -1586,13 +1664,6 @@ u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
            psx_gpu->viewport_start_x, w);
         }
         select_enhancement_buf(psx_gpu);
-
-#ifdef TEXTURE_CACHE_4BPP
-        psx_gpu->viewport_mask =
-         texture_region_mask(psx_gpu->viewport_start_x,
-         psx_gpu->viewport_start_y, psx_gpu->viewport_end_x,
-         psx_gpu->viewport_end_y);
-#endif
         SET_Ex(4, list[0]);
         break;
       }
@@ -1633,9 +1704,9 @@ u32 gpu_parse_enhanced(psx_gpu_struct *psx_gpu, u32 *list, u32 size,
     }
   }
 
-  enhancement_disable();
-
 breakloop:
+  // the next call saves the viewport again, don't leave the doubled one
+  enhancement_disable();
   if (last_command != NULL)
     *last_command = current_command;
   return list - list_start;
@@ -0,0 +1,1103 @@
+/*
+ * SSE2/SSSE3/AVX2 versions of the block kernels (setup, texture, shade and
+ * blend), patched into the render handler tables by psx_gpu_x86_init()
+ * according to what the CPU supports. The C builders in psx_gpu.c are the
+ * reference, these must produce exactly the same blocks and vram
+ * (see tests/test_x86.c).
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+// will be included from psx_gpu.c
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#define TARGET_SSE2  __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+
+#define x86_target_sse2 TARGET_SSE2
+#define x86_target_avx2 TARGET_AVX2
+
+
+// Shade and blend are written once over these, so that the same math works
+// on one block (sse2) or on two blocks at a time (avx2). a and b are the
+// addresses for the first and second block, sse2 ignores b.
+
+#define x86_vec_sse2 __m128i
+#define x86_vec_avx2 __m256i
+
+#define x86_and_sse2(a, b)     _mm_and_si128(a, b)
+#define x86_or_sse2(a, b)      _mm_or_si128(a, b)
+#define x86_xor_sse2(a, b)     _mm_xor_si128(a, b)
+#define x86_andnot_sse2(a, b)  _mm_andnot_si128(a, b)
+#define x86_add16_sse2(a, b)   _mm_add_epi16(a, b)
+#define x86_sub16_sse2(a, b)   _mm_sub_epi16(a, b)
+#define x86_mul16_sse2(a, b)   _mm_mullo_epi16(a, b)
+#define x86_min16_sse2(a, b)   _mm_min_epi16(a, b)
+#define x86_max16_sse2(a, b)   _mm_max_epi16(a, b)
+#define x86_minu8_sse2(a, b)   _mm_min_epu8(a, b)
+#define x86_subsu8_sse2(a, b)  _mm_subs_epu8(a, b)
+#define x86_subsu16_sse2(a, b) _mm_subs_epu16(a, b)
+#define x86_cmpeq16_sse2(a, b) _mm_cmpeq_epi16(a, b)
+#define x86_shr16_sse2(a, n)   _mm_srli_epi16(a, n)
+#define x86_sar16_sse2(a, n)   _mm_srai_epi16(a, n)
+#define x86_shl16_sse2(a, n)   _mm_slli_epi16(a, n)
+#define x86_dup16_sse2(v)      _mm_set1_epi16(v)
+#define x86_zero_sse2()        _mm_setzero_si128()
+
+#define x86_and_avx2(a, b)     _mm256_and_si256(a, b)
+#define x86_or_avx2(a, b)      _mm256_or_si256(a, b)
+#define x86_xor_avx2(a, b)     _mm256_xor_si256(a, b)
+#define x86_andnot_avx2(a, b)  _mm256_andnot_si256(a, b)
+#define x86_add16_avx2(a, b)   _mm256_add_epi16(a, b)
+#define x86_sub16_avx2(a, b)   _mm256_sub_epi16(a, b)
+#define x86_mul16_avx2(a, b)   _mm256_mullo_epi16(a, b)
+#define x86_min16_avx2(a, b)   _mm256_min_epi16(a, b)
+#define x86_max16_avx2(a, b)   _mm256_max_epi16(a, b)
+#define x86_minu8_avx2(a, b)   _mm256_min_epu8(a, b)
+#define x86_subsu8_avx2(a, b)  _mm256_subs_epu8(a, b)
+#define x86_subsu16_avx2(a, b) _mm256_subs_epu16(a, b)
+#define x86_cmpeq16_avx2(a, b) _mm256_cmpeq_epi16(a, b)
+#define x86_shr16_avx2(a, n)   _mm256_srli_epi16(a, n)
+#define x86_sar16_avx2(a, n)   _mm256_srai_epi16(a, n)
+#define x86_shl16_avx2(a, n)   _mm256_slli_epi16(a, n)
+#define x86_dup16_avx2(v)      _mm256_set1_epi16(v)
+#define x86_zero_avx2()        _mm256_setzero_si256()
+
+#define x86_load_sse2(a, b)                                                    \
+  _mm_loadu_si128((const __m128i *)(a))                                        \
+
+#define x86_load_avx2(a, b)                                                    \
+  _mm256_inserti128_si256(_mm256_castsi128_si256(x86_load_sse2(a, a)),         \
+   x86_load_sse2(b, b), 1)                                                     \
+
+#define x86_store_sse2(v, a, b)                                                \
+  _mm_storeu_si128((__m128i *)(a), v)                                          \
+
+#define x86_store_avx2(v, a, b)                                                \
+  _mm_storeu_si128((__m128i *)(a), _mm256_castsi256_si128(v));                 \
+  _mm_storeu_si128((__m128i *)(b), _mm256_extracti128_si256(v, 1))             \
+
+// 8 u8s to 8 u16s
+#define x86_load_wide_sse2(a, b)                                               \
+  _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(a)),                     \
+   _mm_setzero_si128())                                                        \
+
+#define x86_load_wide_avx2(a, b)                                               \
+  _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(                                     \
+   _mm_loadl_epi64((const __m128i *)(a)),                                      \
+   _mm_loadl_epi64((const __m128i *)(b))))                                     \
+
+#define x86_dup_pair16_sse2(a, b)                                              \
+  _mm_set1_epi16(a)                                                            \
+
+#define x86_dup_pair16_avx2(a, b)                                              \
+  _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(a)),           \
+   _mm_set1_epi16(b), 1)                                                       \
+
+#define x86_dup128_sse2(v)                                                     \
+  (v)                                                                          \
+
+#define x86_dup128_avx2(v)                                                     \
+  _mm256_broadcastsi128_si256(v)                                               \
+
+// dest where mask is set, source elsewhere (bif_8x16b)
+#define x86_bif(w, dest, source, mask)                                         \
+  x86_or_##w(x86_andnot_##w(mask, source), x86_and_##w(dest, mask))            \
+
+// all ones where bits & test_mask is not zero (tst_8x16b)
+#define x86_tst(w, bits, test_mask)                                            \
+  x86_xor_##w(x86_cmpeq16_##w(x86_and_##w(bits, test_mask), x86_zero_##w()),   \
+   x86_cmpeq16_##w(x86_zero_##w(), x86_zero_##w()))                            \
+
+
+// Two blocks can only be done together when they don't touch the same vram,
+// otherwise the second one has to see what the first one wrote.
+#define x86_blocks_overlap(block)                                              \
+  ((uintptr_t)((block)[1].fb_ptr - (block)[0].fb_ptr + 7) < 15)                \
+
+#define x86_blocks_constants_sse2()                                            \
+  __m128i msb_mask_sse2 __attribute__((unused)) =                              \
+   _mm_set1_epi16(psx_gpu->mask_msb);                                          \
+  __m128i test_mask_sse2 __attribute__((unused)) =                             \
+   x86_load_sse2(&psx_gpu->test_mask, 0)                                       \
+
+#define x86_blocks_constants_avx2()                                            \
+  x86_blocks_constants_sse2();                                                 \
+  __m256i msb_mask_avx2 __attribute__((unused)) =                              \
+   x86_dup128_avx2(msb_mask_sse2);                                             \
+  __m256i test_mask_avx2 __attribute__((unused)) =                             \
+   x86_dup128_avx2(test_mask_sse2)                                             \
+
+#define x86_blocks_loop_sse2(body, args)                                       \
+  while(num_blocks)                                                            \
+  {                                                                            \
+    body(args, sse2, block, block);                                            \
+    num_blocks--;                                                              \
+    block++;                                                                   \
+  }                                                                            \
+
+#define x86_blocks_loop_avx2(body, args)                                       \
+  while(num_blocks >= 2)                                                       \
+  {                                                                            \
+    if(x86_blocks_overlap(block))                                              \
+    {                                                                          \
+      body(args, sse2, block, block);                                          \
+      num_blocks--;                                                            \
+      block++;                                                                 \
+      continue;                                                                \
+    }                                                                          \
+                                                                               \
+    body(args, avx2, block, block + 1);                                        \
+    num_blocks -= 2;                                                           \
+    block += 2;                                                                \
+  }                                                                            \
+                                                                               \
+  if(num_blocks)                                                               \
+    body(args, sse2, block, block)                                             \
+
+#define x86_args(...) __VA_ARGS__
+
+
+// Setup blocks
+
+#define setup_blocks_x86_load_msb_mask_indirect()                              \
+
+#define setup_blocks_x86_load_msb_mask_direct()                                \
+  __m128i msb_mask = _mm_set1_epi16(psx_gpu->mask_msb)                         \
+
+#define setup_blocks_x86_channel(channel, dx)                                  \
+  __m128i channel##_block;                                                     \
+  __m128i channel##_dx4 = _mm_set1_epi32((u32)(dx) << 2);                      \
+  __m128i channel##_dx8 = _mm_set1_epi32((u32)(dx) << 3)                       \
+
+#define setup_blocks_x86_variables_shaded_textured(target)                     \
+  setup_blocks_x86_channel(u, psx_gpu->uvrg_dx.e[0]);                          \
+  setup_blocks_x86_channel(v, psx_gpu->uvrg_dx.e[1]);                          \
+  setup_blocks_x86_channel(r, psx_gpu->uvrg_dx.e[2]);                          \
+  setup_blocks_x86_channel(g, psx_gpu->uvrg_dx.e[3]);                          \
+  setup_blocks_x86_channel(b, psx_gpu->b_block_span.e[1]);                     \
+  __m128i texture_mask_u = _mm_set1_epi16(psx_gpu->texture_mask_width);        \
+  __m128i texture_mask_v = _mm_set1_epi16(psx_gpu->texture_mask_height)        \
+
+#define setup_blocks_x86_variables_shaded_untextured(target)                   \
+  setup_blocks_x86_channel(r, psx_gpu->uvrg_dx.e[2]);                          \
+  setup_blocks_x86_channel(g, psx_gpu->uvrg_dx.e[3]);                          \
+  setup_blocks_x86_channel(b, psx_gpu->b_block_span.e[1])                      \
+
+#define setup_blocks_x86_variables_unshaded_textured(target)                   \
+  setup_blocks_x86_channel(u, psx_gpu->uvrg_dx.e[0]);                          \
+  setup_blocks_x86_channel(v, psx_gpu->uvrg_dx.e[1]);                          \
+  __m128i texture_mask_u = _mm_set1_epi16(psx_gpu->texture_mask_width);        \
+  __m128i texture_mask_v = _mm_set1_epi16(psx_gpu->texture_mask_height)        \
+
+#define setup_blocks_x86_variables_unshaded_untextured_direct()                \
+  colors = _mm_or_si128(colors, msb_mask)                                      \
+
+#define setup_blocks_x86_variables_unshaded_untextured_indirect()              \
+
+#define setup_blocks_x86_variables_unshaded_untextured(target)                 \
+  u32 color = psx_gpu->triangle_color;                                         \
+  __m128i colors;                                                              \
+                                                                               \
+  u32 color_r = color & 0xFF;                                                  \
+  u32 color_g = (color >> 8) & 0xFF;                                           \
+  u32 color_b = (color >> 16) & 0xFF;                                          \
+                                                                               \
+  color = (color_r >> 3) | ((color_g >> 3) << 5) |                             \
+   ((color_b >> 3) << 10);                                                     \
+  colors = _mm_set1_epi16(color);                                              \
+  setup_blocks_x86_variables_unshaded_untextured_##target()                    \
+
+#define setup_blocks_x86_span_initialize_dithered_textured()                   \
+  __m128i dither_offsets = _mm_slli_epi16(dither_offsets_short, 4)             \
+
+#define setup_blocks_x86_span_initialize_dithered_untextured()                 \
+  __m128i dither_offsets = _mm_and_si128(_mm_add_epi16(dither_offsets_short,   \
+   _mm_set1_epi16(4)), _mm_set1_epi16(0xFF))                                   \
+
+// the 4 s8 offsets of the row twice, widened to s16
+#define setup_blocks_x86_span_initialize_dithered(texturing)                   \
+  u32 dither_row = psx_gpu->dither_table[y & 0x3];                             \
+  u32 dither_shift = (span_edge_data->left_x & 0x3) * 8;                       \
+  __m128i dither_offsets_short;                                                \
+                                                                               \
+  dither_row = (dither_row >> dither_shift) |                                  \
+   (dither_row << ((32 - dither_shift) & 31));                                 \
+  dither_offsets_short = _mm_cvtsi32_si128(dither_row);                        \
+  dither_offsets_short =                                                       \
+   _mm_unpacklo_epi32(dither_offsets_short, dither_offsets_short);             \
+  dither_offsets_short = _mm_srai_epi16(                                       \
+   _mm_unpacklo_epi8(dither_offsets_short, dither_offsets_short), 8);          \
+  setup_blocks_x86_span_initialize_dithered_##texturing()                      \
+
+#define setup_blocks_x86_span_initialize_undithered(texturing)                 \
+
+#define setup_blocks_x86_span_channel(channel, value, block_span)              \
+  channel##_block = _mm_add_epi32(_mm_set1_epi32(value),                       \
+   x86_load_sse2(&psx_gpu->block_span, 0))                                     \
+
+#define setup_blocks_x86_span_initialize_shaded_textured()                     \
+{                                                                              \
+  u32 offset = span_edge_data->left_x;                                         \
+  vec_4x32u *uvrg = span_uvrg_offset;                                          \
+  vec_4x32u *uvrg_dx = &psx_gpu->uvrg_dx;                                      \
+  u32 b = *span_b_offset + psx_gpu->b_block_span.e[1] * offset;                \
+                                                                               \
+  setup_blocks_x86_span_channel(u, uvrg->e[0] + uvrg_dx->e[0] * offset,        \
+   u_block_span);                                                              \
+  setup_blocks_x86_span_channel(v, uvrg->e[1] + uvrg_dx->e[1] * offset,        \
+   v_block_span);                                                              \
+  setup_blocks_x86_span_channel(r, uvrg->e[2] + uvrg_dx->e[2] * offset,        \
+   r_block_span);                                                              \
+  setup_blocks_x86_span_channel(g, uvrg->e[3] + uvrg_dx->e[3] * offset,        \
+   g_block_span);                                                              \
+  setup_blocks_x86_span_channel(b, b, b_block_span);                           \
+}                                                                              \
+
+#define setup_blocks_x86_span_initialize_shaded_untextured()                   \
+{                                                                              \
+  u32 offset = span_edge_data->left_x;                                         \
+  vec_4x32u *uvrg = span_uvrg_offset;                                          \
+  vec_4x32u *uvrg_dx = &psx_gpu->uvrg_dx;                                      \
+  u32 b = *span_b_offset + psx_gpu->b_block_span.e[1] * offset;                \
+                                                                               \
+  setup_blocks_x86_span_channel(r, uvrg->e[2] + uvrg_dx->e[2] * offset,        \
+   r_block_span);                                                              \
+  setup_blocks_x86_span_channel(g, uvrg->e[3] + uvrg_dx->e[3] * offset,        \
+   g_block_span);                                                              \
+  setup_blocks_x86_span_channel(b, b, b_block_span);                           \
+}                                                                              \
+
+#define setup_blocks_x86_span_initialize_unshaded_textured()                   \
+{                                                                              \
+  u32 offset = span_edge_data->left_x;                                         \
+  vec_4x32u *uvrg = span_uvrg_offset;                                          \
+  vec_4x32u *uvrg_dx = &psx_gpu->uvrg_dx;                                      \
+                                                                               \
+  setup_blocks_x86_span_channel(u, uvrg->e[0] + uvrg_dx->e[0] * offset,        \
+   u_block_span);                                                              \
+  setup_blocks_x86_span_channel(v, uvrg->e[1] + uvrg_dx->e[1] * offset,        \
+   v_block_span);                                                              \
+}                                                                              \
+
+#define setup_blocks_x86_span_initialize_unshaded_untextured()                 \
+
+// low byte of the whole part for the 8 pixels, as u16s, then step 8 pixels
+#define setup_blocks_x86_whole(channel)                                        \
+  __m128i channel = _mm_packs_epi32(                                           \
+   _mm_and_si128(_mm_srli_epi32(channel##_block, 16), mask_0xFF),              \
+   _mm_and_si128(_mm_srli_epi32(                                               \
+    _mm_add_epi32(channel##_block, channel##_dx4), 16), mask_0xFF));           \
+  channel##_block = _mm_add_epi32(channel##_block, channel##_dx8)              \
+
+#define setup_blocks_x86_texture_swizzled()                                    \
+{                                                                              \
+  __m128i u_saved = u;                                                         \
+  u = _mm_or_si128(_mm_and_si128(u, _mm_set1_epi16(0x0F)),                     \
+   _mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0xF0)));                 \
+  v = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0xF0)),                     \
+   _mm_srli_epi16(u_saved, 4));                                                \
+}                                                                              \
+
+#define setup_blocks_x86_texture_unswizzled()                                  \
+
+#define setup_blocks_x86_store_uv(swizzling)                                   \
+  u = _mm_and_si128(u, texture_mask_u);                                        \
+  v = _mm_and_si128(v, texture_mask_v);                                        \
+  setup_blocks_x86_texture_##swizzling();                                      \
+                                                                               \
+  x86_store_sse2(_mm_or_si128(u, _mm_slli_epi16(v, 8)), &block->uv, 0);        \
+  x86_store_sse2(dither_offsets, &block->dither_offsets, 0);                   \
+  block->fb_ptr = fb_ptr                                                       \
+
+#define setup_blocks_x86_store_shaded_textured(swizzling, dithering, target,   \
+ edge_type)                                                                    \
+{                                                                              \
+  setup_blocks_x86_whole(u);                                                   \
+  setup_blocks_x86_whole(v);                                                   \
+  setup_blocks_x86_whole(r);                                                   \
+  setup_blocks_x86_whole(g);                                                   \
+  setup_blocks_x86_whole(b);                                                   \
+                                                                               \
+  setup_blocks_x86_store_uv(swizzling);                                        \
+  _mm_storel_epi64((__m128i *)&block->r, _mm_packus_epi16(r, r));              \
+  _mm_storel_epi64((__m128i *)&block->g, _mm_packus_epi16(g, g));              \
+  _mm_storel_epi64((__m128i *)&block->b, _mm_packus_epi16(b, b));              \
+}                                                                              \
+
+#define setup_blocks_x86_store_unshaded_textured(swizzling, dithering, target, \
+ edge_type)                                                                    \
+{                                                                              \
+  setup_blocks_x86_whole(u);                                                   \
+  setup_blocks_x86_whole(v);                                                   \
+                                                                               \
+  setup_blocks_x86_store_uv(swizzling);                                        \
+}                                                                              \
+
+#define setup_blocks_x86_store_shaded_untextured_dithered()                    \
+  r = _mm_subs_epu16(_mm_min_epi16(_mm_add_epi16(r, dither_offsets),           \
+   _mm_set1_epi16(0xFF)), _mm_set1_epi16(4));                                  \
+  g = _mm_subs_epu16(_mm_min_epi16(_mm_add_epi16(g, dither_offsets),           \
+   _mm_set1_epi16(0xFF)), _mm_set1_epi16(4));                                  \
+  b = _mm_subs_epu16(_mm_min_epi16(_mm_add_epi16(b, dither_offsets),           \
+   _mm_set1_epi16(0xFF)), _mm_set1_epi16(4))                                   \
+
+#define setup_blocks_x86_store_shaded_untextured_undithered()                  \
+
+#define setup_blocks_x86_store_untextured_pixels_indirect_full(_pixels)        \
+  x86_store_sse2(_pixels, &block->pixels, 0);                                  \
+  block->fb_ptr = fb_ptr                                                       \
+
+#define setup_blocks_x86_store_untextured_pixels_indirect_edge(_pixels)        \
+  x86_store_sse2(_pixels, &block->pixels, 0);                                  \
+  block->fb_ptr = fb_ptr                                                       \
+
+#define setup_blocks_x86_store_untextured_pixels_direct_full(_pixels)          \
+  x86_store_sse2(_pixels, fb_ptr, 0)                                           \
+
+#define setup_blocks_x86_store_untextured_pixels_direct_edge(_pixels)          \
+{                                                                              \
+  __m128i fb_pixels = x86_load_sse2(fb_ptr, 0);                                \
+  __m128i draw_mask = x86_tst(sse2,                                            \
+   _mm_set1_epi16(span_edge_data->right_mask),                                 \
+   x86_load_sse2(&psx_gpu->test_mask, 0));                                     \
+                                                                               \
+  fb_pixels = x86_bif(sse2, fb_pixels, _pixels, draw_mask);                    \
+  x86_store_sse2(fb_pixels, fb_ptr, 0);                                        \
+}                                                                              \
+
+#define setup_blocks_x86_store_shaded_untextured_seed_pixels_indirect()        \
+
+#define setup_blocks_x86_store_shaded_untextured_seed_pixels_direct()          \
+  pixels = _mm_or_si128(pixels, msb_mask)                                      \
+
+#define setup_blocks_x86_store_shaded_untextured(swizzling, dithering, target, \
+ edge_type)                                                                    \
+{                                                                              \
+  __m128i pixels;                                                              \
+                                                                               \
+  setup_blocks_x86_whole(r);                                                   \
+  setup_blocks_x86_whole(g);                                                   \
+  setup_blocks_x86_whole(b);                                                   \
+                                                                               \
+  setup_blocks_x86_store_shaded_untextured_##dithering();                      \
+                                                                               \
+  r = _mm_srli_epi16(r, 3);                                                    \
+  g = _mm_and_si128(g, _mm_set1_epi16(0xF8));                                  \
+  b = _mm_and_si128(b, _mm_set1_epi16(0xF8));                                  \
+                                                                               \
+  pixels = _mm_or_si128(r,                                                     \
+   _mm_or_si128(_mm_slli_epi16(g, 2), _mm_slli_epi16(b, 7)));                  \
+  setup_blocks_x86_store_shaded_untextured_seed_pixels_##target();             \
+                                                                               \
+  setup_blocks_x86_store_untextured_pixels_##target##_##edge_type(pixels);     \
+}                                                                              \
+
+#define setup_blocks_x86_store_unshaded_untextured(swizzling, dithering,       \
+ target, edge_type)                                                            \
+  setup_blocks_x86_store_untextured_pixels_##target##_##edge_type(colors)      \
+
+#define setup_blocks_x86_store_draw_mask_textured_indirect(_block, bits)       \
+  (_block)->draw_mask_bits = bits                                              \
+
+#define setup_blocks_x86_store_draw_mask_untextured_indirect(_block, bits)     \
+  x86_store_sse2(x86_tst(sse2, _mm_set1_epi16(bits),                           \
+   x86_load_sse2(&psx_gpu->test_mask, 0)), &(_block)->draw_mask, 0)            \
+
+#define setup_blocks_x86_store_draw_mask_untextured_direct(_block, bits)       \
+
+#define setup_blocks_x86_builder(shading, texturing, dithering, sw, target)    \
+void TARGET_SSE2                                                               \
+ setup_blocks_##shading##_##texturing##_##dithering##_##sw##_##target##_sse2(  \
+ psx_gpu_struct *psx_gpu)                                                      \
+{                                                                              \
+  setup_blocks_x86_load_msb_mask_##target();                                   \
+  setup_blocks_x86_variables_##shading##_##texturing(target);                  \
+  __m128i mask_0xFF __attribute__((unused)) = _mm_set1_epi32(0xFF);            \
+                                                                               \
+  edge_data_struct *span_edge_data = psx_gpu->span_edge_data;                  \
+  vec_4x32u *span_uvrg_offset = psx_gpu->span_uvrg_offset;                     \
+  u32 *span_b_offset = psx_gpu->span_b_offset;                                 \
+                                                                               \
+  block_struct *block = psx_gpu->blocks + psx_gpu->num_blocks;                 \
+                                                                               \
+  u32 num_spans = psx_gpu->num_spans;                                          \
+                                                                               \
+  u16 *fb_ptr;                                                                 \
+  u32 y;                                                                       \
+                                                                               \
+  u32 num_blocks = psx_gpu->num_blocks;                                        \
+  u32 span_num_blocks;                                                         \
+                                                                               \
+  while(num_spans)                                                             \
+  {                                                                            \
+    span_num_blocks = span_edge_data->num_blocks;                              \
+    if(span_num_blocks)                                                        \
+    {                                                                          \
+      y = span_edge_data->y;                                                   \
+      fb_ptr = psx_gpu->vram_out_ptr + span_edge_data->left_x + (y * 1024);    \
+                                                                               \
+      setup_blocks_x86_span_initialize_##shading##_##texturing();              \
+      setup_blocks_x86_span_initialize_##dithering(texturing);                 \
+                                                                               \
+      setup_blocks_add_blocks_##target();                                      \
+                                                                               \
+      s32 pixel_span = span_num_blocks * 8;                                    \
+      pixel_span -= __builtin_popcount(span_edge_data->right_mask & 0xFF);     \
+      span_pixels += pixel_span;                                               \
+                                                                               \
+      span_num_blocks--;                                                       \
+      while(span_num_blocks)                                                   \
+      {                                                                        \
+        setup_blocks_x86_store_##shading##_##texturing(sw, dithering, target,  \
+         full);                                                                \
+        setup_blocks_x86_store_draw_mask_##texturing##_##target(block, 0x00);  \
+                                                                               \
+        fb_ptr += 8;                                                           \
+        block++;                                                               \
+        span_num_blocks--;                                                     \
+      }                                                                        \
+                                                                               \
+      setup_blocks_x86_store_##shading##_##texturing(sw, dithering, target,    \
+       edge);                                                                  \
+      setup_blocks_x86_store_draw_mask_##texturing##_##target(block,           \
+       span_edge_data->right_mask);                                            \
+                                                                               \
+      block++;                                                                 \
+    }                                                                          \
+    else                                                                       \
+    {                                                                          \
+      zero_block_spans++;                                                      \
+    }                                                                          \
+                                                                               \
+    num_spans--;                                                               \
+    span_edge_data++;                                                          \
+    span_uvrg_offset++;                                                        \
+    span_b_offset++;                                                           \
+  }                                                                            \
+                                                                               \
+  psx_gpu->num_blocks = num_blocks;                                            \
+}                                                                              \
+
+setup_blocks_x86_builder(shaded, textured, dithered, swizzled, indirect);
+setup_blocks_x86_builder(shaded, textured, dithered, unswizzled, indirect);
+
+setup_blocks_x86_builder(unshaded, textured, dithered, unswizzled, indirect);
+setup_blocks_x86_builder(unshaded, textured, dithered, swizzled, indirect);
+
+setup_blocks_x86_builder(shaded, untextured, undithered, unswizzled, indirect);
+setup_blocks_x86_builder(shaded, untextured, dithered, unswizzled, indirect);
+setup_blocks_x86_builder(shaded, untextured, undithered, unswizzled, direct);
+setup_blocks_x86_builder(shaded, untextured, dithered, unswizzled, direct);
+
+setup_blocks_x86_builder(unshaded, untextured, undithered, unswizzled,
+ indirect);
+setup_blocks_x86_builder(unshaded, untextured, undithered, unswizzled, direct);
+
+
+// Texture blocks, the texel fetches stay scalar (no gathers from vram), but
+// the 4bpp CLUT lookup is done with pshufb.
+
+void TARGET_SSSE3 texture_blocks_4bpp_ssse3(psx_gpu_struct *psx_gpu)
+{
+  block_struct *block = psx_gpu->blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+  texel_blocks_4bpp += num_blocks;
+
+  u8 *texture_ptr_8bpp = psx_gpu->texture_page_ptr;
+  u16 *clut_ptr = psx_gpu->clut_ptr;
+
+  __m128i clut_a = x86_load_sse2(clut_ptr, 0);
+  __m128i clut_b = x86_load_sse2(clut_ptr + 8, 0);
+  __m128i clut_low = _mm_packus_epi16(
+   _mm_and_si128(clut_a, _mm_set1_epi16(0xFF)),
+   _mm_and_si128(clut_b, _mm_set1_epi16(0xFF)));
+  __m128i clut_high = _mm_packus_epi16(_mm_srli_epi16(clut_a, 8),
+   _mm_srli_epi16(clut_b, 8));
+
+  if(psx_gpu->current_texture_mask & psx_gpu->dirty_textures_4bpp_mask)
+    update_texture_4bpp_cache(psx_gpu);
+
+  while(num_blocks)
+  {
+    u16 *uv = block->uv.e;
+    __m128i texels = _mm_setzero_si128();
+
+    texels = _mm_insert_epi16(texels, texture_ptr_8bpp[uv[0]] |
+     (texture_ptr_8bpp[uv[1]] << 8), 0);
+    texels = _mm_insert_epi16(texels, texture_ptr_8bpp[uv[2]] |
+     (texture_ptr_8bpp[uv[3]] << 8), 1);
+    texels = _mm_insert_epi16(texels, texture_ptr_8bpp[uv[4]] |
+     (texture_ptr_8bpp[uv[5]] << 8), 2);
+    texels = _mm_insert_epi16(texels, texture_ptr_8bpp[uv[6]] |
+     (texture_ptr_8bpp[uv[7]] << 8), 3);
+
+    // tbl_16 gives 0 for indexes past the table, pshufb does that for
+    // the ones with the top bit set
+    texels = _mm_or_si128(texels,
+     _mm_cmpgt_epi8(texels, _mm_set1_epi8(15)));
+
+    x86_store_sse2(_mm_unpacklo_epi8(_mm_shuffle_epi8(clut_low, texels),
+     _mm_shuffle_epi8(clut_high, texels)), &block->texels, 0);
+
+    num_blocks--;
+    block++;
+  }
+}
+
+void TARGET_SSE2 texture_blocks_8bpp_sse2(psx_gpu_struct *psx_gpu)
+{
+  block_struct *block = psx_gpu->blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+
+  texel_blocks_8bpp += num_blocks;
+
+  if(psx_gpu->current_texture_mask & psx_gpu->dirty_textures_8bpp_mask)
+    update_texture_8bpp_cache(psx_gpu);
+
+  u8 *texture_ptr_8bpp = psx_gpu->texture_page_ptr;
+  u16 *clut_ptr = psx_gpu->clut_ptr;
+
+  while(num_blocks)
+  {
+    u16 *uv = block->uv.e;
+    __m128i texels = _mm_cvtsi32_si128(clut_ptr[texture_ptr_8bpp[uv[0]]]);
+
+    texels = _mm_insert_epi16(texels, clut_ptr[texture_ptr_8bpp[uv[1]]], 1);
+    texels = _mm_insert_epi16(texels, clut_ptr[texture_ptr_8bpp[uv[2]]], 2);
+    texels = _mm_insert_epi16(texels, clut_ptr[texture_ptr_8bpp[uv[3]]], 3);
+    texels = _mm_insert_epi16(texels, clut_ptr[texture_ptr_8bpp[uv[4]]], 4);
+    texels = _mm_insert_epi16(texels, clut_ptr[texture_ptr_8bpp[uv[5]]], 5);
+    texels = _mm_insert_epi16(texels, clut_ptr[texture_ptr_8bpp[uv[6]]], 6);
+    texels = _mm_insert_epi16(texels, clut_ptr[texture_ptr_8bpp[uv[7]]], 7);
+
+    x86_store_sse2(texels, &block->texels, 0);
+
+    num_blocks--;
+    block++;
+  }
+}
+
+void TARGET_SSE2 texture_blocks_16bpp_sse2(psx_gpu_struct *psx_gpu)
+{
+  block_struct *block = psx_gpu->blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+
+  texel_blocks_16bpp += num_blocks;
+
+  u16 *texture_ptr_16bpp = psx_gpu->texture_page_ptr;
+  __m128i u_mask = _mm_set1_epi16(0xFF);
+  __m128i v_scale = _mm_set1_epi32(1 | (1024 << 16));
+  u32 offsets[8] __attribute__((aligned(16)));
+
+  while(num_blocks)
+  {
+    // u + v * 1024 with pmaddwd
+    __m128i uv = x86_load_sse2(&block->uv, 0);
+    __m128i u = _mm_and_si128(uv, u_mask);
+    __m128i v = _mm_srli_epi16(uv, 8);
+    __m128i texels;
+
+    _mm_store_si128((__m128i *)offsets,
+     _mm_madd_epi16(_mm_unpacklo_epi16(u, v), v_scale));
+    _mm_store_si128((__m128i *)(offsets + 4),
+     _mm_madd_epi16(_mm_unpackhi_epi16(u, v), v_scale));
+
+    texels = _mm_cvtsi32_si128(texture_ptr_16bpp[offsets[0]]);
+    texels = _mm_insert_epi16(texels, texture_ptr_16bpp[offsets[1]], 1);
+    texels = _mm_insert_epi16(texels, texture_ptr_16bpp[offsets[2]], 2);
+    texels = _mm_insert_epi16(texels, texture_ptr_16bpp[offsets[3]], 3);
+    texels = _mm_insert_epi16(texels, texture_ptr_16bpp[offsets[4]], 4);
+    texels = _mm_insert_epi16(texels, texture_ptr_16bpp[offsets[5]], 5);
+    texels = _mm_insert_epi16(texels, texture_ptr_16bpp[offsets[6]], 6);
+    texels = _mm_insert_epi16(texels, texture_ptr_16bpp[offsets[7]], 7);
+
+    x86_store_sse2(texels, &block->texels, 0);
+
+    num_blocks--;
+    block++;
+  }
+}
+
+
+// Shade blocks
+
+#define shade_blocks_x86_store_indirect(w, block_a, block_b, _draw_mask,       \
+ _pixels)                                                                      \
+  x86_store_##w(_draw_mask, &(block_a)->draw_mask, &(block_b)->draw_mask);     \
+  x86_store_##w(_pixels, &(block_a)->pixels, &(block_b)->pixels)               \
+
+#define shade_blocks_x86_store_direct(w, block_a, block_b, _draw_mask,         \
+ _pixels)                                                                      \
+{                                                                              \
+  x86_vec_##w fb_pixels = x86_load_##w((block_a)->fb_ptr, (block_b)->fb_ptr);  \
+  fb_pixels = x86_bif(w, fb_pixels, x86_or_##w(_pixels, msb_mask_##w),         \
+   _draw_mask);                                                                \
+  x86_store_##w(fb_pixels, (block_a)->fb_ptr, (block_b)->fb_ptr);              \
+}                                                                              \
+
+#define shade_blocks_x86_draw_mask(w, block_a, block_b)                        \
+  x86_tst(w, x86_dup_pair16_##w((block_a)->draw_mask_bits,                     \
+   (block_b)->draw_mask_bits),                                                 \
+   test_mask_##w)                                                              \
+
+#define shade_blocks_x86_textured_unmodulated_body(target, w, block_a,         \
+ block_b)                                                                      \
+{                                                                              \
+  x86_vec_##w pixels = x86_load_##w(&(block_a)->texels, &(block_b)->texels);   \
+  x86_vec_##w zero_mask = x86_or_##w(                                          \
+   x86_cmpeq16_##w(pixels, x86_zero_##w()),                                    \
+   shade_blocks_x86_draw_mask(w, block_a, block_b));                           \
+                                                                               \
+  shade_blocks_x86_store_##target(w, block_a, block_b, zero_mask, pixels);     \
+}                                                                              \
+
+#define shade_blocks_x86_textured_unmodulated_builder(target, w)               \
+void x86_target_##w shade_blocks_textured_unmodulated_##target##_##w(          \
+ psx_gpu_struct *psx_gpu)                                                      \
+{                                                                              \
+  block_struct *block = psx_gpu->blocks;                                       \
+  u32 num_blocks = psx_gpu->num_blocks;                                        \
+  x86_blocks_constants_##w();                                                  \
+                                                                               \
+  x86_blocks_loop_##w(shade_blocks_x86_textured_unmodulated_body, target);     \
+}                                                                              \
+
+shade_blocks_x86_textured_unmodulated_builder(indirect, sse2)
+shade_blocks_x86_textured_unmodulated_builder(direct, sse2)
+shade_blocks_x86_textured_unmodulated_builder(indirect, avx2)
+shade_blocks_x86_textured_unmodulated_builder(direct, avx2)
+
+
+#define shade_blocks_x86_false_modulated_check_dithered(target, w)             \
+  if(color == 0x808080)                                                        \
+  {                                                                            \
+    false_modulated_blocks += num_blocks;                                      \
+  }                                                                            \
+
+#define shade_blocks_x86_false_modulated_check_undithered(target, w)           \
+  if(color == 0x808080)                                                        \
+  {                                                                            \
+    shade_blocks_textured_unmodulated_##target##_##w(psx_gpu);                 \
+    false_modulated_blocks += num_blocks;                                      \
+    return;                                                                    \
+  }                                                                            \
+
+#define shade_blocks_x86_modulated_shaded_primitive_load(dithering, target, w) \
+
+#define shade_blocks_x86_modulated_unshaded_primitive_load(dithering, target,  \
+ w)                                                                            \
+  u32 color = psx_gpu->triangle_color;                                         \
+  shade_blocks_x86_false_modulated_check_##dithering(target, w)                \
+
+#define shade_blocks_x86_modulated_shaded_colors(w, block_a, block_b)          \
+  x86_vec_##w colors_r = x86_load_wide_##w(&(block_a)->r, &(block_b)->r);      \
+  x86_vec_##w colors_g = x86_load_wide_##w(&(block_a)->g, &(block_b)->g);      \
+  x86_vec_##w colors_b = x86_load_wide_##w(&(block_a)->b, &(block_b)->b)       \
+
+#define shade_blocks_x86_modulated_unshaded_colors(w, block_a, block_b)        \
+  x86_vec_##w colors_r = x86_dup16_##w(color & 0xFF);                          \
+  x86_vec_##w colors_g = x86_dup16_##w((color >> 8) & 0xFF);                   \
+  x86_vec_##w colors_b = x86_dup16_##w((color >> 16) & 0xFF)                   \
+
+#define shade_blocks_x86_modulate_dithered(w, block_a, block_b)                \
+{                                                                              \
+  x86_vec_##w dither_offsets =                                                 \
+   x86_load_##w(&(block_a)->dither_offsets, &(block_b)->dither_offsets);       \
+  pixels_r = x86_add16_##w(pixels_r, dither_offsets);                          \
+  pixels_g = x86_add16_##w(pixels_g, dither_offsets);                          \
+  pixels_b = x86_add16_##w(pixels_b, dither_offsets);                          \
+}                                                                              \
+
+#define shade_blocks_x86_modulate_undithered(w, block_a, block_b)              \
+
+// (s16)x >> 4 clamped to 0-255 (shrq_narrow_signed_8x16b)
+#define shade_blocks_x86_narrow(w, x)                                          \
+  x86_min16_##w(x86_max16_##w(x86_sar16_##w(x, 4), x86_zero_##w()),            \
+   x86_dup16_##w(0xFF))                                                        \
+
+#define shade_blocks_x86_modulated_body(shading, dithering, target, w,         \
+ block_a, block_b)                                                             \
+{                                                                              \
+  x86_vec_##w texels = x86_load_##w(&(block_a)->texels, &(block_b)->texels);   \
+  x86_vec_##w mask_0x1F = x86_dup16_##w(0x1F);                                 \
+  x86_vec_##w mask_0xF8 = x86_dup16_##w(0xF8);                                 \
+  x86_vec_##w zero_mask;                                                       \
+  x86_vec_##w pixels;                                                          \
+  shade_blocks_x86_modulated_##shading##_colors(w, block_a, block_b);          \
+                                                                               \
+  x86_vec_##w pixels_r = x86_mul16_##w(x86_and_##w(texels, mask_0x1F),         \
+   colors_r);                                                                  \
+  x86_vec_##w pixels_g = x86_mul16_##w(                                        \
+   x86_and_##w(x86_shr16_##w(texels, 5), mask_0x1F), colors_g);                \
+  x86_vec_##w pixels_b = x86_mul16_##w(                                        \
+   x86_and_##w(x86_shr16_##w(texels, 10), mask_0x1F), colors_b);               \
+                                                                               \
+  shade_blocks_x86_modulate_##dithering(w, block_a, block_b);                  \
+                                                                               \
+  pixels_r = x86_shr16_##w(shade_blocks_x86_narrow(w, pixels_r), 3);           \
+  pixels_g = x86_and_##w(shade_blocks_x86_narrow(w, pixels_g), mask_0xF8);     \
+  pixels_b = x86_and_##w(shade_blocks_x86_narrow(w, pixels_b), mask_0xF8);     \
+                                                                               \
+  pixels = x86_and_##w(texels, x86_dup16_##w(0x8000));                         \
+  pixels = x86_or_##w(pixels, x86_or_##w(pixels_r,                             \
+   x86_or_##w(x86_shl16_##w(pixels_g, 2), x86_shl16_##w(pixels_b, 7))));       \
+                                                                               \
+  zero_mask = x86_or_##w(x86_cmpeq16_##w(texels, x86_zero_##w()),              \
+   shade_blocks_x86_draw_mask(w, block_a, block_b));                           \
+                                                                               \
+  shade_blocks_x86_store_##target(w, block_a, block_b, zero_mask, pixels);     \
+}                                                                              \
+
+#define shade_blocks_x86_textured_modulated_builder(shading, dithering,        \
+ target, w)                                                                    \
+void x86_target_##w                                                            \
+ shade_blocks_##shading##_textured_modulated_##dithering##_##target##_##w(     \
+ psx_gpu_struct *psx_gpu)                                                      \
+{                                                                              \
+  block_struct *block = psx_gpu->blocks;                                       \
+  u32 num_blocks = psx_gpu->num_blocks;                                        \
+  x86_blocks_constants_##w();                                                  \
+                                                                               \
+  shade_blocks_x86_modulated_##shading##_primitive_load(dithering, target,     \
+   w);                                                                         \
+                                                                               \
+  x86_blocks_loop_##w(shade_blocks_x86_modulated_body,                         \
+   x86_args(shading, dithering, target));                                      \
+}                                                                              \
+
+#define shade_blocks_x86_textured_modulated_builders(w)                        \
+  shade_blocks_x86_textured_modulated_builder(shaded, dithered, direct, w)     \
+  shade_blocks_x86_textured_modulated_builder(shaded, undithered, direct, w)   \
+  shade_blocks_x86_textured_modulated_builder(unshaded, dithered, direct, w)   \
+  shade_blocks_x86_textured_modulated_builder(unshaded, undithered, direct, w) \
+  shade_blocks_x86_textured_modulated_builder(shaded, dithered, indirect, w)   \
+  shade_blocks_x86_textured_modulated_builder(shaded, undithered, indirect, w) \
+  shade_blocks_x86_textured_modulated_builder(unshaded, dithered, indirect, w) \
+  shade_blocks_x86_textured_modulated_builder(unshaded, undithered, indirect,  \
+   w)                                                                          \
+
+shade_blocks_x86_textured_modulated_builders(sse2)
+shade_blocks_x86_textured_modulated_builders(avx2)
+
+void TARGET_SSE2 shade_blocks_unshaded_untextured_direct_sse2(psx_gpu_struct
+ *psx_gpu)
+{
+  block_struct *block = psx_gpu->blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+
+  __m128i pixels = _mm_or_si128(x86_load_sse2(&block->pixels, 0),
+   _mm_set1_epi16(psx_gpu->mask_msb));
+
+  while(num_blocks)
+  {
+    __m128i fb_pixels = x86_load_sse2(block->fb_ptr, 0);
+    __m128i draw_mask = x86_load_sse2(&block->draw_mask, 0);
+
+    fb_pixels = x86_bif(sse2, fb_pixels, pixels, draw_mask);
+    x86_store_sse2(fb_pixels, block->fb_ptr, 0);
+
+    num_blocks--;
+    block++;
+  }
+}
+
+
+// Blend blocks
+
+#define blend_blocks_x86_mask_evaluate_on(w)                                   \
+  draw_mask = x86_or_##w(draw_mask, x86_sar16_##w(framebuffer_pixels, 15))     \
+
+#define blend_blocks_x86_mask_evaluate_off(w)                                  \
+
+#define blend_blocks_x86_average(w)                                            \
+{                                                                              \
+  x86_vec_##w no_msb = x86_dup16_##w(0x7FFF);                                  \
+  x86_vec_##w pixels_no_msb = x86_and_##w(pixels, no_msb);                     \
+  x86_vec_##w fb_pixels_no_msb = x86_and_##w(framebuffer_pixels, no_msb);      \
+                                                                               \
+  blend_pixels = x86_and_##w(x86_xor_##w(pixels, framebuffer_pixels),          \
+   x86_dup16_##w(0x0421));                                                     \
+  blend_pixels = x86_sub16_##w(pixels_no_msb, blend_pixels);                   \
+                                                                               \
+  /* (a + b) >> 1 without losing the carry out of bit 15 */                    \
+  blend_pixels = x86_add16_##w(x86_and_##w(fb_pixels_no_msb, blend_pixels),    \
+   x86_shr16_##w(x86_xor_##w(fb_pixels_no_msb, blend_pixels), 1));             \
+}                                                                              \
+
+#define blend_blocks_x86_add(w)                                                \
+{                                                                              \
+  x86_vec_##w mask_0x7C1F = x86_dup16_##w(0x7C1F);                             \
+  x86_vec_##w mask_0x03E0 = x86_dup16_##w(0x03E0);                             \
+                                                                               \
+  x86_vec_##w fb_rb = x86_add16_##w(x86_and_##w(framebuffer_pixels,            \
+   mask_0x7C1F), x86_and_##w(pixels, mask_0x7C1F));                            \
+  x86_vec_##w fb_g = x86_add16_##w(x86_and_##w(framebuffer_pixels,             \
+   mask_0x03E0), x86_and_##w(pixels, mask_0x03E0));                            \
+                                                                               \
+  blend_pixels = x86_or_##w(x86_minu8_##w(fb_rb, mask_0x7C1F),                 \
+   x86_min16_##w(fb_g, mask_0x03E0));                                          \
+}                                                                              \
+
+#define blend_blocks_x86_subtract(w)                                           \
+{                                                                              \
+  x86_vec_##w mask_0x7C1F = x86_dup16_##w(0x7C1F);                             \
+  x86_vec_##w mask_0x03E0 = x86_dup16_##w(0x03E0);                             \
+                                                                               \
+  x86_vec_##w fb_rb = x86_subsu8_##w(x86_and_##w(framebuffer_pixels,           \
+   mask_0x7C1F), x86_and_##w(pixels, mask_0x7C1F));                            \
+  x86_vec_##w fb_g = x86_subsu16_##w(x86_and_##w(framebuffer_pixels,           \
+   mask_0x03E0), x86_and_##w(pixels, mask_0x03E0));                            \
+                                                                               \
+  blend_pixels = x86_or_##w(fb_rb, fb_g);                                      \
+}                                                                              \
+
+#define blend_blocks_x86_add_fourth(w)                                         \
+{                                                                              \
+  x86_vec_##w mask_0x7C1F = x86_dup16_##w(0x7C1F);                             \
+  x86_vec_##w mask_0x03E0 = x86_dup16_##w(0x03E0);                             \
+  x86_vec_##w pixels_fourth = x86_shr16_##w(pixels, 2);                        \
+                                                                               \
+  x86_vec_##w fb_rb = x86_add16_##w(x86_and_##w(framebuffer_pixels,            \
+   mask_0x7C1F), x86_and_##w(pixels_fourth, x86_dup16_##w(0x1C07)));           \
+  x86_vec_##w fb_g = x86_add16_##w(x86_and_##w(framebuffer_pixels,             \
+   mask_0x03E0), x86_and_##w(pixels_fourth, x86_dup16_##w(0x00E0)));           \
+                                                                               \
+  blend_pixels = x86_or_##w(x86_minu8_##w(fb_rb, mask_0x7C1F),                 \
+   x86_min16_##w(fb_g, mask_0x03E0));                                          \
+}                                                                              \
+
+#define blend_blocks_x86_combine_textured(w)                                   \
+  blend_pixels = x86_bif(w, x86_or_##w(blend_pixels, x86_dup16_##w(0x8000)),   \
+   pixels, x86_sar16_##w(pixels, 15))                                          \
+
+#define blend_blocks_x86_combine_untextured(w)                                 \
+
+#define blend_blocks_x86_body_average(texturing, w)                            \
+  blend_blocks_x86_average(w);                                                 \
+  blend_blocks_x86_combine_##texturing(w)                                      \
+
+#define blend_blocks_x86_body_add(texturing, w)                                \
+  blend_blocks_x86_add(w);                                                     \
+  blend_blocks_x86_combine_##texturing(w)                                      \
+
+#define blend_blocks_x86_body_subtract(texturing, w)                           \
+  blend_blocks_x86_subtract(w);                                                \
+  blend_blocks_x86_combine_##texturing(w)                                      \
+
+#define blend_blocks_x86_body_add_fourth(texturing, w)                         \
+  blend_blocks_x86_add_fourth(w);                                              \
+  blend_blocks_x86_combine_##texturing(w)                                      \
+
+#define blend_blocks_x86_body_unblended(texturing, w)                          \
+  blend_pixels = pixels                                                        \
+
+#define blend_blocks_x86_block(texturing, blend_mode, mask_evaluate, w,        \
+ block_a, block_b)                                                             \
+{                                                                              \
+  x86_vec_##w pixels = x86_load_##w(&(block_a)->pixels, &(block_b)->pixels);   \
+  x86_vec_##w draw_mask = x86_load_##w(&(block_a)->draw_mask,                  \
+   &(block_b)->draw_mask);                                                     \
+  x86_vec_##w framebuffer_pixels = x86_load_##w((block_a)->fb_ptr,             \
+   (block_b)->fb_ptr);                                                         \
+  x86_vec_##w blend_pixels;                                                    \
+                                                                               \
+  blend_blocks_x86_mask_evaluate_##mask_evaluate(w);                           \
+  blend_blocks_x86_body_##blend_mode(texturing, w);                            \
+                                                                               \
+  blend_pixels = x86_or_##w(blend_pixels, msb_mask_##w);                       \
+  framebuffer_pixels = x86_bif(w, framebuffer_pixels, blend_pixels,            \
+   draw_mask);                                                                 \
+  x86_store_##w(framebuffer_pixels, (block_a)->fb_ptr, (block_b)->fb_ptr);     \
+}                                                                              \
+
+#define blend_blocks_x86_builder(texturing, blend_mode, mask_evaluate, w)      \
+void x86_target_##w                                                            \
+ blend_blocks_##texturing##_##blend_mode##_##mask_evaluate##_##w(              \
+ psx_gpu_struct *psx_gpu)                                                      \
+{                                                                              \
+  block_struct *block = psx_gpu->blocks;                                       \
+  u32 num_blocks = psx_gpu->num_blocks;                                        \
+  x86_blocks_constants_##w();                                                  \
+                                                                               \
+  blend_blocks += num_blocks;                                                  \
+  x86_blocks_loop_##w(blend_blocks_x86_block,                                  \
+   x86_args(texturing, blend_mode, mask_evaluate));                            \
+}                                                                              \
+
+#define blend_blocks_x86_builders(w)                                           \
+  blend_blocks_x86_builder(textured, average, off, w)                          \
+  blend_blocks_x86_builder(textured, average, on, w)                           \
+  blend_blocks_x86_builder(textured, add, off, w)                              \
+  blend_blocks_x86_builder(textured, add, on, w)                               \
+  blend_blocks_x86_builder(textured, subtract, off, w)                         \
+  blend_blocks_x86_builder(textured, subtract, on, w)                          \
+  blend_blocks_x86_builder(textured, add_fourth, off, w)                       \
+  blend_blocks_x86_builder(textured, add_fourth, on, w)                        \
+                                                                               \
+  blend_blocks_x86_builder(untextured, average, off, w)                        \
+  blend_blocks_x86_builder(untextured, average, on, w)                         \
+  blend_blocks_x86_builder(untextured, add, off, w)                            \
+  blend_blocks_x86_builder(untextured, add, on, w)                             \
+  blend_blocks_x86_builder(untextured, subtract, off, w)                       \
+  blend_blocks_x86_builder(untextured, subtract, on, w)                        \
+  blend_blocks_x86_builder(untextured, add_fourth, off, w)                     \
+  blend_blocks_x86_builder(untextured, add_fourth, on, w)                      \
+                                                                               \
+  blend_blocks_x86_builder(textured, unblended, on, w)                         \
+
+blend_blocks_x86_builders(sse2)
+blend_blocks_x86_builders(avx2)
+
+
+// Every kernel with its replacement for each level, levels without one of
+// their own use the one below.
+
+typedef struct
+{
+  const char *name;
+  void *function[X86_LEVELS];
+} x86_block_function_struct;
+
+#define x86_function_sse2(name)                                                \
+  { #name, { name, name##_sse2, name##_sse2, name##_sse2 } }                   \
+
+#define x86_function_ssse3(name)                                               \
+  { #name, { name, name, name##_ssse3, name##_ssse3 } }                        \
+
+#define x86_function_avx2(name)                                                \
+  { #name, { name, name##_sse2, name##_sse2, name##_avx2 } }                   \
+
+static const x86_block_function_struct x86_block_functions[] =
+{
+  x86_function_sse2(setup_blocks_shaded_textured_dithered_swizzled_indirect),
+  x86_function_sse2(setup_blocks_shaded_textured_dithered_unswizzled_indirect),
+  x86_function_sse2(
+   setup_blocks_unshaded_textured_dithered_unswizzled_indirect),
+  x86_function_sse2(setup_blocks_unshaded_textured_dithered_swizzled_indirect),
+  x86_function_sse2(
+   setup_blocks_shaded_untextured_undithered_unswizzled_indirect),
+  x86_function_sse2(
+   setup_blocks_shaded_untextured_dithered_unswizzled_indirect),
+  x86_function_sse2(
+   setup_blocks_shaded_untextured_undithered_unswizzled_direct),
+  x86_function_sse2(setup_blocks_shaded_untextured_dithered_unswizzled_direct),
+  x86_function_sse2(
+   setup_blocks_unshaded_untextured_undithered_unswizzled_indirect),
+  x86_function_sse2(
+   setup_blocks_unshaded_untextured_undithered_unswizzled_direct),
+
+  x86_function_ssse3(texture_blocks_4bpp),
+  x86_function_sse2(texture_blocks_8bpp),
+  x86_function_sse2(texture_blocks_16bpp),
+
+  x86_function_avx2(shade_blocks_shaded_textured_modulated_dithered_direct),
+  x86_function_avx2(shade_blocks_shaded_textured_modulated_undithered_direct),
+  x86_function_avx2(shade_blocks_unshaded_textured_modulated_dithered_direct),
+  x86_function_avx2(shade_blocks_unshaded_textured_modulated_undithered_direct),
+  x86_function_avx2(shade_blocks_shaded_textured_modulated_dithered_indirect),
+  x86_function_avx2(shade_blocks_shaded_textured_modulated_undithered_indirect),
+  x86_function_avx2(shade_blocks_unshaded_textured_modulated_dithered_indirect),
+  x86_function_avx2(
+   shade_blocks_unshaded_textured_modulated_undithered_indirect),
+  x86_function_avx2(shade_blocks_textured_unmodulated_indirect),
+  x86_function_avx2(shade_blocks_textured_unmodulated_direct),
+  x86_function_sse2(shade_blocks_unshaded_untextured_direct),
+
+  x86_function_avx2(blend_blocks_textured_average_off),
+  x86_function_avx2(blend_blocks_textured_average_on),
+  x86_function_avx2(blend_blocks_textured_add_off),
+  x86_function_avx2(blend_blocks_textured_add_on),
+  x86_function_avx2(blend_blocks_textured_subtract_off),
+  x86_function_avx2(blend_blocks_textured_subtract_on),
+  x86_function_avx2(blend_blocks_textured_add_fourth_off),
+  x86_function_avx2(blend_blocks_textured_add_fourth_on),
+  x86_function_avx2(blend_blocks_untextured_average_off),
+  x86_function_avx2(blend_blocks_untextured_average_on),
+  x86_function_avx2(blend_blocks_untextured_add_off),
+  x86_function_avx2(blend_blocks_untextured_add_on),
+  x86_function_avx2(blend_blocks_untextured_subtract_off),
+  x86_function_avx2(blend_blocks_untextured_subtract_on),
+  x86_function_avx2(blend_blocks_untextured_add_fourth_off),
+  x86_function_avx2(blend_blocks_untextured_add_fourth_on),
+  x86_function_avx2(blend_blocks_textured_unblended_on),
+};
+
+static void *x86_select_function(void *function, u32 level)
+{
+  u32 i, j;
+
+  for(i = 0; i < sizeof(x86_block_functions) /
+   sizeof(x86_block_functions[0]); i++)
+  {
+    for(j = 0; j < X86_LEVELS; j++)
+    {
+      if(x86_block_functions[i].function[j] == function)
+        return x86_block_functions[i].function[level];
+    }
+  }
+
+  return function;
+}
+
+static void x86_select_handlers(render_block_handler_struct *handlers,
+ u32 num_handlers, u32 level)
+{
+  u32 i;
+
+  for(i = 0; i < num_handlers; i++)
+  {
+    render_block_handler_struct *handler = &handlers[i];
+
+    handler->setup_blocks = x86_select_function(handler->setup_blocks, level);
+    handler->texture_blocks = (texture_blocks_function_type *)
+     x86_select_function((void *)handler->texture_blocks, level);
+    handler->shade_blocks = (shade_blocks_function_type *)
+     x86_select_function((void *)handler->shade_blocks, level);
+    handler->blend_blocks = (blend_blocks_function_type *)
+     x86_select_function((void *)handler->blend_blocks, level);
+  }
+}
+
+static u32 x86_detect_level(void)
+{
+  u32 level = X86_LEVEL_C;
+
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse2"))
+    level = X86_LEVEL_SSE2;
+  if(__builtin_cpu_supports("ssse3"))
+    level = X86_LEVEL_SSSE3;
+  if(__builtin_cpu_supports("avx2"))
+    level = X86_LEVEL_AVX2;
+
+  return level;
+}
+
+// Switches all the handler tables to the best kernels the CPU has, up to
+// max_level. Must not be called while something is rendering.
+static u32 psx_gpu_x86_init(u32 max_level)
+{
+  u32 level = x86_detect_level();
+
+  if(level > max_level)
+    level = max_level;
+
+#define x86_select_table(table)                                                \
+  x86_select_handlers(table, sizeof(table) / sizeof(table[0]), level)          \
+
+  x86_select_table(render_triangle_block_handlers);
+  x86_select_table(render_sprite_block_handlers);
+  x86_select_table(render_sprite_block_handlers_4x);
+
+#undef x86_select_table
+
+  return level;
+}
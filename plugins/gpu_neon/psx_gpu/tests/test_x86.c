@@ -0,0 +1,226 @@
+/*
+ * checks the x86 SIMD block kernels against the C reference code
+ * on random blocks and spans
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "../psx_gpu.c"
+
+#ifdef HAVE_PSX_GPU_X86
+
+#define VRAM_PIXELS (1024 * 512)
+
+// kernels only draw to the top of vram so that less has to be compared
+#define DRAW_PIXELS (1024 * 64)
+
+static psx_gpu_struct __attribute__((aligned(256))) gpu_ref, gpu_test;
+static u16 __attribute__((aligned(256))) vram_ref[VRAM_PIXELS + 1024];
+static u16 __attribute__((aligned(256))) vram_test[VRAM_PIXELS + 1024];
+static u16 vram_init[VRAM_PIXELS + 1024];
+
+static const char *level_names[X86_LEVELS] = { "c", "sse2", "ssse3", "avx2" };
+
+static u32 seed = 0x12345678;
+static int failed;
+
+static u32 rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static void fill_random(void *ptr, size_t size)
+{
+  u8 *p = ptr;
+  while(size--)
+    *p++ = rnd();
+}
+
+static void blocks_nop(psx_gpu_struct *psx_gpu)
+{
+}
+
+static render_block_handler_struct nop_handler =
+{
+  NULL, blocks_nop, blocks_nop, blocks_nop
+};
+
+// the parts of psx_gpu_struct the kernels look at, plus random blocks and
+// spans, everything else stays as initialize_psx_gpu() left it
+static void random_state(psx_gpu_struct *psx_gpu, u16 *vram)
+{
+  u32 i;
+
+  psx_gpu->render_block_handler = &nop_handler;
+  psx_gpu->render_mode = 0;
+  psx_gpu->mask_msb = (rnd() & 1) ? 0x8000 : 0;
+  psx_gpu->triangle_color = (rnd() & 3) ? rnd() : 0x808080;
+  psx_gpu->texture_mask_width = (rnd() & 1) ? 0xFF : rnd();
+  psx_gpu->texture_mask_height = (rnd() & 1) ? 0xFF : rnd();
+  psx_gpu->current_texture_mask = 0;
+  psx_gpu->dirty_textures_4bpp_mask = 0;
+  psx_gpu->dirty_textures_8bpp_mask = 0;
+
+  fill_random(&psx_gpu->uvrg, sizeof(psx_gpu->uvrg));
+  fill_random(&psx_gpu->uvrg_dx, sizeof(psx_gpu->uvrg_dx));
+  fill_random(&psx_gpu->u_block_span, sizeof(psx_gpu->u_block_span) * 5);
+
+  psx_gpu->texture_page_ptr = psx_gpu->texture_4bpp_cache[rnd() % 32];
+  psx_gpu->clut_ptr = vram + rnd() % (VRAM_PIXELS - 256);
+
+  fill_random(psx_gpu->blocks, sizeof(psx_gpu->blocks));
+  for(i = 0; i < MAX_BLOCKS_PER_ROW; i++)
+  {
+    block_struct *block = &psx_gpu->blocks[i];
+
+    // mostly separate, sometimes overlapping or the same as the last one
+    if(i > 0 && (rnd() & 7) == 0)
+      block->fb_ptr = block[-1].fb_ptr + (rnd() % 15) - 7;
+    else
+      block->fb_ptr = vram + 8 + rnd() % (DRAW_PIXELS - 32);
+  }
+
+  psx_gpu->num_spans = 1 + rnd() % 24;
+  for(i = 0; i < psx_gpu->num_spans; i++)
+  {
+    edge_data_struct *span = &psx_gpu->span_edge_data[i];
+
+    span->num_blocks = (rnd() % 5) ? rnd() % 9 : 0;
+    span->left_x = rnd() % (1024 - span->num_blocks * 8);
+    span->right_mask = rnd();
+    span->y = rnd() % (DRAW_PIXELS / 1024);
+    fill_random(&psx_gpu->span_uvrg_offset[i], sizeof(vec_4x32u));
+    psx_gpu->span_b_offset[i] = rnd() << 8;
+  }
+  psx_gpu->num_blocks = rnd() % (MAX_BLOCKS + 1);
+}
+
+static void check_state(const char *name, u32 level, int iter)
+{
+  u32 i;
+
+  // compare fb_ptr as offsets into each vram
+  for(i = 0; i < MAX_BLOCKS_PER_ROW; i++)
+  {
+    gpu_test.blocks[i].fb_ptr =
+     gpu_test.blocks[i].fb_ptr - vram_test + vram_ref;
+  }
+
+  if(gpu_ref.num_blocks != gpu_test.num_blocks ||
+   memcmp(gpu_ref.blocks, gpu_test.blocks, sizeof(gpu_ref.blocks)) ||
+   memcmp(vram_ref, vram_test, DRAW_PIXELS * 2))
+  {
+    if(failed++ < 16)
+      printf("%s_%s: mismatch on iteration %d\n", name, level_names[level],
+       iter);
+  }
+}
+
+static void test_function(const x86_block_function_struct *functions,
+ u32 level, u32 iterations)
+{
+  void (*function_ref)(psx_gpu_struct *) = functions->function[X86_LEVEL_C];
+  void (*function_test)(psx_gpu_struct *) = functions->function[level];
+  u32 texture_mode;
+  int i;
+
+  if(functions->function[level] == functions->function[level - 1])
+    return;
+
+  for(i = 0; i < iterations; i++)
+  {
+    random_state(&gpu_ref, vram_ref);
+
+    texture_mode = rnd() % 3;
+    if(texture_mode == 1)
+      gpu_ref.texture_page_ptr = gpu_ref.texture_8bpp_even_cache[rnd() % 16];
+    else if(texture_mode == 2)
+      gpu_ref.texture_page_ptr = vram_ref + (rnd() % 768) +
+       (rnd() % 256) * 1024;
+
+    // same state for the other one, with pointers moved to its vram
+#define rebase(ptr)                                                            \
+    gpu_test.ptr = (void *)((u8 *)gpu_ref.ptr - (u8 *)vram_ref +               \
+     (u8 *)vram_test)                                                          \
+
+    memcpy(&gpu_test, &gpu_ref, offsetof(psx_gpu_struct, texture_4bpp_cache));
+    gpu_test.vram_ptr = vram_test;
+    gpu_test.vram_out_ptr = vram_test;
+    rebase(clut_ptr);
+    if(texture_mode == 2)
+      rebase(texture_page_ptr);
+    else
+    {
+      gpu_test.texture_page_ptr = (u8 *)gpu_ref.texture_page_ptr -
+       (u8 *)&gpu_ref + (u8 *)&gpu_test;
+    }
+    for(u32 j = 0; j < MAX_BLOCKS_PER_ROW; j++)
+      rebase(blocks[j].fb_ptr);
+#undef rebase
+
+    memcpy(vram_ref, vram_init, DRAW_PIXELS * 2);
+    memcpy(vram_test, vram_init, DRAW_PIXELS * 2);
+
+    function_ref(&gpu_ref);
+    function_test(&gpu_test);
+
+    check_state(functions->name, level, i);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const x86_block_function_struct *functions = x86_block_functions;
+  u32 num_functions = sizeof(x86_block_functions) /
+   sizeof(x86_block_functions[0]);
+  u32 iterations = argc > 1 ? atoi(argv[1]) : 2000;
+  u32 level, max_level, i;
+
+  initialize_psx_gpu(&gpu_ref, vram_ref);
+  initialize_psx_gpu(&gpu_test, vram_test);
+
+  max_level = x86_detect_level();
+
+  if(max_level == X86_LEVEL_C)
+  {
+    printf("no SSE2, nothing to test\n");
+    return 0;
+  }
+
+  fill_random(vram_init, sizeof(vram_init));
+  memcpy(vram_ref, vram_init, sizeof(vram_ref));
+  memcpy(vram_test, vram_init, sizeof(vram_test));
+  fill_random(gpu_ref.texture_4bpp_cache, sizeof(gpu_ref.texture_4bpp_cache));
+  fill_random(gpu_ref.texture_8bpp_even_cache,
+   sizeof(gpu_ref.texture_8bpp_even_cache));
+  memcpy(gpu_test.texture_4bpp_cache, gpu_ref.texture_4bpp_cache,
+   sizeof(gpu_ref.texture_4bpp_cache) +
+   sizeof(gpu_ref.texture_8bpp_even_cache));
+
+  for(level = X86_LEVEL_SSE2; level <= max_level; level++)
+  {
+    for(i = 0; i < num_functions; i++)
+      test_function(&functions[i], level, iterations);
+  }
+
+  if(max_level < X86_LEVEL_AVX2)
+    printf("no AVX2, only up to %s tested\n", level_names[max_level]);
+
+  printf("%s\n", failed ? "FAILED" : "ok");
+  return failed != 0;
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+  printf("not x86, nothing to test\n");
+  return 0;
+}
+
+#endif
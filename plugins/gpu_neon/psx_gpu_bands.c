@@ -0,0 +1,668 @@
+/*
+ * Splits drawing over threads by horizontal bands of vram. Every thread
+ * has its own psx_gpu_struct that parses all the commands, so that the
+ * state stays the same everywhere, but only draws the rows of its band.
+ *
+ * do_cmd_list() only queues the commands, they are drawn at the next sync
+ * point. The queue is cut into segments where a primitive would read
+ * textures or CLUTs that an earlier one in the segment draws to (or the
+ * other way around), and the threads only wait for each other between the
+ * segments. Vram copies and primitives that texture from where they draw
+ * get segments of their own that egpu draws alone.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <pthread.h>
+
+#define BAND_QUEUE_LEN 0x10000
+#define BAND_SEGS_MAX  256
+
+struct band_rect {
+  s32 x0, y0, x1, y1; // inclusive, empty when x0 > x1
+};
+
+struct band_seg {
+  u32 start, end;            // words in band.queue
+  u32 single:1;              // drawn by egpu alone
+  u32 closed:1;
+  u32 draws;
+  s32 area_y0, area_y1;      // draw area rows to split into bands
+  struct band_rect written;
+  u32 written_pages;
+  struct band_rect clut;     // read
+  u32 texture_pages;         // read
+};
+
+static struct {
+  int enhanced;
+  u32 queue_len;
+  u32 seg_count;
+  pthread_t threads[BAND_THREADS_MAX];
+  pthread_mutex_t queue_lock;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_job;
+  pthread_cond_t cond_barrier;
+  u32 job, phase, arrived;
+  int exit;
+  struct band_seg segs[BAND_SEGS_MAX];
+  u32 queue[BAND_QUEUE_LEN];
+} band;
+
+static const struct band_rect band_rect_empty = { 0, 0, -1, -1 };
+
+static void band_rect_add(struct band_rect *r, s32 x0, s32 y0, s32 x1, s32 y1)
+{
+  if (x0 > x1 || y0 > y1)
+    return;
+  if (r->x0 > r->x1) {
+    r->x0 = x0; r->y0 = y0;
+    r->x1 = x1; r->y1 = y1;
+    return;
+  }
+  if (x0 < r->x0) r->x0 = x0;
+  if (y0 < r->y0) r->y0 = y0;
+  if (x1 > r->x1) r->x1 = x1;
+  if (y1 > r->y1) r->y1 = y1;
+}
+
+static int band_rect_hit(const struct band_rect *a, const struct band_rect *b)
+{
+  return a->x0 <= a->x1 && b->x0 <= b->x1
+    && a->x0 <= b->x1 && b->x0 <= a->x1
+    && a->y0 <= b->y1 && b->y0 <= a->y1;
+}
+
+// primitives are clipped to the draw area
+static void band_rect_clip_area(struct band_rect *r)
+{
+  s32 x0 = ex_regs[3] & 0x3ff, y0 = (ex_regs[3] >> 10) & 0x1ff;
+  s32 x1 = ex_regs[4] & 0x3ff, y1 = (ex_regs[4] >> 10) & 0x1ff;
+
+  if (r->x0 < x0) r->x0 = x0;
+  if (r->y0 < y0) r->y0 = y0;
+  if (r->x1 > x1) r->x1 = x1;
+  if (r->y1 > y1) r->y1 = y1;
+  if (r->x0 > r->x1 || r->y0 > r->y1)
+    *r = band_rect_empty;
+}
+
+static u32 band_rect_pages(const struct band_rect *r)
+{
+  if (r->x0 > r->x1)
+    return 0;
+  return texture_region_mask(r->x0, r->y0, r->x1, r->y1);
+}
+
+// the vram a texture page setting reads, see set_texture()
+static u32 band_texture_pages(u32 texture_settings)
+{
+  u32 page = texture_settings & 0x1f;
+  u32 pages = 1u << page;
+  u32 i;
+
+  switch ((texture_settings >> 7) & 3)
+  {
+    case TEXTURE_MODE_8BPP:
+      pages |= 1u << (((page + 1) & 0xf) | (page & 0x10));
+      break;
+    case TEXTURE_MODE_16BPP:
+      for (i = 1; i < 4; i++) {
+        pages |= 1u << (((page + i) & 0xf) | (page & 0x10));
+        // past the right edge it reads the start of the next line
+        if ((page & 0xf) + i > 15)
+          pages |= 1u << (((page + i) & 0xf) | 0x10);
+      }
+      break;
+  }
+  return pages;
+}
+
+static void band_clut_rect(struct band_rect *r, u32 clut, u32 texture_settings)
+{
+  s32 x = (clut & 0x3f) * 16, y = (clut >> 6) & 0x1ff;
+
+  switch ((texture_settings >> 7) & 3)
+  {
+    case TEXTURE_MODE_16BPP:
+      *r = band_rect_empty;
+      break;
+    case TEXTURE_MODE_8BPP:
+      if (x + 256 > 1024) {
+        r->x0 = 0; r->y0 = y; r->x1 = 1023; r->y1 = y < 511 ? y + 1 : y;
+        break;
+      }
+      r->x0 = x; r->y0 = y; r->x1 = x + 255; r->y1 = y;
+      break;
+    default:
+      r->x0 = x; r->y0 = y; r->x1 = x + 15; r->y1 = y;
+      break;
+  }
+}
+
+static void band_rect_add_wrapped(struct band_rect *r, s32 x, s32 y,
+ s32 w, s32 h)
+{
+  if (w <= 0 || h <= 0)
+    return;
+  if (x + w > 1024)
+    x = 0, w = 1024;
+  if (y + h > 512)
+    y = 0, h = 512;
+  band_rect_add(r, x, y, x + w - 1, y + h - 1);
+}
+
+static void band_rows(const struct band_seg *seg, int i, s32 *start, s32 *end)
+{
+  s32 y0 = seg->area_y0, h = seg->area_y1 - seg->area_y0 + 1;
+
+  if (seg->single) {
+    *start = i ? 512 : 0;
+    *end = 511;
+    return;
+  }
+  if (h <= 0)
+    y0 = 0, h = 512;
+  // the outer bands also take whatever is outside of the draw area,
+  // for fills that ignore it
+  *start = i ? y0 + h * i / band_count : 0;
+  *end = i < band_count - 1 ? y0 + h * (i + 1) / band_count - 1 : 511;
+}
+
+static void band_set_rows(psx_gpu_struct *psx_gpu, s32 start, s32 end)
+{
+  if (psx_gpu->band_start_y == start && psx_gpu->band_end_y == end)
+    return;
+  psx_gpu->band_start_y = start;
+  psx_gpu->band_end_y = end;
+  update_viewport_y(psx_gpu);
+}
+
+static void band_barrier(void)
+{
+  u32 phase;
+
+  pthread_mutex_lock(&band.lock);
+  if (++band.arrived == (u32)band_count) {
+    band.arrived = 0;
+    band.phase++;
+    pthread_cond_broadcast(&band.cond_barrier);
+  }
+  else {
+    phase = band.phase;
+    while (phase == band.phase)
+      pthread_cond_wait(&band.cond_barrier, &band.lock);
+  }
+  pthread_mutex_unlock(&band.lock);
+}
+
+static void band_run(int i)
+{
+  psx_gpu_struct *psx_gpu = gpus[i];
+  const struct band_seg *seg;
+  const struct band_rect *r;
+  u32 count = band.seg_count;
+  s32 start, end;
+  u32 s;
+
+  // egpu may be queuing the next job once the last barrier is passed
+  for (s = 0; s < count; s++) {
+    seg = &band.segs[s];
+    band_rows(seg, i, &start, &end);
+    band_set_rows(psx_gpu, start, end);
+
+    if (band.enhanced)
+      gpu_parse_enhanced(psx_gpu, band.queue + seg->start,
+        (seg->end - seg->start) * 4, NULL);
+    else
+      gpu_parse(psx_gpu, band.queue + seg->start,
+        (seg->end - seg->start) * 4, NULL);
+    flush_render_block_buffer(psx_gpu);
+
+    // the other threads have drawn there too
+    r = &seg->written;
+    if (r->x0 <= r->x1)
+      invalidate_texture_cache_region(psx_gpu, r->x0, r->y0, r->x1, r->y1);
+
+    band_barrier();
+  }
+}
+
+static void *band_thread(void *arg)
+{
+  int i = (long)arg;
+  u32 job = 0;
+
+  pthread_mutex_lock(&band.lock);
+  while (1) {
+    while (band.job == job && !band.exit)
+      pthread_cond_wait(&band.cond_job, &band.lock);
+    if (band.exit)
+      break;
+    job = band.job;
+    pthread_mutex_unlock(&band.lock);
+
+    band_run(i);
+
+    pthread_mutex_lock(&band.lock);
+  }
+  pthread_mutex_unlock(&band.lock);
+  return NULL;
+}
+
+static void band_flush_queue(void)
+{
+  if (band.seg_count == 0)
+    return;
+
+  pthread_mutex_lock(&band.lock);
+  band.job++;
+  pthread_cond_broadcast(&band.cond_job);
+  pthread_mutex_unlock(&band.lock);
+
+  band_run(0);
+
+  band.seg_count = 0;
+  band.queue_len = 0;
+}
+
+// gpulib's video thread queues while the emu thread may flush
+static void band_flush(void)
+{
+  if (band_count <= 1)
+    return;
+  pthread_mutex_lock(&band.queue_lock);
+  band_flush_queue();
+  pthread_mutex_unlock(&band.queue_lock);
+}
+
+static struct band_seg *band_seg_get(int single)
+{
+  struct band_seg *seg = NULL;
+
+  if (band.seg_count > 0)
+    seg = &band.segs[band.seg_count - 1];
+  if (seg != NULL && !seg->closed && seg->single == single)
+    return seg;
+
+  if (band.seg_count == BAND_SEGS_MAX)
+    band_flush_queue();
+  seg = &band.segs[band.seg_count++];
+  memset(seg, 0, sizeof(*seg));
+  seg->start = seg->end = band.queue_len;
+  seg->single = single;
+  seg->area_y0 = (ex_regs[3] >> 10) & 0x1ff;
+  seg->area_y1 = (ex_regs[4] >> 10) & 0x1ff;
+  seg->written = band_rect_empty;
+  seg->clut = band_rect_empty;
+  return seg;
+}
+
+static struct band_seg *band_seg_any(void)
+{
+  struct band_seg *seg;
+
+  if (band.seg_count > 0) {
+    seg = &band.segs[band.seg_count - 1];
+    if (!seg->closed)
+      return seg;
+  }
+  return band_seg_get(0);
+}
+
+#define band_xy(xy, ox, oy, x, y) { \
+  x = (s16)((xy) + (ox)); \
+  y = (s16)(((xy) >> 16) + (oy)); \
+}
+
+// mirrors gpu_parse() to find the extent of the commands and what they
+// read and write, the queued commands are parsed when flushing
+static int band_queue(u32 *list, int count, int *last_cmd)
+{
+  u32 *list_start = list;
+  u32 *list_end = list + count;
+  u32 current_command = 0, command_length;
+  struct band_seg *seg;
+  struct band_rect wr, clut;
+  u32 pages, wr_pages;
+  s32 ox, oy, x, y, w, h;
+  int single, partial, over, i;
+  u32 n;
+
+  pthread_mutex_lock(&band.queue_lock);
+  if (band.seg_count > 0 && band.enhanced != gpu.state.enhancement_active)
+    band_flush_queue();
+  band.enhanced = gpu.state.enhancement_active;
+
+  for (; list < list_end; list += 1 + command_length)
+  {
+    s16 *list_s16 = (void *)list;
+    current_command = *list >> 24;
+    command_length = command_lengths[current_command];
+    if (list + 1 + command_length > list_end) {
+      current_command = (u32)-1;
+      break;
+    }
+
+    wr = band_rect_empty;
+    clut = band_rect_empty;
+    pages = 0;
+    single = partial = over = 0;
+    ox = (s32)(ex_regs[5] << 21) >> 21;
+    oy = (s32)(ex_regs[5] << 10) >> 21;
+
+    switch (current_command)
+    {
+      case 0x02:
+        x = list_s16[2] & 0x3f0;
+        y = list_s16[3] & 0x1ff;
+        w = ((list_s16[4] & 0x3ff) + 0xf) & ~0xf;
+        h = list_s16[5] & 0x1ff;
+        band_rect_add_wrapped(&wr, x, y, w, h);
+        break;
+
+      case 0x20 ... 0x3f:
+      {
+        u32 textured = current_command & 0x04;
+        u32 shaded = current_command & 0x10;
+        u32 stride = 1 + (textured ? 1 : 0) + (shaded ? 1 : 0);
+        u32 vertexes = (current_command & 0x08) ? 4 : 3;
+        u32 v, texture_settings;
+
+        for (v = 0; v < vertexes; v++) {
+          x = sign_extend_12bit(list_s16[(1 + v * stride) * 2]) + ox;
+          y = sign_extend_12bit(list_s16[(1 + v * stride) * 2 + 1]) + oy;
+          band_rect_add(&wr, x, y, x, y);
+        }
+        if (wr.x0 <= wr.x1)
+          band_rect_clip_area(&wr);
+        if (textured) {
+          texture_settings = list_s16[shaded ? 11 : 9] & 0x1ff;
+          ex_regs[1] = (ex_regs[1] & ~0x1ff) | texture_settings;
+          pages = band_texture_pages(texture_settings);
+          band_clut_rect(&clut, (u16)list_s16[5], texture_settings);
+        }
+        break;
+      }
+
+      case 0x40 ... 0x47:
+      case 0x50 ... 0x57:
+      {
+        u32 step = (current_command & 0x10) ? 2 : 1;
+        band_xy(list[1], ox, oy, x, y);
+        band_rect_add(&wr, x, y, x, y);
+        band_xy(list[1 + step], ox, oy, x, y);
+        band_rect_add(&wr, x, y, x, y);
+        band_rect_clip_area(&wr);
+        // shading only steps where the mask lets it draw, and that
+        // depends on the other bands
+        if (step == 2 && (ex_regs[6] & 2))
+          single = 1;
+        break;
+      }
+
+      case 0x48 ... 0x4f:
+      case 0x58 ... 0x5f:
+      {
+        u32 step = (current_command & 0x10) ? 2 : 1;
+        u32 num_vertexes = 1;
+        u32 *list_position = &(list[2]);
+
+        band_xy(list[1], ox, oy, x, y);
+        band_rect_add(&wr, x, y, x, y);
+        while (1)
+        {
+          band_xy(list_position[step - 1], ox, oy, x, y);
+          band_rect_add(&wr, x, y, x, y);
+
+          list_position += step;
+          num_vertexes++;
+
+          if (list_position >= list_end) {
+            // drawn up to here and then again when the rest arrives,
+            // a gouraud one reads the word past the end too
+            partial = 1;
+            over = list_position > list_end;
+            break;
+          }
+          if ((*list_position & 0xf000f000) == 0x50005000)
+            break;
+        }
+        band_rect_clip_area(&wr);
+        if (step == 2 && (ex_regs[6] & 2))
+          single = 1;
+        if (!partial)
+          command_length += (num_vertexes - 2) * step;
+        break;
+      }
+
+      case 0x60 ... 0x6b:
+      case 0x70 ... 0x7f:
+      {
+        x = sign_extend_11bit(list_s16[2] + ox);
+        y = sign_extend_11bit(list_s16[3] + oy);
+        switch ((current_command >> 3) & 3) {
+          case 0:
+            w = list_s16[(current_command & 4) ? 6 : 4] & 0x3ff;
+            h = list_s16[(current_command & 4) ? 7 : 5] & 0x1ff;
+            break;
+          case 1:  w = h = 1; break;
+          case 2:  w = h = 8; break;
+          default: w = h = 16; break;
+        }
+        band_rect_add(&wr, x, y, x + w - 1, y + h - 1);
+        band_rect_clip_area(&wr);
+        if (current_command & 4) {
+          pages = band_texture_pages(ex_regs[1]);
+          band_clut_rect(&clut, (u16)list_s16[5], ex_regs[1]);
+        }
+        break;
+      }
+
+      case 0x80:
+        x = list_s16[4] & 0x3ff;
+        y = list_s16[5] & 0x1ff;
+        w = ((list_s16[6] - 1) & 0x3ff) + 1;
+        h = ((list_s16[7] - 1) & 0x1ff) + 1;
+        // the copy runs past the line end into the next one
+        if (x + w > 1024)
+          x = 0, w = 1024, h++;
+        band_rect_add(&wr, x, y, x + w - 1, y + h - 1 < 511 ? y + h - 1 : 511);
+        single = 1;
+        break;
+
+      case 0xA0:
+      case 0xC0:
+        goto breakloop;
+
+      case 0xE1:
+      case 0xE2:
+      case 0xE5:
+      case 0xE6:
+        ex_regs[current_command & 7] = list[0];
+        break;
+
+      case 0xE3:
+      case 0xE4:
+        if ((ex_regs[current_command & 7] ^ list[0]) & 0x7ffff) {
+          u32 old = ex_regs[current_command & 7];
+          ex_regs[current_command & 7] = list[0];
+          // start a segment with bands for the new area
+          if (((old ^ list[0]) >> 10) & 0x1ff) {
+            seg = band_seg_any();
+            if (seg->draws)
+              seg->closed = 1;
+          }
+        }
+        break;
+    }
+
+    n = partial ? list_end - list : 1 + command_length;
+    if (n > BAND_QUEUE_LEN) {
+      // too long to be queued, egpu draws it alone
+      band_flush_queue();
+      for (i = 0; i < band_count; i++) {
+        band_set_rows(gpus[i], i ? 512 : 0, 511);
+        if (band.enhanced)
+          gpu_parse_enhanced(gpus[i], list, n * 4, NULL);
+        else
+          gpu_parse(gpus[i], list, n * 4, NULL);
+        flush_render_block_buffer(gpus[i]);
+        if (wr.x0 <= wr.x1)
+          invalidate_texture_cache_region(gpus[i], wr.x0, wr.y0, wr.x1, wr.y1);
+      }
+      if (partial) {
+        current_command = (u32)-1;
+        break;
+      }
+      continue;
+    }
+    if (band.queue_len + n + over > BAND_QUEUE_LEN)
+      band_flush_queue();
+
+    wr_pages = band_rect_pages(&wr);
+    if (!single && (wr_pages & pages || band_rect_hit(&wr, &clut)))
+      // samples from where it draws
+      single = 1;
+
+    if (wr.x0 > wr.x1 && pages == 0)
+      seg = band_seg_any();
+    else if (single)
+      seg = band_seg_get(1);
+    else {
+      seg = band_seg_get(0);
+      if ((seg->written_pages & pages) || band_rect_hit(&seg->written, &clut)
+          || (wr_pages & seg->texture_pages) || band_rect_hit(&wr, &seg->clut))
+      {
+        seg->closed = 1;
+        seg = band_seg_get(0);
+      }
+      seg->texture_pages |= pages;
+      band_rect_add(&seg->clut, clut.x0, clut.y0, clut.x1, clut.y1);
+    }
+
+    if (wr.x0 <= wr.x1) {
+      band_rect_add(&seg->written, wr.x0, wr.y0, wr.x1, wr.y1);
+      seg->written_pages = band_rect_pages(&seg->written);
+      seg->draws++;
+    }
+    else if (!seg->draws) {
+      seg->area_y0 = (ex_regs[3] >> 10) & 0x1ff;
+      seg->area_y1 = (ex_regs[4] >> 10) & 0x1ff;
+    }
+
+    memcpy(band.queue + band.queue_len, list, (n + over) * 4);
+    seg->end = band.queue_len + n;
+    band.queue_len += n + over;
+    // flushed alone so the next one samples what this one drew
+    if (single && (pages || clut.x0 <= clut.x1))
+      seg->closed = 1;
+    if (partial) {
+      seg->closed = 1;
+      current_command = (u32)-1;
+      break;
+    }
+  }
+
+breakloop:
+  pthread_mutex_unlock(&band.queue_lock);
+  *last_cmd = current_command;
+  return list - list_start;
+}
+
+// pointers into egpu's own texture caches, left alone if they aren't
+static void *band_rebase(void *ptr, void *copy)
+{
+  u8 *base = (u8 *)&egpu;
+
+  if ((u8 *)ptr >= base && (u8 *)ptr < base + sizeof(egpu))
+    return (u8 *)copy + ((u8 *)ptr - base);
+  return ptr;
+}
+
+static void band_stop(void)
+{
+  int i;
+
+  if (band_count <= 1)
+    return;
+
+  pthread_mutex_lock(&band.lock);
+  band.exit = 1;
+  pthread_cond_broadcast(&band.cond_job);
+  pthread_mutex_unlock(&band.lock);
+
+  for (i = 1; i < band_count; i++) {
+    pthread_join(band.threads[i], NULL);
+    free(gpus[i]);
+    gpus[i] = NULL;
+  }
+  pthread_cond_destroy(&band.cond_barrier);
+  pthread_cond_destroy(&band.cond_job);
+  pthread_mutex_destroy(&band.lock);
+  pthread_mutex_destroy(&band.queue_lock);
+
+  band.seg_count = 0;
+  band.queue_len = 0;
+  band_count = 0;
+  band_set_rows(&egpu, 0, 511);
+}
+
+static void band_set_threads(int count)
+{
+  void *p;
+  int i;
+
+  if (count > BAND_THREADS_MAX)
+    count = BAND_THREADS_MAX;
+  if (count < 2)
+    count = 0;
+  if (count == band_count)
+    return;
+
+  band_flush();
+  band_stop();
+  if (count == 0)
+    return;
+
+  pthread_mutex_init(&band.queue_lock, NULL);
+  pthread_mutex_init(&band.lock, NULL);
+  pthread_cond_init(&band.cond_job, NULL);
+  pthread_cond_init(&band.cond_barrier, NULL);
+  band.job = band.phase = band.arrived = 0;
+  band.exit = 0;
+
+  // the others start as copies of egpu
+  flush_render_block_buffer(&egpu);
+  band_count = 1;
+  for (i = 1; i < count; i++) {
+    if (posix_memalign(&p, 256, sizeof(egpu)) != 0)
+      break;
+    memcpy(p, &egpu, sizeof(egpu));
+    gpus[i] = p;
+    gpus[i]->texture_page_ptr = band_rebase(egpu.texture_page_ptr, p);
+    gpus[i]->texture_page_base = band_rebase(egpu.texture_page_base, p);
+    if (pthread_create(&band.threads[i], NULL, band_thread, (void *)(long)i)) {
+      free(p);
+      gpus[i] = NULL;
+      break;
+    }
+    band_count = i + 1;
+  }
+  if (band_count < count)
+    fprintf(stderr, "gpu_neon: started %d of %d render threads\n",
+      band_count, count);
+  if (band_count == 1) {
+    pthread_cond_destroy(&band.cond_barrier);
+    pthread_cond_destroy(&band.cond_job);
+    pthread_mutex_destroy(&band.lock);
+    pthread_mutex_destroy(&band.queue_lock);
+    band_count = 0;
+  }
+}
+
+// vim:shiftwidth=2:expandtab
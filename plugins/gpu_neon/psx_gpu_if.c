@@ -21,10 +21,12 @@ extern const unsigned char cmd_lengths[256];
 
 static unsigned int *ex_regs;
 static int initialized;
+static int band_count; // threads drawing, see psx_gpu_bands.c
 
 #define PCSX
+// with render threads, band_queue() sets these instead
 #define SET_Ex(r, v) \
-  ex_regs[r] = v
+  if (band_count <= 1) ex_regs[r] = v
 
 #include "psx_gpu/psx_gpu.c"
 #include "psx_gpu/psx_gpu_parse.c"
@@ -32,10 +34,27 @@ static int initialized;
 
 static psx_gpu_struct egpu __attribute__((aligned(256)));
 
+#define BAND_THREADS_MAX 4
+
+static psx_gpu_struct *gpus[BAND_THREADS_MAX] = { &egpu };
+#define gpu_count (band_count > 1 ? band_count : 1)
+
+#if !defined(_WIN32) && !defined(NO_OS)
+#include "psx_gpu_bands.c"
+#else
+#define band_queue(list, count, last_cmd) 0
+#define band_flush()
+#define band_stop()
+#define band_set_threads(count)
+#endif
+
 int do_cmd_list(uint32_t *list, int count, int *last_cmd)
 {
   int ret;
 
+  if (band_count > 1)
+    return band_queue(list, count, last_cmd);
+
   if (gpu.state.enhancement_active)
     ret = gpu_parse_enhanced(&egpu, list, count * 4, (u32 *)last_cmd);
   else
@@ -93,6 +112,7 @@ int renderer_init(void)
 
 void renderer_finish(void)
 {
+  band_stop();
   if (egpu.enhancement_buf_ptr != NULL) {
     egpu.enhancement_buf_ptr -= 4096 / 2;
     gpu.munmap(egpu.enhancement_buf_ptr, ENHANCEMENT_BUF_SIZE);
@@ -132,37 +152,56 @@ sync_enhancement_buffers(int x, int y, int w, int h)
 
 void renderer_sync_ecmds(uint32_t *ecmds)
 {
-  gpu_parse(&egpu, ecmds + 1, 6 * 4, NULL);
+  int i;
+
+  band_flush();
+  for (i = 0; i < gpu_count; i++)
+    gpu_parse(gpus[i], ecmds + 1, 6 * 4, NULL);
 }
 
 void renderer_update_caches(int x, int y, int w, int h)
 {
-  update_texture_cache_region(&egpu, x, y, x + w - 1, y + h - 1);
+  int i;
+
+  band_flush();
+  for (i = 0; i < gpu_count; i++)
+    update_texture_cache_region(gpus[i], x, y, x + w - 1, y + h - 1);
   if (gpu.state.enhancement_active && !gpu.status.rgb24)
     sync_enhancement_buffers(x, y, w, h);
 }
 
 void renderer_flush_queues(void)
 {
+  band_flush();
   flush_render_block_buffer(&egpu);
 }
 
 void renderer_set_interlace(int enable, int is_odd)
 {
-  egpu.render_mode &= ~(RENDER_INTERLACE_ENABLED|RENDER_INTERLACE_ODD);
-  if (enable)
-    egpu.render_mode |= RENDER_INTERLACE_ENABLED;
-  if (is_odd)
-    egpu.render_mode |= RENDER_INTERLACE_ODD;
+  int i;
+
+  band_flush();
+  for (i = 0; i < gpu_count; i++) {
+    gpus[i]->render_mode &= ~(RENDER_INTERLACE_ENABLED|RENDER_INTERLACE_ODD);
+    if (enable)
+      gpus[i]->render_mode |= RENDER_INTERLACE_ENABLED;
+    if (is_odd)
+      gpus[i]->render_mode |= RENDER_INTERLACE_ODD;
+  }
 }
 
 void renderer_notify_res_change(void)
 {
+  int i;
+
+  band_flush();
   // note: must keep it multiple of 8
-  if (egpu.enhancement_x_threshold != gpu.screen.hres)
-  {
-    egpu.enhancement_x_threshold = gpu.screen.hres;
-    update_enhancement_buf_table_from_hres(&egpu);
+  for (i = 0; i < gpu_count; i++) {
+    if (gpus[i]->enhancement_x_threshold != gpu.screen.hres)
+    {
+      gpus[i]->enhancement_x_threshold = gpu.screen.hres;
+      update_enhancement_buf_table_from_hres(gpus[i]);
+    }
   }
 }
 
@@ -171,7 +210,9 @@ void renderer_notify_res_change(void)
 void renderer_set_config(const struct rearmed_cbs *cbs)
 {
   static int enhancement_was_on;
+  int i;
 
+  band_flush();
   disable_main_render = cbs->gpu_neon.enhancement_no_main;
   if (egpu.enhancement_buf_ptr != NULL && cbs->gpu_neon.enhancement_enable
       && !enhancement_was_on)
@@ -190,22 +231,27 @@ void renderer_set_config(const struct rearmed_cbs *cbs)
   if (cbs->pl_set_gpu_caps)
     cbs->pl_set_gpu_caps(GPU_CAP_SUPPORTS_2X);
   
-  egpu.use_dithering = cbs->gpu_neon.allow_dithering;
-  if(!egpu.use_dithering) {
-    egpu.dither_table[0] = dither_table_row(0, 0, 0, 0);
-    egpu.dither_table[1] = dither_table_row(0, 0, 0, 0);
-    egpu.dither_table[2] = dither_table_row(0, 0, 0, 0);
-    egpu.dither_table[3] = dither_table_row(0, 0, 0, 0);
-  } else {
-    egpu.dither_table[0] = dither_table_row(-4, 0, -3, 1);
-    egpu.dither_table[1] = dither_table_row(2, -2, 3, -1);
-    egpu.dither_table[2] = dither_table_row(-3, 1, -4, 0);
-    egpu.dither_table[3] = dither_table_row(3, -1, 2, -2); 
+  for (i = 0; i < gpu_count; i++) {
+    psx_gpu_struct *psx_gpu = gpus[i];
+    psx_gpu->use_dithering = cbs->gpu_neon.allow_dithering;
+    if(!psx_gpu->use_dithering) {
+      psx_gpu->dither_table[0] = dither_table_row(0, 0, 0, 0);
+      psx_gpu->dither_table[1] = dither_table_row(0, 0, 0, 0);
+      psx_gpu->dither_table[2] = dither_table_row(0, 0, 0, 0);
+      psx_gpu->dither_table[3] = dither_table_row(0, 0, 0, 0);
+    } else {
+      psx_gpu->dither_table[0] = dither_table_row(-4, 0, -3, 1);
+      psx_gpu->dither_table[1] = dither_table_row(2, -2, 3, -1);
+      psx_gpu->dither_table[2] = dither_table_row(-3, 1, -4, 0);
+      psx_gpu->dither_table[3] = dither_table_row(3, -1, 2, -2); 
+    }
   }
 
+  band_set_threads(cbs->gpu_neon.render_threads);
 }
 void renderer_sync(void)
 {
+  band_flush();
 }
 void renderer_notify_update_lace(int updated)
 {
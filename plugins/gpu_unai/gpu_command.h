@@ -46,6 +46,7 @@ void gpuSetTexture(u16 tpage)
 	gpu_unai.BLEND_MODE  = ((tpage>>5) & 3) << 3;
 	gpu_unai.TEXT_MODE   = (tmode + 1) << 5; // gpu_unai.TEXT_MODE should be values 1..3, so add one
 	gpu_unai.TBA = &((u16*)gpu_unai.vram)[FRAME_OFFSET(tx, ty)];
+	gpu_unai.TXT = (const u8*)gpu_unai.TBA;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
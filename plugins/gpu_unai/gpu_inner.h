@@ -578,7 +578,7 @@ endpolynotextgou:
 		u32 l_u = gpu_unai.u & l_u_msk;   u32 l_v = gpu_unai.v & l_v_msk;
 		s32 l_u_inc = gpu_unai.u_inc;     s32 l_v_inc = gpu_unai.v_inc;
 
-		const u16* TBA_ = gpu_unai.TBA;
+		const u16* TBA_ = (const u16*)gpu_unai.TXT;
 		const u16* CBA_; if (CF_TEXTMODE!=3) CBA_ = gpu_unai.CBA;
 
 		u8 r5, g5, b5;
@@ -69,7 +69,7 @@ void gpuDrawS(PtrUnion packet, const PS gpuSpriteSpanDriver)
 	const int pif=(ProgressiveInterlaceEnabled()?(gpu_unai.prog_ilace_flag?(gpu_unai.ilace_mask+1):0):1);
 	unsigned int tmode = gpu_unai.TEXT_MODE >> 5;
 	const u32 v0_mask = gpu_unai.TextureWindow[3];
-	u8* pTxt_base = (u8*)gpu_unai.TBA;
+	u8* pTxt_base = (u8*)gpu_unai.TXT;
 
 	// Texture is accessed byte-wise, so adjust idx if 16bpp
 	if (tmode == 3) u0 <<= 1;
@@ -108,8 +108,10 @@ void gpuDrawS16(PtrUnion packet)
 
 	if (x0 > xmax - 16 || x0 < xmin ||
 	    ((u0 | v0) & 15) || !(gpu_unai.TextureWindow[2] & gpu_unai.TextureWindow[3] & 8)) {
-		// send corner cases to general handler
+		// send corner cases to general handler, with TXT back on vram in
+		// case the last 4bpp primitive sampled the texture page cache
 		packet.U4[3] = 0x00100010;
+		gpu_unai.TXT = (const u8*)gpu_unai.TBA;
 		gpuDrawS(packet, gpuSpriteSpanFn<0x20>);
 		return;
 	}
@@ -0,0 +1,156 @@
+/***************************************************************************
+*   This program is free software; you can redistribute it and/or modify  *
+*   it under the terms of the GNU General Public License as published by  *
+*   the Free Software Foundation; either version 2 of the License, or     *
+*   (at your option) any later version.                                   *
+*                                                                         *
+*   This program is distributed in the hope that it will be useful,       *
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+*   GNU General Public License for more details.                          *
+*                                                                         *
+*   You should have received a copy of the GNU General Public License     *
+*   along with this program; if not, write to the                         *
+*   Free Software Foundation, Inc.,                                       *
+*   51 Franklin Street, Fifth Floor, Boston, MA 02111-1307 USA.           *
+***************************************************************************/
+
+#ifndef __GPU_UNAI_GPU_TEXCACHE_H__
+#define __GPU_UNAI_GPU_TEXCACHE_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//  4bpp texture page cache (gpulib only)
+//
+//  Sampling a 4bpp texture has to pick the texel's nibble out of a byte
+//  before the CLUT lookup. Instead, a 4bpp page can be decoded once to a
+//  byte per texel, laid out like 8bpp vram (2048 bytes per line), so the
+//  8bpp inner loops can sample it with the same CLUT. Pages are decoded
+//  again on their first use after vram under them has changed, either
+//  through gpulib (renderer_update_caches()), by fills and copies, or by
+//  anything drawn with the drawing area over them.
+//
+//  The CLUT itself is still read straight from vram. It is at most 512
+//  bytes, so it stays in the data cache anyway.
+//
+//  Pages are numbered like texpage bits 0..4: y * 16 + x. The 32 pages
+//  are kept as 4 blocks of 8 pages side by side.
+
+#define TEXCACHE_SIZE (32 * 256 * 256)
+
+// Pages under the drawing area are always sampled from vram. Others can
+// still be changed between each use (uploads, copies, drawing area moving
+// around), so after this many decodes in a frame the remaining 4bpp
+// primitives sample vram the usual way too.
+#define TEXCACHE_FRAME_DECODES 8
+
+INLINE u8* gpuTexCachePage(u32 page)
+{
+	return gpu_unai.TexCache.data
+		+ (((page >> 4) * 2 + ((page >> 3) & 1)) << 19) + ((page & 7) << 8);
+}
+
+// Pages under a vram rectangle, everything on an axis when it wraps
+static u32 gpuTexCachePages(s32 x, s32 y, s32 w, s32 h)
+{
+	u32 cols, mask = 0;
+
+	if (w <= 0 || h <= 0)
+		return 0;
+	if (x < 0 || x + w > FRAME_WIDTH)
+		cols = 0xffff;
+	else
+		cols = (2u << ((x + w - 1) >> 6)) - (1u << (x >> 6));
+	if (y < 0 || y + h > FRAME_HEIGHT || y < 256)
+		mask |= cols;
+	if (y < 0 || y + h > FRAME_HEIGHT || y + h > 256)
+		mask |= cols << 16;
+	return mask;
+}
+
+INLINE void gpuTexCacheInvalidate(s32 x, s32 y, s32 w, s32 h)
+{
+	gpu_unai.TexCache.dirty |= gpuTexCachePages(x, y, w, h);
+}
+
+// To be called whenever the drawing area changes
+INLINE void gpuTexCacheSetDrawArea()
+{
+	gpu_unai.TexCache.draw_pages = gpuTexCachePages(
+		gpu_unai.DrawingArea[0], gpu_unai.DrawingArea[1],
+		gpu_unai.DrawingArea[2] - gpu_unai.DrawingArea[0],
+		gpu_unai.DrawingArea[3] - gpu_unai.DrawingArea[1]);
+}
+
+// To be called after each primitive that draws within the drawing area
+INLINE void gpuTexCacheDraw()
+{
+	gpu_unai.TexCache.dirty |= gpu_unai.TexCache.draw_pages;
+}
+
+static void gpuTexCacheDecode(u32 page)
+{
+	const u16 *src =
+		&gpu_unai.vram[FRAME_OFFSET((page & 15) << 6, (page >> 4) << 8)];
+	u32 *dst = (u32*)gpuTexCachePage(page);
+
+	for (int y = 0; y < 256; y++, src += FRAME_WIDTH, dst += 2048 / 4) {
+		for (int x = 0; x < 64; x++) {
+			u32 p = src[x];
+			dst[x] = (p & 0xf) | ((p & 0xf0) << 4) | ((p & 0xf00) << 8)
+				| ((p & 0xf000) << 12);
+		}
+	}
+}
+
+// Points TXT at what the inner loops should sample the current texture
+// from, and returns the TEXT_MODE bits to pick them with.
+INLINE u32 gpuTexCacheSelect()
+{
+	u32 page = gpu_unai.GPU_GP1 & 0x1f;
+
+	gpu_unai.TXT = (const u8*)gpu_unai.TBA;
+	if (gpu_unai.TEXT_MODE != (1 << 5) || !gpu_unai.TexCache.data)
+		return gpu_unai.TEXT_MODE;
+
+	// The primitive may draw over its own texels and then read them back
+	if (gpu_unai.TexCache.draw_pages & (1u << page))
+		return gpu_unai.TEXT_MODE;
+
+	if (gpu_unai.TexCache.dirty & (1u << page)) {
+		if (gpu_unai.TexCache.decodes_left == 0)
+			return gpu_unai.TEXT_MODE;
+		gpu_unai.TexCache.decodes_left--;
+		gpuTexCacheDecode(page);
+		gpu_unai.TexCache.dirty &= ~(1u << page);
+	}
+
+	gpu_unai.TXT = gpuTexCachePage(page) + gpu_unai.TextureWindow[0]
+		+ gpu_unai.TextureWindow[1] * 2048;
+	return 2 << 5; // 8bpp
+}
+
+INLINE void gpuTexCacheNewFrame(u32 frame)
+{
+	if (gpu_unai.TexCache.frame != frame) {
+		gpu_unai.TexCache.frame = frame;
+		gpu_unai.TexCache.decodes_left = TEXCACHE_FRAME_DECODES;
+	}
+}
+
+static void gpuTexCacheInit()
+{
+#ifndef GPU_UNAI_NO_TEXCACHE
+	gpu_unai.TexCache.data = (u8*)malloc(TEXCACHE_SIZE);
+#endif
+	gpu_unai.TexCache.dirty = ~0u;
+	gpu_unai.TexCache.decodes_left = TEXCACHE_FRAME_DECODES;
+	gpuTexCacheSetDrawArea();
+}
+
+static void gpuTexCacheFinish()
+{
+	free(gpu_unai.TexCache.data);
+	gpu_unai.TexCache.data = NULL;
+}
+
+#endif /* __GPU_UNAI_GPU_TEXCACHE_H__ */
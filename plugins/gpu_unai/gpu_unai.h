@@ -42,6 +42,9 @@
 //#define GPU_UNAI_USE_INT_DIV_MULTINV   // If GPU_UNAI_USE_FLOATMATH is *not*
                                          //  defined, use old inaccurate division
 
+//#define GPU_UNAI_NO_TEXCACHE           // Don't cache 4bpp texture pages
+                                         //  decoded to 8bpp (gpu_texcache.h)
+
 
 #define GPU_INLINE static inline __attribute__((always_inline))
 #define INLINE     static inline __attribute__((always_inline))
@@ -140,6 +143,15 @@ struct gpu_unai_t {
 
 #ifdef USE_GPULIB
 	u16 *downscale_vram;
+
+	// 4bpp texture page cache, see gpu_texcache.h
+	struct {
+		u8  *data;         // Decoded pages, NULL when disabled
+		u32 dirty;         // Pages to decode again before use (bit per page)
+		u32 draw_pages;    // Pages under the drawing area
+		u32 frame;         // Frame the decode budget was reset at
+		u32 decodes_left;  // Decodes allowed for the rest of this frame
+	} TexCache;
 #endif
 	////////////////////////////////////////////////////////////////////////////
 	// Variables used only by older standalone version of gpu_unai (gpu.cpp)
@@ -199,6 +211,8 @@ struct gpu_unai_t {
 
 	u16* TBA;              // Ptr to current texture in VRAM
 	u16* CBA;              // Ptr to current CLUT in VRAM
+	const u8* TXT;         // Ptr inner loops sample the texture from: TBA,
+	                       //  or its page in the texture cache
 
 	////////////////////////////////////////////////////////////////////////////
 	//  Inner Loop parameters
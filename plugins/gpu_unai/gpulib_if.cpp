@@ -66,6 +66,9 @@
 // GPU command buffer execution/store
 #include "gpu_command.h"
 
+// 4bpp texture page cache
+#include "gpu_texcache.h"
+
 /////////////////////////////////////////////////////////////////////////////
 
 #define DOWNSCALE_VRAM_SIZE (1024 * 512 * 2 * 2 + 4096)
@@ -262,6 +265,7 @@ int renderer_init(void)
 
   SetupLightLUT();
   SetupDitheringConstants();
+  gpuTexCacheInit();
 
   if (gpu_unai.config.scale_hires) {
     map_downscale_buffer();
@@ -273,6 +277,7 @@ int renderer_init(void)
 void renderer_finish(void)
 {
   unmap_downscale_buffer();
+  gpuTexCacheFinish();
 }
 
 void renderer_notify_res_change(void)
@@ -363,12 +368,14 @@ static void gpuGP0Cmd_0xEx(gpu_unai_t &gpu_unai, u32 cmd_word)
       // GP0(E3h) - Set Drawing Area top left (X1,Y1)
       gpu_unai.DrawingArea[0] = cmd_word         & 0x3FF;
       gpu_unai.DrawingArea[1] = (cmd_word >> 10) & 0x3FF;
+      gpuTexCacheSetDrawArea();
     } break;
 
     case 4: {
       // GP0(E4h) - Set Drawing Area bottom right (X2,Y2)
       gpu_unai.DrawingArea[2] = (cmd_word         & 0x3FF) + 1;
       gpu_unai.DrawingArea[3] = ((cmd_word >> 10) & 0x3FF) + 1;
+      gpuTexCacheSetDrawArea();
     } break;
 
     case 5: {
@@ -405,6 +412,8 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
     gpu_unai.ilace_mask |= gpu.status.interlace;
   }
 
+  gpuTexCacheNewFrame(*gpu.state.frame_count);
+
   for (; list < list_end; list += 1 + len)
   {
     cmd = *list >> 24;
@@ -424,6 +433,8 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
     switch (cmd)
     {
       case 0x02:
+        gpuTexCacheInvalidate(packet.S2[2], packet.S2[3],
+          packet.S2[4] & 0x3ff, packet.S2[5] & 0x3ff);
         gpuClearImage(packet);
         break;
 
@@ -449,7 +460,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
         u32 driver_idx =
           (gpu_unai.blit_mask?1024:0) |
           Dithering |
-          Blending_Mode | gpu_unai.TEXT_MODE |
+          Blending_Mode | gpuTexCacheSelect() |
           gpu_unai.Masking | Blending | gpu_unai.PixelMSB;
 
         if (!FastLightingEnabled()) {
@@ -485,7 +496,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
         u32 driver_idx =
           (gpu_unai.blit_mask?1024:0) |
           Dithering |
-          Blending_Mode | gpu_unai.TEXT_MODE |
+          Blending_Mode | gpuTexCacheSelect() |
           gpu_unai.Masking | Blending | gpu_unai.PixelMSB;
 
         if (!FastLightingEnabled()) {
@@ -525,7 +536,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
         PP driver = gpuPolySpanDrivers[
           (gpu_unai.blit_mask?1024:0) |
           Dithering |
-          Blending_Mode | gpu_unai.TEXT_MODE |
+          Blending_Mode | gpuTexCacheSelect() |
           gpu_unai.Masking | Blending | ((Lighting)?129:0) | gpu_unai.PixelMSB
         ];
         gpuDrawPolyGT(packet, driver, false);
@@ -554,7 +565,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
         PP driver = gpuPolySpanDrivers[
           (gpu_unai.blit_mask?1024:0) |
           Dithering |
-          Blending_Mode | gpu_unai.TEXT_MODE |
+          Blending_Mode | gpuTexCacheSelect() |
           gpu_unai.Masking | Blending | ((Lighting)?129:0) | gpu_unai.PixelMSB
         ];
         gpuDrawPolyGT(packet, driver, true); // is_quad = true
@@ -588,6 +599,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
           num_vertexes++;
           if(list_position >= list_end) {
             cmd = -1;
+            gpuTexCacheDraw();
             goto breakloop;
           }
           if((*list_position & 0xf000f000) == 0x50005000)
@@ -631,6 +643,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
           num_vertexes++;
           if(list_position >= list_end) {
             cmd = -1;
+            gpuTexCacheDraw();
             goto breakloop;
           }
           if((*list_position & 0xf000f000) == 0x50005000)
@@ -653,7 +666,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
       case 0x66:
       case 0x67: {          // Textured rectangle (variable size)
         gpuSetCLUT    (gpu_unai.PacketBuffer.U4[2] >> 16);
-        u32 driver_idx = Blending_Mode | gpu_unai.TEXT_MODE | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>1);
+        u32 driver_idx = Blending_Mode | gpuTexCacheSelect() | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>1);
 
         //senquack - Only color 808080h-878787h allows skipping lighting calculation:
         // This fixes Silent Hill running animation on loading screens:
@@ -699,7 +712,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
       case 0x77: {          // Textured rectangle (8x8)
         gpu_unai.PacketBuffer.U4[3] = 0x00080008;
         gpuSetCLUT    (gpu_unai.PacketBuffer.U4[2] >> 16);
-        u32 driver_idx = Blending_Mode | gpu_unai.TEXT_MODE | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>1);
+        u32 driver_idx = Blending_Mode | gpuTexCacheSelect() | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>1);
 
         //senquack - Only color 808080h-878787h allows skipping lighting calculation:
         //if ((gpu_unai.PacketBuffer.U1[0]>0x5F) && (gpu_unai.PacketBuffer.U1[1]>0x5F) && (gpu_unai.PacketBuffer.U1[2]>0x5F))
@@ -734,7 +747,7 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
       case 0x7F: {          // Textured rectangle (16x16)
         gpu_unai.PacketBuffer.U4[3] = 0x00100010;
         gpuSetCLUT    (gpu_unai.PacketBuffer.U4[2] >> 16);
-        u32 driver_idx = Blending_Mode | gpu_unai.TEXT_MODE | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>1);
+        u32 driver_idx = Blending_Mode | gpuTexCacheSelect() | gpu_unai.Masking | Blending | (gpu_unai.PixelMSB>>1);
         //senquack - Only color 808080h-878787h allows skipping lighting calculation:
         //if ((gpu_unai.PacketBuffer.U1[0]>0x5F) && (gpu_unai.PacketBuffer.U1[1]>0x5F) && (gpu_unai.PacketBuffer.U1[2]>0x5F))
         // Strip lower 3 bits of each color and determine if lighting should be used:
@@ -745,6 +758,8 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
       } break;
 
       case 0x80:          //  vid -> vid
+        gpuTexCacheInvalidate(packet.U2[4] & 1023, packet.U2[5] & 511,
+          packet.U2[6], packet.U2[7]);
         gpuMoveImage(packet);
         break;
 
@@ -770,6 +785,10 @@ int do_cmd_list(u32 *list, int list_len, int *last_cmd)
         gpuGP0Cmd_0xEx(gpu_unai, gpu_unai.PacketBuffer.U4[0]);
       } break;
     }
+
+    // Anything drawn may have landed on a cached texture page
+    if (cmd >= 0x20 && cmd < 0x80)
+      gpuTexCacheDraw();
   }
 
 breakloop:
@@ -788,6 +807,7 @@ void renderer_sync_ecmds(uint32_t *ecmds)
 
 void renderer_update_caches(int x, int y, int w, int h)
 {
+  gpuTexCacheInvalidate(x, y, w, h);
 }
 
 void renderer_flush_queues(void)
@@ -803,6 +823,7 @@ void renderer_set_interlace(int enable, int is_odd)
 void renderer_set_config(const struct rearmed_cbs *cbs)
 {
   gpu_unai.vram = (u16*)gpu.vram;
+  gpu_unai.TexCache.dirty = ~0u;
   gpu_unai.config.ilace_force   = cbs->gpu_unai.ilace_force;
   gpu_unai.config.pixel_skip    = cbs->gpu_unai.pixel_skip;
   gpu_unai.config.lighting      = cbs->gpu_unai.lighting;
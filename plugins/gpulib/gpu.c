@@ -13,6 +13,8 @@
 #include <stdlib.h> /* for calloc */
 
 #include "gpu.h"
+#include "record.h"
+#include "stats.h"
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 #ifdef __GNUC__
@@ -35,12 +37,25 @@
 
 struct psx_gpu gpu;
 
+// time a call for the stats, when the frontend wants them
+#define timed_call(type, call) do { \
+  if (unlikely(gpu_stats_active())) { \
+    uint64_t t_ = gpu_stats_now(); \
+    call; \
+    gpu_stats_time(type, t_); \
+  } \
+  else \
+    call; \
+} while (0)
+
 static noinline int do_cmd_buffer(uint32_t *data, int count);
 static void finish_vram_transfer(int is_read);
+static noinline void mark_cmds_dirty(const uint32_t *list, int count,
+  uint32_t e3, uint32_t e4, uint32_t e5);
 
 static noinline void do_cmd_reset(void)
 {
-  renderer_sync();
+  timed_call(GPU_STAT_SYNC, renderer_sync());
 
   if (unlikely(gpu.cmd_len > 0))
     do_cmd_buffer(gpu.cmd_buffer, gpu.cmd_len);
@@ -107,6 +122,8 @@ static noinline void decide_frameskip(void)
   if (!gpu.frameskip.active && gpu.frameskip.pending_fill[0] != 0) {
     int dummy;
     do_cmd_list(gpu.frameskip.pending_fill, 3, &dummy);
+    if (gpu.state.track_dirty)
+      mark_cmds_dirty(gpu.frameskip.pending_fill, 3, 0, 0, 0);
     gpu.frameskip.pending_fill[0] = 0;
   }
 }
@@ -234,6 +251,13 @@ long GPUinit(void)
   gpu.cmd_len = 0;
   do_reset();
 
+#ifndef NO_OS
+  if (getenv("GPU_RECORD")) {
+    const char *frames = getenv("GPU_RECORD_FRAMES");
+    gpu_rec_start(getenv("GPU_RECORD"), frames ? atoi(frames) : 0);
+  }
+#endif
+
   /*if (gpu.mmap != NULL) {
     if (map_vram() != 0)
       ret = -1;
@@ -245,6 +269,8 @@ long GPUshutdown(void)
 {
   long ret;
 
+  gpu_rec_stop();
+  gpu_stats_set_cb(NULL);
   renderer_finish();
   ret = vout_finish();
 
@@ -269,6 +295,9 @@ void GPUwriteStatus(uint32_t data)
   static const short vres[4] = { 240, 480, 256, 480 };
   uint32_t cmd = data >> 24;
 
+  if (gpu_rec_active())
+    gpu_rec_event(GPU_REC_WRITE_STATUS, data, 0, NULL, 0);
+
   if (cmd < ARRAY_SIZE(gpu.regs)) {
     if (cmd > 1 && cmd != 5 && gpu.regs[cmd] == data)
       return;
@@ -371,7 +400,7 @@ static int do_vram_io(uint32_t *data, int count, int is_read)
   int l;
   count *= 2; // operate in 16bpp pixels
 
-  renderer_sync();
+  timed_call(GPU_STAT_SYNC, renderer_sync());
 
   if (gpu.dma.offset) {
     l = w - gpu.dma.offset;
@@ -426,7 +455,11 @@ static void start_vram_transfer(uint32_t pos_word, uint32_t size_word, int is_re
   gpu.dma.is_read = is_read;
   gpu.dma_start = gpu.dma;
 
-  renderer_flush_queues();
+  if (unlikely(gpu_stats_active()))
+    gpu_stats_vram_io(gpu.dma.w, gpu.dma.h, is_read);
+  if (gpu.state.track_dirty && !is_read)
+    gpu_mark_dirty(gpu.dma.x, gpu.dma.y, gpu.dma.w, gpu.dma.h);
+  timed_call(GPU_STAT_SYNC, renderer_flush_queues());
   if (is_read) {
     gpu.status.img = 1;
     // XXX: wrong for width 1
@@ -438,6 +471,113 @@ static void start_vram_transfer(uint32_t pos_word, uint32_t size_word, int is_re
     gpu.dma.x, gpu.dma.y, gpu.dma.w, gpu.dma.h);
 }
 
+void gpu_mark_dirty(int x, int y, int w, int h)
+{
+  // wraps around vram, take all of that axis
+  if (x + w > 1024) {
+    x = 0;
+    w = 1024;
+  }
+  if (y + h > 512) {
+    y = 0;
+    h = 512;
+  }
+  if (w <= 0 || h <= 0)
+    return;
+
+  if (x < gpu.state.dirty.x0) gpu.state.dirty.x0 = x;
+  if (y < gpu.state.dirty.y0) gpu.state.dirty.y0 = y;
+  if (x + w > gpu.state.dirty.x1) gpu.state.dirty.x1 = x + w;
+  if (y + h > gpu.state.dirty.y1) gpu.state.dirty.y1 = y + h;
+}
+
+static int sext11(uint32_t v)
+{
+  return (int)(v << 21) >> 21;
+}
+
+// what a list drew to: the bounding box of each primitive, clipped to the
+// drawing area that was set for it
+static noinline void mark_cmds_dirty(const uint32_t *list, int count,
+  uint32_t e3, uint32_t e4, uint32_t e5)
+{
+  int pos, len, cmd, i, end, stride, x, y, w, h;
+  int x0, y0, x1, y1;
+
+  for (pos = 0; pos < count; pos += len) {
+    const uint32_t *l = list + pos;
+    cmd = l[0] >> 24;
+    len = gpu_cmd_len(l, count - pos);
+
+    switch (cmd >> 5) {
+      case 0:
+        if (cmd == 0x02)
+          gpu_mark_dirty(l[1] & 0x3f0, (l[1] >> 16) & 0x1ff,
+            ((l[2] & 0x3ff) + 0xf) & ~0xf, (l[2] >> 16) & 0x1ff);
+        continue;
+      case 1:
+        stride = 1 + ((cmd >> 2) & 1) + ((cmd >> 4) & 1);
+        end = 1 + ((cmd & 8) ? 4 : 3) * stride;
+        break;
+      case 2:
+        stride = (cmd & 0x10) ? 2 : 1;
+        end = (cmd & 8) ? len - 1 : len; // polyline terminator
+        break;
+      case 3:
+        x = sext11(l[1]);
+        y = sext11(l[1] >> 16);
+        switch ((cmd >> 3) & 3) {
+          case 0:
+            w = l[(cmd & 4) ? 3 : 2];
+            h = (w >> 16) & 0x1ff;
+            w &= 0x3ff;
+            break;
+          case 1: w = h = 1; break;
+          case 2: w = h = 8; break;
+          default: w = h = 16; break;
+        }
+        x0 = x; y0 = y;
+        x1 = x + w - 1; y1 = y + h - 1;
+        stride = end = 0;
+        break;
+      default:
+        if (cmd == 0x80) {
+          w = ((((l[3] & 0xffff) - 1) & 0x3ff) + 1);
+          h = ((((l[3] >> 16) - 1) & 0x1ff) + 1);
+          gpu_mark_dirty(l[2] & 0x3ff, (l[2] >> 16) & 0x1ff, w, h);
+        }
+        else if (cmd == 0xe3)
+          e3 = l[0];
+        else if (cmd == 0xe4)
+          e4 = l[0];
+        else if (cmd == 0xe5)
+          e5 = l[0];
+        continue;
+    }
+
+    if (stride) {
+      x0 = y0 = 0x7fff;
+      x1 = y1 = -0x8000;
+      for (i = 1; i < end; i += stride) {
+        x = sext11(l[i]);
+        y = sext11(l[i] >> 16);
+        if (x < x0) x0 = x;
+        if (x > x1) x1 = x;
+        if (y < y0) y0 = y;
+        if (y > y1) y1 = y;
+      }
+    }
+
+    x0 += sext11(e5); x1 += sext11(e5);
+    y0 += sext11(e5 >> 11); y1 += sext11(e5 >> 11);
+    if (x0 < (int)(e3 & 0x3ff)) x0 = e3 & 0x3ff;
+    if (y0 < (int)((e3 >> 10) & 0x1ff)) y0 = (e3 >> 10) & 0x1ff;
+    if (x1 > (int)(e4 & 0x3ff)) x1 = e4 & 0x3ff;
+    if (y1 > (int)((e4 >> 10) & 0x1ff)) y1 = (e4 >> 10) & 0x1ff;
+    gpu_mark_dirty(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+  }
+}
+
 static void finish_vram_transfer(int is_read)
 {
   if (is_read)
@@ -461,9 +601,12 @@ static noinline int do_cmd_list_skip(uint32_t *data, int count, int *last_cmd)
 
     switch (cmd) {
       case 0x02:
-        if ((int)(list[2] & 0x3ff) > gpu.screen.w || (int)((list[2] >> 16) & 0x1ff) > gpu.screen.h)
+        if ((int)(list[2] & 0x3ff) > gpu.screen.w || (int)((list[2] >> 16) & 0x1ff) > gpu.screen.h) {
           // clearing something large, don't skip
           do_cmd_list(list, 3, &dummy);
+          if (gpu.state.track_dirty)
+            mark_cmds_dirty(list, 3, 0, 0, 0);
+        }
         else
           memcpy(gpu.frameskip.pending_fill, list, 3 * 4);
         break;
@@ -513,6 +656,16 @@ static noinline int do_cmd_list_skip(uint32_t *data, int count, int *last_cmd)
   return pos;
 }
 
+static noinline int do_cmd_list_stats(uint32_t *list, int count, int *last_cmd)
+{
+  uint64_t t = gpu_stats_now();
+  int done = do_cmd_list(list, count, last_cmd);
+
+  gpu_stats_time(GPU_STAT_CMD_LIST, t);
+  gpu_stats_cmds(list, done);
+  return done;
+}
+
 static noinline int do_cmd_buffer(uint32_t *data, int count)
 {
   int cmd, pos;
@@ -547,7 +700,16 @@ static noinline int do_cmd_buffer(uint32_t *data, int count)
     if (gpu.frameskip.active && (gpu.frameskip.allow || ((data[pos] >> 24) & 0xf0) == 0xe0))
       pos += do_cmd_list_skip(data + pos, count - pos, &cmd);
     else {
-      pos += do_cmd_list(data + pos, count - pos, &cmd);
+      uint32_t e3 = gpu.ex_regs[3], e4 = gpu.ex_regs[4], e5 = gpu.ex_regs[5];
+      int done;
+
+      if (unlikely(gpu_stats_active()))
+        done = do_cmd_list_stats(data + pos, count - pos, &cmd);
+      else
+        done = do_cmd_list(data + pos, count - pos, &cmd);
+      if (gpu.state.track_dirty)
+        mark_cmds_dirty(data + pos, done, e3, e4, e5);
+      pos += done;
       vram_dirty = 1;
     }
 
@@ -582,6 +744,9 @@ void GPUwriteDataMem(uint32_t *mem, int count)
 
   log_io("gpu_dma_write %p %d\n", mem, count);
 
+  if (gpu_rec_active())
+    gpu_rec_event(GPU_REC_WRITE_DATA_MEM, 0, 0, mem, count * 4);
+
   if (unlikely(gpu.cmd_len > 0))
     flush_cmd_buffer();
 
@@ -593,6 +758,8 @@ void GPUwriteDataMem(uint32_t *mem, int count)
 void GPUwriteData(uint32_t data)
 {
   log_io("gpu_write %08x\n", data);
+  if (gpu_rec_active())
+    gpu_rec_write_data(data);
   gpu.cmd_buffer[gpu.cmd_len++] = data;
   if (gpu.cmd_len >= CMD_BUFFER_LEN)
     flush_cmd_buffer();
@@ -624,6 +791,9 @@ long GPUdmaChain(uint32_t *rambase, uint32_t start_addr)
 
     log_io(".chain %08x #%d\n", (list - rambase) * 4, len);
 
+    if (unlikely(gpu_rec_active()))
+      gpu_rec_chain_node((list - rambase) * 4, list, len);
+
     if (len) {
       left = do_cmd_buffer(list + 1, len);
       if (left)
@@ -660,6 +830,10 @@ long GPUdmaChain(uint32_t *rambase, uint32_t start_addr)
   gpu.state.last_list.cycles = cpu_cycles;
   gpu.state.last_list.addr = start_addr;
 
+  if (gpu_rec_active())
+    gpu_rec_event(GPU_REC_DMA_CHAIN, start_addr, 0,
+      gpu_rec.chain, gpu_rec.chain_len * 4);
+
   return cpu_cycles;
 }
 
@@ -667,6 +841,9 @@ void GPUreadDataMem(uint32_t *mem, int count)
 {
   log_io("gpu_dma_read  %p %d\n", mem, count);
 
+  if (gpu_rec_active())
+    gpu_rec_event(GPU_REC_READ_DATA_MEM, count, 0, NULL, 0);
+
   if (unlikely(gpu.cmd_len > 0))
     flush_cmd_buffer();
 
@@ -678,6 +855,9 @@ uint32_t GPUreadData(void)
 {
   uint32_t ret;
 
+  if (gpu_rec_active())
+    gpu_rec_read_data();
+
   if (unlikely(gpu.cmd_len > 0))
     flush_cmd_buffer();
 
@@ -701,30 +881,28 @@ uint32_t GPUreadStatus(void)
   return ret;
 }
 
-struct GPUFreeze
-{
-  uint32_t ulFreezeVersion;      // should be always 1 for now (set by main emu)
-  uint32_t ulStatus;             // current gpu status
-  uint32_t ulControl[256];       // latest control register values
-  unsigned char psxVRam[1024*1024*2]; // current VRam image (full 2 MB for ZN)
-};
-
 long GPUfreeze(uint32_t type, struct GPUFreeze *freeze)
 {
   int i;
 
   switch (type) {
     case 1: // save
+    case 3: // save without VRAM, the caller tracks it via GPUgetVram
       if (gpu.cmd_len > 0)
         flush_cmd_buffer();
 
       renderer_sync();
-      memcpy(freeze->psxVRam, gpu.vram, 1024 * 512 * 2);
+      if (type == 1)
+        memcpy(freeze->psxVRam, gpu.vram, 1024 * 512 * 2);
       memcpy(freeze->ulControl, gpu.regs, sizeof(gpu.regs));
       memcpy(freeze->ulControl + 0xe0, gpu.ex_regs, sizeof(gpu.ex_regs));
       freeze->ulStatus = gpu.status.reg;
       break;
     case 0: // load
+      if (gpu_rec_active())
+        gpu_rec_event(GPU_REC_LOAD, 0, 0, &freeze->ulStatus,
+          sizeof(struct gpu_rec_state));
+      gpu_rec.mute++;
       renderer_sync();
       memcpy(gpu.vram, freeze->psxVRam, 1024 * 512 * 2);
       memcpy(gpu.regs, freeze->ulControl, sizeof(gpu.regs));
@@ -737,17 +915,24 @@ long GPUfreeze(uint32_t type, struct GPUFreeze *freeze)
       }
       renderer_sync_ecmds(gpu.ex_regs);
       renderer_update_caches(0, 0, 1024, 512);
+      gpu_mark_dirty(0, 0, 1024, 512);
+      gpu_rec.mute--;
       break;
   }
 
   return 1;
 }
 
-void GPUupdateLace(void)
+void *GPUgetVram(void)
+{
+  return gpu.vram;
+}
+
+static void update_lace(void)
 {
   if (gpu.cmd_len > 0)
     flush_cmd_buffer();
-  renderer_flush_queues();
+  timed_call(GPU_STAT_SYNC, renderer_flush_queues());
 
   if (gpu.status.blanking) {
     if (!gpu.state.blanked) {
@@ -772,15 +957,31 @@ void GPUupdateLace(void)
     gpu.frameskip.frame_ready = 0;
   }
 
-  vout_update();
+  timed_call(GPU_STAT_VOUT, vout_update());
   gpu.state.fb_dirty = 0;
   gpu.state.blanked = 0;
   renderer_notify_update_lace(1);
 }
 
+void GPUupdateLace(void)
+{
+  if (gpu_rec_active())
+    gpu_rec_event(GPU_REC_UPDATE_LACE, 0, 0, NULL, 0);
+
+  update_lace();
+
+  if (unlikely(gpu_stats_active()))
+    gpu_stats_frame_end();
+}
+
 void GPUvBlank(int is_vblank, int lcf)
 {
-  int interlace = gpu.state.allow_interlace
+  int interlace;
+
+  if (gpu_rec_active())
+    gpu_rec_event(GPU_REC_VBLANK, is_vblank, lcf, NULL, 0);
+
+  interlace = gpu.state.allow_interlace
     && gpu.status.interlace && gpu.status.dheight;
   // interlace doesn't look nice on progressive displays,
   // so we have this "auto" mode here for games that don't read vram
@@ -794,7 +995,7 @@ void GPUvBlank(int is_vblank, int lcf)
 
     if (gpu.cmd_len > 0)
       flush_cmd_buffer();
-    renderer_flush_queues();
+    timed_call(GPU_STAT_SYNC, renderer_flush_queues());
     renderer_set_interlace(interlace, !lcf);
   }
 }
@@ -813,8 +1014,12 @@ void GPUrearmedCallbacks(const struct rearmed_cbs *cbs)
   gpu.state.enhancement_enable = cbs->gpu_neon.enhancement_enable;
 
   gpu.useDithering = cbs->gpu_neon.allow_dithering;
+  gpu_rec_config((gpu.useDithering ? GPU_REC_CFG_DITHER : 0)
+    | (gpu.state.enhancement_enable ? GPU_REC_CFG_ENHANCEMENT : 0)
+    | (gpu.state.allow_interlace << GPU_REC_CFG_INTERLACE_SHIFT));
   gpu.mmap = cbs->mmap;
   gpu.munmap = cbs->munmap;
+  gpu_stats_set_cb(cbs->pl_gpu_frame_stats);
 
   // delayed vram mmap
   if (gpu.vram == NULL)
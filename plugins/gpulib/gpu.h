@@ -73,6 +73,7 @@ struct psx_gpu {
     uint32_t enhancement_active:1;
     uint32_t downscale_enable:1;
     uint32_t downscale_active:1;
+    uint32_t track_dirty:1;
     uint32_t *frame_count;
     uint32_t *hcnt; /* hsync count */
     struct {
@@ -82,6 +83,9 @@ struct psx_gpu {
       uint32_t hcnt;
     } last_list;
     uint32_t last_vram_read_frame;
+    struct {
+      int x0, y0, x1, y1;
+    } dirty; /* vram written since the last flip, if track_dirty */
   } state;
   struct {
     int32_t set:3; /* -1 auto, 0 off, 1-3 fixed */
@@ -108,6 +112,7 @@ extern struct psx_gpu gpu;
 extern const unsigned char cmd_lengths[256];
 
 int do_cmd_list(uint32_t *list, int count, int *last_cmd);
+void gpu_mark_dirty(int x, int y, int w, int h);
 
 struct rearmed_cbs;
 
@@ -128,8 +133,15 @@ void vout_update(void);
 void vout_blank(void);
 void vout_set_config(const struct rearmed_cbs *config);
 
+struct GPUFreeze
+{
+  uint32_t ulFreezeVersion;      // should be always 1 for now (set by main emu)
+  uint32_t ulStatus;             // current gpu status
+  uint32_t ulControl[256];       // latest control register values
+  unsigned char psxVRam[1024*1024*2]; // current VRam image (full 2 MB for ZN)
+};
+
 /* listing these here for correct linkage if rasterizer uses c++ */
-struct GPUFreeze;
 
 long GPUinit(void);
 long GPUshutdown(void);
@@ -141,6 +153,7 @@ uint32_t GPUreadData(void);
 uint32_t GPUreadStatus(void);
 void GPUwriteStatus(uint32_t data);
 long GPUfreeze(uint32_t type, struct GPUFreeze *freeze);
+void *GPUgetVram(void);
 void GPUupdateLace(void);
 long GPUopen(void **dpy);
 long GPUclose(void);
@@ -29,34 +29,42 @@
 #define TRUE 1
 #define BOOL unsigned short
 
+/* Command lists are copied into a ring of words, each one preceded by a
+ * header, and the render thread runs them from there in place. Only the
+ * emu thread moves 'end' and 'pub' and only the render thread moves
+ * 'start', so no lock is needed unless one side has to sleep. Lists
+ * that are held back for the next frame (hold_cmds) sit between 'pub'
+ * and 'end' until they are published. */
+#define ARENA_SIZE 0x40000 /* words, must be a power of 2 */
+#define ARENA_MASK (ARENA_SIZE - 1)
+#define ARENA_WRAP -1 /* in count, continue from the start */
+
 typedef struct {
-	uint32_t *cmd_list;
 	int count;
 	int last_cmd;
 } video_thread_cmd;
 
-#define QUEUE_SIZE 0x2000
+#define CMD_HDR_WORDS (sizeof(video_thread_cmd) / sizeof(uint32_t))
 
 typedef struct {
-	size_t start;
-	size_t end;
-	size_t used;
-	video_thread_cmd queue[QUEUE_SIZE];
-} video_thread_queue;
+	uint32_t *buf;
+	uint32_t start; /* free running word positions */
+	uint32_t pub;
+	uint32_t end;
+} video_thread_arena;
 
 typedef struct {
 	pthread_t thread;
 	pthread_mutex_t queue_lock;
 	pthread_cond_t cond_msg_avail;
 	pthread_cond_t cond_msg_done;
-	pthread_cond_t cond_queue_empty;
-	video_thread_queue *queue;
-	video_thread_queue *bg_queue;
+	video_thread_arena arena;
+	int render_waiting;
+	int emu_waiting;
 	BOOL running;
 } video_thread_state;
 
 static video_thread_state thread;
-static video_thread_queue queues[2];
 static int thread_rendering;
 static BOOL hold_cmds;
 static BOOL needs_display;
@@ -64,38 +72,57 @@ static BOOL flushed;
 
 extern const unsigned char cmd_lengths[];
 
+/* Both sides set their waiting flag before checking the other's
+ * position, and update their position before checking the flag, so
+ * one of them always sees the other. */
+static void wake(int *waiting, pthread_cond_t *cond) {
+	if (!__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+		return;
+
+	pthread_mutex_lock(&thread.queue_lock);
+	pthread_cond_signal(cond);
+	pthread_mutex_unlock(&thread.queue_lock);
+}
+
 static void *video_thread_main(void *arg) {
 	video_thread_state *thread = (video_thread_state *)arg;
+	video_thread_arena *arena = &thread->arena;
 	video_thread_cmd *cmd;
-	int i;
+	uint32_t start = arena->start, pub;
 
 #ifdef _3DS
 	static int processed = 0;
 #endif /* _3DS */
 
 	while(1) {
-		int result, last_cmd, start, end;
-		video_thread_queue *queue;
-		pthread_mutex_lock(&thread->queue_lock);
+		int result, last_cmd;
 
-		while (!thread->queue->used && thread->running) {
-			pthread_cond_wait(&thread->cond_msg_avail, &thread->queue_lock);
-		}
+		pub = __atomic_load_n(&arena->pub, __ATOMIC_ACQUIRE);
+		if (start == pub) {
+			pthread_mutex_lock(&thread->queue_lock);
+			__atomic_store_n(&thread->render_waiting, TRUE, __ATOMIC_SEQ_CST);
 
-		if (!thread->running) {
+			while (__atomic_load_n(&arena->pub, __ATOMIC_SEQ_CST) == start && thread->running) {
+				pthread_cond_wait(&thread->cond_msg_avail, &thread->queue_lock);
+			}
+
+			__atomic_store_n(&thread->render_waiting, FALSE, __ATOMIC_RELAXED);
+			if (!thread->running) {
+				pthread_mutex_unlock(&thread->queue_lock);
+				break;
+			}
 			pthread_mutex_unlock(&thread->queue_lock);
-			break;
+			continue;
 		}
 
-		queue = thread->queue;
-		start = queue->start;
-		end = queue->end > queue->start ? queue->end : QUEUE_SIZE;
-		queue->start = end % QUEUE_SIZE;
-		pthread_mutex_unlock(&thread->queue_lock);
+		while (start != pub) {
+			cmd = (video_thread_cmd *)&arena->buf[start & ARENA_MASK];
+			if (cmd->count == ARENA_WRAP) {
+				start += ARENA_SIZE - (start & ARENA_MASK);
+				continue;
+			}
 
-		for (i = start; i < end; i++) {
-			cmd = &queue->queue[i];
-			result = real_do_cmd_list(cmd->cmd_list, cmd->count, &last_cmd);
+			result = real_do_cmd_list((uint32_t *)(cmd + 1), cmd->count, &last_cmd);
 
 			if (result != cmd->count) {
 				fprintf(stderr, "Processed wrong cmd count: expected %d, got %d\n", cmd->count, result);
@@ -109,66 +136,73 @@ static void *video_thread_main(void *arg) {
 				processed %= 512;
 			}
 #endif /* _3DS */
-		}
-
-		pthread_mutex_lock(&thread->queue_lock);
-		queue->used -= (end - start);
 
-		if (!queue->used)
-			pthread_cond_signal(&thread->cond_queue_empty);
-
-		pthread_cond_signal(&thread->cond_msg_done);
-		pthread_mutex_unlock(&thread->queue_lock);
+			/* Give the space back right away, the emu thread may be
+			 * waiting for it */
+			start += CMD_HDR_WORDS + cmd->count;
+			__atomic_store_n(&arena->start, start, __ATOMIC_SEQ_CST);
+			wake(&thread->emu_waiting, &thread->cond_msg_done);
+		}
 	}
 
 	return 0;
 }
 
-static void cmd_queue_swap() {
-	video_thread_queue *tmp;
-	if (!thread.bg_queue->used) return;
+static uint32_t queue_used(void) {
+	return thread.arena.pub - __atomic_load_n(&thread.arena.start, __ATOMIC_ACQUIRE);
+}
 
-	pthread_mutex_lock(&thread.queue_lock);
-	if (!thread.queue->used) {
-		tmp = thread.queue;
-		thread.queue = thread.bg_queue;
-		thread.bg_queue = tmp;
-		pthread_cond_signal(&thread.cond_msg_avail);
-	}
-	pthread_mutex_unlock(&thread.queue_lock);
+static uint32_t bg_queue_used(void) {
+	return thread.arena.end - thread.arena.pub;
 }
 
-/* Waits for the main queue to completely finish. */
-void renderer_wait() {
-	if (!thread.running) return;
+/* Waits until the render thread gets to 'pos'. */
+static void wait_for_start(uint32_t pos) {
+	video_thread_arena *arena = &thread.arena;
 
-	/* Not completely safe, but should be fine since the render thread
-	 * only decreases used, and we check again inside the lock. */
-	if (!thread.queue->used) {
+	if ((int32_t)(__atomic_load_n(&arena->start, __ATOMIC_ACQUIRE) - pos) >= 0)
 		return;
-	}
 
 	pthread_mutex_lock(&thread.queue_lock);
+	__atomic_store_n(&thread.emu_waiting, TRUE, __ATOMIC_SEQ_CST);
 
-	while (thread.queue->used) {
-		pthread_cond_wait(&thread.cond_queue_empty, &thread.queue_lock);
+	while ((int32_t)(__atomic_load_n(&arena->start, __ATOMIC_SEQ_CST) - pos) < 0) {
+		pthread_cond_wait(&thread.cond_msg_done, &thread.queue_lock);
 	}
 
+	__atomic_store_n(&thread.emu_waiting, FALSE, __ATOMIC_RELAXED);
 	pthread_mutex_unlock(&thread.queue_lock);
 }
 
+static void cmd_queue_publish(void) {
+	__atomic_store_n(&thread.arena.pub, thread.arena.end, __ATOMIC_SEQ_CST);
+	wake(&thread.render_waiting, &thread.cond_msg_avail);
+}
+
+static void cmd_queue_swap() {
+	if (!bg_queue_used()) return;
+
+	if (!queue_used())
+		cmd_queue_publish();
+}
+
+/* Waits for the main queue to completely finish. */
+void renderer_wait() {
+	if (!thread.running) return;
+
+	wait_for_start(thread.arena.pub);
+}
+
 /* Waits for all GPU commands in both queues to finish, bringing VRAM
  * completely up-to-date. */
 void renderer_sync(void) {
 	if (!thread.running) return;
 
-	/* Not completely safe, but should be fine since the render thread
-	 * only decreases used, and we check again inside the lock. */
-	if (!thread.queue->used && !thread.bg_queue->used) {
+	if (!queue_used() && !bg_queue_used()) {
 		return;
 	}
 
-	if (thread.bg_queue->used) {
+	if (bg_queue_used()) {
 		/* When we flush the background queue, the vblank handler can't
 		 * know that we had a frame pending, and we delay rendering too
 		 * long. Force it. */
@@ -189,106 +223,90 @@ void renderer_sync(void) {
 }
 
 static void video_thread_stop() {
-	int i;
 	renderer_sync();
 
 	if (thread.running) {
+		pthread_mutex_lock(&thread.queue_lock);
 		thread.running = FALSE;
 		pthread_cond_signal(&thread.cond_msg_avail);
+		pthread_mutex_unlock(&thread.queue_lock);
 		pthread_join(thread.thread, NULL);
 	}
 
 	pthread_mutex_destroy(&thread.queue_lock);
 	pthread_cond_destroy(&thread.cond_msg_avail);
 	pthread_cond_destroy(&thread.cond_msg_done);
-	pthread_cond_destroy(&thread.cond_queue_empty);
-
-	for (i = 0; i < QUEUE_SIZE; i++) {
-		video_thread_cmd *cmd = &thread.queue->queue[i];
-		free(cmd->cmd_list);
-		cmd->cmd_list = NULL;
-	}
 
-	for (i = 0; i < QUEUE_SIZE; i++) {
-		video_thread_cmd *cmd = &thread.bg_queue->queue[i];
-		free(cmd->cmd_list);
-		cmd->cmd_list = NULL;
-	}
+	free(thread.arena.buf);
+	thread.arena.buf = NULL;
 }
 
 static void video_thread_start() {
 	fprintf(stdout, "Starting render thread\n");
 
-	if (pthread_cond_init(&thread.cond_msg_avail, NULL) ||
+	thread.arena.buf = malloc(ARENA_SIZE * sizeof(uint32_t));
+	thread.arena.start = thread.arena.pub = thread.arena.end = 0;
+	thread.render_waiting = thread.emu_waiting = FALSE;
+	thread.running = TRUE;
+
+	if (!thread.arena.buf ||
+			pthread_cond_init(&thread.cond_msg_avail, NULL) ||
 			pthread_cond_init(&thread.cond_msg_done, NULL) ||
-			pthread_cond_init(&thread.cond_queue_empty, NULL) ||
 			pthread_mutex_init(&thread.queue_lock, NULL) ||
 			pthread_create(&thread.thread, NULL, video_thread_main, &thread)) {
 		goto error;
 	}
 
-	thread.queue = &queues[0];
-	thread.bg_queue = &queues[1];
-
-	thread.running = TRUE;
 	return;
 
  error:
 	fprintf(stderr,"Failed to start rendering thread\n");
+	thread.running = FALSE;
 	video_thread_stop();
 }
 
 static void video_thread_queue_cmd(uint32_t *list, int count, int last_cmd) {
+	video_thread_arena *arena = &thread.arena;
 	video_thread_cmd *cmd;
-	uint32_t *cmd_list;
-	video_thread_queue *queue;
-	BOOL lock;
-
-	cmd_list = (uint32_t *)calloc(count, sizeof(uint32_t));
-
-	if (!cmd_list) {
-		/* Out of memory, disable the thread and run sync from now on */
-		fprintf(stderr,"Failed to allocate render thread command list, stopping thread\n");
-		video_thread_stop();
-	}
-
-	memcpy(cmd_list, list, count * sizeof(uint32_t));
+	uint32_t need = CMD_HDR_WORDS + count;
+	uint32_t skip, pos;
 
-	if (hold_cmds && thread.bg_queue->used >= QUEUE_SIZE) {
-		/* If the bg queue is full, do a full sync to empty both queues
-		 * and clear space. This should be very rare, I've only seen it in
-		 * Tekken 3 post-battle-replay. */
+	if (need > ARENA_SIZE / 2) {
+		/* Doesn't fit, run it right here once the thread is idle */
+		int dummy;
 		renderer_sync();
+		real_do_cmd_list(list, count, &dummy);
+		return;
 	}
 
-	if (hold_cmds) {
-		queue = thread.bg_queue;
-		lock = FALSE;
-	} else {
-		queue = thread.queue;
-		lock = TRUE;
+	skip = ARENA_SIZE - (arena->end & ARENA_MASK);
+	if (skip >= need)
+		skip = 0;
+
+	pos = arena->end + skip + need - ARENA_SIZE;
+	if ((int32_t)(pos - __atomic_load_n(&arena->start, __ATOMIC_ACQUIRE)) > 0) {
+		if ((int32_t)(pos - arena->pub) > 0) {
+			/* The held back commands are in the way, so do a full sync
+			 * to empty both queues and clear space. This should be very
+			 * rare, I've only seen it in Tekken 3 post-battle-replay. */
+			renderer_sync();
+		}
+		wait_for_start(pos);
 	}
 
-	if (lock) {
-		pthread_mutex_lock(&thread.queue_lock);
-
-		while (queue->used >= QUEUE_SIZE) {
-			pthread_cond_wait(&thread.cond_msg_done, &thread.queue_lock);
-		}
+	if (skip) {
+		arena->buf[arena->end & ARENA_MASK] = ARENA_WRAP;
+		arena->end += skip;
 	}
 
-	cmd = &queue->queue[queue->end];
-	free(cmd->cmd_list);
-	cmd->cmd_list = cmd_list;
+	cmd = (video_thread_cmd *)&arena->buf[arena->end & ARENA_MASK];
 	cmd->count = count;
 	cmd->last_cmd = last_cmd;
-	queue->end = (queue->end + 1) % QUEUE_SIZE;
-	queue->used++;
+	memcpy(cmd + 1, list, count * sizeof(uint32_t));
+	arena->end += need;
 
-	if (lock) {
-		pthread_cond_signal(&thread.cond_msg_avail);
-		pthread_mutex_unlock(&thread.queue_lock);
-	}
+	if (!hold_cmds)
+		cmd_queue_publish();
 }
 
 /* Slice off just the part of the list that can be handled async, and
@@ -435,18 +453,19 @@ void renderer_notify_update_lace(int updated) {
 	}
 
 	if (updated) {
+		/* Commands held back for the next frame were already counted
+		 * as drawn in the frame just shown, so redo all of it. */
+		if (gpu.state.track_dirty && bg_queue_used())
+			gpu_mark_dirty(0, 0, 1024, 512);
 		cmd_queue_swap();
 		return;
 	}
 
-	pthread_mutex_lock(&thread.queue_lock);
-	if (thread.bg_queue->used || flushed) {
+	if (bg_queue_used() || flushed) {
 		/* We have commands for a future frame to run. Force a wait until
 		 * the current frame is finished, and start processing the next
 		 * frame after it's drawn (see the `updated` clause above). */
-		pthread_mutex_unlock(&thread.queue_lock);
 		renderer_wait();
-		pthread_mutex_lock(&thread.queue_lock);
 
 		/* We are no longer holding commands back, so the next frame may
 		 * get mixed into the following frame. This is usually fine, but can
@@ -455,14 +474,14 @@ void renderer_notify_update_lace(int updated) {
 		hold_cmds = FALSE;
 		needs_display = TRUE;
 		gpu.state.fb_dirty = TRUE;
-	} else if (thread.queue->used) {
+	} else if (queue_used()) {
 		/* We are still drawing during a vblank. Cut off the current frame
 		 * by sending new commands to the background queue and skip
 		 * drawing our partly rendered frame to the display. */
 		hold_cmds = TRUE;
 		needs_display = TRUE;
 		gpu.state.fb_dirty = FALSE;
-	} else if (needs_display && !thread.queue->used) {
+	} else if (needs_display && !queue_used()) {
 		/* We have processed all commands in the queue, render the
 		 * buffer. We know we have something to render, because
 		 * needs_display is TRUE. */
@@ -472,8 +491,6 @@ void renderer_notify_update_lace(int updated) {
 	} else {
 		/* Everything went normally, so do the normal thing. */
 	}
-
-	pthread_mutex_unlock(&thread.queue_lock);
 }
 
 void renderer_set_interlace(int enable, int is_odd) {
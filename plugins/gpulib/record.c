@@ -0,0 +1,196 @@
+/*
+ * Records the calls the emu makes into gpulib so that they can be replayed
+ * headless against any renderer by test_replay.c. Enabled by setting
+ * GPU_RECORD=<file> in the environment, and optionally GPU_RECORD_FRAMES=<n>
+ * to stop after n frames. The recording begins on the first call after
+ * GPUinit() with a snapshot of vram and the registers, so it can also be
+ * started in the middle of a game.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu.h"
+#include "record.h"
+
+struct gpu_rec gpu_rec;
+
+#ifndef NO_OS
+
+static void flush_pending(void);
+static void write_event(int type, uint32_t a, uint32_t b,
+  const void *data, uint32_t size);
+
+int gpu_rec_start(const char *fname, int frames)
+{
+  gpu_rec_stop();
+
+  gpu_rec.f = fopen(fname, "wb");
+  if (gpu_rec.f == NULL) {
+    perror(fname);
+    return -1;
+  }
+  gpu_rec.started = 0;
+  gpu_rec.frames_left = frames;
+  gpu_rec.pending_cnt = 0;
+  gpu_rec.chain_len = 0;
+  return 0;
+}
+
+void gpu_rec_stop(void)
+{
+  if (gpu_rec.f == NULL)
+    return;
+  flush_pending();
+  fclose(gpu_rec.f);
+  gpu_rec.f = NULL;
+  gpu_rec.started = 0;
+  free(gpu_rec.chain);
+  gpu_rec.chain = NULL;
+  gpu_rec.chain_alloc = 0;
+}
+
+static int write_header(void)
+{
+  struct gpu_rec_header hdr;
+  struct GPUFreeze *freeze;
+
+  freeze = (struct GPUFreeze *)malloc(sizeof(*freeze));
+  if (freeze == NULL) {
+    gpu_rec_stop();
+    return -1;
+  }
+  GPUfreeze(1, freeze);
+
+  memcpy(hdr.magic, GPU_REC_MAGIC, sizeof(hdr.magic));
+  hdr.version = GPU_REC_VERSION;
+  hdr.config = gpu_rec.config;
+  hdr.frame = *gpu.state.frame_count;
+  fwrite(&hdr, 1, sizeof(hdr), gpu_rec.f);
+  fwrite(&freeze->ulStatus, 1, sizeof(freeze->ulStatus), gpu_rec.f);
+  fwrite(freeze->ulControl, 1, sizeof(freeze->ulControl), gpu_rec.f);
+  fwrite(freeze->psxVRam, 1, 1024 * 512 * 2, gpu_rec.f);
+  free(freeze);
+
+  gpu_rec.started = 1;
+
+  // a partial command left in the buffer isn't part of the state
+  if (gpu.cmd_len > 0)
+    write_event(GPU_REC_WRITE_DATA, 0, 0, gpu.cmd_buffer, gpu.cmd_len * 4);
+  return 0;
+}
+
+static void write_event(int type, uint32_t a, uint32_t b,
+  const void *data, uint32_t size)
+{
+  struct gpu_rec_event ev;
+
+  ev.type = type;
+  ev.frame = *gpu.state.frame_count;
+  ev.a = a;
+  ev.b = b;
+  ev.size = size;
+  fwrite(&ev, 1, sizeof(ev), gpu_rec.f);
+  if (size)
+    fwrite(data, 1, size, gpu_rec.f);
+}
+
+static void flush_pending(void)
+{
+  uint32_t cnt = gpu_rec.pending_cnt;
+
+  if (cnt == 0)
+    return;
+  gpu_rec.pending_cnt = 0;
+  if (gpu_rec.pending_type == GPU_REC_WRITE_DATA)
+    write_event(GPU_REC_WRITE_DATA, 0, 0, gpu_rec.pending, cnt * 4);
+  else
+    write_event(GPU_REC_READ_DATA, cnt, 0, NULL, 0);
+}
+
+void gpu_rec_event(int type, uint32_t a, uint32_t b,
+  const void *data, uint32_t size)
+{
+  if (!gpu_rec.started) {
+    if (write_header() != 0)
+      return;
+    // the chain has already been run, so the snapshot includes it
+    if (type == GPU_REC_DMA_CHAIN)
+      return;
+  }
+
+  flush_pending();
+  write_event(type, a, b, data, size);
+  if (type == GPU_REC_DMA_CHAIN)
+    gpu_rec.chain_len = 0;
+
+  if (type == GPU_REC_UPDATE_LACE && gpu_rec.frames_left > 0
+      && --gpu_rec.frames_left == 0)
+    gpu_rec_stop();
+}
+
+static void add_pending(uint32_t type, uint32_t data)
+{
+  if (!gpu_rec.started && write_header() != 0)
+    return;
+  if (gpu_rec.pending_cnt != 0 && (gpu_rec.pending_type != type
+      || gpu_rec.pending_cnt == sizeof(gpu_rec.pending) / 4))
+    flush_pending();
+  gpu_rec.pending_type = type;
+  gpu_rec.pending[gpu_rec.pending_cnt++] = data;
+}
+
+void gpu_rec_write_data(uint32_t data)
+{
+  add_pending(GPU_REC_WRITE_DATA, data);
+}
+
+void gpu_rec_read_data(void)
+{
+  add_pending(GPU_REC_READ_DATA, 0);
+}
+
+void gpu_rec_chain_node(uint32_t addr, const uint32_t *list, int len)
+{
+  uint32_t need = gpu_rec.chain_len + 2 + len;
+
+  if (!gpu_rec.started)
+    return;
+  if (need > gpu_rec.chain_alloc) {
+    uint32_t alloc = gpu_rec.chain_alloc ? gpu_rec.chain_alloc * 2 : 16 * 1024;
+    uint32_t *chain;
+    while (alloc < need)
+      alloc *= 2;
+    chain = (uint32_t *)realloc(gpu_rec.chain, alloc * 4);
+    if (chain == NULL) {
+      fprintf(stderr, "gpu_rec: out of memory, stopping\n");
+      gpu_rec_stop();
+      return;
+    }
+    gpu_rec.chain = chain;
+    gpu_rec.chain_alloc = alloc;
+  }
+  gpu_rec.chain[gpu_rec.chain_len++] = addr;
+  memcpy(gpu_rec.chain + gpu_rec.chain_len, list, (1 + len) * 4);
+  gpu_rec.chain_len += 1 + len;
+}
+
+void gpu_rec_config(uint32_t config)
+{
+  if (config == gpu_rec.config)
+    return;
+  gpu_rec.config = config;
+  if (gpu_rec.started && gpu_rec_active())
+    gpu_rec_event(GPU_REC_CONFIG, config, 0, NULL, 0);
+}
+
+#endif // NO_OS
+
+// vim:shiftwidth=2:expandtab
@@ -0,0 +1,105 @@
+#ifndef __GPULIB_RECORD_H__
+#define __GPULIB_RECORD_H__
+
+// recording of everything the emu feeds to the GPU, see test_replay.c
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPU_REC_MAGIC   "GPUR"
+#define GPU_REC_VERSION 1
+
+enum gpu_rec_type {
+  GPU_REC_WRITE_DATA = 1, // data: words, consecutive GPUwriteData() calls
+  GPU_REC_WRITE_DATA_MEM, // data: words
+  GPU_REC_READ_DATA,      // a: consecutive GPUreadData() calls
+  GPU_REC_READ_DATA_MEM,  // a: word count
+  GPU_REC_DMA_CHAIN,      // a: start addr, data: the nodes as walked
+  GPU_REC_WRITE_STATUS,   // a: val
+  GPU_REC_UPDATE_LACE,
+  GPU_REC_VBLANK,         // a: is_vblank, b: lcf
+  GPU_REC_LOAD,           // data: struct gpu_rec_state
+  GPU_REC_CONFIG,         // a: GPU_REC_CFG_*, when it changes
+  GPU_REC_TYPE_CNT
+};
+
+// gpulib settings that change what gets drawn
+#define GPU_REC_CFG_DITHER      (1 << 0)
+#define GPU_REC_CFG_ENHANCEMENT (1 << 1)
+#define GPU_REC_CFG_INTERLACE_SHIFT 2 // allow_interlace, 2 bits
+
+// a dma chain node is its address followed by the header word and the
+// len words it points to
+
+// the state is what GPUfreeze() saves, minus the unused half of vram
+struct gpu_rec_state {
+  uint32_t status;
+  uint32_t control[256];
+  uint16_t vram[1024 * 512];
+};
+
+// file header, followed by the starting state
+struct gpu_rec_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t config;
+  uint32_t frame;
+};
+
+// followed by 'size' bytes of data
+struct gpu_rec_event {
+  uint32_t type;
+  uint32_t frame;         // *gpu.state.frame_count at the time of the call
+  uint32_t a, b;
+  uint32_t size;
+};
+
+struct gpu_rec {
+  FILE *f;
+  int started;            // header written
+  int mute;               // inside GPUfreeze() load, don't record nested calls
+  int frames_left;        // stop after this many GPUupdateLace(), 0 - never
+  uint32_t config;
+  // consecutive GPUwriteData()/GPUreadData() calls are merged
+  uint32_t pending_type;
+  uint32_t pending_cnt;
+  uint32_t pending[256];
+  // nodes of the dma chain being walked
+  uint32_t *chain;
+  uint32_t chain_len, chain_alloc;
+};
+
+extern struct gpu_rec gpu_rec;
+
+#ifndef NO_OS
+
+#define gpu_rec_active() \
+  (gpu_rec.f != NULL && !gpu_rec.mute)
+
+int  gpu_rec_start(const char *fname, int frames);
+void gpu_rec_stop(void);
+void gpu_rec_event(int type, uint32_t a, uint32_t b,
+  const void *data, uint32_t size);
+void gpu_rec_write_data(uint32_t data);
+void gpu_rec_read_data(void);
+void gpu_rec_chain_node(uint32_t addr, const uint32_t *list, int len);
+void gpu_rec_config(uint32_t config);
+
+#else
+
+#define gpu_rec_active() 0
+#define gpu_rec_stop()
+#define gpu_rec_event(type, a, b, data, size)
+#define gpu_rec_write_data(data)
+#define gpu_rec_read_data()
+#define gpu_rec_chain_node(addr, list, len)
+#define gpu_rec_config(config)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GPULIB_RECORD_H__ */
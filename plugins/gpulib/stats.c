@@ -0,0 +1,213 @@
+/*
+ * Per frame counts of what the GPU was asked to draw and where the time
+ * went, for the frontend to show or export. Nothing is collected unless
+ * the frontend sets rearmed_cbs.pl_gpu_frame_stats.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <string.h>
+#ifndef NO_OS
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#include "gpu.h"
+#include "stats.h"
+
+// spans closer than this are merged
+#define SPAN_MERGE_NS 100000
+
+struct gpu_stats gpu_stats;
+
+static int sext11(uint32_t v)
+{
+  return (int)(v << 21) >> 21;
+}
+
+static unsigned int tri_pixels(const int *x, const int *y)
+{
+  int area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  return (area < 0 ? -area : area) / 2;
+}
+
+static unsigned int line_pixels(uint32_t xy0, uint32_t xy1)
+{
+  int dx = sext11(xy1) - sext11(xy0);
+  int dy = sext11(xy1 >> 16) - sext11(xy0 >> 16);
+  dx = dx < 0 ? -dx : dx;
+  dy = dy < 0 ? -dy : dy;
+  return (dx > dy ? dx : dy) + 1;
+}
+
+// roughly how many pixels a command draws, ignoring clipping
+unsigned int gpu_prim_pixels(const uint32_t *list, int len)
+{
+  int cmd = list[0] >> 24;
+  int x[4], y[4], i, n, stride;
+
+  switch (cmd >> 5) {
+    case 0:
+      if (cmd != 2)
+        return 0;
+      return (((list[2] & 0x3ff) + 0xf) & ~0xf) * ((list[2] >> 16) & 0x1ff);
+    case 1:
+      n = (cmd & 8) ? 4 : 3;
+      stride = 1 + ((cmd >> 2) & 1) + ((cmd >> 4) & 1);
+      for (i = 0; i < n; i++) {
+        uint32_t xy = list[1 + i * stride];
+        x[i] = sext11(xy);
+        y[i] = sext11(xy >> 16);
+      }
+      return tri_pixels(x, y) + (n == 4 ? tri_pixels(x + 1, y + 1) : 0);
+    case 2: {
+      unsigned int pixels = 0;
+      stride = (cmd & 0x10) ? 2 : 1;
+      for (i = 1; i + stride < len; i += stride)
+        pixels += line_pixels(list[i], list[i + stride]);
+      return pixels;
+    }
+    case 3: {
+      static const int sizes[4] = { 0, 1, 8, 16 };
+      int size = sizes[(cmd >> 3) & 3];
+      if (size)
+        return size * size;
+      i = list[(cmd & 4) ? 3 : 2];
+      return (i & 0x3ff) * ((i >> 16) & 0x1ff);
+    }
+  }
+  if (cmd == 0x80)
+    return ((((list[3] & 0xffff) - 1) & 0x3ff) + 1)
+      * ((((list[3] >> 16) - 1) & 0x1ff) + 1);
+  return 0;
+}
+
+// unlike cmd_lengths[], polylines run up to and including the terminator
+int gpu_cmd_len(const uint32_t *list, int count)
+{
+  int cmd = list[0] >> 24;
+  int v;
+
+  if ((cmd & 0xf8) == 0x48) {
+    for (v = 3; v < count; v++)
+      if ((list[v] & 0xf000f000) == 0x50005000)
+        break;
+    return v + 1;
+  }
+  if ((cmd & 0xf8) == 0x58) {
+    for (v = 4; v < count; v += 2)
+      if ((list[v] & 0xf000f000) == 0x50005000)
+        break;
+    return v + 1;
+  }
+  return 1 + cmd_lengths[cmd];
+}
+
+#ifndef NO_OS
+
+uint64_t gpu_stats_now(void)
+{
+#ifdef _WIN32
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000000ull + tv.tv_usec * 1000ull;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+void gpu_stats_time(uint32_t type, uint64_t start_ns)
+{
+  struct gpu_frame_stats *s = &gpu_stats.frame;
+  uint64_t now = gpu_stats_now();
+  uint32_t n = s->span_cnt;
+
+  s->ns[type] += now - start_ns;
+
+  if (n > 0 && s->spans[n - 1].type == type
+      && start_ns - s->spans[n - 1].start_ns - s->spans[n - 1].dur_ns
+         < SPAN_MERGE_NS)
+    s->spans[n - 1].dur_ns = now - s->spans[n - 1].start_ns;
+  else if (n < GPU_STAT_MAX_SPANS) {
+    s->spans[n].type = type;
+    s->spans[n].start_ns = start_ns;
+    s->spans[n].dur_ns = now - start_ns;
+    s->span_cnt++;
+  }
+}
+
+static int prim_type(int cmd)
+{
+  switch (cmd >> 5) {
+    case 0:
+      return cmd == 2 ? GPU_STAT_FILL : -1;
+    case 1:
+      // gouraud and textured bits to the enum's order
+      return GPU_STAT_POLY + ((cmd >> 4) & 1) + ((cmd >> 1) & 2);
+    case 2:
+      return GPU_STAT_LINE;
+    case 3:
+      return (cmd & 4) ? GPU_STAT_SPRITE : GPU_STAT_RECT;
+  }
+  return cmd == 0x80 ? GPU_STAT_COPY : -1;
+}
+
+void gpu_stats_cmds(const uint32_t *list, int count)
+{
+  struct gpu_frame_stats *s = &gpu_stats.frame;
+  unsigned int pixels;
+  int pos, len, type;
+
+  for (pos = 0; pos < count; pos += len) {
+    len = gpu_cmd_len(list + pos, count - pos);
+    type = prim_type(list[pos] >> 24);
+    if (type < 0)
+      continue;
+    pixels = gpu_prim_pixels(list + pos, len);
+    s->count[type]++;
+    s->pixels[type] += pixels;
+    if (type == GPU_STAT_SPRITE || type == GPU_STAT_POLY_TEX
+        || type == GPU_STAT_POLY_GOURAUD_TEX)
+      s->texels[type] += pixels;
+  }
+}
+
+void gpu_stats_vram_io(int w, int h, int is_read)
+{
+  int type = is_read ? GPU_STAT_VRAM_READ : GPU_STAT_VRAM_WRITE;
+
+  gpu_stats.frame.count[type]++;
+  gpu_stats.frame.pixels[type] += w * h;
+}
+
+void gpu_stats_frame_end(void)
+{
+  struct gpu_frame_stats *s = &gpu_stats.frame;
+  uint64_t now = gpu_stats_now();
+
+  s->frame = *gpu.state.frame_count;
+  s->end_ns = now;
+  gpu_stats.cb(s);
+
+  memset(s, 0, sizeof(*s));
+  s->start_ns = now;
+}
+
+void gpu_stats_set_cb(void (*cb)(const struct gpu_frame_stats *stats))
+{
+  if (cb == gpu_stats.cb)
+    return;
+  memset(&gpu_stats.frame, 0, sizeof(gpu_stats.frame));
+  gpu_stats.frame.start_ns = gpu_stats_now();
+  gpu_stats.cb = cb;
+}
+
+#endif // NO_OS
+
+// vim:shiftwidth=2:expandtab
@@ -0,0 +1,92 @@
+#ifndef __GPULIB_STATS_H__
+#define __GPULIB_STATS_H__
+
+// per frame counters and timings, passed to the frontend's
+// rearmed_cbs.pl_gpu_frame_stats after each GPUupdateLace()
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum gpu_stat_prim {
+  GPU_STAT_POLY,              // flat, untextured
+  GPU_STAT_POLY_GOURAUD,
+  GPU_STAT_POLY_TEX,
+  GPU_STAT_POLY_GOURAUD_TEX,
+  GPU_STAT_SPRITE,            // textured rectangle
+  GPU_STAT_RECT,
+  GPU_STAT_LINE,              // polylines count as one
+  GPU_STAT_FILL,
+  GPU_STAT_COPY,              // vram to vram
+  GPU_STAT_VRAM_WRITE,        // from the cpu or dma
+  GPU_STAT_VRAM_READ,
+  GPU_STAT_PRIM_CNT
+};
+
+enum gpu_stat_time {
+  GPU_STAT_CMD_LIST,          // the renderer's do_cmd_list()
+  GPU_STAT_SYNC,              // waiting for a render thread
+  GPU_STAT_VOUT,              // vout_update()
+  GPU_STAT_TIME_CNT
+};
+
+#define GPU_STAT_MAX_SPANS 64
+
+// pixels are estimated from the command words, before clipping, so they
+// are the same for every renderer; texels are the textured pixels
+struct gpu_frame_stats {
+  uint32_t frame;             // *gpu.state.frame_count at the end
+  uint64_t start_ns, end_ns;
+  uint32_t count[GPU_STAT_PRIM_CNT];
+  uint64_t pixels[GPU_STAT_PRIM_CNT];
+  uint64_t texels[GPU_STAT_PRIM_CNT];
+  uint64_t ns[GPU_STAT_TIME_CNT];
+  // when the time was spent, spans of the same kind that are close
+  // together are merged, and once they run out only the totals are kept
+  uint32_t span_cnt;
+  struct {
+    uint32_t type;            // GPU_STAT_CMD_LIST...
+    uint32_t dur_ns;
+    uint64_t start_ns;
+  } spans[GPU_STAT_MAX_SPANS];
+};
+
+struct gpu_stats {
+  void (*cb)(const struct gpu_frame_stats *stats);
+  struct gpu_frame_stats frame;
+};
+
+extern struct gpu_stats gpu_stats;
+
+int gpu_cmd_len(const uint32_t *list, int count);
+unsigned int gpu_prim_pixels(const uint32_t *list, int len);
+
+#ifndef NO_OS
+
+#define gpu_stats_active() \
+  (gpu_stats.cb != NULL)
+
+uint64_t gpu_stats_now(void);
+void gpu_stats_time(uint32_t type, uint64_t start_ns);
+void gpu_stats_cmds(const uint32_t *list, int count);
+void gpu_stats_vram_io(int w, int h, int is_read);
+void gpu_stats_frame_end(void);
+void gpu_stats_set_cb(void (*cb)(const struct gpu_frame_stats *stats));
+
+#else
+
+#define gpu_stats_active() 0
+#define gpu_stats_now() 0
+#define gpu_stats_time(type, start_ns) (void)(start_ns)
+#define gpu_stats_cmds(list, count)
+#define gpu_stats_vram_io(w, h, is_read)
+#define gpu_stats_frame_end()
+#define gpu_stats_set_cb(cb)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GPULIB_STATS_H__ */
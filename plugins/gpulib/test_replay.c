@@ -0,0 +1,450 @@
+/*
+ * replays a recording made with GPU_RECORD=<file> (see record.c) against
+ * whichever renderer this is linked with, reports the speed and optionally
+ * compares the final vram to one saved by another run or renderer
+ *
+ * With -p every primitive is passed to the renderer on its own and timed,
+ * which costs some speed. Threaded renderers only get timed for queuing
+ * the work then, the waiting shows up under renderer_sync.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "gpu.h"
+
+// gpu.c's calls to the renderer go through here to be counted
+static int replay_do_cmd_list(uint32_t *list, int count, int *last_cmd);
+#define do_cmd_list replay_do_cmd_list
+#include "gpu.c"
+#undef do_cmd_list
+
+static const char * const type_names[GPU_REC_TYPE_CNT] = {
+  [GPU_REC_WRITE_DATA]     = "GPUwriteData",
+  [GPU_REC_WRITE_DATA_MEM] = "GPUwriteDataMem",
+  [GPU_REC_READ_DATA]      = "GPUreadData",
+  [GPU_REC_READ_DATA_MEM]  = "GPUreadDataMem",
+  [GPU_REC_DMA_CHAIN]      = "GPUdmaChain",
+  [GPU_REC_WRITE_STATUS]   = "GPUwriteStatus",
+  [GPU_REC_UPDATE_LACE]    = "GPUupdateLace",
+  [GPU_REC_VBLANK]         = "GPUvBlank",
+  [GPU_REC_LOAD]           = "GPUfreeze",
+  [GPU_REC_CONFIG]         = "config",
+};
+
+static int dither = -1, enhancement = -1, interlace = -1, threads;
+static int prim_timing, max_frames;
+
+static struct {
+  unsigned int count;
+  unsigned long long ns;
+} stats[GPU_REC_TYPE_CNT];
+
+// by command with the bits that don't matter masked out, 0x7f - vram copy
+static struct {
+  unsigned int count;
+  unsigned long long pixels;
+  unsigned long long ns;
+} prim_stats[128];
+
+static unsigned int frame, hcnt, frames_done;
+static unsigned long long sync_ns;
+static uint32_t *ram;
+
+static unsigned long long get_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *load_file(const char *fname, size_t *size)
+{
+  FILE *f;
+  void *buf;
+  long len;
+
+  f = fopen(fname, "rb");
+  if (f == NULL) {
+    perror(fname);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf = malloc(len > 0 ? len : 1);
+  if (buf != NULL && fread(buf, 1, len, f) != (size_t)len) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(f);
+  if (buf == NULL)
+    fprintf(stderr, "%s: read failed\n", fname);
+  *size = len;
+  return buf;
+}
+
+// no display, just count the frames
+int vout_init(void) { return 0; }
+int vout_finish(void) { return 0; }
+void vout_update(void) { frames_done++; }
+void vout_blank(void) { frames_done++; }
+void vout_set_config(const struct rearmed_cbs *cbs) {}
+
+static const char *prim_name(int cmd)
+{
+  static char buf[32];
+  const char *semi = (cmd & 2) ? " semi" : "";
+
+  switch (cmd >> 5) {
+    case 0:
+      return cmd == 2 ? "fill" : "nop";
+    case 1:
+      snprintf(buf, sizeof(buf), "%s %s%s%s", (cmd & 8) ? "quad" : "tri",
+        (cmd & 0x10) ? "gouraud" : "flat", (cmd & 4) ? " tex" : "", semi);
+      return buf;
+    case 2:
+      snprintf(buf, sizeof(buf), "%s %s%s", (cmd & 8) ? "polyline" : "line",
+        (cmd & 0x10) ? "gouraud" : "flat", semi);
+      return buf;
+    case 3: {
+      static const char * const sizes[4] = { "", " 1x1", " 8x8", " 16x16" };
+      snprintf(buf, sizeof(buf), "%s%s%s", (cmd & 4) ? "sprite" : "rect",
+        sizes[(cmd >> 3) & 3], semi);
+      return buf;
+    }
+  }
+  return cmd == 0x80 ? "vram copy" : "other";
+}
+
+static void count_prim(const uint32_t *list, int len, unsigned long long ns)
+{
+  int cmd = list[0] >> 24;
+
+  if (cmd >= 0x80 && cmd != 0x80)
+    return; // image i/o and settings
+  if (cmd == 0x80)
+    cmd = 0x7f;
+  else
+    cmd &= (cmd >> 5) == 2 ? ~5 : ~1;
+  prim_stats[cmd].count++;
+  prim_stats[cmd].pixels += gpu_prim_pixels(list, len);
+  prim_stats[cmd].ns += ns;
+}
+
+static int replay_do_cmd_list(uint32_t *list, int count, int *last_cmd)
+{
+  unsigned long long t;
+  int pos, len, done;
+
+  if (!prim_timing) {
+    done = do_cmd_list(list, count, last_cmd);
+    for (pos = 0; pos < done; pos += len) {
+      len = gpu_cmd_len(list + pos, done - pos);
+      count_prim(list + pos, len, 0);
+    }
+    return done;
+  }
+
+  for (pos = 0; pos < count; pos += done) {
+    len = gpu_cmd_len(list + pos, count - pos);
+    if (len > count - pos)
+      len = count - pos;
+    t = get_ns();
+    done = do_cmd_list(list + pos, len, last_cmd);
+    if (done == 0 && len < count - pos)
+      // the renderer parses it differently, let it have the rest
+      done = do_cmd_list(list + pos, count - pos, last_cmd);
+    t = get_ns() - t;
+    if (done == 0)
+      break; // incomplete or image i/o for gpulib
+    count_prim(list + pos, done, t);
+  }
+  return pos;
+}
+
+// rebuild the chain in a fake ram at the recorded addresses
+static void build_chain(const uint32_t *nodes, uint32_t size)
+{
+  uint32_t i, addr, len;
+
+  for (i = 0; i + 2 <= size; i += 2 + len) {
+    addr = nodes[i] & 0x1ffffc;
+    len = nodes[i + 1] >> 24;
+    if (i + 2 + len > size)
+      break;
+    memcpy(ram + addr / 4, nodes + i + 1, (1 + len) * 4);
+  }
+}
+
+static void load_state(const struct gpu_rec_state *state)
+{
+  static struct GPUFreeze freeze;
+
+  freeze.ulFreezeVersion = 1;
+  freeze.ulStatus = state->status;
+  memcpy(freeze.ulControl, state->control, sizeof(freeze.ulControl));
+  memcpy(freeze.psxVRam, state->vram, sizeof(state->vram));
+  GPUfreeze(0, &freeze);
+}
+
+static void set_config(uint32_t config)
+{
+  static struct rearmed_cbs cbs;
+
+  cbs.gpu_frame_count = &frame;
+  cbs.gpu_hcnt = &hcnt;
+  cbs.gpu_neon.allow_dithering = dither >= 0 ? dither
+    : !!(config & GPU_REC_CFG_DITHER);
+  cbs.gpu_neon.enhancement_enable = enhancement >= 0 ? enhancement
+    : !!(config & GPU_REC_CFG_ENHANCEMENT);
+  cbs.gpu_neon.allow_interlace = interlace >= 0 ? interlace
+    : (config >> GPU_REC_CFG_INTERLACE_SHIFT) & 3;
+  cbs.gpu_neon.render_threads = threads;
+  cbs.gpu_peops.iUseDither = cbs.gpu_neon.allow_dithering;
+  cbs.gpu_unai.dithering = cbs.gpu_neon.allow_dithering;
+  cbs.gpu_unai.lighting = 1;
+  cbs.gpu_unai.blending = 1;
+  GPUrearmedCallbacks(&cbs);
+}
+
+static int replay(const unsigned char *rec, size_t size)
+{
+  const struct gpu_rec_event *ev;
+  static uint32_t tmp[0x40000];
+  unsigned long long t;
+  size_t pos;
+  int i;
+
+  pos = sizeof(struct gpu_rec_header);
+  load_state((const void *)(rec + pos));
+  pos += sizeof(struct gpu_rec_state);
+
+  while (pos + sizeof(*ev) <= size) {
+    ev = (const void *)(rec + pos);
+    pos += sizeof(*ev);
+    if (ev->type >= GPU_REC_TYPE_CNT || pos + ev->size > size) {
+      fprintf(stderr, "bad event at %zu\n", pos - sizeof(*ev));
+      return -1;
+    }
+    frame = ev->frame;
+
+    t = get_ns();
+    switch (ev->type) {
+      case GPU_REC_WRITE_DATA:
+        for (i = 0; i < ev->size / 4; i++)
+          GPUwriteData(((const uint32_t *)(rec + pos))[i]);
+        break;
+      case GPU_REC_WRITE_DATA_MEM:
+        // the renderer may write to it, like the emu's ram
+        memcpy(tmp, rec + pos, ev->size < sizeof(tmp) ? ev->size : sizeof(tmp));
+        GPUwriteDataMem(tmp, ev->size / 4);
+        break;
+      case GPU_REC_READ_DATA:
+        for (i = 0; i < ev->a; i++)
+          GPUreadData();
+        break;
+      case GPU_REC_READ_DATA_MEM:
+        GPUreadDataMem(tmp, ev->a < 0x40000 ? ev->a : 0x40000);
+        break;
+      case GPU_REC_DMA_CHAIN:
+        build_chain((const uint32_t *)(rec + pos), ev->size / 4);
+        GPUdmaChain(ram, ev->a);
+        break;
+      case GPU_REC_WRITE_STATUS:
+        GPUwriteStatus(ev->a);
+        break;
+      case GPU_REC_UPDATE_LACE:
+        GPUupdateLace();
+        break;
+      case GPU_REC_VBLANK:
+        GPUvBlank(ev->a, ev->b);
+        break;
+      case GPU_REC_LOAD:
+        load_state((const void *)(rec + pos));
+        break;
+      case GPU_REC_CONFIG:
+        set_config(ev->a);
+        break;
+    }
+    stats[ev->type].ns += get_ns() - t;
+    stats[ev->type].count++;
+    pos += ev->size;
+
+    if (ev->type == GPU_REC_UPDATE_LACE && max_frames
+        && stats[ev->type].count >= max_frames)
+      break;
+  }
+
+  t = get_ns();
+  renderer_flush_queues();
+  renderer_sync();
+  sync_ns = get_ns() - t;
+
+  return 0;
+}
+
+static int compare(const char *fname)
+{
+  const uint16_t *a = gpu.vram, *b;
+  int x0 = 1024, y0 = 512, x1 = -1, y1 = -1, x, y;
+  size_t size, cnt = 0;
+
+  b = load_file(fname, &size);
+  if (b == NULL)
+    return -1;
+  if (size != 1024 * 512 * 2) {
+    printf("%s: not a vram dump\n", fname);
+    free((void *)b);
+    return -1;
+  }
+
+  for (y = 0; y < 512; y++) {
+    for (x = 0; x < 1024; x++) {
+      if (a[y * 1024 + x] == b[y * 1024 + x])
+        continue;
+      cnt++;
+      if (x < x0) x0 = x;
+      if (x > x1) x1 = x;
+      if (y < y0) y0 = y;
+      if (y > y1) y1 = y;
+    }
+  }
+  if (cnt)
+    printf("%zu pixels differ from %s, in %d,%d - %d,%d\n",
+      cnt, fname, x0, y0, x1, y1);
+  else
+    printf("matches %s\n", fname);
+
+  free((void *)b);
+  return cnt ? 1 : 0;
+}
+
+static void usage(const char *argv0)
+{
+  printf("usage:\n%s [-d dither] [-e enhancement] [-i interlace] "
+    "[-t threads] [-f frames] [-p] <recording> [vram_out] [golden_vram]\n"
+    " -d, -e, -i: override the recorded settings\n"
+    " -t: render threads for gpu_neon\n"
+    " -f: stop after this many frames\n"
+    " -p: time each primitive\n",
+    argv0);
+}
+
+int main(int argc, char *argv[])
+{
+  const struct gpu_rec_header *hdr;
+  unsigned long long t, total = 0, prims = 0, pixels = 0;
+  unsigned char *rec;
+  size_t size;
+  FILE *f;
+  int i, ret = 0;
+
+  while ((i = getopt(argc, argv, "d:e:i:t:f:p")) != -1) {
+    switch (i) {
+      case 'd': dither = atoi(optarg); break;
+      case 'e': enhancement = atoi(optarg); break;
+      case 'i': interlace = atoi(optarg); break;
+      case 't': threads = atoi(optarg); break;
+      case 'f': max_frames = atoi(optarg); break;
+      case 'p': prim_timing = 1; break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (optind >= argc || argc - optind > 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  rec = load_file(argv[optind], &size);
+  if (rec == NULL)
+    return 1;
+  hdr = (const void *)rec;
+  if (size < sizeof(*hdr) + sizeof(struct gpu_rec_state)
+      || memcmp(hdr->magic, GPU_REC_MAGIC, 4)
+      || hdr->version != GPU_REC_VERSION) {
+    fprintf(stderr, "%s: not a recording or a different version\n",
+      argv[optind]);
+    return 1;
+  }
+
+  ram = calloc(0x200000 + 256 * 4, 1);
+  if (ram == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  unsetenv("GPU_RECORD");
+  GPUinit();
+  frame = hdr->frame;
+  set_config(hdr->config);
+
+  t = get_ns();
+  if (replay(rec, size))
+    ret = 1;
+  t = get_ns() - t;
+
+  for (i = 0; i < 128; i++) {
+    prims += prim_stats[i].count;
+    pixels += prim_stats[i].pixels;
+  }
+  printf("%u frames, %llu primitives in %.3f s: %.1f fps, %.0f prims/s, "
+    "%.1f Mpixels/s\n", frames_done, prims, t / 1e9,
+    frames_done / (t / 1e9), prims / (t / 1e9), pixels / (t / 1e3));
+
+  for (i = 1; i < GPU_REC_TYPE_CNT; i++)
+    total += stats[i].ns;
+  printf("%-20s %8s %10s %8s %6s\n", "", "calls", "total ms", "avg us", "%");
+  for (i = 1; i < GPU_REC_TYPE_CNT; i++) {
+    if (stats[i].count == 0)
+      continue;
+    printf("%-20s %8u %10.3f %8.3f %6.1f\n", type_names[i],
+      stats[i].count, stats[i].ns / 1e6,
+      stats[i].ns / 1e3 / stats[i].count,
+      total ? stats[i].ns * 100.0 / total : 0.0);
+  }
+  printf("%-20s %8s %10.3f\n", "renderer_sync", "", sync_ns / 1e6);
+
+  printf("\n%-20s %8s %12s", "", "count", "pixels");
+  if (prim_timing)
+    printf(" %10s %8s %8s", "total ms", "avg us", "Mpix/s");
+  printf("\n");
+  for (i = 0; i < 128; i++) {
+    if (prim_stats[i].count == 0)
+      continue;
+    printf("%-20s %8u %12llu", prim_name(i == 0x7f ? 0x80 : i),
+      prim_stats[i].count, prim_stats[i].pixels);
+    if (prim_timing)
+      printf(" %10.3f %8.3f %8.1f", prim_stats[i].ns / 1e6,
+        prim_stats[i].ns / 1e3 / prim_stats[i].count,
+        prim_stats[i].ns ? prim_stats[i].pixels * 1e3 / prim_stats[i].ns : 0.0);
+    printf("\n");
+  }
+
+  if (argc - optind >= 2 && strcmp(argv[optind + 1], "-") != 0) {
+    f = fopen(argv[optind + 1], "wb");
+    if (f == NULL) {
+      perror(argv[optind + 1]);
+      return 1;
+    }
+    fwrite(gpu.vram, 1, 1024 * 512 * 2, f);
+    fclose(f);
+  }
+  if (argc - optind >= 3 && compare(argv[optind + 2]))
+    ret = 1;
+
+  GPUshutdown();
+  free(ram);
+  free(rec);
+  return ret;
+}
+
+// vim:shiftwidth=2:expandtab
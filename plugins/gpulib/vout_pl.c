@@ -15,6 +15,13 @@
 
 static const struct rearmed_cbs *cbs;
 
+// what the last pl_vout_flip_partial() showed
+static struct {
+  int x, y, w, h;
+  int rgb24;
+  int valid;
+} last_flip;
+
 int vout_init(void)
 {
   return 0;
@@ -59,9 +66,49 @@ static void check_mode_change(int force)
     old_h = h;
 
     cbs->pl_vout_set_mode(w_out, h_out, w, h, gpu.status.rgb24 ? 24 : 16);
+    last_flip.valid = 0;
   }
 }
 
+// tell the frontend which of the displayed rows changed, all of them
+// unless it's the same area as last time
+static void flip_partial(uint16_t *vram, int x, int y, int w, int h)
+{
+  // the enhanced and downscaled buffers aren't tracked
+  int track = !gpu.state.enhancement_active && !gpu.state.downscale_active;
+  int vram_w = gpu.status.rgb24 ? w * 3 / 2 : w;
+  int y0 = 0, y1 = h;
+
+  if (track && last_flip.valid && x == last_flip.x && y == last_flip.y
+      && w == last_flip.w && h == last_flip.h
+      && gpu.status.rgb24 == last_flip.rgb24)
+  {
+    y0 = y1 = 0;
+    if (gpu.state.dirty.x0 < x + vram_w && gpu.state.dirty.x1 > x) {
+      y0 = gpu.state.dirty.y0 - y;
+      y1 = gpu.state.dirty.y1 - y;
+      if (y0 < 0) y0 = 0;
+      if (y1 > h) y1 = h;
+      if (y1 <= y0)
+        y0 = y1 = 0;
+    }
+  }
+
+  last_flip.valid = track;
+  last_flip.x = x;
+  last_flip.y = y;
+  last_flip.w = w;
+  last_flip.h = h;
+  last_flip.rgb24 = gpu.status.rgb24;
+
+  gpu.state.dirty.x0 = 1024;
+  gpu.state.dirty.y0 = 512;
+  gpu.state.dirty.x1 = gpu.state.dirty.y1 = 0;
+
+  cbs->pl_vout_flip_partial(vram + y * 1024 + x, 1024, gpu.status.rgb24,
+    w, h, y0, y1 - y0);
+}
+
 void vout_update(void)
 {
   int x = gpu.screen.x & ~1; // alignment needed by blitter
@@ -92,6 +139,11 @@ void vout_update(void)
       h = vram_h - y;
   }
 
+  if (cbs->pl_vout_flip_partial != NULL) {
+    flip_partial(vram, x, y, w, h);
+    return;
+  }
+
   vram += y * 1024 + x;
 
   cbs->pl_vout_flip(vram, 1024, gpu.status.rgb24, w, h);
@@ -107,6 +159,7 @@ void vout_blank(void)
     w *= 2;
     h *= 2;
   }
+  last_flip.valid = 0;
   cbs->pl_vout_flip(NULL, 1024, gpu.status.rgb24, w, h);
 }
 
@@ -116,6 +169,7 @@ long GPUopen(void **unused)
   gpu.frameskip.frame_ready = 1;
 
   cbs->pl_vout_open();
+  last_flip.valid = 0;
   check_mode_change(1);
   vout_update();
   return 0;
@@ -130,6 +184,9 @@ long GPUclose(void)
 void vout_set_config(const struct rearmed_cbs *cbs_)
 {
   cbs = cbs_;
+  if (gpu.state.track_dirty != (cbs->pl_vout_flip_partial != NULL))
+    last_flip.valid = 0;
+  gpu.state.track_dirty = cbs->pl_vout_flip_partial != NULL;
 }
 
 // vim:shiftwidth=2:expandtab